@@ -0,0 +1,140 @@
+#!/bin/bash
+#
+# Benchmarks pcheck and sd_card_extract on synthetic card images made by
+# sd_make_image, and checks every result against what the generator says
+# the image holds: the extracted packets must match its oracle byte for
+# byte, pcheck must find the same dropped packets and RF syncs.
+#
+# Usage: ./benchmark.sh [-m MB] [-c CONFIG] [-j THREADS] [-k] [WORK_DIR]
+#   -m MB       size of the recording in the large images (default 1024)
+#   -c CONFIG   configuration file (default config/config128.cfg)
+#   -j THREADS  threads for --threads runs (default 4)
+#   -k          keep the images and outputs
+# Exits with 1 if any check fails.
+
+MB=1024
+CONFIG=config/config128.cfg
+THREADS=4
+KEEP=0
+while getopts "m:c:j:k" opt; do
+    case $opt in
+        m) MB=$OPTARG ;;
+        c) CONFIG=$OPTARG ;;
+        j) THREADS=$OPTARG ;;
+        k) KEEP=1 ;;
+        *) exit 2 ;;
+    esac
+done
+shift $((OPTIND - 1))
+WORK=${1:-/tmp/sd_benchmark}
+BIN=$(cd "$(dirname "$0")" && pwd)/bin
+
+for tool in sd_make_image sd_time pcheck sd_card_extract sd_decompress; do
+    if [ ! -x "$BIN/$tool" ]; then
+        echo "$BIN/$tool is missing, run ./compile_all.sh first"
+        exit 2
+    fi
+done
+mkdir -p "$WORK" || exit 2
+
+# packets of MB megabytes with this configuration
+channels=$(head -n 32 "$CONFIG" | tr -cd 1 | wc -c)
+psize=$((14 + 2*channels))
+packets=$((MB*1024*1024 / psize))
+minutes=$((packets / 1800000 + 1))
+
+# name, generator options. stale and dropout are small, they check where
+# the recording ends rather than speed. stale leaves an older recording
+# with the same timestamps (shift 0) behind one with gaps, dropout has a
+# 5.7 s dropout after packet 21212. Older data level with or ahead of
+# the new recording's timestamps can't be told from it, so it isn't tested
+IMAGES=(
+    "clean|-n $packets --tail 64"
+    "gaps|-n $packets --gaps $((20*minutes)) --bad $((5*minutes)) --rf-every 3000 --seed 7"
+    "stale|-n 600000 --gaps 12 --bad 3 --partial --stale 300000 --seed 3"
+    "dropout|-n 600000 --gaps 1 --gap-max 200000 --bad 3 --partial --seed 3"
+)
+
+# name, command (IMG and OUT are filled in), check
+MODES=(
+    "pcheck|pcheck IMG|pcheck"
+    "pcheck --fast|pcheck --fast IMG|fast"
+    "extract|sd_card_extract IMG OUT|packets"
+    "extract -d|sd_card_extract -d IMG OUT|packets"
+    "extract --io-threads|sd_card_extract --io-threads IMG OUT|packets"
+    "extract --threads $THREADS|sd_card_extract --threads $THREADS IMG OUT|packets"
+    "extract --zero-copy|sd_card_extract --zero-copy IMG OUT|packets"
+    "extract compressed|sd_card_extract --format compressed IMG OUT|unpack"
+    "extract container|sd_card_extract --format container IMG OUT|unpack"
+)
+
+failed=0
+printf "%-7s %-28s %9s %8s %8s %8s %9s %8s  %s\n" image mode "MB/s" "wall s" \
+       "user s" "sys s" "CPU s/GB" "RSS MB" check
+for image in "${IMAGES[@]}"; do
+    name=${image%%|*}
+    img=$WORK/$name.img
+    oracle=$WORK/$name.oracle
+    if ! "$BIN/sd_make_image" ${image#*|} -o "$oracle" "$CONFIG" "$img" \
+         > "$WORK/$name.summary"; then
+        echo "Error making $img, see $WORK/$name.summary"
+        exit 2
+    fi
+    dataMB=$(awk '/^Valid packets:/ {gsub(/\(/, "", $4); print $4/1048576}' "$WORK/$name.summary")
+    dropped=$(awk '/^Dropped packets:/ {print $3}' "$WORK/$name.summary")
+    gaps=$(awk '/^Dropped packets:/ {print $5}' "$WORK/$name.summary")
+    rfSyncs=$(awk '/^RF sync values:/ {print $4}' "$WORK/$name.summary")
+
+    for mode in "${MODES[@]}"; do
+        label=${mode%%|*}
+        rest=${mode#*|}
+        command=${rest%|*}
+        check=${rest##*|}
+        out=$WORK/$name.out
+        log=$WORK/$name.log
+        rm -f "$out" "$out".*
+        command=${command//IMG/$img}
+        command=${command//OUT/$out}
+        read wall user sys rss status < <("$BIN/sd_time" "$log" "$BIN"/$command)
+
+        result=ok
+        if [ "$status" != 0 ]; then
+            result="FAIL (exit $status, see $log)"
+        else
+            case $check in
+                pcheck)
+                    found=$(awk '/^Dropped packets =/ {print $4} /^No dropped/ {print 0}' "$log")
+                    foundRf=$(awk '/^Found .* RF sync values/ {print $2}' "$log")
+                    if [ "$found" != "$dropped" ] || [ "${foundRf:-0}" != "$rfSyncs" ]; then
+                        result="FAIL ($found dropped, ${foundRf:-0} RF syncs, expected $dropped, $rfSyncs)"
+                    fi ;;
+                fast)
+                    found=$(awk '/ gaps, .* dropped packets, found with/ {print $1, $3}' "$log")
+                    if [ "$found" != "$gaps $dropped" ]; then
+                        result="FAIL (gaps, dropped: $found, expected $gaps $dropped)"
+                    fi ;;
+                packets)
+                    cmp -s "$out" "$oracle" || result="FAIL (output differs from the oracle)" ;;
+                unpack)
+                    if ! "$BIN/sd_decompress" "$out" "$out.dat" > "$log.unpack" 2>&1; then
+                        result="FAIL (sd_decompress, see $log.unpack)"
+                    elif ! cmp -s "$out.dat" "$oracle"; then
+                        result="FAIL (unpacked output differs from the oracle)"
+                    fi ;;
+            esac
+        fi
+        case $result in FAIL*) failed=1 ;; esac
+
+        awk -v i="$name" -v m="$label" -v mb="$dataMB" -v w="$wall" -v u="$user" \
+            -v s="$sys" -v r="$rss" -v c="$result" 'BEGIN {
+            printf "%-7s %-28s %9.1f %8.2f %8.2f %8.2f %9.2f %8.1f  %s\n", i, m,
+                   (w > 0) ? mb/w : 0, w, u, s, (mb > 0) ? (u + s)*1024/mb : 0,
+                   r/1024, c }'
+        rm -f "$out" "$out".*
+    done
+    if [ $KEEP = 0 ]; then
+        rm -f "$img" "$oracle"
+    fi
+done
+
+exit $failed
@@ -4,8 +4,16 @@ if [ ! -d bin ]; then
     mkdir bin
 fi
 
-gcc src/read_config.c src/diskio_linux.c -o bin/read_config
-gcc src/write_config.c src/diskio_linux.c -o bin/write_config
-gcc src/card_enable.c src/diskio_linux.c -o bin/card_enable
-gcc src/pcheck.c src/diskio_linux.c -o bin/pcheck -lm
-gcc src/sd_card_extract.c src/diskio_linux.c -o bin/sd_card_extract -lm
+# 64 bit file offsets on 32 bit hosts too, cards are much larger than 2 GB
+LFS="-D_FILE_OFFSET_BITS=64"
+
+gcc $LFS src/read_config.c src/diskio_linux.c -o bin/read_config
+gcc $LFS src/write_config.c src/diskio_linux.c -o bin/write_config
+gcc $LFS src/card_enable.c src/diskio_linux.c -o bin/card_enable
+gcc $LFS -O2 src/pcheck.c src/diskio_linux.c src/block_reader.c src/packet_scan.c src/perf_stats.c src/record_end.c -o bin/pcheck -lm -pthread
+gcc $LFS -O2 src/sd_card_extract.c src/extract_queue.c src/diskio_linux.c src/block_reader.c src/spsc_ring.c src/packet_scan.c src/card_config.c src/sample_writer.c src/sample_codec.c src/packet_index.c src/container.c src/perf_stats.c src/record_end.c -o bin/sd_card_extract -lm -pthread
+gcc $LFS -O2 src/scan_bench.c src/packet_scan.c src/sample_writer.c src/sample_codec.c src/card_config.c -o bin/scan_bench
+gcc $LFS -O2 src/sd_decompress.c src/sample_codec.c src/sample_writer.c src/packet_scan.c src/card_config.c src/container.c -o bin/sd_decompress -pthread
+gcc $LFS -O2 src/sd_query.c src/packet_map.c src/packet_index.c src/packet_scan.c src/sample_writer.c src/sample_codec.c src/card_config.c -o bin/sd_query -lm
+gcc $LFS -O2 src/sd_make_image.c src/card_config.c -o bin/sd_make_image -lm
+gcc $LFS -O2 src/sd_time.c -o bin/sd_time
@@ -0,0 +1,752 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "block_reader.h"
+
+#define BLOCK_IDLE 0
+#define BLOCK_INFLIGHT 1
+#define BLOCK_DONE 2
+
+struct BlockReader {
+    DiskSessionType *session;
+    BlockReaderBackendType backend;
+    uint32_t packetSize;
+    uint64_t firstPacket;
+    uint64_t numPackets;
+    uint64_t spanStart;      // device byte offset of the first packet
+    uint64_t spanEnd;        // one past the last byte of the last packet
+    uint64_t alignedStart;   // spanStart rounded down for the session
+    uint64_t blockSize;
+    uint64_t numBlocks;
+    uint64_t nextDeliverSeq;
+    uint64_t bytesRead;
+    uint32_t queueDepth;
+    BlockType *blocks;
+    PerfStatsType *stats;    // reads are counted here if set
+
+    // io_uring backend
+    int ringFd;
+    void *sqMap, *cqMap;
+    size_t sqMapSize, cqMapSize, sqesMapSize;
+    struct io_uring_sqe *sqes;
+    unsigned *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+    struct io_uring_cqe *cqes;
+
+    // thread pool backend
+    pthread_t *threads;
+    uint32_t numThreads;
+    pthread_mutex_t lock;
+    pthread_cond_t submitted;
+    pthread_cond_t completed;
+    uint32_t *pending;       // ring of block indices waiting for a thread
+    uint64_t pendingHead, pendingTail;
+    int stopping;
+};
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : vPrepareBlock()
+// Description : Works out which part of the device a block covers
+// Parameters  : BlockReaderType *reader - The reader
+//               BlockType *block - Block to set up
+//               uint64_t seq - Position of the block in the span
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+static void vPrepareBlock(BlockReaderType *reader, BlockType *block, uint64_t seq) {
+
+    uint64_t align = reader->session->ioAlign;
+    uint64_t deviceSize = reader->session->deviceInfo.deviceSize;
+
+    block->seq = seq;
+    block->offset = reader->alignedStart + seq * reader->blockSize;
+    block->validBytes = reader->spanEnd - block->offset;
+    if ( block->validBytes > reader->blockSize ) {
+        block->validBytes = reader->blockSize;
+    }
+    // round up to the I/O alignment, but not past the end of the device.
+    // An unaligned tail then goes through the page cache
+    block->readBytes = ((block->validBytes + align - 1) / align) * align;
+    if ( block->readBytes > (deviceSize - block->offset) ) {
+        block->readBytes = deviceSize - block->offset;
+    }
+    block->result = 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iUringSetup()
+// Description : Creates an io_uring and maps its queues. liburing isn't
+//               needed for the handful of operations used here
+// Parameters  : BlockReaderType *reader - The reader
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+static int iUringSetup(BlockReaderType *reader) {
+
+    struct io_uring_params params;
+
+    memset(&params, 0, sizeof(params));
+    reader->ringFd = (int)syscall(__NR_io_uring_setup, reader->queueDepth, &params);
+    if ( reader->ringFd < 0 ) {
+        reader->ringFd = -1;
+        return -1;
+    }
+
+    reader->sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    reader->cqMapSize = params.cq_off.cqes
+                        + params.cq_entries * sizeof(struct io_uring_cqe);
+    if ( params.features & IORING_FEAT_SINGLE_MMAP ) {
+        if ( reader->cqMapSize > reader->sqMapSize ) {
+            reader->sqMapSize = reader->cqMapSize;
+        }
+        reader->cqMapSize = 0;
+    }
+
+    reader->sqMap = mmap(NULL, reader->sqMapSize, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, reader->ringFd,
+                         IORING_OFF_SQ_RING);
+    if ( MAP_FAILED == reader->sqMap ) {
+        reader->sqMap = NULL;
+        return -2;
+    }
+    if ( reader->cqMapSize ) {
+        reader->cqMap = mmap(NULL, reader->cqMapSize, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, reader->ringFd,
+                             IORING_OFF_CQ_RING);
+        if ( MAP_FAILED == reader->cqMap ) {
+            reader->cqMap = NULL;
+            return -3;
+        }
+    }
+    else {
+        reader->cqMap = reader->sqMap;
+    }
+    reader->sqesMapSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    reader->sqes = mmap(NULL, reader->sqesMapSize, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, reader->ringFd,
+                        IORING_OFF_SQES);
+    if ( MAP_FAILED == reader->sqes ) {
+        reader->sqes = NULL;
+        return -4;
+    }
+
+    reader->sqTail = (unsigned *)((uint8_t *)reader->sqMap + params.sq_off.tail);
+    reader->sqMask = (unsigned *)((uint8_t *)reader->sqMap + params.sq_off.ring_mask);
+    reader->sqArray = (unsigned *)((uint8_t *)reader->sqMap + params.sq_off.array);
+    reader->cqHead = (unsigned *)((uint8_t *)reader->cqMap + params.cq_off.head);
+    reader->cqTail = (unsigned *)((uint8_t *)reader->cqMap + params.cq_off.tail);
+    reader->cqMask = (unsigned *)((uint8_t *)reader->cqMap + params.cq_off.ring_mask);
+    reader->cqes = (struct io_uring_cqe *)((uint8_t *)reader->cqMap + params.cq_off.cqes);
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : vUringTeardown()
+// Description : Unmaps the queues and closes the io_uring
+// Parameters  : BlockReaderType *reader - The reader
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+static void vUringTeardown(BlockReaderType *reader) {
+
+    if ( reader->sqes ) {
+        munmap(reader->sqes, reader->sqesMapSize);
+    }
+    if ( reader->cqMap && (reader->cqMap != reader->sqMap) ) {
+        munmap(reader->cqMap, reader->cqMapSize);
+    }
+    if ( reader->sqMap ) {
+        munmap(reader->sqMap, reader->sqMapSize);
+    }
+    if ( -1 != reader->ringFd ) {
+        close(reader->ringFd);
+    }
+    reader->sqes = NULL;
+    reader->sqMap = NULL;
+    reader->cqMap = NULL;
+    reader->ringFd = -1;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iUringSubmit()
+// Description : Queues the read of one block on the io_uring
+// Parameters  : BlockReaderType *reader - The reader
+//               BlockType *block - Block to read
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+static int iUringSubmit(BlockReaderType *reader, BlockType *block) {
+
+    int res;
+    unsigned tail, index;
+    struct io_uring_sqe *sqe;
+
+    // only this thread touches the submission queue tail
+    tail = *reader->sqTail;
+    index = tail & *reader->sqMask;
+    sqe = &reader->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = DISKIO_iGetReadFd(reader->session, block->buff,
+                                block->offset, block->readBytes);
+    sqe->addr = (uint64_t)(uintptr_t)block->buff;
+    sqe->len = (uint32_t)block->readBytes;
+    sqe->off = block->offset;
+    sqe->user_data = (uint64_t)(block - reader->blocks);
+    reader->sqArray[index] = index;
+    __atomic_store_n(reader->sqTail, tail + 1, __ATOMIC_RELEASE);
+
+    do {
+        res = (int)syscall(__NR_io_uring_enter, reader->ringFd, 1, 0, 0, NULL, 0);
+    } while ( (res < 0) && (EINTR == errno) );
+    if ( res < 0 ) {
+        fprintf(stderr, "Error %d submitting read: %s\n", errno, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iUringReap()
+// Description : Waits for at least one read to complete and marks every
+//               completed block as done. A short or failed read is
+//               finished with a plain pread, which also covers kernels
+//               that lack IORING_OP_READ
+// Parameters  : BlockReaderType *reader - The reader
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+static int iUringReap(BlockReaderType *reader) {
+
+    int res;
+    unsigned head, tail;
+    double now;
+    struct io_uring_cqe *cqe;
+    BlockType *block;
+
+    head = *reader->cqHead;
+    tail = __atomic_load_n(reader->cqTail, __ATOMIC_ACQUIRE);
+    while ( head == tail ) {
+        res = (int)syscall(__NR_io_uring_enter, reader->ringFd, 0, 1,
+                           IORING_ENTER_GETEVENTS, NULL, 0);
+        if ( (res < 0) && (EINTR != errno) ) {
+            fprintf(stderr, "Error %d waiting for reads: %s\n", errno, strerror(errno));
+            return -1;
+        }
+        tail = __atomic_load_n(reader->cqTail, __ATOMIC_ACQUIRE);
+    }
+
+    // a read may have finished before this call, so its latency is how
+    // long it took to be seen
+    now = PSTAT_dNow();
+    while ( head != tail ) {
+        cqe = &reader->cqes[head & *reader->cqMask];
+        block = &reader->blocks[cqe->user_data];
+        if ( cqe->res < 0 ) {
+            block->result = DISKIO_iReadBytes(reader->session, block->buff,
+                                              block->offset, block->readBytes);
+        }
+        else if ( (uint64_t)cqe->res < block->readBytes ) {
+            block->result = DISKIO_iReadBytes(reader->session,
+                                              block->buff + cqe->res,
+                                              block->offset + cqe->res,
+                                              block->readBytes - cqe->res);
+        }
+        PSTAT_vAddRead(reader->stats, block->readBytes, now - block->submitSec);
+        block->state = BLOCK_DONE;
+        head++;
+    }
+    __atomic_store_n(reader->cqHead, head, __ATOMIC_RELEASE);
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : pvReadThread()
+// Description : Thread pool worker, reads blocks with blocking pread
+// Parameters  : void *arg - The reader
+// Returns     : void * - NULL
+//////////////////////////////////////////////////////////////////////////
+static void *pvReadThread(void *arg) {
+
+    int result;
+    BlockReaderType *reader = (BlockReaderType *)arg;
+    BlockType *block;
+
+    pthread_mutex_lock(&reader->lock);
+    while ( 1 ) {
+        while ( !reader->stopping && (reader->pendingHead == reader->pendingTail) ) {
+            pthread_cond_wait(&reader->submitted, &reader->lock);
+        }
+        if ( reader->stopping ) {
+            break;
+        }
+        block = &reader->blocks[reader->pending[reader->pendingHead % reader->queueDepth]];
+        reader->pendingHead++;
+        pthread_mutex_unlock(&reader->lock);
+
+        result = DISKIO_iReadBytes(reader->session, block->buff,
+                                   block->offset, block->readBytes);
+        PSTAT_vAddRead(__atomic_load_n(&reader->stats, __ATOMIC_ACQUIRE),
+                       block->readBytes, PSTAT_dNow() - block->submitSec);
+
+        pthread_mutex_lock(&reader->lock);
+        block->result = result;
+        block->state = BLOCK_DONE;
+        pthread_cond_broadcast(&reader->completed);
+    }
+    pthread_mutex_unlock(&reader->lock);
+
+    return NULL;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iSubmitBlock()
+// Description : Starts the read of the block at a given position
+// Parameters  : BlockReaderType *reader - The reader
+//               uint64_t seq - Position of the block in the span
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+static int iSubmitBlock(BlockReaderType *reader, uint64_t seq) {
+
+    BlockType *block = &reader->blocks[seq % reader->queueDepth];
+
+    vPrepareBlock(reader, block, seq);
+    block->state = BLOCK_INFLIGHT;
+    block->submitSec = PSTAT_dNow();
+
+    if ( BLKRD_BACKEND_IO_URING == reader->backend ) {
+        return iUringSubmit(reader, block);
+    }
+
+    pthread_mutex_lock(&reader->lock);
+    reader->pending[reader->pendingTail % reader->queueDepth] =
+        (uint32_t)(seq % reader->queueDepth);
+    reader->pendingTail++;
+    pthread_cond_signal(&reader->submitted);
+    pthread_mutex_unlock(&reader->lock);
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : BLKRD_iOpen()
+// Description : Starts reading a span of packets from the device in large
+//               blocks, keeping up to queueDepth reads in flight. Blocks
+//               are handed out in device order by BLKRD_iNextBlock()
+// Parameters  : BlockReaderType **readerPtr - Set to the new reader
+//               DiskSessionType *session - The open device
+//               uint32_t packetSize - Number of bytes per packet
+//               uint64_t firstPacket - Index of the first packet to read
+//               uint64_t numPackets - Number of packets to read
+//               uint64_t blockSize - Bytes per read, rounded up to the
+//                                    session's I/O alignment
+//               uint32_t queueDepth - Number of reads kept in flight
+//               BlockReaderBackendType backend - How reads are issued
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int BLKRD_iOpen(BlockReaderType **readerPtr, DiskSessionType *session,
+                uint32_t packetSize, uint64_t firstPacket, uint64_t numPackets,
+                uint64_t blockSize, uint32_t queueDepth,
+                BlockReaderBackendType backend) {
+
+    uint32_t i;
+    uint64_t align = session->ioAlign;
+    BlockReaderType *reader;
+
+    *readerPtr = NULL;
+    if ( (0 == queueDepth) || (BLKRD_MAX_QUEUE_DEPTH < queueDepth) ) {
+        fprintf(stderr, "Queue depth must be between 1 and %d\n",
+                BLKRD_MAX_QUEUE_DEPTH);
+        return -1;
+    }
+    blockSize = ((blockSize + align - 1) / align) * align;
+    if ( blockSize < packetSize ) {
+        fprintf(stderr, "Block size must be larger than a packet\n");
+        return -2;
+    }
+
+    reader = calloc(1, sizeof(*reader));
+    if ( NULL == reader ) {
+        return -3;
+    }
+    reader->session = session;
+    reader->packetSize = packetSize;
+    reader->firstPacket = firstPacket;
+    reader->numPackets = numPackets;
+    reader->spanStart = session->deviceInfo.sectorSize + firstPacket * packetSize;
+    reader->spanEnd = reader->spanStart + numPackets * packetSize;
+    reader->alignedStart = (reader->spanStart / align) * align;
+    reader->blockSize = blockSize;
+    reader->numBlocks = (reader->spanEnd - reader->alignedStart + blockSize - 1)
+                        / blockSize;
+    reader->queueDepth = queueDepth;
+    reader->ringFd = -1;
+    pthread_mutex_init(&reader->lock, NULL);
+    pthread_cond_init(&reader->submitted, NULL);
+    pthread_cond_init(&reader->completed, NULL);
+
+    reader->blocks = calloc(queueDepth, sizeof(BlockType));
+    reader->pending = calloc(queueDepth, sizeof(uint32_t));
+    if ( (NULL == reader->blocks) || (NULL == reader->pending) ) {
+        BLKRD_vClose(reader);
+        return -3;
+    }
+    for (i = 0; i < queueDepth; i++) {
+        reader->blocks[i].buff = DISKIO_pu8AllocBuffer(session, blockSize);
+        if ( NULL == reader->blocks[i].buff ) {
+            fprintf(stderr, "Error allocating %u read buffers of %llu bytes\n",
+                    (unsigned)queueDepth, (long long unsigned)blockSize);
+            BLKRD_vClose(reader);
+            return -3;
+        }
+    }
+
+    // io_uring may be compiled out of the kernel or blocked by seccomp
+    if ( BLKRD_BACKEND_THREADS != backend ) {
+        if ( 0 == iUringSetup(reader) ) {
+            backend = BLKRD_BACKEND_IO_URING;
+        }
+        else {
+            vUringTeardown(reader);
+            if ( BLKRD_BACKEND_IO_URING == backend ) {
+                fprintf(stdout, "io_uring not available, using a thread pool\n");
+            }
+            backend = BLKRD_BACKEND_THREADS;
+        }
+    }
+    reader->backend = backend;
+
+    if ( BLKRD_BACKEND_THREADS == backend ) {
+        reader->threads = calloc(queueDepth, sizeof(pthread_t));
+        if ( NULL == reader->threads ) {
+            BLKRD_vClose(reader);
+            return -3;
+        }
+        for (i = 0; i < queueDepth; i++) {
+            if ( pthread_create(&reader->threads[i], NULL, pvReadThread, reader) ) {
+                fprintf(stderr, "Error starting read thread\n");
+                BLKRD_vClose(reader);
+                return -4;
+            }
+            reader->numThreads++;
+        }
+    }
+
+    for (i = 0; (i < queueDepth) && (i < reader->numBlocks); i++) {
+        if ( iSubmitBlock(reader, i) ) {
+            BLKRD_vClose(reader);
+            return -5;
+        }
+    }
+
+    *readerPtr = reader;
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : BLKRD_iNextBlock()
+// Description : Waits for the next block in device order to be read. The
+//               block must be given back with BLKRD_iReleaseBlock()
+// Parameters  : BlockReaderType *reader - The reader
+//               BlockType **blockPtr - Set to the block, NULL at the end
+//                                      of the span
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int BLKRD_iNextBlock(BlockReaderType *reader, BlockType **blockPtr) {
+
+    BlockType *block;
+
+    *blockPtr = NULL;
+    if ( reader->nextDeliverSeq >= reader->numBlocks ) {
+        return 0;
+    }
+
+    block = &reader->blocks[reader->nextDeliverSeq % reader->queueDepth];
+    if ( BLKRD_BACKEND_IO_URING == reader->backend ) {
+        while ( BLOCK_DONE != block->state ) {
+            if ( iUringReap(reader) ) {
+                return -1;
+            }
+        }
+    }
+    else {
+        pthread_mutex_lock(&reader->lock);
+        while ( BLOCK_DONE != block->state ) {
+            pthread_cond_wait(&reader->completed, &reader->lock);
+        }
+        pthread_mutex_unlock(&reader->lock);
+    }
+
+    if ( block->result ) {
+        fprintf(stderr, "Error reading %llu bytes at byte offset %llu\n",
+                (long long unsigned)block->readBytes,
+                (long long unsigned)block->offset);
+        return -2;
+    }
+
+    reader->nextDeliverSeq++;
+    reader->bytesRead += block->readBytes;
+    *blockPtr = block;
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : BLKRD_iReleaseBlock()
+// Description : Gives a block's buffer back so the next read can use it
+// Parameters  : BlockReaderType *reader - The reader
+//               BlockType *block - Block from BLKRD_iNextBlock()
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int BLKRD_iReleaseBlock(BlockReaderType *reader, BlockType *block) {
+
+    uint64_t seq = block->seq + reader->queueDepth;
+
+    block->state = BLOCK_IDLE;
+    if ( seq < reader->numBlocks ) {
+        return iSubmitBlock(reader, seq);
+    }
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : BLKRD_iInitWalker()
+// Description : Sets up a walker that turns the reader's blocks into runs
+//               of whole packets. The blocks may be walked on a different
+//               thread than the one reading them
+// Parameters  : BlockReaderType *reader - The reader the blocks come from
+//               PacketWalkerType *walker - Walker to set up
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int BLKRD_iInitWalker(BlockReaderType *reader, PacketWalkerType *walker) {
+
+    memset(walker, 0, sizeof(*walker));
+    walker->packetSize = reader->packetSize;
+    walker->spanStart = reader->spanStart;
+    walker->firstPacket = reader->firstPacket;
+    walker->packetIndex = reader->firstPacket;
+    walker->endIndex = reader->firstPacket + reader->numPackets;
+    walker->straddle = malloc(reader->packetSize);
+    if ( NULL == walker->straddle ) {
+        return -1;
+    }
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : BLKRD_iWalkBlock()
+// Description : Passes the packets of the next block, in order, to a 
+//               callback as runs of whole packets. A packet split across
+//               two blocks is put back together in a side buffer first, 
+//               so blocks must be walked in device order
+// Parameters  : PacketWalkerType *walker - The walker
+//               BlockType *block - Next block from the reader
+//               PacketSpanFuncType spanFunc - Called for every run
+//               void *ctx - Passed through to spanFunc
+// Returns     : int - 0 if success, the callback's value if it stopped 
+//               the walk
+//////////////////////////////////////////////////////////////////////////
+int BLKRD_iWalkBlock(PacketWalkerType *walker, BlockType *block,
+                     PacketSpanFuncType spanFunc, void *ctx) {
+
+    int res = 0;
+    uint32_t psize = walker->packetSize;
+    uint64_t pos, count;
+
+    // finish the packet that started at the end of the previous block
+    if ( walker->partialBytes ) {
+        memcpy(walker->straddle + walker->partialBytes, block->buff, 
+               psize - walker->partialBytes);
+        pos = psize - walker->partialBytes;
+        walker->partialBytes = 0;
+        res = spanFunc(ctx, walker->straddle, 1, walker->packetIndex);
+        ++walker->packetIndex;
+    }
+    else {
+        pos = walker->spanStart + (walker->packetIndex - walker->firstPacket) * psize
+              - block->offset;
+    }
+
+    count = (block->validBytes - pos) / psize;
+    if ( count > (walker->endIndex - walker->packetIndex) ) {
+        count = walker->endIndex - walker->packetIndex;
+    }
+    if ( (0 == res) && count ) {
+        res = spanFunc(ctx, block->buff + pos, count, walker->packetIndex);
+    }
+    walker->packetIndex += count;
+    pos += count * psize;
+
+    // keep the head of a packet that continues in the next block
+    if ( walker->packetIndex < walker->endIndex ) {
+        walker->partialBytes = block->validBytes - pos;
+        memcpy(walker->straddle, block->buff + pos, walker->partialBytes);
+    }
+
+    return res;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : BLKRD_vFreeWalker()
+// Description : Frees a walker's side buffer
+// Parameters  : PacketWalkerType *walker - The walker
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+void BLKRD_vFreeWalker(PacketWalkerType *walker) {
+
+    free(walker->straddle);
+    walker->straddle = NULL;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : BLKRD_iWalkPackets()
+// Description : Reads the whole span and passes its packets, in order, to
+//               a callback as runs of whole packets
+// Parameters  : BlockReaderType *reader - The reader
+//               PacketSpanFuncType spanFunc - Called for every run
+//               void *ctx - Passed through to spanFunc
+// Returns     : int - 0 if success, the callback's value if it stopped the
+//               walk, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int BLKRD_iWalkPackets(BlockReaderType *reader, PacketSpanFuncType spanFunc,
+                       void *ctx) {
+
+    int res = 0;
+    BlockType *block;
+    PacketWalkerType walker;
+
+    if ( BLKRD_iInitWalker(reader, &walker) ) {
+        return -1;
+    }
+
+    while ( walker.packetIndex < walker.endIndex ) {
+        res = BLKRD_iNextBlock(reader, &block);
+        if ( res || (NULL == block) ) {
+            fprintf(stderr, "Error: ran out of data at packet %llu\n",
+                    (long long unsigned)walker.packetIndex);
+            res = -2;
+            break;
+        }
+
+        res = BLKRD_iWalkBlock(&walker, block, spanFunc, ctx);
+
+        if ( BLKRD_iReleaseBlock(reader, block) ) {
+            res = -3;
+        }
+        if ( res ) {
+            break;
+        }
+    }
+
+    BLKRD_vFreeWalker(&walker);
+    return res;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : BLKRD_vSetStats()
+// Description : Counts every read finished from now on, with its latency
+// Parameters  : BlockReaderType *reader - The reader
+//               PerfStatsType *stats - Counters to add the reads to
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+void BLKRD_vSetStats(BlockReaderType *reader, PerfStatsType *stats) {
+
+    __atomic_store_n(&reader->stats, stats, __ATOMIC_RELEASE);
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : BLKRD_pcBackendName()
+// Description : Names the backend in use, for reporting
+// Parameters  : BlockReaderType *reader - The reader
+// Returns     : const char * - name of the backend
+//////////////////////////////////////////////////////////////////////////
+const char *BLKRD_pcBackendName(BlockReaderType *reader) {
+
+    if ( BLKRD_BACKEND_IO_URING == reader->backend ) {
+        return "io_uring";
+    }
+    return "thread pool";
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : BLKRD_u64BytesRead()
+// Description : Total bytes handed out so far, alignment padding included
+// Parameters  : BlockReaderType *reader - The reader
+// Returns     : uint64_t - number of bytes
+//////////////////////////////////////////////////////////////////////////
+uint64_t BLKRD_u64BytesRead(BlockReaderType *reader) {
+
+    return reader->bytesRead;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : BLKRD_vClose()
+// Description : Waits for outstanding reads, then frees the reader
+// Parameters  : BlockReaderType *reader - The reader, may be NULL
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+void BLKRD_vClose(BlockReaderType *reader) {
+
+    uint32_t i;
+
+    if ( NULL == reader ) {
+        return;
+    }
+
+    // the kernel may still be writing into the buffers
+    if ( -1 != reader->ringFd ) {
+        for (i = 0; i < reader->queueDepth; i++) {
+            while ( (BLOCK_INFLIGHT == reader->blocks[i].state)
+                    && (0 == iUringReap(reader)) );
+        }
+        vUringTeardown(reader);
+    }
+
+    if ( reader->numThreads ) {
+        pthread_mutex_lock(&reader->lock);
+        reader->stopping = 1;
+        pthread_cond_broadcast(&reader->submitted);
+        pthread_mutex_unlock(&reader->lock);
+        for (i = 0; i < reader->numThreads; i++) {
+            pthread_join(reader->threads[i], NULL);
+        }
+    }
+    pthread_mutex_destroy(&reader->lock);
+    pthread_cond_destroy(&reader->submitted);
+    pthread_cond_destroy(&reader->completed);
+
+    if ( reader->blocks ) {
+        for (i = 0; i < reader->queueDepth; i++) {
+            free(reader->blocks[i].buff);
+        }
+    }
+    free(reader->threads);
+    free(reader->blocks);
+    free(reader->pending);
+    free(reader);
+
+}
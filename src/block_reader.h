@@ -0,0 +1,79 @@
+#ifndef BLOCK_READER_H
+#define BLOCK_READER_H
+
+#include <stdint.h>
+#include "diskio_linux.h"
+#include "perf_stats.h"
+
+#define BLKRD_DEFAULT_QUEUE_DEPTH 4
+#define BLKRD_MAX_QUEUE_DEPTH 64
+
+//////////////////////////////////////////////////////////////////////////
+//                      Public Data Types
+//////////////////////////////////////////////////////////////////////////
+typedef enum {
+    BLKRD_BACKEND_AUTO,     // io_uring if the kernel allows it, else threads
+    BLKRD_BACKEND_IO_URING,
+    BLKRD_BACKEND_THREADS   // pool of threads doing blocking pread()
+} BlockReaderBackendType;
+
+typedef struct {
+    uint8_t *buff;
+    uint64_t offset;     // device byte offset of buff[0]
+    uint64_t readBytes;  // bytes read into buff, aligned for the session
+    uint64_t validBytes; // bytes of buff that are inside the requested span
+    uint64_t seq;        // position of the block in the span
+    double submitSec;    // when the read was started
+    int state;
+    int result;
+} BlockType;
+
+// called with runs of whole packets in device order. Packets that
+// straddle two blocks are handed over on their own from a side buffer.
+// Return non-zero to stop the walk
+typedef int (*PacketSpanFuncType)(void *ctx, uint8_t *packets,
+                                  uint64_t numPackets, uint64_t firstPacketIndex);
+
+typedef struct {
+    uint32_t packetSize;
+    uint64_t spanStart;
+    uint64_t firstPacket;
+    uint64_t packetIndex;   // next packet to hand to the callback
+    uint64_t endIndex;
+    uint64_t partialBytes;  // head of a straddling packet held in straddle
+    uint8_t *straddle;
+} PacketWalkerType;
+
+typedef struct BlockReader BlockReaderType;
+
+//////////////////////////////////////////////////////////////////////////
+//                    Public Function Prototypes
+//////////////////////////////////////////////////////////////////////////
+int BLKRD_iOpen(BlockReaderType **readerPtr, DiskSessionType *session,
+                uint32_t packetSize, uint64_t firstPacket, uint64_t numPackets,
+                uint64_t blockSize, uint32_t queueDepth,
+                BlockReaderBackendType backend);
+
+int BLKRD_iNextBlock(BlockReaderType *reader, BlockType **blockPtr);
+
+int BLKRD_iReleaseBlock(BlockReaderType *reader, BlockType *block);
+
+int BLKRD_iInitWalker(BlockReaderType *reader, PacketWalkerType *walker);
+
+int BLKRD_iWalkBlock(PacketWalkerType *walker, BlockType *block,
+                     PacketSpanFuncType spanFunc, void *ctx);
+
+void BLKRD_vFreeWalker(PacketWalkerType *walker);
+
+int BLKRD_iWalkPackets(BlockReaderType *reader, PacketSpanFuncType spanFunc,
+                       void *ctx);
+
+void BLKRD_vSetStats(BlockReaderType *reader, PerfStatsType *stats);
+
+const char *BLKRD_pcBackendName(BlockReaderType *reader);
+
+uint64_t BLKRD_u64BytesRead(BlockReaderType *reader);
+
+void BLKRD_vClose(BlockReaderType *reader);
+
+#endif // BLOCK_READER_H
@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+#include <stdint.h>
+#include "card_config.h"
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : CFG_iDecodeChannelMap()
+// Description : Works out which hardware channel each sample slot of a
+//               packet holds from the configuration sector
+// Parameters  : const uint8_t *configSector - Sector 0 of the card
+//               ChannelMapType *map - The decoded map
+// Returns     : int - 0 if success, negative value if no channels are
+//               enabled
+//////////////////////////////////////////////////////////////////////////
+int CFG_iDecodeChannelMap(const uint8_t *configSector, ChannelMapType *map) {
+
+    uint32_t group, module;
+
+    memset(map, 0, sizeof(*map));
+    for (group = 0; group < CFG_NUM_GROUPS; group++) {
+        for (module = 0; module < CFG_NUM_MODULES; module++) {
+            if ( (configSector[group] >> module) & 0x01 ) {
+                map->channelId[map->numChannels++] =
+                    (uint16_t)(module * CFG_NUM_GROUPS + group);
+            }
+        }
+    }
+
+    return map->numChannels ? 0 : -1;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : CFG_iReadConfigFile()
+// Description : Builds a configuration sector from a .cfg file as
+//               write_config puts it on the card: one line of 8 module
+//               flags per group, module 7 first
+// Parameters  : const char *path - The .cfg file
+//               uint8_t *configSector - CFG_NUM_GROUPS bytes, filled in
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int CFG_iReadConfigFile(const char *path, uint8_t *configSector) {
+
+    char line[100];
+    uint32_t group, module;
+    FILE *fp;
+
+    fp = fopen(path, "r");
+    if ( NULL == fp ) {
+        return -1;
+    }
+    memset(configSector, 0, CFG_NUM_GROUPS);
+    for (group = 0; group < CFG_NUM_GROUPS; group++) {
+        if ( 1 != fscanf(fp, "%99s", line) ) {
+            fclose(fp);
+            return -2;
+        }
+        // like write_config, a malformed line leaves the group off
+        if ( CFG_NUM_MODULES == strlen(line) ) {
+            for (module = 0; module < CFG_NUM_MODULES; module++) {
+                configSector[group] = (uint8_t)(configSector[group] << 1);
+                if ( '1' == line[module] ) {
+                    configSector[group] |= 0x01;
+                }
+            }
+        }
+    }
+    fclose(fp);
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : CFG_u32PacketSize()
+// Description : Size of a packet recorded with a channel map
+// Parameters  : const ChannelMapType *map - The map
+// Returns     : uint32_t - bytes per packet
+//////////////////////////////////////////////////////////////////////////
+uint32_t CFG_u32PacketSize(const ChannelMapType *map) {
+
+    return CFG_HEADER_BYTES + CFG_SAMPLE_BYTES * map->numChannels;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : CFG_iParseChannelList()
+// Description : Reads the hardware channels wanted from the command line,
+//               either a list of channels and ranges such as 0-3,64,70-71
+//               or a hex mask such as 0xF000F where bit n is channel n
+// Parameters  : const char *arg - The option value
+//               uint8_t *wanted - CFG_MAX_CHANNELS flags, set for each
+//                                 channel in the list
+// Returns     : int - 0 if success, negative value if the list is bad
+//////////////////////////////////////////////////////////////////////////
+int CFG_iParseChannelList(const char *arg, uint8_t *wanted) {
+
+    const char *digit;
+    char *endPtr;
+    unsigned long first, last, bit;
+    int value;
+
+    memset(wanted, 0, CFG_MAX_CHANNELS);
+    if ( ('0' == arg[0]) && (('x' == arg[1]) || ('X' == arg[1])) ) {
+        digit = arg + strlen(arg) - 1;
+        if ( digit < arg + 2 ) {
+            return -1;
+        }
+        // lowest channels are in the last digit
+        for (bit = 0; digit >= arg + 2; digit--, bit += 4) {
+            if ( !isxdigit((unsigned char)*digit) ) {
+                return -1;
+            }
+            value = isdigit((unsigned char)*digit) ? (*digit - '0')
+                                                   : (tolower(*digit) - 'a' + 10);
+            if ( value && (bit >= CFG_MAX_CHANNELS) ) {
+                return -2;
+            }
+            for (first = 0; first < 4; first++) {
+                if ( (value >> first) & 0x01 ) {
+                    wanted[bit + first] = 1;
+                }
+            }
+        }
+        return 0;
+    }
+
+    while ( 1 ) {
+        if ( !isdigit((unsigned char)*arg) ) {
+            return -1;
+        }
+        first = strtoul(arg, &endPtr, 10);
+        last = first;
+        if ( '-' == *endPtr ) {
+            arg = endPtr + 1;
+            if ( !isdigit((unsigned char)*arg) ) {
+                return -1;
+            }
+            last = strtoul(arg, &endPtr, 10);
+        }
+        if ( (last < first) || (last >= CFG_MAX_CHANNELS) ) {
+            return -2;
+        }
+        for (; first <= last; first++) {
+            wanted[first] = 1;
+        }
+        if ( '\0' == *endPtr ) {
+            return 0;
+        }
+        if ( ',' != *endPtr ) {
+            return -1;
+        }
+        arg = endPtr + 1;
+    }
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : CFG_iSelectChannels()
+// Description : Finds the packet slots of the wanted channels
+// Parameters  : const ChannelMapType *map - Channels on the card
+//               const uint8_t *wanted - CFG_MAX_CHANNELS flags
+//               ChannelSelectType *select - Slots to copy, in slot order
+//               ChannelMapType *subset - Channels of the packets that
+//                                        are left once the slots are copied
+// Returns     : int - 0 if success, negative value if nothing was wanted
+//               or a wanted channel isn't recorded on the card
+//////////////////////////////////////////////////////////////////////////
+int CFG_iSelectChannels(const ChannelMapType *map, const uint8_t *wanted,
+                        ChannelSelectType *select, ChannelMapType *subset) {
+
+    uint8_t found[CFG_MAX_CHANNELS];
+    uint32_t i;
+    int res = 0;
+
+    memset(found, 0, sizeof(found));
+    memset(select, 0, sizeof(*select));
+    memset(subset, 0, sizeof(*subset));
+    for (i = 0; i < map->numChannels; i++) {
+        if ( wanted[map->channelId[i]] ) {
+            found[map->channelId[i]] = 1;
+            select->slot[select->numChannels++] = (uint16_t)i;
+            subset->channelId[subset->numChannels++] = map->channelId[i];
+        }
+    }
+    for (i = 0; i < CFG_MAX_CHANNELS; i++) {
+        if ( wanted[i] && !found[i] ) {
+            fprintf(stderr, "Channel %u (module %u, group %u) isn't recorded"
+                    " on this card\n", (unsigned)i, 
+                    (unsigned)(i / CFG_NUM_GROUPS), (unsigned)(i % CFG_NUM_GROUPS));
+            res = -1;
+        }
+    }
+    if ( 0 == select->numChannels ) {
+        res = -2;
+    }
+
+    return res;
+
+}
@@ -0,0 +1,44 @@
+#ifndef CARD_CONFIG_H
+#define CARD_CONFIG_H
+
+#include <stdint.h>
+
+// sector 0 of the card holds one byte per group, bit j set if module j
+// records that group
+#define CFG_NUM_GROUPS 32
+#define CFG_NUM_MODULES 8
+#define CFG_MAX_CHANNELS (CFG_NUM_GROUPS * CFG_NUM_MODULES)
+#define CFG_HEADER_BYTES 14   // packet header before the samples
+#define CFG_SAMPLE_BYTES 2    // int16 samples, little endian
+
+//////////////////////////////////////////////////////////////////////////
+//                      Public Data Types
+//////////////////////////////////////////////////////////////////////////
+typedef struct {
+    // samples in a packet are stored group by group, and within a group
+    // module by module. Hardware channel id is module*32 + group
+    uint32_t numChannels;
+    uint16_t channelId[CFG_MAX_CHANNELS];  // packet slot -> hardware channel
+} ChannelMapType;
+
+typedef struct {
+    // channels picked out of a packet, in packet slot order
+    uint32_t numChannels;
+    uint16_t slot[CFG_MAX_CHANNELS];
+} ChannelSelectType;
+
+//////////////////////////////////////////////////////////////////////////
+//                    Public Function Prototypes
+//////////////////////////////////////////////////////////////////////////
+int CFG_iDecodeChannelMap(const uint8_t *configSector, ChannelMapType *map);
+
+int CFG_iReadConfigFile(const char *path, uint8_t *configSector);
+
+uint32_t CFG_u32PacketSize(const ChannelMapType *map);
+
+int CFG_iParseChannelList(const char *arg, uint8_t *wanted);
+
+int CFG_iSelectChannels(const ChannelMapType *map, const uint8_t *wanted,
+                        ChannelSelectType *select, ChannelMapType *subset);
+
+#endif // CARD_CONFIG_H
@@ -0,0 +1,11 @@
+#ifndef CARD_CONSTANTS_H
+#define CARD_CONSTANTS_H
+
+// constants shared by the SD card tools
+
+#define MAX_FNAME_LENGTH 1000
+#define SAMPLING_RATE 30000   // samples/sec
+#define SEC_PER_MIN 60
+#define BYTES_PER_MB (1024*1024)
+
+#endif
@@ -3,8 +3,8 @@
 #include <stdint.h>
 #include <errno.h>
 #include "diskio_linux.h"
+#include "card_constants.h"
 
-#define MAX_FNAME_LENGTH 1000
 #define BUFFER_LENGTH 32768
 #define DEFAULT_SECTOR_SIZE 512
 
@@ -24,7 +24,7 @@ int main (int argc, char *argv[])
     int i, j;
     uint8_t buff[BUFFER_LENGTH];
     FILE *output_fp;
-    DeviceInfoType deviceInfo;
+    DiskSessionType session;
     FilePermissionType permission;
  
     // turn off output buffering
@@ -69,37 +69,34 @@ int main (int argc, char *argv[])
             return -3;
         }
 
-        // check that device information can be determined
-        // have gotten strange results when using uninitialized deviceInfo so 
-        // initialize here. In general it never hurts to initialize anyway  
-        memset(&deviceInfo, 0, sizeof(deviceInfo));
-        deviceInfoRes = DISKIO_iGetDeviceInfo(deviceFile, &deviceInfo);
+        // open the device once and determine its information
+        deviceInfoRes = DISKIO_iOpenSession(deviceFile, WRITE_ACCESS, &session);
         if ( deviceInfoRes ) {
             fprintf(stderr, "\nError checking device info: return value"
-                    " of DISKIO_iGetDeviceInfo() is %d\n",
+                    " of DISKIO_iOpenSession() is %d\n",
                     deviceInfoRes);
             return -4;
         }
 
         // fill buffer with values we will write to the disk and check if data written 
         // without errors
-        for (i = 0; i < deviceInfo.sectorSize; i++) {
+        for (i = 0; i < session.deviceInfo.sectorSize; i++) {
             buff[i] = 0xaa;
         }
-        writeDiskRes = DISKIO_iWriteDisk(deviceFile, buff, 1, 1, &deviceInfo);
+        writeDiskRes = DISKIO_iWriteSectors(&session, buff, 1, 1);
         if ( writeDiskRes ) {
         	fprintf(stderr, "\nError enabling card for recording: "
-        		    "return value of DISKIO_iWriteDisk() is %d\n",
+        		    "return value of DISKIO_iWriteSectors() is %d\n",
         		    writeDiskRes );
         	return -5;
         }
 
         // confirm that card was enabled for recording successfully
         fprintf(stdout, "\nConfirming that card was enabled successfully\n");
-        readAccessRes = DISKIO_iReadDisk(deviceFile, buff, 1, 1, &deviceInfo);
+        readAccessRes = DISKIO_iReadSectors(&session, buff, 1, 1);
         if ( readAccessRes ) {
         	fprintf(stderr, "\nError confirming that card was enabled successfully: "
-        		    "return value of DISKIO_iReadDisk() is %d\n", 
+        		    "return value of DISKIO_iReadSectors() is %d\n", 
         		    readAccessRes);
             return -6;
         }
@@ -113,6 +110,7 @@ int main (int argc, char *argv[])
         		fprintf(stdout, "\nCard enabled successfully for recording!\n");
         	}
         }
+        DISKIO_iCloseSession(&session);
 
         return 0;
     }
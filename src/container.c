@@ -0,0 +1,556 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "packet_scan.h"
+#include "container.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define CNT_HAVE_X86 1
+#endif
+
+#define CRC32C_POLY 0x82F63B78  // Castagnoli, bit reflected
+
+typedef uint32_t (*CrcKernelFuncType)(uint32_t crc, const uint8_t *data,
+                                      uint64_t numBytes);
+
+static CrcKernelFuncType crcKernel = NULL;
+static pthread_once_t crcOnce = PTHREAD_ONCE_INIT;
+static uint32_t crcTable[8][256];
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : u32CrcScalar()
+// Description : CRC-32C eight bytes at a time with eight tables
+//               ("slicing by 8"), for CPUs without the crc32 instruction
+// Parameters  : uint32_t crc - Running value, inverted
+//               const uint8_t *data - Bytes to add
+//               uint64_t numBytes - Number of bytes
+// Returns     : uint32_t - the running value, inverted
+//////////////////////////////////////////////////////////////////////////
+static uint32_t u32CrcScalar(uint32_t crc, const uint8_t *data, uint64_t numBytes) {
+
+    uint64_t word;
+
+    while ( numBytes >= 8 ) {
+        memcpy(&word, data, sizeof(word));
+        word ^= crc;
+        crc = crcTable[7][word & 0xFF] ^ crcTable[6][(word >> 8) & 0xFF]
+              ^ crcTable[5][(word >> 16) & 0xFF] ^ crcTable[4][(word >> 24) & 0xFF]
+              ^ crcTable[3][(word >> 32) & 0xFF] ^ crcTable[2][(word >> 40) & 0xFF]
+              ^ crcTable[1][(word >> 48) & 0xFF] ^ crcTable[0][word >> 56];
+        data += 8;
+        numBytes -= 8;
+    }
+    while ( numBytes-- ) {
+        crc = crcTable[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+    }
+
+    return crc;
+
+}
+
+#ifdef CNT_HAVE_X86
+//////////////////////////////////////////////////////////////////////////
+// Function    : u32CrcSse42()
+// Description : CRC-32C with the SSE4.2 crc32 instruction
+// Parameters  : See u32CrcScalar()
+// Returns     : uint32_t - the running value, inverted
+//////////////////////////////////////////////////////////////////////////
+__attribute__((target("sse4.2")))
+static uint32_t u32CrcSse42(uint32_t crc, const uint8_t *data, uint64_t numBytes) {
+
+    uint64_t word, crc64 = crc;
+
+    while ( numBytes >= 8 ) {
+        memcpy(&word, data, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+        data += 8;
+        numBytes -= 8;
+    }
+    crc = (uint32_t)crc64;
+    while ( numBytes-- ) {
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+
+    return crc;
+
+}
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : vSelectCrc()
+// Description : Builds the tables and picks the CRC kernel, once
+// Parameters  : none
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+static void vSelectCrc(void) {
+
+    uint32_t i, k, crc;
+
+    for (i = 0; i < 256; i++) {
+        crc = i;
+        for (k = 0; k < 8; k++) {
+            crc = (crc >> 1) ^ (CRC32C_POLY & (0 - (crc & 1)));
+        }
+        crcTable[0][i] = crc;
+    }
+    for (i = 0; i < 256; i++) {
+        for (k = 1; k < 8; k++) {
+            crcTable[k][i] = crcTable[0][crcTable[k - 1][i] & 0xFF]
+                             ^ (crcTable[k - 1][i] >> 8);
+        }
+    }
+    crcKernel = u32CrcScalar;
+#ifdef CNT_HAVE_X86
+    if ( __builtin_cpu_supports("sse4.2") ) {
+        crcKernel = u32CrcSse42;
+    }
+#endif
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iWriteAt()
+// Description : pwrite() wrapper that retries after interrupts and short
+//               writes until all bytes are out
+// Parameters  : int fd - File descriptor to write to
+//               const void *buff - Bytes to write
+//               uint64_t numBytes - Number of bytes to write
+//               uint64_t offset - Byte offset in the file to write at
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+static int iWriteAt(int fd, const void *buff, uint64_t numBytes, uint64_t offset) {
+
+    ssize_t res;
+    uint64_t done = 0;
+
+    while ( done < numBytes ) {
+        res = pwrite(fd, (const uint8_t *)buff + done, numBytes - done,
+                     (off_t)(offset + done));
+        if ( res < 0 ) {
+            if ( EINTR == errno ) {
+                continue;
+            }
+            fprintf(stderr, "Error %d writing %llu bytes at container offset"
+                    " %llu: %s\n", errno, (long long unsigned)numBytes,
+                    (long long unsigned)offset, strerror(errno));
+            return -1;
+        }
+        if ( 0 == res ) {
+            // nothing written and no error, don't spin on it
+            fprintf(stderr, "Error writing %llu bytes at container offset %llu:"
+                    " no bytes written\n", (long long unsigned)numBytes,
+                    (long long unsigned)offset);
+            return -1;
+        }
+        done += (uint64_t)res;
+    }
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iReadAt()
+// Description : pread() wrapper that retries after interrupts and short
+//               reads until all bytes are in
+// Parameters  : int fd - File descriptor to read from
+//               void *buff - Where to put the bytes
+//               uint64_t numBytes - Number of bytes to read
+//               uint64_t offset - Byte offset in the file to read from
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+static int iReadAt(int fd, void *buff, uint64_t numBytes, uint64_t offset) {
+
+    ssize_t res;
+    uint64_t done = 0;
+
+    while ( done < numBytes ) {
+        res = pread(fd, (uint8_t *)buff + done, numBytes - done, (off_t)(offset + done));
+        if ( res < 0 ) {
+            if ( EINTR == errno ) {
+                continue;
+            }
+            return -1;
+        }
+        if ( 0 == res ) {
+            return -2;
+        }
+        done += (uint64_t)res;
+    }
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : CNT_u32Crc()
+// Description : CRC-32C of a buffer, with the SSE4.2 instruction when the
+//               CPU has it. Can be run over a buffer in pieces
+// Parameters  : uint32_t crc - 0 to start, else the CRC of what came before
+//               const uint8_t *data - Bytes to add
+//               uint64_t numBytes - Number of bytes
+// Returns     : uint32_t - CRC of everything so far
+//////////////////////////////////////////////////////////////////////////
+uint32_t CNT_u32Crc(uint32_t crc, const uint8_t *data, uint64_t numBytes) {
+
+    pthread_once(&crcOnce, vSelectCrc);
+
+    return ~crcKernel(~crc, data, numBytes);
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : CNT_iInit()
+// Description : Starts a container in an empty file by writing its header
+// Parameters  : ContainerWriterType *writer - The writer
+//               int fd - The output file, written with pwrite() only
+//               const ContainerHeaderType *header - Filled in by the
+//                                                   caller except magic
+//                                                   and headerBytes
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int CNT_iInit(ContainerWriterType *writer, int fd, const ContainerHeaderType *header) {
+
+    ContainerHeaderType out = *header;
+
+    memset(writer, 0, sizeof(*writer));
+    writer->fd = fd;
+    writer->psize = header->psize;
+    writer->chunkPackets = header->chunkPackets;
+    writer->firstPacket = header->firstPacket;
+    writer->timeBase = header->timeBase;
+    memcpy(out.magic, CNT_MAGIC, sizeof(out.magic));
+    out.headerBytes = sizeof(out);
+    if ( iWriteAt(fd, &out, sizeof(out), 0) ) {
+        return -1;
+    }
+    writer->endOffset = sizeof(out);
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : u64ChunkTime()
+// Description : Unwraps the timestamp of a packet in a chunk. Chunks cover
+//               fixed stretches of the card, so where the chunk starts
+//               says roughly what time it is
+// Parameters  : const ContainerWriterType *writer - The writer
+//               uint64_t chunkIndex - Which chunk of the recording it is
+//               const uint8_t *packet - The packet
+// Returns     : uint64_t - the unwrapped timestamp
+//////////////////////////////////////////////////////////////////////////
+static uint64_t u64ChunkTime(const ContainerWriterType *writer, uint64_t chunkIndex,
+                             const uint8_t *packet) {
+
+    return PSCAN_u64Unwrap(PSCAN_u32ReadTimestamp(packet), writer->timeBase
+                           + writer->firstPacket + chunkIndex * writer->chunkPackets);
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : CNT_vMakeChunkHeader()
+// Description : Fills in the header of a chunk of packets, CRC included.
+//               Only reads the packets and the writer, so threads can
+//               make their chunks' headers at the same time
+// Parameters  : const ContainerWriterType *writer - The writer
+//               ContainerChunkHeaderType *chunk - The header
+//               uint64_t chunkIndex - Which chunk of the recording it is
+//               const uint8_t *packets - The chunk's packets
+//               uint64_t numPackets - Number of packets, may be 0
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+void CNT_vMakeChunkHeader(const ContainerWriterType *writer,
+                          ContainerChunkHeaderType *chunk, uint64_t chunkIndex,
+                          const uint8_t *packets, uint64_t numPackets) {
+
+    memset(chunk, 0, sizeof(*chunk));
+    memcpy(chunk->magic, CNT_CHUNK_MAGIC, sizeof(chunk->magic));
+    chunk->numPackets = (uint32_t)numPackets;
+    chunk->chunkIndex = chunkIndex;
+    if ( numPackets ) {
+        chunk->firstTimestamp = u64ChunkTime(writer, chunkIndex, packets);
+        chunk->lastTimestamp = u64ChunkTime(writer, chunkIndex,
+                                            packets + (numPackets - 1)*writer->psize);
+    }
+    chunk->crc = CNT_u32Crc(0, packets, numPackets * writer->psize);
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : CNT_iPlaceChunk()
+// Description : Gives a chunk its place at the end of the container and
+//               adds it to the index. Chunks must be placed in order from
+//               one thread, after which they can be written in any order
+// Parameters  : ContainerWriterType *writer - The writer
+//               const ContainerChunkHeaderType *chunk - The chunk's header
+//               uint64_t *offset - Where to write the chunk, on return
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int CNT_iPlaceChunk(ContainerWriterType *writer, const ContainerChunkHeaderType *chunk,
+                    uint64_t *offset) {
+
+    ContainerIndexEntryType *entry;
+
+    if ( PSCAN_iGrowList((void **)&writer->entryList, &writer->entryCapacity,
+                         writer->entryCt, sizeof(ContainerIndexEntryType)) ) {
+        return -1;
+    }
+    entry = &writer->entryList[writer->entryCt++];
+    entry->offset = writer->endOffset;
+    entry->numPackets = chunk->numPackets;
+    entry->firstTimestamp = chunk->firstTimestamp;
+    entry->lastTimestamp = chunk->lastTimestamp;
+    entry->crc = chunk->crc;
+    *offset = writer->endOffset;
+    writer->endOffset += sizeof(*chunk) + (uint64_t)chunk->numPackets * writer->psize;
+    writer->numPackets += chunk->numPackets;
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : CNT_iWriteChunk()
+// Description : Writes a placed chunk. Safe to call from several threads
+//               at once for different chunks
+// Parameters  : int fd - The output file
+//               uint64_t offset - From CNT_iPlaceChunk()
+//               const ContainerChunkHeaderType *chunk - The chunk's header
+//               const uint8_t *packets - The chunk's packets
+//               uint32_t psize - Number of bytes per packet
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int CNT_iWriteChunk(int fd, uint64_t offset, const ContainerChunkHeaderType *chunk,
+                    const uint8_t *packets, uint32_t psize) {
+
+    if ( iWriteAt(fd, chunk, sizeof(*chunk), offset)
+         || iWriteAt(fd, packets, (uint64_t)chunk->numPackets * psize,
+                     offset + sizeof(*chunk)) ) {
+        return -1;
+    }
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : CNT_iAppend()
+// Description : Streams packets into the current chunk, for a writer that
+//               gets its packets a buffer at a time. The packets go
+//               straight to the file and the CRC is kept running, the
+//               header is written by CNT_iEndChunk()
+// Parameters  : ContainerWriterType *writer - The writer
+//               const uint8_t *packets - Packets to add
+//               uint64_t numPackets - Number of packets
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int CNT_iAppend(ContainerWriterType *writer, const uint8_t *packets,
+                uint64_t numPackets) {
+
+    uint64_t numBytes = numPackets * writer->psize;
+
+    if ( 0 == numPackets ) {
+        return 0;
+    }
+    if ( !writer->chunkOpen ) {
+        CNT_vMakeChunkHeader(writer, &writer->chunk, writer->entryCt, packets, 0);
+        writer->chunk.firstTimestamp = u64ChunkTime(writer, writer->entryCt, packets);
+        writer->chunkOffset = writer->endOffset;
+        writer->endOffset += sizeof(writer->chunk);
+        writer->chunkOpen = 1;
+    }
+    if ( iWriteAt(writer->fd, packets, numBytes, writer->endOffset) ) {
+        return -1;
+    }
+    writer->endOffset += numBytes;
+    writer->chunk.numPackets += (uint32_t)numPackets;
+    writer->chunk.lastTimestamp = u64ChunkTime(writer, writer->entryCt,
+                                               packets + (numPackets - 1)*writer->psize);
+    writer->chunk.crc = CNT_u32Crc(writer->chunk.crc, packets, numBytes);
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : CNT_iEndChunk()
+// Description : Closes the chunk CNT_iAppend() has been streaming, or
+//               writes an empty chunk if nothing was appended since the
+//               last one
+// Parameters  : ContainerWriterType *writer - The writer
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int CNT_iEndChunk(ContainerWriterType *writer) {
+
+    uint64_t offset, dataBytes;
+
+    if ( !writer->chunkOpen ) {
+        CNT_vMakeChunkHeader(writer, &writer->chunk, writer->entryCt, NULL, 0);
+        writer->chunkOffset = writer->endOffset;
+        writer->endOffset += sizeof(writer->chunk);
+    }
+    writer->chunkOpen = 0;
+
+    // placing rewinds to the chunk's start and moves on past its data
+    dataBytes = writer->endOffset - writer->chunkOffset - sizeof(writer->chunk);
+    writer->endOffset = writer->chunkOffset;
+    if ( CNT_iPlaceChunk(writer, &writer->chunk, &offset)
+         || (writer->endOffset != offset + sizeof(writer->chunk) + dataBytes)
+         || iWriteAt(writer->fd, &writer->chunk, sizeof(writer->chunk), offset) ) {
+        return -1;
+    }
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : CNT_iFinish()
+// Description : Writes the index and trailer after the last chunk and
+//               releases the writer's index
+// Parameters  : ContainerWriterType *writer - The writer
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int CNT_iFinish(ContainerWriterType *writer) {
+
+    ContainerTrailerType trailer;
+    uint64_t indexBytes = writer->entryCt * sizeof(ContainerIndexEntryType);
+    int res = 0;
+
+    if ( writer->chunkOpen && CNT_iEndChunk(writer) ) {
+        res = -1;
+    }
+    memset(&trailer, 0, sizeof(trailer));
+    memcpy(trailer.magic, CNT_TRAILER_MAGIC, sizeof(trailer.magic));
+    trailer.indexOffset = writer->endOffset;
+    trailer.numChunks = writer->entryCt;
+    trailer.numPackets = writer->numPackets;
+    trailer.indexCrc = CNT_u32Crc(0, (const uint8_t *)writer->entryList, indexBytes);
+    if ( (0 == res)
+         && (iWriteAt(writer->fd, writer->entryList, indexBytes, writer->endOffset)
+             || iWriteAt(writer->fd, &trailer, sizeof(trailer),
+                         writer->endOffset + indexBytes)) ) {
+        res = -2;
+    }
+    free(writer->entryList);
+    writer->entryList = NULL;
+    writer->entryCt = writer->entryCapacity = 0;
+
+    return res;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : CNT_iOpen()
+// Description : Opens a container and loads its index through the trailer,
+//               without reading any chunks
+// Parameters  : ContainerReaderType *reader - Filled in on return
+//               const char *path - The container file
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int CNT_iOpen(ContainerReaderType *reader, const char *path) {
+
+    struct stat fileStat;
+    uint64_t fileBytes, indexBytes;
+
+    memset(reader, 0, sizeof(*reader));
+    reader->fd = open(path, O_RDONLY);
+    if ( (reader->fd < 0) || fstat(reader->fd, &fileStat) ) {
+        fprintf(stderr, "Error opening %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    fileBytes = (uint64_t)fileStat.st_size;
+    if ( (fileBytes < sizeof(reader->header) + sizeof(reader->trailer))
+         || iReadAt(reader->fd, &reader->header, sizeof(reader->header), 0)
+         || memcmp(reader->header.magic, CNT_MAGIC, sizeof(reader->header.magic))
+         || (reader->header.headerBytes != sizeof(reader->header))
+         || iReadAt(reader->fd, &reader->trailer, sizeof(reader->trailer),
+                    fileBytes - sizeof(reader->trailer))
+         || memcmp(reader->trailer.magic, CNT_TRAILER_MAGIC,
+                   sizeof(reader->trailer.magic)) ) {
+        fprintf(stderr, "%s isn't a complete container\n", path);
+        CNT_vClose(reader);
+        return -2;
+    }
+    indexBytes = reader->trailer.numChunks * sizeof(ContainerIndexEntryType);
+    if ( reader->trailer.indexOffset + indexBytes + sizeof(reader->trailer) != fileBytes ) {
+        fprintf(stderr, "%s: index doesn't fit the file\n", path);
+        CNT_vClose(reader);
+        return -3;
+    }
+    reader->entryList = malloc(indexBytes ? indexBytes : 1);
+    if ( (NULL == reader->entryList)
+         || iReadAt(reader->fd, reader->entryList, indexBytes, reader->trailer.indexOffset)
+         || (CNT_u32Crc(0, (const uint8_t *)reader->entryList, indexBytes)
+             != reader->trailer.indexCrc) ) {
+        fprintf(stderr, "%s: index is damaged\n", path);
+        CNT_vClose(reader);
+        return -4;
+    }
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : CNT_iReadChunk()
+// Description : Reads one chunk's packets and checks them against the CRC.
+//               Uses pread() only, so threads can read chunks at once
+// Parameters  : const ContainerReaderType *reader - The open container
+//               uint64_t chunk - Which chunk
+//               uint8_t *packets - Room for the chunk's numPackets packets
+// Returns     : int - 0 if success, negative value if the chunk can't be
+//               read or is damaged
+//////////////////////////////////////////////////////////////////////////
+int CNT_iReadChunk(const ContainerReaderType *reader, uint64_t chunk,
+                   uint8_t *packets) {
+
+    const ContainerIndexEntryType *entry;
+    ContainerChunkHeaderType header;
+    uint64_t numBytes;
+
+    if ( chunk >= reader->trailer.numChunks ) {
+        return -1;
+    }
+    entry = &reader->entryList[chunk];
+    numBytes = (uint64_t)entry->numPackets * reader->header.psize;
+    if ( iReadAt(reader->fd, &header, sizeof(header), entry->offset)
+         || memcmp(header.magic, CNT_CHUNK_MAGIC, sizeof(header.magic))
+         || (header.chunkIndex != chunk)
+         || (header.numPackets != entry->numPackets)
+         || (header.crc != entry->crc)
+         || iReadAt(reader->fd, packets, numBytes, entry->offset + sizeof(header)) ) {
+        return -2;
+    }
+    if ( CNT_u32Crc(0, packets, numBytes) != entry->crc ) {
+        return -3;
+    }
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : CNT_vClose()
+// Description : Closes a container opened with CNT_iOpen()
+// Parameters  : ContainerReaderType *reader - The open container
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+void CNT_vClose(ContainerReaderType *reader) {
+
+    if ( reader->fd >= 0 ) {
+        close(reader->fd);
+    }
+    free(reader->entryList);
+    memset(reader, 0, sizeof(*reader));
+    reader->fd = -1;
+
+}
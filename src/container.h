@@ -0,0 +1,128 @@
+#ifndef CONTAINER_H
+#define CONTAINER_H
+
+#include <stdint.h>
+#include "card_config.h"
+
+#define CNT_MAGIC "SDCONT02"
+#define CNT_CHUNK_MAGIC "CHNK"
+#define CNT_TRAILER_MAGIC "SDCTRLR1"
+#define CNT_CHUNK_SEC 1      // card packets per chunk, in seconds of recording
+
+// Self-describing container for extracted packets:
+//   ContainerHeaderType
+//   chunks: ContainerChunkHeaderType, then numPackets packets
+//   numChunks ContainerIndexEntryType
+//   ContainerTrailerType, the last bytes of the file
+// Chunk k holds the valid packets of card packets firstPacket + k*chunkPackets
+// up to the next chunk, so chunks cover fixed stretches of the recording
+// and one with only bad packets is empty. The header and each chunk can
+// be written by any thread once the chunk's offset is known, and the
+// trailer leads straight to the index, so a reader needs three reads to
+// find every chunk. CRCs are CRC-32C of the chunk's packets and of the
+// index. Timestamps are unwrapped to 64 bits against timeBase (see
+// packet_scan.h), so they keep going up past the 32 bit counter's wrap.
+// All values are little endian.
+
+//////////////////////////////////////////////////////////////////////////
+//                      Public Data Types
+//////////////////////////////////////////////////////////////////////////
+typedef struct {
+    char magic[8];
+    uint32_t headerBytes;   // sizeof(ContainerHeaderType)
+    uint32_t psize;         // bytes per packet in the chunks
+    uint32_t numChannels;
+    uint32_t samplingRate;  // samples/sec
+    uint32_t chunkPackets;  // card packets per chunk
+    uint32_t sectorSize;    // of the card
+    uint64_t sectorCount;
+    uint64_t firstPacket;   // card packets extracted
+    uint64_t lastPacket;
+    uint64_t timeBase;      // unwrapped time of card packet 0, less any drops
+    uint8_t configSector[512];
+    uint16_t channelId[CFG_MAX_CHANNELS];
+} ContainerHeaderType;
+
+typedef struct {
+    char magic[4];
+    uint32_t numPackets;
+    uint64_t chunkIndex;
+    uint64_t firstTimestamp;
+    uint64_t lastTimestamp;
+    uint32_t crc;
+    uint32_t reserved;
+} ContainerChunkHeaderType;
+
+typedef struct {
+    uint64_t offset;        // of the chunk header
+    uint32_t numPackets;
+    uint32_t crc;
+    uint64_t firstTimestamp;
+    uint64_t lastTimestamp;
+} ContainerIndexEntryType;
+
+typedef struct {
+    char magic[8];
+    uint64_t indexOffset;
+    uint64_t numChunks;
+    uint64_t numPackets;
+    uint32_t indexCrc;
+    uint32_t reserved;
+} ContainerTrailerType;
+
+typedef struct {
+    int fd;
+    uint32_t psize;
+    uint32_t chunkPackets;  // from the header
+    uint64_t firstPacket;
+    uint64_t timeBase;
+    uint64_t endOffset;     // bytes placed so far
+    uint64_t numPackets;
+    ContainerIndexEntryType *entryList;
+    uint64_t entryCt;
+    uint64_t entryCapacity;
+    // chunk being streamed by CNT_iAppend()
+    int chunkOpen;
+    ContainerChunkHeaderType chunk;
+    uint64_t chunkOffset;
+} ContainerWriterType;
+
+typedef struct {
+    int fd;
+    ContainerHeaderType header;
+    ContainerTrailerType trailer;
+    ContainerIndexEntryType *entryList;
+} ContainerReaderType;
+
+//////////////////////////////////////////////////////////////////////////
+//                    Public Function Prototypes
+//////////////////////////////////////////////////////////////////////////
+uint32_t CNT_u32Crc(uint32_t crc, const uint8_t *data, uint64_t numBytes);
+
+int CNT_iInit(ContainerWriterType *writer, int fd, const ContainerHeaderType *header);
+
+void CNT_vMakeChunkHeader(const ContainerWriterType *writer,
+                          ContainerChunkHeaderType *chunk, uint64_t chunkIndex,
+                          const uint8_t *packets, uint64_t numPackets);
+
+int CNT_iPlaceChunk(ContainerWriterType *writer, const ContainerChunkHeaderType *chunk,
+                    uint64_t *offset);
+
+int CNT_iWriteChunk(int fd, uint64_t offset, const ContainerChunkHeaderType *chunk,
+                    const uint8_t *packets, uint32_t psize);
+
+int CNT_iAppend(ContainerWriterType *writer, const uint8_t *packets,
+                uint64_t numPackets);
+
+int CNT_iEndChunk(ContainerWriterType *writer);
+
+int CNT_iFinish(ContainerWriterType *writer);
+
+int CNT_iOpen(ContainerReaderType *reader, const char *path);
+
+int CNT_iReadChunk(const ContainerReaderType *reader, uint64_t chunk,
+                   uint8_t *packets);
+
+void CNT_vClose(ContainerReaderType *reader);
+
+#endif // CONTAINER_H
@@ -1,11 +1,14 @@
+#define _GNU_SOURCE   // O_DIRECT, statx()
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <stdint.h>
 #include <errno.h>
 #include <linux/fs.h> // BLKSSZGET, BLKGETSIZE64 
-#include <fcntl.h>    // O_RDONLY, O_NONBLOCK
+#include <fcntl.h>    // O_RDONLY, O_NONBLOCK, O_DIRECT
 #include <sys/ioctl.h>
+#include <sys/stat.h>
 #include "diskio_linux.h"
 
 //////////////////////////////////////////////////////////////////////////
@@ -60,167 +63,437 @@ int DISKIO_iCheckFileAccess(char *filename, FilePermissionType permission) {
 }
 
 //////////////////////////////////////////////////////////////////////////
-// Function    : DISKIO_iGetDeviceInfo()
-// Description : Gets block information about a device e.g. sector size
+// Function    : iPreadFull()
+// Description : pread() wrapper that retries after interrupts and short 
+//               reads until all requested bytes are in
+// Parameters  : int fd - File descriptor to read from
+//               uint8_t *buff - Where to put the bytes
+//               uint64_t numBytes - Number of bytes to read
+//               uint64_t offset - Byte offset to read at
+// Returns     : int64_t - number of bytes read (less than numBytes only at
+//               end of file), -1 on error with errno set
+//////////////////////////////////////////////////////////////////////////
+static int64_t iPreadFull(int fd, uint8_t *buff, uint64_t numBytes, 
+                          uint64_t offset) {
+
+    ssize_t res;
+    uint64_t done = 0;
+
+    while ( done < numBytes ) {
+        res = pread(fd, buff + done, numBytes - done, (off_t)(offset + done));
+        if ( res < 0 ) {
+            if ( EINTR == errno ) {
+                continue;
+            }
+            return -1;
+        }
+        if ( 0 == res ) {
+            break;
+        }
+        done += (uint64_t)res;
+    }
+
+    return (int64_t)done;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iPwriteFull()
+// Description : pwrite() wrapper that retries after interrupts and short 
+//               writes until all bytes are out
+// Parameters  : int fd - File descriptor to write to
+//               uint8_t *buff - Bytes to write
+//               uint64_t numBytes - Number of bytes to write
+//               uint64_t offset - Byte offset to write at
+// Returns     : int64_t - number of bytes written, -1 on error with errno set
+//////////////////////////////////////////////////////////////////////////
+static int64_t iPwriteFull(int fd, uint8_t *buff, uint64_t numBytes, 
+                           uint64_t offset) {
+
+    ssize_t res;
+    uint64_t done = 0;
+
+    while ( done < numBytes ) {
+        res = pwrite(fd, buff + done, numBytes - done, (off_t)(offset + done));
+        if ( res < 0 ) {
+            if ( EINTR == errno ) {
+                continue;
+            }
+            return -1;
+        }
+        if ( 0 == res ) {
+            // nothing written and no error, don't spin on it
+            errno = EIO;
+            return -1;
+        }
+        done += (uint64_t)res;
+    }
+
+    return (int64_t)done;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : DISKIO_iOpenSession()
+// Description : Opens a device once for all further reads and writes and 
+//               gets its block information e.g. sector size. Regular files
+//               (card images) are accepted too and use the default sector
+//               size
 // Parameters  : char *filename - The name of the device file
-//               DeviceInfoType deviceInfoObj - Object that will hold the 
-//                                              device information 
+//               FilePermissionType permission - READ_ACCESS to open read
+//                                               only, WRITE_ACCESS to open
+//                                               for reading and writing
+//               DiskSessionType *session - Session to fill in
 // Returns     : int - 0 if success, negative value otherwise
 //////////////////////////////////////////////////////////////////////////
-int DISKIO_iGetDeviceInfo(char *filename, DeviceInfoType *deviceInfoObj) {
+int DISKIO_iOpenSession(char *filename, FilePermissionType permission, 
+                        DiskSessionType *session) {
 
-    int fdDevice;
+    int flags, sectorSize;
+    struct stat fileStat;
+    DeviceInfoType *deviceInfoObj = &(session->deviceInfo);
 
     // turn off output buffering
     setvbuf(stdout, 0, _IONBF, 0);
     setvbuf(stderr, 0, _IONBF, 0);
 
+    memset(session, 0, sizeof(*session));
+    session->fd = -1;
+    session->directFd = -1;
+    session->filename = filename;
+
+    switch(permission) {
+        case READ_ACCESS:
+            flags = O_RDONLY;
+            break;
+        case WRITE_ACCESS:
+            flags = O_RDWR;
+            break;
+        default:
+            fprintf(stderr, "\nInvalid parameter!\n");
+            return -1;
+    }
+
     fprintf(stdout, "\nGetting info from device %s ...\n", filename);
-    fdDevice = open(filename, O_RDONLY|O_NONBLOCK);
-    if ( -1 == fdDevice ) {
+    session->fd = open(filename, flags);
+    if ( -1 == session->fd ) {
         fprintf(stderr, "\nError %d opening device: %s \n",
                 errno, strerror(errno) );
-        return -1;
+        return -2;
+    }
+    session->writable = (WRITE_ACCESS == permission);
+
+    if ( fstat(session->fd, &fileStat) ) {
+        fprintf(stderr, "\nError %d getting file status: %s \n",
+                errno, strerror(errno) );
+        DISKIO_iCloseSession(session);
+        return -3;
+    }
+
+    if ( S_ISREG(fileStat.st_mode) ) {
+        // card image, lay it out like an SD card
+        deviceInfoObj->sectorSize = DISKIO_DEFAULT_SECTOR_SIZE;
+        deviceInfoObj->deviceSize = (uint64_t)fileStat.st_size;
     }
-        
-    if ( -1 == ioctl(fdDevice, BLKSSZGET, &(deviceInfoObj->sectorSize)) ) {
+    else if ( -1 == ioctl(session->fd, BLKSSZGET, &sectorSize) ) {
         fprintf(stderr, "\nError getting sector size!\n");
         fprintf(stderr, "Error %d: %s \n", errno, strerror(errno));
-        return -2;
+        DISKIO_iCloseSession(session);
+        return -4;
     }
-    else if ( -1 == ioctl(fdDevice, BLKGETSIZE64, &(deviceInfoObj->deviceSize)) ) {
+    else if ( -1 == ioctl(session->fd, BLKGETSIZE64, &(deviceInfoObj->deviceSize)) ) {
         fprintf(stderr, "\nError getting device size\n!");
         fprintf(stderr, "Error %d: %s \n", errno, strerror(errno));
-        return -3;
+        DISKIO_iCloseSession(session);
+        return -5;
     }
-    // no errors getting device info
     else {
-        deviceInfoObj->sectorCount = deviceInfoObj->deviceSize / deviceInfoObj->sectorSize;
-        fprintf(stdout, "Device is %llu bytes = %.2f MB = %.2f GB large \n",
-                (long long unsigned)deviceInfoObj->deviceSize,
-                (double)(deviceInfoObj->deviceSize/1000.0/1000.0),
-                (double)(deviceInfoObj->deviceSize/1000.0/1000.0/1000.0) );
-        fprintf(stdout, "Sector info: %llu bytes/sector, %llu sectors\n\n", 
-                (long long unsigned)deviceInfoObj->sectorSize, 
-                (long long unsigned)deviceInfoObj->sectorCount );
-
-    } 
-
-    // done getting device info, time to close
-    if ( close(fdDevice) ) {
+        deviceInfoObj->sectorSize = (uint64_t)sectorSize;
+    }
+
+    deviceInfoObj->sectorCount = deviceInfoObj->deviceSize / deviceInfoObj->sectorSize;
+    session->ioAlign = deviceInfoObj->sectorSize;
+    fprintf(stdout, "Device is %llu bytes = %.2f MB = %.2f GB large \n",
+            (long long unsigned)deviceInfoObj->deviceSize,
+            (double)(deviceInfoObj->deviceSize/1000.0/1000.0),
+            (double)(deviceInfoObj->deviceSize/1000.0/1000.0/1000.0) );
+    fprintf(stdout, "Sector info: %llu bytes/sector, %llu sectors\n\n", 
+            (long long unsigned)deviceInfoObj->sectorSize, 
+            (long long unsigned)deviceInfoObj->sectorCount );
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : DISKIO_iCloseSession()
+// Description : Closes a device opened with DISKIO_iOpenSession()
+// Parameters  : DiskSessionType *session - Session to close
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int DISKIO_iCloseSession(DiskSessionType *session) {
+
+    if ( -1 != session->directFd ) {
+        close(session->directFd);
+        session->directFd = -1;
+    }
+
+    if ( -1 == session->fd ) {
+        return 0;
+    }
+
+    if ( close(session->fd) ) {
         // don't really care if there's an error closing device because it can
         // still be considered effectively closed, but it's good practice to 
         // check for errors anyway
         fprintf(stderr, "\nError %d closing device: %s \n",
                 errno, strerror(errno) );
-        return -4;
+        session->fd = -1;
+        return -1;
     }
+    session->fd = -1;
 
     return 0;
 
 }
 
 //////////////////////////////////////////////////////////////////////////
-// Function    : DISKIO_iReadDisk()
-// Description : Reads a specified number of sectors from a device
-// Parameters  : char *filename - The name of the device file
+// Function    : DISKIO_iReadSectors()
+// Description : Reads a specified number of sectors from an open device. 
+//               Suitable for large block reads of many megabytes
+// Parameters  : DiskSessionType *session - The open device
 //               uint8_t *buff - Pointer to the block of memory for which to 
 //                               read in the bytes
-//               uint32_t sector - Which sector to start reading
-//               uint32_t numSectors - Number of sectors to read
-//               DeviceInfoType *deviceInfoObj - Object that holds the 
-//                                               device information
+//               uint64_t startSector - Which sector to start reading
+//               uint64_t numSectors - Number of sectors to read
 // Returns     : int - 0 if success, negative value otherwise
 //////////////////////////////////////////////////////////////////////////
-int DISKIO_iReadDisk(char *filename, uint8_t *buff, uint32_t sector, 
-                     uint32_t numSectors, DeviceInfoType *deviceInfoObj) {
+int DISKIO_iReadSectors(DiskSessionType *session, uint8_t *buff, 
+                        uint64_t startSector, uint64_t numSectors) {
 
-    long int offset;
-    uint64_t bytesExpected, bytesRead;
-    FILE *fpDevice;
+    DeviceInfoType *deviceInfoObj = &(session->deviceInfo);
 
-    // turn off output buffering
-    setvbuf(stdout, 0, _IONBF, 0);
-    setvbuf(stderr, 0, _IONBF, 0);
-    
-    fpDevice = fopen(filename, "r");
-    if ( NULL == fpDevice ) {
-        fprintf(stderr, "\nCould not open %s to read!", filename);
+    if ( (startSector + numSectors) > deviceInfoObj->sectorCount ) {
+        fprintf(stderr, "Error: sectors %llu to %llu are past the end of the device\n",
+                (long long unsigned)startSector,
+                (long long unsigned)(startSector + numSectors - 1) );
         return -1;
     }
-        
-    fprintf(stdout, "\nReading from %s ...\n", filename);
-    offset = (long int)(sector * deviceInfoObj->sectorSize);
-    if ( fseek(fpDevice, offset, SEEK_SET) ) {
-        fprintf(stderr, "\nError finding sectors to read!\n");
+
+    if ( DISKIO_iReadBytes(session, buff, startSector * deviceInfoObj->sectorSize,
+                           numSectors * deviceInfoObj->sectorSize) ) {
         return -2;
     }
-    bytesExpected = numSectors * deviceInfoObj->sectorSize;
-    bytesRead = (uint64_t)fread(buff, sizeof(uint8_t), bytesExpected, fpDevice);
-    if ( bytesExpected != bytesRead ) {
-        fprintf(stderr, "\nError: %llu bytes read but expected number of bytes is %llu\n"
-                "Please try again.",
-                (long long unsigned)bytesRead,
-                (long long unsigned)bytesExpected );
-        return -3;
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : DISKIO_iEnableDirectIO()
+// Description : Opens a second, O_DIRECT descriptor on the device so large 
+//               aligned reads bypass the page cache. Reading a whole card
+//               through the page cache evicts everything else on the 
+//               machine and costs an extra copy. If the device or file 
+//               system can't do O_DIRECT the session stays buffered
+// Parameters  : DiskSessionType *session - The open device
+// Returns     : int - 0 if direct I/O is enabled, 1 if the session fell
+//               back to buffered I/O
+//////////////////////////////////////////////////////////////////////////
+int DISKIO_iEnableDirectIO(DiskSessionType *session) {
+
+    uint64_t align;
+    uint8_t *probe;
+    struct stat fileStat;
+#ifdef STATX_DIOALIGN
+    struct statx fileStatx;
+#endif
+
+    if ( -1 != session->directFd ) {
+        return 0;
     }
 
-    // done reading, time to close
-    if ( fclose(fpDevice) ) {
-        fprintf(stderr, "\nError closing file %s", filename);
-        return -4;
+    // block devices need sector alignment. For card images the alignment
+    // comes from the file system, and a page is always enough if it 
+    // can't tell us
+    align = session->deviceInfo.sectorSize;
+    if ( (0 == fstat(session->fd, &fileStat)) && S_ISREG(fileStat.st_mode) ) {
+        align = (uint64_t)sysconf(_SC_PAGESIZE);
+#ifdef STATX_DIOALIGN
+        if ( (0 == statx(session->fd, "", AT_EMPTY_PATH, STATX_DIOALIGN, &fileStatx)) 
+             && (fileStatx.stx_mask & STATX_DIOALIGN) ) {
+            if ( 0 == fileStatx.stx_dio_offset_align ) {
+                fprintf(stdout, "Direct I/O not supported for %s, using buffered"
+                        " reads\n", session->filename);
+                return 1;
+            }
+            align = fileStatx.stx_dio_offset_align;
+        }
+#endif
+        if ( align < session->deviceInfo.sectorSize ) {
+            align = session->deviceInfo.sectorSize;
+        }
+    }
+
+    session->directFd = open(session->filename, O_RDONLY | O_DIRECT);
+    if ( -1 == session->directFd ) {
+        fprintf(stdout, "Direct I/O not available for %s (%s), using buffered"
+                " reads\n", session->filename, strerror(errno));
+        return 1;
     }
+    session->ioAlign = align;
+
+    // some file systems accept O_DIRECT at open time and only fail the read
+    probe = DISKIO_pu8AllocBuffer(session, align);
+    if ( (NULL == probe) || (iPreadFull(session->directFd, probe, align, 0) < 0) ) {
+        fprintf(stdout, "Direct I/O not available for %s (%s), using buffered"
+                " reads\n", session->filename, strerror(errno));
+        free(probe);
+        close(session->directFd);
+        session->directFd = -1;
+        session->ioAlign = session->deviceInfo.sectorSize;
+        return 1;
+    }
+    free(probe);
+
+    fprintf(stdout, "Using direct I/O, %llu byte alignment\n", 
+            (long long unsigned)session->ioAlign);
 
     return 0;
+
 }
 
 //////////////////////////////////////////////////////////////////////////
-// Function    : DISKIO_iWriteDisk()
-// Description : Writes data to a specified number of sectors in a device
-// Parameters  : char *filename - The name of the device file
+// Function    : DISKIO_pu8AllocBuffer()
+// Description : Allocates a read buffer that satisfies the alignment the 
+//               session needs for direct I/O. Free it with free()
+// Parameters  : DiskSessionType *session - The open device
+//               uint64_t numBytes - Size of the buffer, rounded up to a 
+//                                   multiple of the I/O alignment
+// Returns     : uint8_t * - the buffer, NULL if out of memory
+//////////////////////////////////////////////////////////////////////////
+uint8_t *DISKIO_pu8AllocBuffer(DiskSessionType *session, uint64_t numBytes) {
+
+    void *buff;
+    uint64_t align;
+
+    align = session->ioAlign;
+    if ( align < (uint64_t)sysconf(_SC_PAGESIZE) ) {
+        align = (uint64_t)sysconf(_SC_PAGESIZE);
+    }
+    numBytes = ((numBytes + session->ioAlign - 1) / session->ioAlign) * session->ioAlign;
+    if ( posix_memalign(&buff, align, numBytes) ) {
+        return NULL;
+    }
+
+    return (uint8_t *)buff;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : DISKIO_iGetReadFd()
+// Description : Picks the descriptor a read should use. Reads whose 
+//               offset, length and buffer all meet the session's I/O 
+//               alignment go through the direct descriptor when it is 
+//               enabled, everything else through the buffered one. Used by
+//               readers that issue their own I/O e.g. io_uring
+// Parameters  : DiskSessionType *session - The open device
+//               uint8_t *buff - Destination of the read
+//               uint64_t offset - Byte offset of the read
+//               uint64_t numBytes - Length of the read
+// Returns     : int - the file descriptor to read from
+//////////////////////////////////////////////////////////////////////////
+int DISKIO_iGetReadFd(DiskSessionType *session, uint8_t *buff, 
+                      uint64_t offset, uint64_t numBytes) {
+
+    if ( (-1 != session->directFd) 
+         && (0 == (offset % session->ioAlign))
+         && (0 == (numBytes % session->ioAlign))
+         && (0 == ((uintptr_t)buff % session->ioAlign)) ) {
+        return session->directFd;
+    }
+
+    return session->fd;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : DISKIO_iReadBytes()
+// Description : Reads an arbitrary byte span from an open device, through
+//               the direct descriptor when the span allows it
+// Parameters  : DiskSessionType *session - The open device
 //               uint8_t *buff - Pointer to the block of memory for which to 
 //                               read in the bytes
-//               uint32_t sector - Which sector to start reading
-//               uint32_t numSectors - Number of sectors to read
-//               DeviceInfoType *deviceInfoObj - Object that holds the 
-//                                               device information
+//               uint64_t offset - Byte offset to start reading at
+//               uint64_t numBytes - Number of bytes to read
 // Returns     : int - 0 if success, negative value otherwise
 //////////////////////////////////////////////////////////////////////////
-int DISKIO_iWriteDisk(char *filename, uint8_t *buff, uint32_t sector, uint32_t numSectors, 
-                      DeviceInfoType *deviceInfoObj) {
+int DISKIO_iReadBytes(DiskSessionType *session, uint8_t *buff, 
+                      uint64_t offset, uint64_t numBytes) {
 
-    long int offset;
-    uint64_t bytesExpected, bytesWritten;
-    FILE *fpDevice;
+    int64_t bytesRead;
 
-    // turn off output buffering
-    setvbuf(stdout, 0, _IONBF, 0);
-    setvbuf(stderr, 0, _IONBF, 0);
-    
-    fpDevice = fopen(filename, "w");
-    if ( NULL == fpDevice ) {
-        fprintf(stderr, "\nCould not open %s to write!\n", filename);
+    bytesRead = iPreadFull(DISKIO_iGetReadFd(session, buff, offset, numBytes), 
+                           buff, numBytes, offset);
+    if ( bytesRead < 0 ) {
+        fprintf(stderr, "Error %d reading %llu bytes at offset %llu: %s\n", 
+                errno, (long long unsigned)numBytes, 
+                (long long unsigned)offset, strerror(errno));
+        return -1;
+    }
+    if ( numBytes != (uint64_t)bytesRead ) {
+        fprintf(stderr, "Error: %llu bytes read but expected number of bytes is %llu\n",
+                (long long unsigned)bytesRead,
+                (long long unsigned)numBytes );
+        return -2;
+    }
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : DISKIO_iWriteSectors()
+// Description : Writes data to a specified number of sectors of an open 
+//               device and flushes it out to the card
+// Parameters  : DiskSessionType *session - The device, opened for writing
+//               uint8_t *buff - Pointer to the bytes to write
+//               uint64_t startSector - Which sector to start writing
+//               uint64_t numSectors - Number of sectors to write
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int DISKIO_iWriteSectors(DiskSessionType *session, uint8_t *buff, 
+                         uint64_t startSector, uint64_t numSectors) {
+
+    int64_t bytesWritten;
+    uint64_t bytesExpected;
+    DeviceInfoType *deviceInfoObj = &(session->deviceInfo);
+
+    if ( !session->writable ) {
+        fprintf(stderr, "\nError: %s was not opened for writing\n", 
+                session->filename);
         return -1;
     }
-    fprintf(stdout, "\nWriting to %s ...\n", filename);
-    offset = (long int)(sector * deviceInfoObj->sectorSize);
-    if ( fseek(fpDevice, offset, SEEK_SET) ) {
-        fprintf(stderr, "\nError finding sectors to write!\n");
+    if ( (startSector + numSectors) > deviceInfoObj->sectorCount ) {
+        fprintf(stderr, "Error: sectors %llu to %llu are past the end of the device\n",
+                (long long unsigned)startSector,
+                (long long unsigned)(startSector + numSectors - 1) );
         return -2;
     }
+
+    fprintf(stdout, "\nWriting to %s ...\n", session->filename);
     bytesExpected = numSectors * deviceInfoObj->sectorSize;
-    bytesWritten = (uint64_t)fwrite(buff, sizeof(uint8_t), bytesExpected, fpDevice);
-    if ( bytesExpected != bytesWritten ) {
-        fprintf(stderr, "\nError: %llu bytes written but expected number of bytes is %llu\n"
-                "Please try again.",
-                (long long unsigned)bytesWritten,
-                (long long unsigned)bytesExpected );
+    bytesWritten = iPwriteFull(session->fd, buff, bytesExpected,
+                               startSector * deviceInfoObj->sectorSize);
+    if ( bytesWritten < 0 ) {
+        fprintf(stderr, "Error %d writing sectors: %s\n", errno, strerror(errno));
         return -3;
     }
-    
-    // done reading, time to close
-    if ( fclose(fpDevice) ) {
-        fprintf(stderr, "\nError closing file %s\n", filename);
+
+    // make sure the sectors are on the card before it gets pulled out
+    if ( fsync(session->fd) ) {
+        fprintf(stderr, "Error %d flushing writes to %s: %s\n", 
+                errno, session->filename, strerror(errno));
         return -4;
     }
 
@@ -230,43 +503,36 @@ int DISKIO_iWriteDisk(char *filename, uint8_t *buff, uint32_t sector, uint32_t n
 
 //////////////////////////////////////////////////////////////////////////
 // Function    : DISKIO_iReadPacket()
-// Description : Reads packets from device
-// Parameters  : FILE *fp - The file pointer to the device
+// Description : Reads packets from device. Packets are stored back to back
+//               starting at the second sector
+// Parameters  : DiskSessionType *session - The open device
 //               uint8_t *buff - Pointer to the block of memory for which to 
 //                               read in the bytes
 //               uint64_t startPacketIndex - Packet to start reading at
-//               uint16_t packetSize - Number of bytes per packet
+//               uint32_t packetSize - Number of bytes per packet
 //               uint64_t numPackets - Number of packets to read
-//               DeviceInfoType *deviceInfoObj - Object that holds the 
-//                                               device information
 // Returns     : int - 0 if success, negative value otherwise
 //////////////////////////////////////////////////////////////////////////
-int DISKIO_iReadPacket(FILE *fpDevice, uint8_t *buff, uint64_t startPacketIndex, 
-                       uint16_t packetSize, uint64_t numPackets,
-                       DeviceInfoType *deviceInfoObj) {
-
-    long int startSector;
-    long int offset;
-    uint64_t numPacketsRead;
+int DISKIO_iReadPacket(DiskSessionType *session, uint8_t *buff, 
+                       uint64_t startPacketIndex, uint32_t packetSize, 
+                       uint64_t numPackets) {
 
-    // turn off output buffering
-    setvbuf(stdout, 0, _IONBF, 0);
-    setvbuf(stderr, 0, _IONBF, 0);
+    int64_t bytesRead;
+    uint64_t bytesExpected;
 
-    // position file pointer to correct byte
-    if ( fseek(fpDevice, deviceInfoObj->sectorSize 
-                         + startPacketIndex * packetSize, SEEK_SET) ) {
-        fprintf(stderr, "Error setting file pointer to read packets\n");
+    bytesExpected = numPackets * packetSize;
+    bytesRead = iPreadFull(session->fd, buff, bytesExpected, 
+                           session->deviceInfo.sectorSize 
+                           + startPacketIndex * packetSize);
+    if ( bytesRead < 0 ) {
+        fprintf(stderr, "Error %d reading packets: %s\n", errno, strerror(errno));
         return -1;
     }
-
-    numPacketsRead = (uint64_t)fread(buff, sizeof(uint8_t) * packetSize,  
-                                     numPackets, fpDevice);
-    if ( numPacketsRead != numPackets ) {
+    if ( bytesExpected != (uint64_t)bytesRead ) {
         fprintf(stderr, "Error reading packets: %llu packets requested but"
-               " %llu packets read", 
+               " %llu packets read\n", 
                (long long unsigned)numPackets,
-               (long long unsigned)numPacketsRead);
+               (long long unsigned)((uint64_t)bytesRead / packetSize));
         return -2;
     }
 
@@ -4,6 +4,8 @@
 #include <stdio.h>
 #include <stdint.h>
 
+#define DISKIO_DEFAULT_SECTOR_SIZE 512 // used for card image files
+
 //////////////////////////////////////////////////////////////////////////
 //                      Public Data Types
 //////////////////////////////////////////////////////////////////////////
@@ -21,21 +23,59 @@ typedef struct {
     uint64_t deviceSize;
 } DeviceInfoType;
 
+typedef struct {
+    // where the recording on the card ends, found by REND_iLocate() (see
+    // record_end.h) and kept so it is only searched for once a session
+    uint32_t packetSize;    // 0 until it has been found
+    uint64_t lastPacket;    // last complete packet of the recording
+    uint64_t firstTimestamp;
+    uint64_t lastTimestamp; // unwrapped against the first
+    int olderDataFound;     // packets of an older recording follow it
+    uint64_t numReads;      // reads the search took
+} RecordingEndType;
+
+typedef struct {
+    // one open file descriptor is kept for the life of the session so the
+    // device is opened and queried only once
+    int fd;
+    int writable;
+    char *filename;
+    DeviceInfoType deviceInfo;
+    // optional O_DIRECT descriptor for large reads, -1 when not enabled.
+    // Direct reads need offsets, lengths and buffers aligned to ioAlign
+    int directFd;
+    uint64_t ioAlign;
+    RecordingEndType recordingEnd;
+} DiskSessionType;
+
 //////////////////////////////////////////////////////////////////////////
 //                    Public Function Prototypes
 //////////////////////////////////////////////////////////////////////////
 int DISKIO_iCheckFileAccess(char *filename, FilePermissionType permission);
 
-int DISKIO_iGetDeviceInfo(char *filename, DeviceInfoType *deviceInfoObj);
+int DISKIO_iOpenSession(char *filename, FilePermissionType permission, 
+                        DiskSessionType *session);
+
+int DISKIO_iCloseSession(DiskSessionType *session);
+
+int DISKIO_iEnableDirectIO(DiskSessionType *session);
+
+uint8_t *DISKIO_pu8AllocBuffer(DiskSessionType *session, uint64_t numBytes);
+
+int DISKIO_iGetReadFd(DiskSessionType *session, uint8_t *buff, 
+                      uint64_t offset, uint64_t numBytes);
+
+int DISKIO_iReadBytes(DiskSessionType *session, uint8_t *buff, 
+                      uint64_t offset, uint64_t numBytes);
 
-int DISKIO_iReadDisk(char *filename, uint8_t *buff, uint32_t sector, 
-                     uint32_t numSectors, DeviceInfoType *deviceInfoObj);
+int DISKIO_iReadSectors(DiskSessionType *session, uint8_t *buff, 
+                        uint64_t startSector, uint64_t numSectors);
 
-int DISKIO_iWriteDisk(char *filename, uint8_t *buff, uint32_t sector, 
-                      uint32_t numSectors, DeviceInfoType *deviceInfoObj);
+int DISKIO_iWriteSectors(DiskSessionType *session, uint8_t *buff, 
+                         uint64_t startSector, uint64_t numSectors);
 
-int DISKIO_iReadPacket(FILE *device_fp, uint8_t *buff, uint64_t startPacketIndex, 
-                       uint16_t packetSize, uint64_t numPackets, 
-                       DeviceInfoType *deviceInfoObj);
+int DISKIO_iReadPacket(DiskSessionType *session, uint8_t *buff, 
+                       uint64_t startPacketIndex, uint32_t packetSize, 
+                       uint64_t numPackets);
 
 #endif // DISKIO_LINUX_H
\ No newline at end of file
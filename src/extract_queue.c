@@ -0,0 +1,486 @@
+#define _GNU_SOURCE   // copy_file_range(), splice()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include "extract_queue.h"
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : EXQ_u64SegmentOf()
+// Description : Segment a timestamp falls in, counted from the first
+//               packet on the card
+// Parameters  : const SegmentSetType *set - The segments
+//               uint64_t timestamp - Unwrapped packet timestamp
+// Returns     : uint64_t - the segment number
+//////////////////////////////////////////////////////////////////////////
+uint64_t EXQ_u64SegmentOf(const SegmentSetType *set, uint64_t timestamp) {
+
+    if ( timestamp < set->origin ) {
+        return 0;
+    }
+
+    return (timestamp - set->origin) / set->segmentPackets;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : EXQ_u64SegmentEnd()
+// Description : Binary search for where the segment of packet start ends.
+//               Timestamps only go up, so the packets of a segment are
+//               consecutive
+// Parameters  : const SegmentSetType *set - The segments
+//               const uint8_t *packets - First byte of packet 0
+//               uint32_t psize - Number of bytes per packet
+//               uint64_t start - First packet of the piece
+//               uint64_t end - Packet after the last one to look at
+//               uint64_t startTimestamp - Unwrapped timestamp of packet
+//                                         start, the others are unwrapped
+//                                         against it
+// Returns     : uint64_t - first packet from start in a later segment, or
+//               end
+//////////////////////////////////////////////////////////////////////////
+uint64_t EXQ_u64SegmentEnd(const SegmentSetType *set, const uint8_t *packets,
+                           uint32_t psize, uint64_t start, uint64_t end,
+                           uint64_t startTimestamp) {
+
+    uint64_t segment = EXQ_u64SegmentOf(set, startTimestamp);
+    uint64_t lo = start + 1, hi = end, mid;
+
+    while ( lo < hi ) {
+        mid = lo + (hi - lo)/2;
+        if ( EXQ_u64SegmentOf(set, PSCAN_u64Unwrap(PSCAN_u32ReadTimestamp(packets + mid*psize),
+                                               startTimestamp + (mid - start))) > segment ) {
+            hi = mid;
+        }
+        else {
+            lo = mid + 1;
+        }
+    }
+
+    return lo;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : EXQ_iHandOver()
+// Description : Passes the output buffer being filled to the writer and
+//               takes a written one back to fill next. Waiting for it
+//               is time the output is the limit
+// Parameters  : ExtractContextType *extract - The extraction
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int EXQ_iHandOver(ExtractContextType *extract) {
+
+    double waitStart = PSTAT_dNow();
+
+    extract->current->segment = extract->segment;
+    if ( RING_iPush(&extract->outRing, extract->current, &extract->abortFlag)
+         || RING_iPop(&extract->outFreeRing, (void **)&extract->current,
+                      &extract->abortFlag) ) {
+        return -1;
+    }
+    extract->perf->writeStallSec += PSTAT_dNow() - waitStart;
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : EXQ_iQueueRun()
+// Description : Copies a run of consecutive valid packets into the output
+//               buffer being filled, handing full buffers to the writer.
+//               With a channel selection only the wanted samples are
+//               copied
+// Parameters  : ExtractContextType *extract - The extraction
+//               uint8_t *run - First byte of the first packet in the run
+//               uint64_t runPackets - Number of packets in the run
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int EXQ_iQueueRun(ExtractContextType *extract, uint8_t *run, 
+                  uint64_t runPackets) {
+
+    uint32_t psize = extract->psize;
+    uint32_t outPsize = extract->outPsize;
+    uint64_t fit;
+    OutputBufferType *out;
+
+    while ( runPackets ) {
+        out = extract->current;
+        fit = (extract->outCapacity - out->numBytes) / outPsize;
+        if ( fit > runPackets ) {
+            fit = runPackets;
+        }
+        if ( extract->select ) {
+            SWR_vGather(run, psize, fit, extract->select, out->buff + out->numBytes);
+        }
+        else {
+            memcpy(out->buff + out->numBytes, run, fit*psize);
+        }
+        out->numBytes += fit*outPsize;
+        extract->stats->packetsWritten += fit;
+        run += fit*psize;
+        runPackets -= fit;
+
+        if ( ((extract->outCapacity - out->numBytes) < outPsize)
+             && EXQ_iHandOver(extract) ) {
+            return -1;
+        }
+    }
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : EXQ_iQueueRange()
+// Description : EXQ_iQueueRun() for --zero-copy. A long run of valid packets
+//               is queued as its place on the device, for the writer to
+//               have the kernel copy, short runs between bad packets are
+//               copied into the buffer as usual
+// Parameters  : ExtractContextType *extract - The extraction
+//               uint8_t *run - First byte of the first packet in the run
+//               uint64_t packetIndex - Index of that packet on the disk
+//               uint64_t runPackets - Number of packets in the run
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int EXQ_iQueueRange(ExtractContextType *extract, uint8_t *run,
+                    uint64_t packetIndex, uint64_t runPackets) {
+
+    uint64_t numBytes = runPackets * extract->psize;
+    OutputBufferType *out = extract->current;
+    CopyRangeType *range;
+
+    if ( numBytes < MIN_RANGE_BYTES ) {
+        return EXQ_iQueueRun(extract, run, runPackets);
+    }
+    range = &out->rangeList[out->rangeCt++];
+    range->buffBytes = out->numBytes;
+    range->srcOffset = extract->dataOffset + packetIndex * extract->psize;
+    range->numBytes = numBytes;
+    out->rangeBytes += numBytes;
+    extract->stats->packetsWritten += runPackets;
+
+    if ( ((MAX_RANGES == out->rangeCt) || (out->rangeBytes >= extract->outCapacity))
+         && EXQ_iHandOver(extract) ) {
+        return -1;
+    }
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iQueueFill()
+// Description : Queues placeholders for the packets missing between the
+//               last packet queued and the next one, so the output stays
+//               one packet per timestamp. The placeholders copy the header
+//               of the last packet with FILL_FLAG_VAL in the flag byte and
+//               the missing timestamps. They are stamped out of one
+//               preallocated buffer, or in sparse mode not written at all
+// Parameters  : ExtractContextType *extract - The extraction
+//               uint64_t numMissing - Number of packets to make up
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+static int iQueueFill(ExtractContextType *extract, uint64_t numMissing) {
+
+    uint32_t psize = extract->psize;
+    uint64_t timestamp = extract->lastTimestamp + 1;
+    uint64_t i, n, numBuilt;
+    uint8_t *fillBuff = extract->fillBuff;
+
+    extract->stats->packetsFilled += numMissing;
+    if ( FILL_SPARSE == extract->fillGaps ) {
+        extract->current->holeBytes = numMissing * extract->outPsize;
+        extract->stats->packetsWritten += numMissing;
+        return EXQ_iHandOver(extract);
+    }
+
+    memcpy(fillBuff, extract->lastWritten, psize);
+    if ( FILL_ZERO == extract->fillGaps ) {
+        memset(fillBuff + CFG_HEADER_BYTES, 0, psize - CFG_HEADER_BYTES);
+    }
+    fillBuff[FLAG_BYTE_IND] = FILL_FLAG_VAL;
+    numBuilt = (numMissing < FILL_CHUNK_PACKETS) ? numMissing : FILL_CHUNK_PACKETS;
+    for (n = 1; n < numBuilt; n *= 2) {
+        memcpy(fillBuff + n*psize, fillBuff,
+               ((2*n <= numBuilt) ? n : numBuilt - n) * psize);
+    }
+
+    while ( numMissing ) {
+        n = (numMissing < numBuilt) ? numMissing : numBuilt;
+        for (i = 0; i < n; i++) {
+            PSCAN_vWriteTimestamp(fillBuff + i*psize, (uint32_t)timestamp++);
+        }
+        if ( EXQ_iQueueRun(extract, fillBuff, n) ) {
+            return -1;
+        }
+        numMissing -= n;
+    }
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : EXQ_iQueueTimed()
+// Description : EXQ_iQueueRun() for --fill-gaps and --index. Splits a run of
+//               valid packets where the timestamps jump, queues
+//               placeholders for the packets missing before each piece if
+//               asked to, and adds the pieces and their RF syncs to the
+//               index. Backward jumps and repeated timestamps are passed
+//               through unfilled
+// Parameters  : ExtractContextType *extract - The extraction
+//               uint8_t *packets - First packet of the last scan
+//               uint64_t start - First packet of the run, in the scan
+//               uint64_t runEnd - Packet after the run, in the scan
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int EXQ_iQueueTimed(ExtractContextType *extract, uint8_t *packets,
+                    uint64_t start, uint64_t runEnd) {
+
+    uint32_t psize = extract->psize;
+    const PacketScanType *scan = &extract->scan;
+    PacketIndexType *index = extract->index;
+    uint64_t i, pieceEnd, jumpAt, rfAt, filePacket, timestamp, missing;
+
+    for (i = start; i < runEnd; i = pieceEnd) {
+        // the piece goes up to the next jump inside the run
+        pieceEnd = runEnd;
+        while ( extract->nextJump < scan->jumpCt ) {
+            jumpAt = scan->jumpList[extract->nextJump].packetIndex - scan->firstPacket;
+            if ( jumpAt > i ) {
+                if ( jumpAt < runEnd ) {
+                    pieceEnd = jumpAt;
+                }
+                break;
+            }
+            ++extract->nextJump;
+        }
+
+        // the check is against the last packet written, not the one
+        // before, so bad packets that were left out are filled as well
+        timestamp = PSCAN_u64TimeAt(scan, PSCAN_u32ReadTimestamp(packets + i*psize),
+                                    scan->firstPacket + i);
+        if ( extract->fillGaps && extract->haveWritten ) {
+            missing = timestamp - extract->lastTimestamp - 1;
+            filePacket = extract->stats->packetsWritten;
+            if ( timestamp <= extract->lastTimestamp + 1 ) {
+                // next in order, or not forward: nothing to fill
+            }
+            else if ( missing > (uint64_t)MAX_FILL_MIN*SEC_PER_MIN*SAMPLING_RATE ) {
+                fprintf(stderr, "Not filling %llu missing packets before packet"
+                        " %llu, the timestamp looks corrupt\n",
+                        (long long unsigned)missing,
+                        (long long unsigned)(scan->firstPacket + i));
+            }
+            else if ( iQueueFill(extract, missing)
+                      || (index && PIDX_iAddRun(index, filePacket,
+                                                extract->lastTimestamp + 1, missing)) ) {
+                return -1;
+            }
+        }
+
+        filePacket = extract->stats->packetsWritten;
+        if ( index ) {
+            if ( PIDX_iAddRun(index, filePacket, timestamp, pieceEnd - i) ) {
+                return -1;
+            }
+            while ( extract->nextRfSync < scan->rfSyncCt ) {
+                rfAt = scan->rfSyncList[extract->nextRfSync] - scan->firstPacket;
+                if ( rfAt >= pieceEnd ) {
+                    break;
+                }
+                if ( PIDX_iAddRfSync(index, filePacket + (rfAt - i)) ) {
+                    return -1;
+                }
+                ++extract->nextRfSync;
+            }
+        }
+        if ( EXQ_iQueueRun(extract, packets + i*psize, pieceEnd - i) ) {
+            return -1;
+        }
+        memcpy(extract->lastWritten, packets + (pieceEnd - 1)*psize, psize);
+        extract->lastTimestamp = PSCAN_u64TimeAt(scan,
+                                     PSCAN_u32ReadTimestamp(extract->lastWritten),
+                                     scan->firstPacket + pieceEnd - 1);
+        extract->haveWritten = 1;
+    }
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : EXQ_iQueueSegmented()
+// Description : EXQ_iQueueRun() for --segment-minutes. Splits a run of valid
+//               packets where it crosses into a later segment, and hands
+//               the buffer being filled to the writer before the first
+//               packet of each new segment, so no buffer mixes segments
+// Parameters  : ExtractContextType *extract - The extraction
+//               uint8_t *packets - First packet of the last scan
+//               uint64_t start - First packet of the run, in the scan
+//               uint64_t runEnd - Packet after the run, in the scan
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int EXQ_iQueueSegmented(ExtractContextType *extract, uint8_t *packets,
+                        uint64_t start, uint64_t runEnd) {
+
+    uint32_t psize = extract->psize;
+    const PacketScanType *scan = &extract->scan;
+    uint64_t i, pieceEnd, segment, timestamp;
+
+    for (i = start; i < runEnd; i = pieceEnd) {
+        timestamp = PSCAN_u64TimeAt(scan, PSCAN_u32ReadTimestamp(packets + i*psize),
+                                    scan->firstPacket + i);
+        segment = EXQ_u64SegmentOf(extract->segments, timestamp);
+        pieceEnd = EXQ_u64SegmentEnd(extract->segments, packets, psize, i, runEnd,
+                                 timestamp);
+        // a timestamp going back stays in the segment being written
+        if ( segment > extract->segment ) {
+            if ( extract->current->numBytes && EXQ_iHandOver(extract) ) {
+                return -1;
+            }
+            extract->segment = segment;
+        }
+        // the writer needs it for buffers that start a segment
+        if ( 0 == extract->current->numBytes ) {
+            extract->current->firstTimestamp = timestamp;
+        }
+        if ( EXQ_iQueueRun(extract, packets + i*psize, pieceEnd - i) ) {
+            return -1;
+        }
+    }
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iCopyRange()
+// Description : Appends bytes of the device to the output inside the
+//               kernel. copy_file_range() is tried first (card images on
+//               the same filesystem may not even copy), then splice()
+//               through a pipe, which block devices support, and if
+//               neither works pread() and write()
+// Parameters  : ExtractContextType *extract - The extraction
+//               uint64_t srcOffset - Offset on the device
+//               uint64_t numBytes - Number of bytes
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+static int iCopyRange(ExtractContextType *extract, uint64_t srcOffset,
+                      uint64_t numBytes) {
+
+    int outFd = fileno(extract->fpOutput);
+    loff_t offset;
+    ssize_t res, moved;
+    uint64_t n;
+
+    while ( numBytes ) {
+        offset = (loff_t)srcOffset;
+        if ( COPY_RANGE == extract->copyMethod ) {
+            res = copy_file_range(extract->srcFd, &offset, outFd, NULL, numBytes, 0);
+            if ( (res < 0) && ((EINVAL == errno) || (EXDEV == errno)
+                               || (EOPNOTSUPP == errno) || (ENOSYS == errno)) ) {
+                extract->copyMethod = COPY_SPLICE;
+                continue;
+            }
+        }
+        else if ( COPY_SPLICE == extract->copyMethod ) {
+            if ( extract->pipeFd[0] < 0 ) {
+                if ( pipe(extract->pipeFd) ) {
+                    extract->copyMethod = COPY_BUFFERED;
+                    continue;
+                }
+                // a larger pipe means fewer calls, the default is kept if
+                // the system limit is lower
+                fcntl(extract->pipeFd[1], F_SETPIPE_SZ, SPLICE_PIPE_BYTES);
+            }
+            n = (numBytes < SPLICE_PIPE_BYTES) ? numBytes : SPLICE_PIPE_BYTES;
+            res = splice(extract->srcFd, &offset, extract->pipeFd[1], NULL, n,
+                         SPLICE_F_MOVE);
+            if ( (res < 0) && ((EINVAL == errno) || (ENOSYS == errno)) ) {
+                extract->copyMethod = COPY_BUFFERED;
+                continue;
+            }
+            // empty the pipe into the output before the next piece
+            for (moved = 0; (res > 0) && (moved < res); moved += n) {
+                n = splice(extract->pipeFd[0], NULL, outFd, NULL, res - moved,
+                           SPLICE_F_MOVE);
+                if ( (ssize_t)n <= 0 ) {
+                    res = -1;
+                    break;
+                }
+            }
+        }
+        else {
+            if ( (NULL == extract->bounce)
+                 && (NULL == (extract->bounce = malloc(extract->outCapacity))) ) {
+                return -1;
+            }
+            n = (numBytes < extract->outCapacity) ? numBytes : extract->outCapacity;
+            res = pread(extract->srcFd, extract->bounce, n, (off_t)srcOffset);
+            if ( (res > 0) && (write(outFd, extract->bounce, res) != res) ) {
+                res = -1;
+            }
+        }
+        if ( res < 0 ) {
+            if ( EINTR == errno ) {
+                continue;
+            }
+            fprintf(stderr, "Error %d copying %llu bytes from device offset %llu:"
+                    " %s\n", errno, (long long unsigned)numBytes,
+                    (long long unsigned)srcOffset, strerror(errno));
+            return -1;
+        }
+        if ( 0 == res ) {
+            fprintf(stderr, "Error: device ends at offset %llu\n",
+                    (long long unsigned)srcOffset);
+            return -2;
+        }
+        srcOffset += (uint64_t)res;
+        numBytes -= (uint64_t)res;
+        extract->bytesCopied += (uint64_t)res;
+    }
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : EXQ_iWriteRanges()
+// Description : Writes an output buffer that has device ranges queued in
+//               it, in order: buffered bytes with fwrite, ranges with
+//               iCopyRange()
+// Parameters  : ExtractContextType *extract - The extraction
+//               OutputBufferType *out - Buffer to write
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int EXQ_iWriteRanges(ExtractContextType *extract, OutputBufferType *out) {
+
+    uint64_t k, done = 0, n;
+    CopyRangeType *range;
+
+    for (k = 0; k <= out->rangeCt; k++) {
+        range = (k < out->rangeCt) ? &out->rangeList[k] : NULL;
+        n = (range ? range->buffBytes : out->numBytes) - done;
+        if ( n && (fwrite(out->buff + done, 1, n, extract->fpOutput) != n) ) {
+            fprintf(stderr, "Error writing %llu bytes\n", (long long unsigned)n);
+            return -1;
+        }
+        done += n;
+        if ( range ) {
+            // the kernel writes at the descriptor's offset, so nothing may
+            // be left in the stdio buffer
+            if ( fflush(extract->fpOutput)
+                 || iCopyRange(extract, range->srcOffset, range->numBytes) ) {
+                return -2;
+            }
+        }
+    }
+
+    return 0;
+
+}
@@ -0,0 +1,193 @@
+#ifndef EXTRACT_QUEUE_H
+#define EXTRACT_QUEUE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "block_reader.h"
+#include "spsc_ring.h"
+#include "packet_scan.h"
+#include "card_config.h"
+#include "sample_writer.h"
+#include "packet_index.h"
+#include "container.h"
+#include "perf_stats.h"
+#include "card_constants.h"
+
+// The output side of sd_card_extract's pipeline. The validator queues runs
+// of valid packets into output buffers, split by segment, with placeholders
+// for dropped packets or as ranges of the device left for the kernel to
+// copy, and the writer writes them out
+
+#define NUM_OUTPUT_BUFFERS 4  // buffers between validation and writer
+#define FILL_CHUNK_PACKETS 4096 // placeholder packets built at a time
+#define MAX_FILL_MIN 10       // longer timestamp jumps are taken as corrupt
+#define MIN_RANGE_BYTES 65536 // shorter runs are copied through user space
+#define MAX_RANGES 256        // device ranges queued per output buffer
+#define SPLICE_PIPE_BYTES (1024*1024)
+
+//////////////////////////////////////////////////////////////////////////
+//                      Public Data Types
+//////////////////////////////////////////////////////////////////////////
+typedef enum {
+    FILL_NONE,
+    FILL_ZERO,         // placeholder packets with zero samples
+    FILL_LAST,         // placeholder packets repeating the last samples
+    FILL_SPARSE        // holes seeked over, they read back as zero bytes
+} FillModeType;
+
+typedef enum {
+    COPY_RANGE,        // copy_file_range(), in the kernel
+    COPY_SPLICE,       // splice() through a pipe
+    COPY_BUFFERED      // pread() and write(), if neither works
+} CopyMethodType;
+
+typedef enum {
+    QUEUE_PACKETS,     // whole runs copied into the output buffer
+    QUEUE_RANGES,      // --zero-copy, long runs left on the device
+    QUEUE_SEGMENTED,   // --segment-minutes, split where segments change
+    QUEUE_TIMED        // --fill-gaps and --index, split at timestamp jumps
+} QueueModeType;
+
+typedef struct {
+    uint64_t bytesRead;
+    uint64_t bytesCopied;   // moved from the device by the kernel, --zero-copy
+    uint64_t packetsWritten;
+    uint64_t packetsFilled; // placeholders for dropped packets, in packetsWritten
+    uint64_t badPackets;
+    uint64_t rfSyncCt;
+    double elapsedSec;
+    double readWaitSec;  // reader thread time spent waiting on the device
+    double writeSec;     // writer thread time spent in fwrite
+} ExtractStatsType;
+
+typedef struct {
+    // what the integrity report lists, collected in packet order
+    GapListType gaps;
+    uint64_t *badList;
+    uint64_t badCt;
+    uint64_t badCapacity;
+    uint64_t *rfSyncList;
+    uint64_t rfSyncCt;
+    uint64_t rfSyncCapacity;
+} IntegrityLogType;
+
+typedef struct {
+    char fname[MAX_FNAME_LENGTH + 16];
+    uint64_t segment;        // (timestamp - origin) / segmentPackets
+    int fd;                  // -1 once finished
+    uint64_t numPackets;
+    uint64_t firstTimestamp; // unwrapped
+    uint64_t lastTimestamp;
+    uint64_t lastRound;      // --threads: last round that writes to it
+} SegmentType;
+
+typedef struct {
+    // --segment-minutes output, one file per stretch of timestamps
+    const char *path;        // output path given by the user
+    uint64_t origin;         // unwrapped time of the first packet on the card
+    uint64_t segmentPackets; // timestamps per segment
+    FILE *fpManifest;
+    SegmentType *segmentList;
+    uint64_t segmentCt;
+    uint64_t segmentCapacity;
+} SegmentSetType;
+
+typedef struct {
+    uint64_t buffBytes;      // bytes of buff written before the range
+    uint64_t srcOffset;      // on the device
+    uint64_t numBytes;
+} CopyRangeType;
+
+typedef struct {
+    uint8_t *buff;
+    uint64_t numBytes;
+    uint64_t holeBytes;  // left unwritten after buff, for sparse gap fill
+    uint64_t chunkEnds;  // container chunks that end with buff
+    uint64_t segment;    // of the packets in buff, with --segment-minutes
+    uint64_t firstTimestamp; // unwrapped, set when buff starts a segment
+    CopyRangeType *rangeList; // --zero-copy runs left on the device
+    uint64_t rangeCt;
+    uint64_t rangeBytes;
+} OutputBufferType;
+
+typedef struct {
+    // shared by the three pipeline stages
+    int abortFlag;
+    uint32_t psize;
+    uint32_t outPsize;           // bytes per packet once channels are cut
+    const ChannelSelectType *select; // NULL keeps every channel
+    uint32_t queueDepth;
+    QueueModeType queueMode;     // how runs of valid packets are queued
+    PerfStatsType *perf;
+    BlockReaderType *reader;
+    SpscRingType blockRing;      // read blocks, reader -> validator
+    SpscRingType blockFreeRing;  // checked blocks, validator -> reader
+    SpscRingType outRing;        // valid packets, validator -> writer
+    SpscRingType outFreeRing;    // written buffers, writer -> validator
+    OutputBufferType outBuffers[NUM_OUTPUT_BUFFERS];
+    uint64_t outCapacity;
+    // reader stage
+    int readerRes;
+    double readWaitSec;
+    // validation stage
+    PacketScanType scan;
+    OutputBufferType *current;
+    uint64_t firstPacket;
+    uint64_t lastPacket;
+    double nextProgressSec;
+    double startSec;
+    ExtractStatsType *stats;
+    IntegrityLogType *integrity; // NULL if no report was asked for
+    FillModeType fillGaps;
+    uint8_t *fillBuff;           // FILL_CHUNK_PACKETS placeholder packets
+    uint8_t *lastWritten;        // copy of the last packet queued
+    int haveWritten;
+    uint64_t lastTimestamp;      // of lastWritten, unwrapped
+    uint64_t nextJump;           // first jump of the scan not yet passed
+    PacketIndexType *index;      // NULL if no index was asked for
+    uint64_t nextRfSync;         // first RF sync of the scan not yet indexed
+    uint64_t chunkPackets;       // card packets per container chunk
+    uint64_t nextChunkEnd;       // first card packet of the next chunk
+    SegmentSetType *segments;    // NULL unless --segment-minutes
+    uint64_t segment;            // of the packets being queued
+    uint64_t dataOffset;         // device offset of packet 0
+    // writer stage
+    FILE *fpOutput;
+    SampleWriterType *samples;   // channel-major output, NULL for packets
+    ContainerWriterType *container; // chunked output, NULL otherwise
+    int haveSegment;             // segmentList[segmentCt - 1] is written to
+    int srcFd;                   // device, for --zero-copy
+    CopyMethodType copyMethod;
+    int pipeFd[2];               // for COPY_SPLICE
+    uint8_t *bounce;             // for COPY_BUFFERED
+    uint64_t bytesCopied;
+    int writerRes;
+    double writeSec;
+} ExtractContextType;
+
+//////////////////////////////////////////////////////////////////////////
+//                    Public Function Prototypes
+//////////////////////////////////////////////////////////////////////////
+uint64_t EXQ_u64SegmentOf(const SegmentSetType *set, uint64_t timestamp);
+
+uint64_t EXQ_u64SegmentEnd(const SegmentSetType *set, const uint8_t *packets,
+                           uint32_t psize, uint64_t start, uint64_t end,
+                           uint64_t startTimestamp);
+
+int EXQ_iHandOver(ExtractContextType *extract);
+
+int EXQ_iQueueRun(ExtractContextType *extract, uint8_t *run, 
+                  uint64_t runPackets);
+
+int EXQ_iQueueRange(ExtractContextType *extract, uint8_t *run,
+                    uint64_t packetIndex, uint64_t runPackets);
+
+int EXQ_iQueueTimed(ExtractContextType *extract, uint8_t *packets,
+                    uint64_t start, uint64_t runEnd);
+
+int EXQ_iQueueSegmented(ExtractContextType *extract, uint8_t *packets,
+                        uint64_t start, uint64_t runEnd);
+
+int EXQ_iWriteRanges(ExtractContextType *extract, OutputBufferType *out);
+
+#endif // EXTRACT_QUEUE_H
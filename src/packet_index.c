@@ -0,0 +1,360 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "packet_scan.h"
+#include "packet_index.h"
+
+typedef struct {
+    uint64_t firstPacket;
+    uint32_t firstTimestamp;
+    uint32_t numPackets;
+} IndexRunV1Type;
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : PIDX_vInit()
+// Description : Starts an empty index for an extraction
+// Parameters  : PacketIndexType *index - The index
+//               uint32_t psize - Number of bytes per extracted packet
+//               const ChannelMapType *map - Channels in each packet
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+void PIDX_vInit(PacketIndexType *index, uint32_t psize, const ChannelMapType *map) {
+
+    memset(index, 0, sizeof(*index));
+    index->psize = psize;
+    index->map = *map;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : PIDX_vFree()
+// Description : Releases the lists held by an index
+// Parameters  : PacketIndexType *index - The index
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+void PIDX_vFree(PacketIndexType *index) {
+
+    free(index->runList);
+    free(index->rfSyncList);
+    memset(index, 0, sizeof(*index));
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : PIDX_iAddRun()
+// Description : Records that packets were appended to the file. They
+//               extend the last run if they carry on its timestamps, so
+//               the extractor can add packets in any size of piece
+// Parameters  : PacketIndexType *index - The index
+//               uint64_t firstPacket - File index of the first packet,
+//                                      the end of the file so far
+//               uint64_t firstTimestamp - Its unwrapped timestamp
+//               uint64_t numPackets - Packets with consecutive timestamps
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int PIDX_iAddRun(PacketIndexType *index, uint64_t firstPacket,
+                 uint64_t firstTimestamp, uint64_t numPackets) {
+
+    IndexRunType *run;
+
+    if ( 0 == numPackets ) {
+        return 0;
+    }
+    run = index->runCt ? &index->runList[index->runCt - 1] : NULL;
+    if ( (NULL == run)
+         || (run->firstPacket + run->numPackets != firstPacket)
+         || (run->firstTimestamp + run->numPackets != firstTimestamp) ) {
+        if ( PSCAN_iGrowList((void **)&index->runList, &index->runCapacity,
+                             index->runCt, sizeof(IndexRunType)) ) {
+            return -1;
+        }
+        run = &index->runList[index->runCt++];
+        run->firstPacket = firstPacket;
+        run->firstTimestamp = firstTimestamp;
+        run->numPackets = 0;
+    }
+    run->numPackets += numPackets;
+    index->numPackets = firstPacket + numPackets;
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : PIDX_iAddRfSync()
+// Description : Records a packet with the RF sync flag
+// Parameters  : PacketIndexType *index - The index
+//               uint64_t packet - File index of the packet
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int PIDX_iAddRfSync(PacketIndexType *index, uint64_t packet) {
+
+    if ( PSCAN_iGrowList((void **)&index->rfSyncList, &index->rfSyncCapacity,
+                         index->rfSyncCt, sizeof(uint64_t)) ) {
+        return -1;
+    }
+    index->rfSyncList[index->rfSyncCt++] = packet;
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : PIDX_iWrite()
+// Description : Writes the index file
+// Parameters  : const PacketIndexType *index - The index
+//               const char *path - File to write
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int PIDX_iWrite(const PacketIndexType *index, const char *path) {
+
+    FILE *fp;
+    IndexFileHeaderType header;
+    int res = 0;
+
+    fp = fopen(path, "w");
+    if ( NULL == fp ) {
+        fprintf(stderr, "Error opening index file %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PIDX_MAGIC, sizeof(header.magic));
+    header.psize = index->psize;
+    header.numChannels = index->map.numChannels;
+    header.numPackets = index->numPackets;
+    header.numRuns = index->runCt;
+    header.numRfSyncs = index->rfSyncCt;
+    if ( (1 != fwrite(&header, sizeof(header), 1, fp))
+         || (index->map.numChannels != fwrite(index->map.channelId, sizeof(uint16_t),
+                                              index->map.numChannels, fp))
+         || (index->runCt != fwrite(index->runList, sizeof(IndexRunType),
+                                    index->runCt, fp))
+         || (index->rfSyncCt != fwrite(index->rfSyncList, sizeof(uint64_t),
+                                       index->rfSyncCt, fp)) ) {
+        fprintf(stderr, "Error writing index file %s\n", path);
+        res = -2;
+    }
+    if ( fclose(fp) ) {
+        fprintf(stderr, "Error closing index file %s\n", path);
+        res = -3;
+    }
+
+    return res;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iReadRunsV1()
+// Description : Reads the runs of an SDINDEX1 file, whose timestamps are
+//               the recorder's 32 bit ones, unwrapping each against where
+//               the run before it ends
+// Parameters  : FILE *fp - The index file, at the runs
+//               IndexRunType *runList - numRuns runs, filled in on return
+//               uint64_t numRuns - Number of runs
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+static int iReadRunsV1(FILE *fp, IndexRunType *runList, uint64_t numRuns) {
+
+    IndexRunV1Type old;
+    uint64_t i, expected = 0;
+
+    for (i = 0; i < numRuns; i++) {
+        if ( 1 != fread(&old, sizeof(old), 1, fp) ) {
+            return -1;
+        }
+        runList[i].firstPacket = old.firstPacket;
+        runList[i].firstTimestamp = i ? PSCAN_u64Unwrap(old.firstTimestamp, expected)
+                                      : old.firstTimestamp;
+        runList[i].numPackets = old.numPackets;
+        expected = runList[i].firstTimestamp + runList[i].numPackets;
+    }
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : PIDX_iRead()
+// Description : Loads an index file written by PIDX_iWrite(), or by an
+//               older version with 32 bit timestamps
+// Parameters  : PacketIndexType *index - Filled in on return, free with
+//                                        PIDX_vFree()
+//               const char *path - File to read
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int PIDX_iRead(PacketIndexType *index, const char *path) {
+
+    FILE *fp;
+    IndexFileHeaderType header;
+    int res = 0, isV1;
+
+    memset(index, 0, sizeof(*index));
+    fp = fopen(path, "r");
+    if ( NULL == fp ) {
+        fprintf(stderr, "Error opening index file %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    if ( (1 != fread(&header, sizeof(header), 1, fp))
+         || (memcmp(header.magic, PIDX_MAGIC, sizeof(header.magic))
+             && memcmp(header.magic, PIDX_MAGIC_V1, sizeof(header.magic)))
+         || (0 == header.psize)
+         || (header.numChannels > CFG_MAX_CHANNELS) ) {
+        fprintf(stderr, "%s isn't an index file\n", path);
+        fclose(fp);
+        return -2;
+    }
+    isV1 = !memcmp(header.magic, PIDX_MAGIC_V1, sizeof(header.magic));
+    index->psize = header.psize;
+    index->numPackets = header.numPackets;
+    index->map.numChannels = header.numChannels;
+    index->runList = malloc((header.numRuns ? header.numRuns : 1) * sizeof(IndexRunType));
+    index->rfSyncList = malloc((header.numRfSyncs ? header.numRfSyncs : 1) * sizeof(uint64_t));
+    if ( (NULL == index->runList) || (NULL == index->rfSyncList) ) {
+        res = -3;
+    }
+    else if ( (header.numChannels != fread(index->map.channelId, sizeof(uint16_t),
+                                           header.numChannels, fp))
+              || (isV1 ? iReadRunsV1(fp, index->runList, header.numRuns)
+                       : (header.numRuns != fread(index->runList, sizeof(IndexRunType),
+                                                  header.numRuns, fp)))
+              || (header.numRfSyncs != fread(index->rfSyncList, sizeof(uint64_t),
+                                             header.numRfSyncs, fp)) ) {
+        fprintf(stderr, "Index file %s is cut short\n", path);
+        res = -4;
+    }
+    fclose(fp);
+    if ( res ) {
+        PIDX_vFree(index);
+        return res;
+    }
+    index->runCt = index->runCapacity = header.numRuns;
+    index->rfSyncCt = index->rfSyncCapacity = header.numRfSyncs;
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : PIDX_iFindTimestamp()
+// Description : Finds the packet of a timestamp by binary search over the
+//               runs, so the cost grows with log of the number of gaps.
+//               Timestamps are taken to go up through the file, which
+//               the unwrapping keeps true past the 32 bit counter's wrap
+// Parameters  : const PacketIndexType *index - The index
+//               uint64_t timestamp - Unwrapped timestamp to look for
+//               uint64_t *packet - File index of the packet with the
+//                                  timestamp, or if it is missing the
+//                                  first packet after it (numPackets if
+//                                  there is none)
+// Returns     : int - 0 if the timestamp is in the file, 1 if it isn't
+//////////////////////////////////////////////////////////////////////////
+int PIDX_iFindTimestamp(const PacketIndexType *index, uint64_t timestamp,
+                        uint64_t *packet) {
+
+    uint64_t lo = 0, hi = index->runCt, mid;
+    const IndexRunType *run;
+
+    // first run starting after the timestamp
+    while ( lo < hi ) {
+        mid = lo + (hi - lo)/2;
+        if ( index->runList[mid].firstTimestamp <= timestamp ) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    if ( lo ) {
+        run = &index->runList[lo - 1];
+        if ( timestamp - run->firstTimestamp < run->numPackets ) {
+            *packet = run->firstPacket + (timestamp - run->firstTimestamp);
+            return 0;
+        }
+    }
+    *packet = (lo < index->runCt) ? index->runList[lo].firstPacket : index->numPackets;
+
+    return 1;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : PIDX_iMapWindow()
+// Description : Maps the packets with timestamps from startTimestamp up to,
+//               not including, endTimestamp out of a packets file. Only
+//               the pages holding the window are mapped and they are
+//               read on first touch, so the cost doesn't depend on where
+//               in the recording the window is
+// Parameters  : const PacketIndexType *index - Index of the file
+//               const char *dataPath - The extracted packets file
+//               uint64_t startTimestamp - Start of the window
+//               uint64_t endTimestamp - End of the window
+//               IndexWindowType *window - Filled in on return, release
+//                                         with PIDX_vUnmapWindow()
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int PIDX_iMapWindow(const PacketIndexType *index, const char *dataPath,
+                    uint64_t startTimestamp, uint64_t endTimestamp,
+                    IndexWindowType *window) {
+
+    int fd;
+    uint64_t first, end, mapStart, pageSize;
+    struct stat fileStat;
+    void *base;
+
+    memset(window, 0, sizeof(*window));
+    PIDX_iFindTimestamp(index, startTimestamp, &first);
+    PIDX_iFindTimestamp(index, endTimestamp, &end);
+    window->firstPacket = first;
+    if ( end <= first ) {
+        return 0;
+    }
+
+    fd = open(dataPath, O_RDONLY);
+    if ( fd < 0 ) {
+        fprintf(stderr, "Error opening %s: %s\n", dataPath, strerror(errno));
+        return -1;
+    }
+    if ( fstat(fd, &fileStat)
+         || ((uint64_t)fileStat.st_size < end * index->psize) ) {
+        fprintf(stderr, "%s is shorter than its index\n", dataPath);
+        close(fd);
+        return -2;
+    }
+    pageSize = (uint64_t)sysconf(_SC_PAGESIZE);
+    mapStart = first * index->psize / pageSize * pageSize;
+    window->mapBytes = end * index->psize - mapStart;
+    base = mmap(NULL, window->mapBytes, PROT_READ, MAP_SHARED, fd, (off_t)mapStart);
+    close(fd);
+    if ( MAP_FAILED == base ) {
+        fprintf(stderr, "Error mapping %s: %s\n", dataPath, strerror(errno));
+        window->mapBytes = 0;
+        return -3;
+    }
+    window->mapBase = base;
+    window->packets = (const uint8_t *)base + (first * index->psize - mapStart);
+    window->numPackets = end - first;
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : PIDX_vUnmapWindow()
+// Description : Releases a window mapped by PIDX_iMapWindow()
+// Parameters  : IndexWindowType *window - The window
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+void PIDX_vUnmapWindow(IndexWindowType *window) {
+
+    if ( window->mapBase ) {
+        munmap(window->mapBase, window->mapBytes);
+    }
+    memset(window, 0, sizeof(*window));
+
+}
@@ -0,0 +1,84 @@
+#ifndef PACKET_INDEX_H
+#define PACKET_INDEX_H
+
+#include <stdint.h>
+#include "card_config.h"
+
+#define PIDX_MAGIC "SDINDEX2"
+#define PIDX_MAGIC_V1 "SDINDEX1" // 32 bit timestamps, still read
+
+// Sidecar index of an extracted file, written as OUTPUT.idx. It holds an
+// IndexFileHeaderType, numChannels uint16 channel ids (the map from
+// sector 0, after any channel selection), numRuns IndexRunType and
+// numRfSyncs uint64 packet indices. A run is a stretch of the file whose
+// timestamps go up by one per packet, so a new run starts after every
+// gap. Packet indices count packets of the extracted file, not of the
+// card, and timestamps are unwrapped to 64 bits (see packet_scan.h) so
+// they keep going up past the 32 bit counter's wrap. All values are
+// little endian.
+
+//////////////////////////////////////////////////////////////////////////
+//                      Public Data Types
+//////////////////////////////////////////////////////////////////////////
+typedef struct {
+    char magic[8];
+    uint32_t psize;         // bytes per packet of the extracted file
+    uint32_t numChannels;
+    uint64_t numPackets;
+    uint64_t numRuns;
+    uint64_t numRfSyncs;
+} IndexFileHeaderType;
+
+typedef struct {
+    uint64_t firstPacket;
+    uint64_t firstTimestamp;
+    uint64_t numPackets;
+} IndexRunType;
+
+typedef struct {
+    uint32_t psize;
+    uint64_t numPackets;
+    ChannelMapType map;
+    IndexRunType *runList;  // in file order
+    uint64_t runCt;
+    uint64_t runCapacity;
+    uint64_t *rfSyncList;
+    uint64_t rfSyncCt;
+    uint64_t rfSyncCapacity;
+} PacketIndexType;
+
+typedef struct {
+    // packets of a time window, mapped from the extracted file
+    const uint8_t *packets;
+    uint64_t numPackets;
+    uint64_t firstPacket;   // index in the file of the first packet
+    void *mapBase;
+    uint64_t mapBytes;
+} IndexWindowType;
+
+//////////////////////////////////////////////////////////////////////////
+//                    Public Function Prototypes
+//////////////////////////////////////////////////////////////////////////
+void PIDX_vInit(PacketIndexType *index, uint32_t psize, const ChannelMapType *map);
+
+void PIDX_vFree(PacketIndexType *index);
+
+int PIDX_iAddRun(PacketIndexType *index, uint64_t firstPacket,
+                 uint64_t firstTimestamp, uint64_t numPackets);
+
+int PIDX_iAddRfSync(PacketIndexType *index, uint64_t packet);
+
+int PIDX_iWrite(const PacketIndexType *index, const char *path);
+
+int PIDX_iRead(PacketIndexType *index, const char *path);
+
+int PIDX_iFindTimestamp(const PacketIndexType *index, uint64_t timestamp,
+                        uint64_t *packet);
+
+int PIDX_iMapWindow(const PacketIndexType *index, const char *dataPath,
+                    uint64_t startTimestamp, uint64_t endTimestamp,
+                    IndexWindowType *window);
+
+void PIDX_vUnmapWindow(IndexWindowType *window);
+
+#endif // PACKET_INDEX_H
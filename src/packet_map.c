@@ -0,0 +1,298 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "packet_scan.h"
+#include "sample_writer.h"
+#include "packet_map.h"
+
+#define MAX_PATH_LENGTH 1024
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : u64FirstFrom()
+// Description : Binary search of the mapped headers for the first packet
+//               at or after a timestamp, used when there is no index.
+//               Touches one page per step. Each timestamp is unwrapped
+//               against where its packet is in the file
+// Parameters  : const PacketMapType *rec - The open file
+//               uint64_t timestamp - Unwrapped timestamp to look for
+// Returns     : uint64_t - index of the packet, numPackets if there is none
+//////////////////////////////////////////////////////////////////////////
+static uint64_t u64FirstFrom(const PacketMapType *rec, uint64_t timestamp) {
+
+    uint64_t lo = 0, hi = rec->numPackets, mid;
+
+    while ( lo < hi ) {
+        mid = lo + (hi - lo)/2;
+        if ( PSCAN_u64Unwrap(PSCAN_u32ReadTimestamp(rec->base + mid*rec->psize),
+                             rec->firstTimestamp + mid) < timestamp ) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : PMAP_iOpen()
+// Description : Maps an extracted packets file for querying. PATH.idx is
+//               used when it is there, for the channel ids and to find
+//               timestamps, otherwise timestamps are found by binary
+//               search of the packet headers
+// Parameters  : PacketMapType *rec - Filled in on return
+//               const char *path - The packets file
+//               uint32_t numChannels - Channels per packet, or 0 to take
+//                                      it from PATH.idx
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int PMAP_iOpen(PacketMapType *rec, const char *path, uint32_t numChannels) {
+
+    char indexPath[MAX_PATH_LENGTH];
+    struct stat fileStat;
+    uint32_t i;
+    void *base;
+    int fd;
+
+    memset(rec, 0, sizeof(*rec));
+    snprintf(indexPath, sizeof(indexPath), "%s.idx", path);
+    if ( 0 == access(indexPath, R_OK) ) {
+        if ( PIDX_iRead(&rec->index, indexPath) ) {
+            return -1;
+        }
+        rec->haveIndex = 1;
+        rec->psize = rec->index.psize;
+        rec->map = rec->index.map;
+        if ( numChannels && (CFG_HEADER_BYTES + CFG_SAMPLE_BYTES*numChannels != rec->psize) ) {
+            fprintf(stderr, "%s says the packets have %u channels\n", indexPath,
+                    (unsigned)rec->map.numChannels);
+            PMAP_vClose(rec);
+            return -2;
+        }
+    }
+    else {
+        if ( (0 == numChannels) || (CFG_MAX_CHANNELS < numChannels) ) {
+            fprintf(stderr, "%s has no index, the number of channels is needed\n",
+                    path);
+            return -2;
+        }
+        rec->psize = CFG_HEADER_BYTES + CFG_SAMPLE_BYTES*numChannels;
+        rec->map.numChannels = numChannels;
+        for (i = 0; i < numChannels; i++) {
+            rec->map.channelId[i] = (uint16_t)i;
+        }
+    }
+
+    fd = open(path, O_RDONLY);
+    if ( (fd < 0) || fstat(fd, &fileStat) ) {
+        fprintf(stderr, "Error opening %s: %s\n", path, strerror(errno));
+        if ( fd >= 0 ) {
+            close(fd);
+        }
+        PMAP_vClose(rec);
+        return -3;
+    }
+    rec->fileBytes = (uint64_t)fileStat.st_size;
+    rec->numPackets = rec->fileBytes / rec->psize;
+    if ( (0 == rec->numPackets)
+         || (rec->haveIndex && (rec->index.numPackets != rec->numPackets)) ) {
+        fprintf(stderr, "%s doesn't hold the packets its index lists\n", path);
+        close(fd);
+        PMAP_vClose(rec);
+        return -4;
+    }
+    base = mmap(NULL, rec->fileBytes, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if ( MAP_FAILED == base ) {
+        fprintf(stderr, "Error mapping %s: %s\n", path, strerror(errno));
+        PMAP_vClose(rec);
+        return -5;
+    }
+    rec->base = (const uint8_t *)base;
+    rec->firstTimestamp = (rec->haveIndex && rec->index.runCt)
+                          ? rec->index.runList[0].firstTimestamp
+                          : PSCAN_u32ReadTimestamp(rec->base);
+    // queries jump around, readahead is asked for per window instead
+    madvise(base, rec->fileBytes, MADV_RANDOM);
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : PMAP_vClose()
+// Description : Unmaps the file and frees the index
+// Parameters  : PacketMapType *rec - The open file
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+void PMAP_vClose(PacketMapType *rec) {
+
+    if ( rec->base ) {
+        munmap((void *)rec->base, rec->fileBytes);
+    }
+    if ( rec->haveIndex ) {
+        PIDX_vFree(&rec->index);
+    }
+    memset(rec, 0, sizeof(*rec));
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : PMAP_vFindWindow()
+// Description : Finds the packets with timestamps from startTimestamp up
+//               to, not including, endTimestamp
+// Parameters  : const PacketMapType *rec - The open file
+//               uint64_t startTimestamp - Start of the window
+//               uint64_t endTimestamp - End of the window
+//               uint64_t *firstPacket - First packet of the window
+//               uint64_t *numPackets - Packets in the window, 0 if none
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+void PMAP_vFindWindow(const PacketMapType *rec, uint64_t startTimestamp,
+                      uint64_t endTimestamp, uint64_t *firstPacket,
+                      uint64_t *numPackets) {
+
+    uint64_t end;
+
+    if ( rec->haveIndex ) {
+        PIDX_iFindTimestamp(&rec->index, startTimestamp, firstPacket);
+        PIDX_iFindTimestamp(&rec->index, endTimestamp, &end);
+    }
+    else {
+        *firstPacket = u64FirstFrom(rec, startTimestamp);
+        end = u64FirstFrom(rec, endTimestamp);
+    }
+    *numPackets = (end > *firstPacket) ? end - *firstPacket : 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : PMAP_vView()
+// Description : Gives the packets of a time window in place, and starts
+//               reading them in. Sample s of packet i is at
+//               packets + i*psize + 14 + 2*s, see PMAP_i16Sample()
+// Parameters  : const PacketMapType *rec - The open file
+//               uint64_t startTimestamp - Start of the window
+//               uint64_t endTimestamp - End of the window
+//               PacketViewType *view - Filled in on return
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+void PMAP_vView(const PacketMapType *rec, uint64_t startTimestamp,
+                uint64_t endTimestamp, PacketViewType *view) {
+
+    uint64_t pageSize, start, end;
+
+    PMAP_vFindWindow(rec, startTimestamp, endTimestamp, &view->firstPacket,
+                     &view->numPackets);
+    view->psize = rec->psize;
+    view->packets = rec->base + view->firstPacket*rec->psize;
+    if ( view->numPackets ) {
+        pageSize = (uint64_t)sysconf(_SC_PAGESIZE);
+        start = view->firstPacket*rec->psize / pageSize * pageSize;
+        end = (view->firstPacket + view->numPackets)*rec->psize;
+        madvise((void *)(rec->base + start), end - start, MADV_WILLNEED);
+    }
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : PMAP_iSelectChannels()
+// Description : Looks up channels in the file's channel map
+// Parameters  : const PacketMapType *rec - The open file
+//               const uint8_t *wanted - CFG_MAX_CHANNELS flags, see
+//                                       CFG_iParseChannelList(). Without an
+//                                       index the channels are slots
+//               ChannelSelectType *select - Filled in on return
+// Returns     : int - 0 if success, negative value if a channel isn't
+//               in the file
+//////////////////////////////////////////////////////////////////////////
+int PMAP_iSelectChannels(const PacketMapType *rec, const uint8_t *wanted,
+                         ChannelSelectType *select) {
+
+    ChannelMapType subset;
+
+    return CFG_iSelectChannels(&rec->map, wanted, select, &subset);
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : PMAP_iReadChannels()
+// Description : Copies channels of a time window into caller buffers, one
+//               row per channel, with the SIMD kernels of the extractor.
+//               A run of neighbouring slots is transposed straight out of
+//               the mapping, other selections are gathered a block at a
+//               time first
+// Parameters  : const PacketMapType *rec - The open file
+//               uint64_t startTimestamp - Start of the window
+//               uint64_t endTimestamp - End of the window
+//               const ChannelSelectType *select - Channels, NULL for all
+//               int16_t *dst - One row per channel
+//               uint64_t dstStride - Samples from one row to the next,
+//                                    the most packets a row can take
+//               uint64_t *numPackets - Samples per row on return, or the
+//                                      room needed if dstStride is short
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int PMAP_iReadChannels(const PacketMapType *rec, uint64_t startTimestamp,
+                       uint64_t endTimestamp, const ChannelSelectType *select,
+                       int16_t *dst, uint64_t dstStride, uint64_t *numPackets) {
+
+    PacketViewType view;
+    uint32_t k, outPsize;
+    uint64_t i, n;
+    uint8_t *scratch;
+    int contiguous = 1;
+
+    PMAP_vView(rec, startTimestamp, endTimestamp, &view);
+    *numPackets = view.numPackets;
+    if ( view.numPackets > dstStride ) {
+        return -1;
+    }
+    if ( 0 == view.numPackets ) {
+        return 0;
+    }
+
+    if ( NULL == select ) {
+        SWR_vTranspose(view.packets, rec->psize, view.numPackets,
+                       rec->map.numChannels, dst, dstStride);
+        return 0;
+    }
+    for (k = 1; k < select->numChannels; k++) {
+        if ( select->slot[k] != select->slot[0] + k ) {
+            contiguous = 0;
+        }
+    }
+    if ( contiguous ) {
+        // the kernel reads from the sample after the header, so shifting
+        // the packets starts it at the first wanted slot
+        SWR_vTranspose(view.packets + CFG_SAMPLE_BYTES*select->slot[0], rec->psize,
+                       view.numPackets, select->numChannels, dst, dstStride);
+        return 0;
+    }
+
+    outPsize = CFG_HEADER_BYTES + CFG_SAMPLE_BYTES*select->numChannels;
+    scratch = malloc((uint64_t)SWR_BLOCK_PACKETS * outPsize);
+    if ( NULL == scratch ) {
+        return -2;
+    }
+    for (i = 0; i < view.numPackets; i += n) {
+        n = view.numPackets - i;
+        if ( n > SWR_BLOCK_PACKETS ) {
+            n = SWR_BLOCK_PACKETS;
+        }
+        SWR_vGather(view.packets + i*rec->psize, rec->psize, n, select, scratch);
+        SWR_vTranspose(scratch, outPsize, n, select->numChannels, dst + i, dstStride);
+    }
+    free(scratch);
+
+    return 0;
+
+}
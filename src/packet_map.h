@@ -0,0 +1,69 @@
+#ifndef PACKET_MAP_H
+#define PACKET_MAP_H
+
+#include <stdint.h>
+#include <string.h>
+#include "card_config.h"
+#include "packet_index.h"
+
+// Read-only access to an extracted packets file (psize = 14 + 2*channels,
+// timestamp at byte 10) through one shared mapping of the whole file.
+// Queries don't copy unless asked to gather, and since the mapping is
+// shared, processes querying the same file all use the one copy in the
+// page cache. Once open, a PacketMapType is only read, so threads can
+// query it at the same time. Timestamps are unwrapped to 64 bits, see
+// packet_scan.h; with an index they are the extraction's, otherwise
+// they count on from the first packet's own timestamp.
+
+//////////////////////////////////////////////////////////////////////////
+//                      Public Data Types
+//////////////////////////////////////////////////////////////////////////
+typedef struct {
+    const uint8_t *base;    // the mapped file
+    uint64_t fileBytes;
+    uint32_t psize;
+    uint64_t numPackets;
+    ChannelMapType map;     // from PATH.idx, else slot numbers
+    int haveIndex;
+    PacketIndexType index;  // loaded from PATH.idx when there is one
+    uint64_t firstTimestamp; // unwrapped, of packet 0
+} PacketMapType;
+
+typedef struct {
+    // packets of a time window, straight out of the mapping
+    const uint8_t *packets;
+    uint64_t numPackets;
+    uint64_t firstPacket;   // index in the file of the first packet
+    uint32_t psize;
+} PacketViewType;
+
+//////////////////////////////////////////////////////////////////////////
+//                    Public Function Prototypes
+//////////////////////////////////////////////////////////////////////////
+int PMAP_iOpen(PacketMapType *rec, const char *path, uint32_t numChannels);
+
+void PMAP_vClose(PacketMapType *rec);
+
+void PMAP_vFindWindow(const PacketMapType *rec, uint64_t startTimestamp,
+                      uint64_t endTimestamp, uint64_t *firstPacket,
+                      uint64_t *numPackets);
+
+void PMAP_vView(const PacketMapType *rec, uint64_t startTimestamp,
+                uint64_t endTimestamp, PacketViewType *view);
+
+int PMAP_iSelectChannels(const PacketMapType *rec, const uint8_t *wanted,
+                         ChannelSelectType *select);
+
+int PMAP_iReadChannels(const PacketMapType *rec, uint64_t startTimestamp,
+                       uint64_t endTimestamp, const ChannelSelectType *select,
+                       int16_t *dst, uint64_t dstStride, uint64_t *numPackets);
+
+static inline int16_t PMAP_i16Sample(const PacketViewType *view, uint64_t packet,
+                                     uint32_t slot) {
+    int16_t sample;
+    memcpy(&sample, view->packets + packet*view->psize + CFG_HEADER_BYTES
+                    + CFG_SAMPLE_BYTES*slot, sizeof(sample));
+    return sample;
+}
+
+#endif // PACKET_MAP_H
@@ -0,0 +1,635 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "packet_scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PSCAN_HAVE_X86 1
+#endif
+
+// fills the three bitmaps for packets [0, numPackets) and returns the
+// timestamp of the last packet. Bit 0 of jumpBits compares against
+// prevTimestamp. The bitmaps are zeroed by the caller
+typedef uint32_t (*ScanKernelFuncType)(const uint8_t *packets, uint32_t psize,
+                                       uint64_t numPackets, uint32_t prevTimestamp,
+                                       uint64_t *validBits, uint64_t *rfBits,
+                                       uint64_t *jumpBits);
+
+static ScanKernelFuncType scanKernel = NULL;
+static const char *scanKernelName = "none";
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : u32ScanRange()
+// Description : Scalar scan of packets [start, numPackets), also used by
+//               the vector kernels for the packets after the last whole
+//               vector
+// Parameters  : See ScanKernelFuncType, plus
+//               uint64_t start - First packet to scan
+// Returns     : uint32_t - timestamp of the last packet
+//////////////////////////////////////////////////////////////////////////
+static uint32_t u32ScanRange(const uint8_t *packets, uint32_t psize,
+                             uint64_t start, uint64_t numPackets,
+                             uint32_t prevTimestamp, uint64_t *validBits,
+                             uint64_t *rfBits, uint64_t *jumpBits) {
+
+    const uint8_t *packet;
+    uint32_t timestamp;
+    uint64_t i, bit;
+
+    for (i = start; i < numPackets; i++) {
+        packet = packets + i*psize;
+        bit = (uint64_t)1 << (i & 63);
+        if ( packet[START_BYTE_IND] == START_BYTE_VAL ) {
+            validBits[i >> 6] |= bit;
+            if ( packet[FLAG_BYTE_IND] == RF_VALID_VAL ) {
+                rfBits[i >> 6] |= bit;
+            }
+        }
+        timestamp = PSCAN_u32ReadTimestamp(packet);
+        if ( (uint32_t)(timestamp - prevTimestamp) != 1 ) {
+            jumpBits[i >> 6] |= bit;
+        }
+        prevTimestamp = timestamp;
+    }
+
+    return prevTimestamp;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : u32ScanScalar()
+// Description : Portable kernel, one packet at a time
+// Parameters  : See ScanKernelFuncType
+// Returns     : uint32_t - timestamp of the last packet
+//////////////////////////////////////////////////////////////////////////
+static uint32_t u32ScanScalar(const uint8_t *packets, uint32_t psize,
+                              uint64_t numPackets, uint32_t prevTimestamp,
+                              uint64_t *validBits, uint64_t *rfBits,
+                              uint64_t *jumpBits) {
+
+    return u32ScanRange(packets, psize, 0, numPackets, prevTimestamp,
+                        validBits, rfBits, jumpBits);
+
+}
+
+#ifdef PSCAN_HAVE_X86
+//////////////////////////////////////////////////////////////////////////
+// Function    : u32ScanSse2()
+// Description : SSE2 kernel. SSE2 has no gather, so the header word and
+//               timestamp of four packets are loaded into a vector and
+//               compared together, eight packets (one bitmap byte) per
+//               iteration
+// Parameters  : See ScanKernelFuncType
+// Returns     : uint32_t - timestamp of the last packet
+//////////////////////////////////////////////////////////////////////////
+__attribute__((target("sse2")))
+static uint32_t u32ScanSse2(const uint8_t *packets, uint32_t psize,
+                            uint64_t numPackets, uint32_t prevTimestamp,
+                            uint64_t *validBits, uint64_t *rfBits,
+                            uint64_t *jumpBits) {
+
+    const __m128i byteMask = _mm_set1_epi32(0xFF);
+    const __m128i startVal = _mm_set1_epi32(START_BYTE_VAL);
+    const __m128i rfVal = _mm_set1_epi32(RF_VALID_VAL);
+    const __m128i one = _mm_set1_epi32(1);
+    uint8_t *validBytes = (uint8_t *)validBits;
+    uint8_t *rfBytes = (uint8_t *)rfBits;
+    uint8_t *jumpBytes = (uint8_t *)jumpBits;
+    const uint8_t *p;
+    uint32_t hdr[8], ts[8];
+    uint64_t i, numGroups = numPackets / 8;
+    int half, k, validMask, rfMask, jumpMask;
+    __m128i h, t, prev, valid, rf, jump;
+
+    for (i = 0; i < numGroups; i++) {
+        p = packets + i*8*psize;
+        for (k = 0; k < 8; k++) {
+            memcpy(&hdr[k], p + k*psize, sizeof(uint32_t));
+            memcpy(&ts[k], p + k*psize + TIMESTAMP_START_IND, sizeof(uint32_t));
+        }
+        validMask = rfMask = jumpMask = 0;
+        for (half = 0; half < 2; half++) {
+            h = _mm_loadu_si128((const __m128i *)&hdr[4*half]);
+            t = _mm_loadu_si128((const __m128i *)&ts[4*half]);
+            valid = _mm_cmpeq_epi32(_mm_and_si128(h, byteMask), startVal);
+            rf = _mm_and_si128(valid, _mm_cmpeq_epi32(
+                     _mm_and_si128(_mm_srli_epi32(h, 8*FLAG_BYTE_IND), byteMask),
+                     rfVal));
+            prev = _mm_or_si128(_mm_slli_si128(t, 4),
+                                _mm_cvtsi32_si128((int)prevTimestamp));
+            jump = _mm_cmpeq_epi32(_mm_sub_epi32(t, prev), one);
+            validMask |= _mm_movemask_ps(_mm_castsi128_ps(valid)) << (4*half);
+            rfMask |= _mm_movemask_ps(_mm_castsi128_ps(rf)) << (4*half);
+            jumpMask |= (~_mm_movemask_ps(_mm_castsi128_ps(jump)) & 0xF) << (4*half);
+            prevTimestamp = ts[4*half + 3];
+        }
+        validBytes[i] = (uint8_t)validMask;
+        rfBytes[i] = (uint8_t)rfMask;
+        jumpBytes[i] = (uint8_t)jumpMask;
+    }
+
+    return u32ScanRange(packets, psize, numGroups*8, numPackets, prevTimestamp,
+                        validBits, rfBits, jumpBits);
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : u32ScanAvx2()
+// Description : AVX2 kernel. Gathers the header word and timestamp of
+//               eight packets at stride psize and compares them in one
+//               go, giving one bitmap byte per iteration
+// Parameters  : See ScanKernelFuncType
+// Returns     : uint32_t - timestamp of the last packet
+//////////////////////////////////////////////////////////////////////////
+__attribute__((target("avx2")))
+static uint32_t u32ScanAvx2(const uint8_t *packets, uint32_t psize,
+                            uint64_t numPackets, uint32_t prevTimestamp,
+                            uint64_t *validBits, uint64_t *rfBits,
+                            uint64_t *jumpBits) {
+
+    const __m256i byteMask = _mm256_set1_epi32(0xFF);
+    const __m256i startVal = _mm256_set1_epi32(START_BYTE_VAL);
+    const __m256i rfVal = _mm256_set1_epi32(RF_VALID_VAL);
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i rotate = _mm256_setr_epi32(7, 0, 1, 2, 3, 4, 5, 6);
+    const __m256i offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+                                               _mm256_set1_epi32((int)psize));
+    uint8_t *validBytes = (uint8_t *)validBits;
+    uint8_t *rfBytes = (uint8_t *)rfBits;
+    uint8_t *jumpBytes = (uint8_t *)jumpBits;
+    const uint8_t *p;
+    uint64_t i, numGroups = numPackets / 8;
+    __m256i h, t, prev, valid, rf, jump;
+
+    for (i = 0; i < numGroups; i++) {
+        p = packets + i*8*psize;
+        h = _mm256_i32gather_epi32((const int *)p, offsets, 1);
+        t = _mm256_i32gather_epi32((const int *)(p + TIMESTAMP_START_IND), offsets, 1);
+        valid = _mm256_cmpeq_epi32(_mm256_and_si256(h, byteMask), startVal);
+        rf = _mm256_and_si256(valid, _mm256_cmpeq_epi32(
+                 _mm256_and_si256(_mm256_srli_epi32(h, 8*FLAG_BYTE_IND), byteMask),
+                 rfVal));
+        // each lane's previous timestamp, lane 0 takes the carried one
+        prev = _mm256_blend_epi32(_mm256_permutevar8x32_epi32(t, rotate),
+                                  _mm256_set1_epi32((int)prevTimestamp), 0x01);
+        jump = _mm256_cmpeq_epi32(_mm256_sub_epi32(t, prev), one);
+        validBytes[i] = (uint8_t)_mm256_movemask_ps(_mm256_castsi256_ps(valid));
+        rfBytes[i] = (uint8_t)_mm256_movemask_ps(_mm256_castsi256_ps(rf));
+        jumpBytes[i] = (uint8_t)~_mm256_movemask_ps(_mm256_castsi256_ps(jump));
+        prevTimestamp = (uint32_t)_mm256_extract_epi32(t, 7);
+    }
+
+    return u32ScanRange(packets, psize, numGroups*8, numPackets, prevTimestamp,
+                        validBits, rfBits, jumpBits);
+
+}
+#endif // PSCAN_HAVE_X86
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : PSCAN_iSelectKernel()
+// Description : Picks the kernel PSCAN_iScan() uses. AUTO takes the
+//               fastest one the CPU supports, the others are mainly for
+//               benchmarking and checking the kernels against each other
+// Parameters  : PacketScanKernelType kernel - Kernel to use
+// Returns     : int - 0 if success, negative value if the CPU or build
+//               doesn't support the kernel
+//////////////////////////////////////////////////////////////////////////
+int PSCAN_iSelectKernel(PacketScanKernelType kernel) {
+
+    switch (kernel) {
+        case PSCAN_KERNEL_AUTO:
+#ifdef PSCAN_HAVE_X86
+            if ( 0 == PSCAN_iSelectKernel(PSCAN_KERNEL_AVX2) ) {
+                return 0;
+            }
+            if ( 0 == PSCAN_iSelectKernel(PSCAN_KERNEL_SSE2) ) {
+                return 0;
+            }
+#endif
+            return PSCAN_iSelectKernel(PSCAN_KERNEL_SCALAR);
+        case PSCAN_KERNEL_SCALAR:
+            scanKernel = u32ScanScalar;
+            scanKernelName = "scalar";
+            return 0;
+#ifdef PSCAN_HAVE_X86
+        case PSCAN_KERNEL_SSE2:
+            __builtin_cpu_init();
+            if ( !__builtin_cpu_supports("sse2") ) {
+                return -1;
+            }
+            scanKernel = u32ScanSse2;
+            scanKernelName = "sse2";
+            return 0;
+        case PSCAN_KERNEL_AVX2:
+            __builtin_cpu_init();
+            if ( !__builtin_cpu_supports("avx2") ) {
+                return -1;
+            }
+            scanKernel = u32ScanAvx2;
+            scanKernelName = "avx2";
+            return 0;
+#endif
+        default:
+            return -1;
+    }
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : PSCAN_pcKernelName()
+// Description : Name of the kernel in use, for log output
+// Parameters  : none
+// Returns     : const char * - the name
+//////////////////////////////////////////////////////////////////////////
+const char *PSCAN_pcKernelName(void) {
+
+    if ( NULL == scanKernel ) {
+        PSCAN_iSelectKernel(PSCAN_KERNEL_AUTO);
+    }
+
+    return scanKernelName;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : PSCAN_vInit()
+// Description : Sets up an empty scan. Nothing is allocated until the
+//               first PSCAN_iScan()
+// Parameters  : PacketScanType *scan - Scan to set up
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+void PSCAN_vInit(PacketScanType *scan) {
+
+    memset(scan, 0, sizeof(*scan));
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : PSCAN_vFree()
+// Description : Releases the memory held by a scan
+// Parameters  : PacketScanType *scan - Scan to free
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+void PSCAN_vFree(PacketScanType *scan) {
+
+    free(scan->validBits);
+    free(scan->rfBits);
+    free(scan->jumpBits);
+    free(scan->rfSyncList);
+    free(scan->jumpList);
+    memset(scan, 0, sizeof(*scan));
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : PSCAN_vSetTimeBase()
+// Description : Sets the time base timestamps are unwrapped against, so
+//               scans that start in different places (threads, --start)
+//               agree on the time of a packet
+// Parameters  : PacketScanType *scan - The scan
+//               uint64_t timeBase - Unwrapped time of packet 0, usually
+//                                   PSCAN_u64TimeBaseOf() of a good packet
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+void PSCAN_vSetTimeBase(PacketScanType *scan, uint64_t timeBase) {
+
+    scan->timeBase = timeBase;
+    scan->haveTimeBase = 1;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : u64PrevValid()
+// Description : Finds the last valid packet before one in the last scan,
+//               a word of the bitmap at a time
+// Parameters  : const PacketScanType *scan - The scan
+//               uint64_t i - Packet, relative to the scan, to look before
+// Returns     : uint64_t - the valid packet relative to the scan, or
+//               numPackets if there is none
+//////////////////////////////////////////////////////////////////////////
+static uint64_t u64PrevValid(const PacketScanType *scan, uint64_t i) {
+
+    uint64_t w, bits;
+
+    w = i >> 6;
+    bits = scan->validBits[w] & (((uint64_t)1 << (i & 63)) - 1);
+    while ( 0 == bits ) {
+        if ( 0 == w ) {
+            return scan->numPackets;
+        }
+        bits = scan->validBits[--w];
+    }
+
+    return 64*w + 63 - (uint64_t)__builtin_clzll(bits);
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : PSCAN_iScan()
+// Description : Checks a run of packets in one pass: start bytes, RF sync
+//               flags and timestamp continuity. Results replace those of
+//               the previous call, except that the last good packet is
+//               carried over so consecutive runs are checked as one. Bad
+//               packets' timestamps are garbage, so each good packet is
+//               checked against the last good one, and jumps are only
+//               taken at good packets. The kernels compare the 32 bit
+//               timestamps, which is exact across the wrap, and only the
+//               jumps get unwrapped
+// Parameters  : PacketScanType *scan - The scan
+//               const uint8_t *packets - First byte of the first packet
+//               uint32_t psize - Number of bytes per packet
+//               uint64_t numPackets - Number of packets in the run
+//               uint64_t firstPacketIndex - Index of the first packet
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int PSCAN_iScan(PacketScanType *scan, const uint8_t *packets, uint32_t psize,
+                uint64_t numPackets, uint64_t firstPacketIndex) {
+
+    uint64_t numWords, w, bits, i, first, runEnd, prevPacket, lastPacket;
+    uint32_t prevTimestamp, lastTimestamp;
+    int haveLast;
+    TimestampJumpType *jump;
+
+    if ( NULL == scanKernel ) {
+        PSCAN_iSelectKernel(PSCAN_KERNEL_AUTO);
+    }
+
+    numWords = (numPackets + 63) / 64;
+    if ( numWords > scan->bitCapacity ) {
+        free(scan->validBits);
+        free(scan->rfBits);
+        free(scan->jumpBits);
+        scan->validBits = malloc(numWords * sizeof(uint64_t));
+        scan->rfBits = malloc(numWords * sizeof(uint64_t));
+        scan->jumpBits = malloc(numWords * sizeof(uint64_t));
+        if ( (NULL == scan->validBits) || (NULL == scan->rfBits)
+             || (NULL == scan->jumpBits) ) {
+            scan->bitCapacity = 0;
+            return -1;
+        }
+        scan->bitCapacity = numWords;
+    }
+    scan->firstPacket = firstPacketIndex;
+    scan->numPackets = numPackets;
+    scan->validCt = 0;
+    scan->rfSyncCt = 0;
+    scan->jumpCt = 0;
+    if ( 0 == numPackets ) {
+        return 0;
+    }
+    memset(scan->validBits, 0, numWords * sizeof(uint64_t));
+    memset(scan->rfBits, 0, numWords * sizeof(uint64_t));
+    memset(scan->jumpBits, 0, numWords * sizeof(uint64_t));
+
+    // packet 0 is compared against the timestamp its place would have
+    // after the last good packet
+    prevTimestamp = scan->lastTimestamp
+                    + (uint32_t)(firstPacketIndex - 1 - scan->lastValidPacket);
+    scanKernel(packets, psize, numPackets, prevTimestamp,
+               scan->validBits, scan->rfBits, scan->jumpBits);
+    for (w = 0; w < numWords; w++) {
+        scan->jumpBits[w] &= scan->validBits[w];
+    }
+    if ( !scan->haveTimeBase ) {
+        first = PSCAN_u64RunEnd(scan, 0, 0);
+        if ( first == numPackets ) {
+            // nothing good yet, packet 0 will do until there is
+            first = 0;
+        }
+        else {
+            scan->haveTimeBase = 1;
+        }
+        scan->timeBase = PSCAN_u64TimeBaseOf(
+            PSCAN_u32ReadTimestamp(packets + first*psize), firstPacketIndex + first);
+    }
+
+    // the kernel compares neighbours, so the first good packet after bad
+    // ones is checked again against the last good packet. The first good
+    // packet ever has nothing to be compared against
+    haveLast = scan->haveTimestamp;
+    lastPacket = scan->lastValidPacket;
+    lastTimestamp = scan->lastTimestamp;
+    i = PSCAN_u64RunEnd(scan, 0, 0);
+    while ( i < numPackets ) {
+        bits = (uint64_t)1 << (i & 63);
+        if ( !haveLast ) {
+            scan->jumpBits[i >> 6] &= ~bits;
+        }
+        else if ( i > 0 ) {
+            if ( PSCAN_u32ReadTimestamp(packets + i*psize) - lastTimestamp
+                 != (uint32_t)(firstPacketIndex + i - lastPacket) ) {
+                scan->jumpBits[i >> 6] |= bits;
+            }
+            else {
+                scan->jumpBits[i >> 6] &= ~bits;
+            }
+        }
+        runEnd = PSCAN_u64RunEnd(scan, i, 1);
+        haveLast = 1;
+        lastPacket = firstPacketIndex + runEnd - 1;
+        lastTimestamp = PSCAN_u32ReadTimestamp(packets + (runEnd - 1)*psize);
+        i = PSCAN_u64RunEnd(scan, runEnd, 0);
+    }
+
+    // RF syncs and jumps are rare, so the sparse lists come from the
+    // bitmaps a word at a time
+    for (w = 0; w < numWords; w++) {
+        scan->validCt += (uint64_t)__builtin_popcountll(scan->validBits[w]);
+
+        bits = scan->rfBits[w];
+        while ( bits ) {
+            i = 64*w + (uint64_t)__builtin_ctzll(bits);
+            bits &= bits - 1;
+            if ( PSCAN_iGrowList((void **)&scan->rfSyncList, &scan->rfSyncCapacity,
+                           scan->rfSyncCt, sizeof(uint64_t)) ) {
+                return -2;
+            }
+            scan->rfSyncList[scan->rfSyncCt++] = firstPacketIndex + i;
+        }
+
+        bits = scan->jumpBits[w];
+        while ( bits ) {
+            i = 64*w + (uint64_t)__builtin_ctzll(bits);
+            bits &= bits - 1;
+            if ( PSCAN_iGrowList((void **)&scan->jumpList, &scan->jumpCapacity,
+                           scan->jumpCt, sizeof(TimestampJumpType)) ) {
+                return -2;
+            }
+            jump = &scan->jumpList[scan->jumpCt++];
+            jump->packetIndex = firstPacketIndex + i;
+            // the last good packet, in this scan or carried over
+            first = ((i > 0) && PSCAN_iIsValid(scan, i - 1)) ? i - 1
+                                                               : u64PrevValid(scan, i);
+            if ( first < numPackets ) {
+                prevPacket = firstPacketIndex + first;
+                prevTimestamp = PSCAN_u32ReadTimestamp(packets + first*psize);
+            }
+            else {
+                prevPacket = scan->lastValidPacket;
+                prevTimestamp = scan->lastTimestamp;
+            }
+            jump->prevTimestamp = PSCAN_u64TimeAt(scan, prevTimestamp, prevPacket)
+                                  + (firstPacketIndex + i - 1 - prevPacket);
+            jump->timestamp = PSCAN_u64TimeAt(scan, PSCAN_u32ReadTimestamp(packets + i*psize),
+                                              firstPacketIndex + i);
+        }
+    }
+
+    if ( haveLast ) {
+        scan->haveTimestamp = 1;
+        scan->lastValidPacket = lastPacket;
+        scan->lastTimestamp = lastTimestamp;
+        scan->lastTime = PSCAN_u64TimeAt(scan, lastTimestamp, lastPacket);
+    }
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : PSCAN_u64RunEnd()
+// Description : Finds where a run of valid (or invalid) packets in the
+//               last scan ends, a word of the bitmap at a time
+// Parameters  : const PacketScanType *scan - The scan
+//               uint64_t start - Packet, relative to the scan, to start at
+//               int valid - 1 to follow valid packets, 0 for invalid ones
+// Returns     : uint64_t - first packet from start, relative to the scan,
+//               whose state differs, or numPackets
+//////////////////////////////////////////////////////////////////////////
+uint64_t PSCAN_u64RunEnd(const PacketScanType *scan, uint64_t start, int valid) {
+
+    uint64_t w, bits, i;
+
+    if ( start >= scan->numPackets ) {
+        return scan->numPackets;
+    }
+    w = start >> 6;
+    // bits that end the run are set, those before start are ignored
+    bits = (valid ? ~scan->validBits[w] : scan->validBits[w])
+           & (~(uint64_t)0 << (start & 63));
+    while ( 0 == bits ) {
+        if ( ++w >= (scan->numPackets + 63) / 64 ) {
+            return scan->numPackets;
+        }
+        bits = valid ? ~scan->validBits[w] : scan->validBits[w];
+    }
+    i = 64*w + (uint64_t)__builtin_ctzll(bits);
+
+    return (i < scan->numPackets) ? i : scan->numPackets;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : PSCAN_iGrowList()
+// Description : Makes room for one more entry in a growable list, doubling
+//               its capacity when full
+// Parameters  : void **list - The list
+//               uint64_t *capacity - Entries the list can hold
+//               uint64_t count - Entries in use
+//               size_t entrySize - Bytes per entry
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int PSCAN_iGrowList(void **list, uint64_t *capacity, uint64_t count,
+                    size_t entrySize) {
+
+    uint64_t newCapacity;
+    void *newList;
+
+    if ( count < *capacity ) {
+        return 0;
+    }
+    newCapacity = *capacity ? 2 * *capacity : 64;
+    newList = realloc(*list, newCapacity * entrySize);
+    if ( NULL == newList ) {
+        return -1;
+    }
+    *list = newList;
+    *capacity = newCapacity;
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : PSCAN_u64Dropped()
+// Description : Counts the packets dropped at a timestamp jump. Only a
+//               jump forward drops packets. One back, e.g. to a corrupt
+//               timestamp and back again, is a discontinuity
+// Parameters  : const TimestampJumpType *jump - The jump
+// Returns     : uint64_t - Packets dropped, 0 if the timestamp repeats or
+//               goes back
+//////////////////////////////////////////////////////////////////////////
+uint64_t PSCAN_u64Dropped(const TimestampJumpType *jump) {
+
+    int64_t step;
+
+    step = (int64_t)(jump->timestamp - jump->prevTimestamp);
+
+    return (step > 1) ? (uint64_t)(step - 1) : 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : PSCAN_iAddGap()
+// Description : Adds a timestamp jump to a gap list. A repeated timestamp
+//               isn't a gap and is left out, as pcheck has always done. One
+//               that goes back is listed but drops no packets
+// Parameters  : GapListType *gaps - The list
+//               const TimestampJumpType *jump - The jump
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int PSCAN_iAddGap(GapListType *gaps, const TimestampJumpType *jump) {
+
+    if ( jump->timestamp == jump->prevTimestamp ) {
+        return 0;
+    }
+    if ( PSCAN_iGrowList((void **)&gaps->gapList, &gaps->gapCapacity,
+                         gaps->gapCt, sizeof(TimestampJumpType)) ) {
+        return -1;
+    }
+    gaps->gapList[gaps->gapCt++] = *jump;
+    if ( (int64_t)(jump->timestamp - jump->prevTimestamp) < 0 ) {
+        ++gaps->discontinuityCt;
+    }
+    gaps->droppedPackets += PSCAN_u64Dropped(jump);
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : PSCAN_iAddScanGaps()
+// Description : Adds the timestamp jumps found by the last scan to a gap 
+//               list
+// Parameters  : GapListType *gaps - The list
+//               const PacketScanType *scan - The scan
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int PSCAN_iAddScanGaps(GapListType *gaps, const PacketScanType *scan) {
+
+    uint64_t i;
+
+    for (i = 0; i < scan->jumpCt; i++) {
+        if ( PSCAN_iAddGap(gaps, &scan->jumpList[i]) ) {
+            return -1;
+        }
+    }
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : PSCAN_vFreeGapList()
+// Description : Releases a gap list and empties it
+// Parameters  : GapListType *gaps - The list
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+void PSCAN_vFreeGapList(GapListType *gaps) {
+
+    free(gaps->gapList);
+    memset(gaps, 0, sizeof(*gaps));
+
+}
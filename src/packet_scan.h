@@ -0,0 +1,142 @@
+#ifndef PACKET_SCAN_H
+#define PACKET_SCAN_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// layout of the header at the start of every recorded packet
+#define START_BYTE_IND 0
+#define FLAG_BYTE_IND 2
+#define TIMESTAMP_START_IND 10
+#define START_BYTE_VAL 0x55
+#define RF_VALID_VAL 0x1
+#define FILL_FLAG_VAL 0x80 // flag byte of packets sd_card_extract --fill-gaps makes up
+
+//////////////////////////////////////////////////////////////////////////
+//                      Public Data Types
+//////////////////////////////////////////////////////////////////////////
+typedef enum {
+    PSCAN_KERNEL_AUTO,      // best kernel the CPU supports
+    PSCAN_KERNEL_SCALAR,
+    PSCAN_KERNEL_SSE2,
+    PSCAN_KERNEL_AVX2
+} PacketScanKernelType;
+
+typedef struct {
+    uint64_t packetIndex;   // first packet after the discontinuity
+    uint64_t prevTimestamp; // unwrapped, see PSCAN_u64Unwrap(). What the
+                            // packet before would have, counted on from
+                            // the last good packet
+    uint64_t timestamp;
+} TimestampJumpType;
+
+typedef struct {
+    // gaps in packet order, repeated timestamps aren't counted as gaps.
+    // Timestamps that go back are listed too, as discontinuities
+    TimestampJumpType *gapList;
+    uint64_t gapCt;           // including the discontinuities
+    uint64_t gapCapacity;
+    uint64_t droppedPackets;  // sum over the forward gaps
+    uint64_t discontinuityCt; // timestamps that go back, not dropped packets
+} GapListType;
+
+typedef struct {
+    // results of the last PSCAN_iScan() call, indices are on the disk
+    uint64_t firstPacket;
+    uint64_t numPackets;
+    uint64_t *validBits;    // bit i set if packet firstPacket+i has a good start byte
+    uint64_t validCt;
+    uint64_t *rfSyncList;   // packets with a good start byte and the RF flag
+    uint64_t rfSyncCt;
+    TimestampJumpType *jumpList; // good packets whose timestamp doesn't
+    uint64_t jumpCt;             // follow on from the last good packet
+
+    // carried between calls so runs split across blocks scan as one. Bad
+    // packets' timestamps are garbage, so only good packets are carried
+    int haveTimestamp;          // a good packet has been scanned
+    uint64_t lastValidPacket;   // the last one, on the disk
+    uint32_t lastTimestamp;     // its timestamp
+    uint64_t lastTime;          // lastTimestamp unwrapped
+
+    // unwrapped time packet 0 would have with nothing dropped. Set from
+    // the first good packet scanned unless PSCAN_vSetTimeBase() was called
+    int haveTimeBase;
+    uint64_t timeBase;
+
+    // scratch, owned by the scan
+    uint64_t bitCapacity;   // 64 bit words in each bitmap
+    uint64_t *rfBits;
+    uint64_t *jumpBits;
+    uint64_t rfSyncCapacity;
+    uint64_t jumpCapacity;
+} PacketScanType;
+
+//////////////////////////////////////////////////////////////////////////
+//                    Public Function Prototypes
+//////////////////////////////////////////////////////////////////////////
+int PSCAN_iSelectKernel(PacketScanKernelType kernel);
+
+const char *PSCAN_pcKernelName(void);
+
+void PSCAN_vInit(PacketScanType *scan);
+
+void PSCAN_vFree(PacketScanType *scan);
+
+void PSCAN_vSetTimeBase(PacketScanType *scan, uint64_t timeBase);
+
+int PSCAN_iScan(PacketScanType *scan, const uint8_t *packets, uint32_t psize,
+                uint64_t numPackets, uint64_t firstPacketIndex);
+
+uint64_t PSCAN_u64RunEnd(const PacketScanType *scan, uint64_t start, int valid);
+
+int PSCAN_iGrowList(void **list, uint64_t *capacity, uint64_t count, 
+                    size_t entrySize);
+
+uint64_t PSCAN_u64Dropped(const TimestampJumpType *jump);
+
+int PSCAN_iAddGap(GapListType *gaps, const TimestampJumpType *jump);
+
+int PSCAN_iAddScanGaps(GapListType *gaps, const PacketScanType *scan);
+
+void PSCAN_vFreeGapList(GapListType *gaps);
+
+static inline uint32_t PSCAN_u32ReadTimestamp(const uint8_t *packet) {
+    return (uint32_t)packet[TIMESTAMP_START_IND + 3] << 24 |
+           (uint32_t)packet[TIMESTAMP_START_IND + 2] << 16 |
+           (uint32_t)packet[TIMESTAMP_START_IND + 1] <<  8 |
+           (uint32_t)packet[TIMESTAMP_START_IND];
+}
+
+static inline void PSCAN_vWriteTimestamp(uint8_t *packet, uint32_t timestamp) {
+    packet[TIMESTAMP_START_IND] = (uint8_t)timestamp;
+    packet[TIMESTAMP_START_IND + 1] = (uint8_t)(timestamp >> 8);
+    packet[TIMESTAMP_START_IND + 2] = (uint8_t)(timestamp >> 16);
+    packet[TIMESTAMP_START_IND + 3] = (uint8_t)(timestamp >> 24);
+}
+
+// The recorder's timestamps are 32 bits and wrap after 39.7 hours at
+// 30 kHz. Unwrapping gives the 64 bit time closest to what was expected,
+// and the expected time of packet i is timeBase + i, so a timestamp is
+// placed by where its packet is on the card rather than by the packet
+// before it. That is right as long as fewer than 2^31 packets (19.9
+// hours) have been dropped before it, and a corrupt timestamp can't throw
+// off the ones after it.
+static inline uint64_t PSCAN_u64Unwrap(uint32_t timestamp, uint64_t expected) {
+    return expected + (uint64_t)(int64_t)(int32_t)(timestamp - (uint32_t)expected);
+}
+
+// time base that puts a good packet at its own timestamp
+static inline uint64_t PSCAN_u64TimeBaseOf(uint32_t timestamp, uint64_t packetIndex) {
+    return PSCAN_u64Unwrap(timestamp, packetIndex) - packetIndex;
+}
+
+static inline uint64_t PSCAN_u64TimeAt(const PacketScanType *scan, uint32_t timestamp,
+                                       uint64_t packetIndex) {
+    return PSCAN_u64Unwrap(timestamp, scan->timeBase + packetIndex);
+}
+
+static inline int PSCAN_iIsValid(const PacketScanType *scan, uint64_t i) {
+    return (int)((scan->validBits[i >> 6] >> (i & 63)) & 1);
+}
+
+#endif // PACKET_SCAN_H
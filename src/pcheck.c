@@ -1,20 +1,342 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 #include <errno.h>
-#include <math.h>
+#include <time.h>
+#include <getopt.h>
 #include "diskio_linux.h"
+#include "block_reader.h"
+#include "packet_scan.h"
+#include "perf_stats.h"
+#include "record_end.h"
+#include "card_constants.h"
 
 #define BUFFER_LENGTH 32768
-#define MAX_FNAME_LENGTH 1000
-#define NUM_PACKETS 1
-#define SAMPLING_RATE 30000   // samples/sec
-#define PROGRESS_PERCENT 5
-#define START_BYTE_IND 0
-#define FLAG_BYTE_IND 2
-#define TIMESTAMP_START_IND 10
-#define START_BYTE_VAL 0x55
-#define RF_VALID_VAL 0x1
+#define PROGRESS_SEC 5.0      // between progress lines
+#define DEFAULT_BLOCK_MB 16   // size of each read from the device
+#define MAX_BLOCK_MB 1024
+#define FAST_PROBE_PACKETS 64      // packets read at each bisection probe
+#define FAST_SCAN_BYTES (64*1024)  // ranges this small are read whole
+
+typedef struct {
+    uint64_t lastPacket;
+    double nextProgressSec;
+    uint64_t rfSyncCt;
+    uint32_t psize;
+    int printGaps;
+    PacketScanType scan;
+    GapListType gaps;           // collected for --verify
+    PerfStatsType *perf;
+} CheckContextType;
+
+typedef struct {
+    DiskSessionType *session;
+    uint32_t psize;
+    uint8_t *buff;
+    PacketScanType scan;
+    GapListType gaps;
+    uint64_t numReads;
+    uint64_t bytesRead;
+    uint64_t badCt;             // bad packets in the ranges read whole
+} FastGapSearchType;
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : dGetMonotonicSec()
+// Description : Reads the monotonic clock, used for timing the search
+// Parameters  : none
+// Returns     : double - seconds since an arbitrary fixed point
+//////////////////////////////////////////////////////////////////////////
+static double dGetMonotonicSec(void) {
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : vPrintGap()
+// Description : Prints a gap the way the full scan always has, or a
+//               timestamp that goes back
+// Parameters  : FILE *fp - Where to print it
+//               const TimestampJumpType *gap - The gap
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+static void vPrintGap(FILE *fp, const TimestampJumpType *gap) {
+
+    if ( (int64_t)(gap->timestamp - gap->prevTimestamp) < 0 ) {
+        fprintf(fp, "Timestamp goes back by %llu after packet %llu \n",
+                (long long unsigned)(gap->prevTimestamp - gap->timestamp),
+                (long long unsigned)(gap->packetIndex - 1) );
+        return;
+    }
+    fprintf(fp, "%llu dropped packets after packet %llu \n",
+            (long long unsigned)PSCAN_u64Dropped(gap),
+            (long long unsigned)(gap->packetIndex - 1) );
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iCheckSpan()
+// Description : Checks a run of packets straight out of a read block: 
+//               start bytes, RF sync flags and timestamp gaps, all found
+//               in one pass by the packet scan kernel
+// Parameters  : void *ctx - CheckContextType of the scan
+//               uint8_t *packets - First byte of the first packet
+//               uint64_t numPackets - Number of packets in the run
+//               uint64_t firstPacketIndex - Index of the first packet
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+static int iCheckSpan(void *ctx, uint8_t *packets, uint64_t numPackets,
+                      uint64_t firstPacketIndex) {
+
+    CheckContextType *check = (CheckContextType *)ctx;
+    PacketScanType *scan = &check->scan;
+    PerfStatsType *perf = check->perf;
+    TimestampJumpType *jump;
+    uint64_t i, badEnd, j, dropped;
+    double now = PSTAT_dNow();
+
+    if ( now >= check->nextProgressSec ) {
+        fprintf(stdout, "%4.1f%% of packets read\n", 
+                (float)firstPacketIndex / (float)(check->lastPacket + 1) * 100);
+        check->nextProgressSec = now + PROGRESS_SEC;
+    }
+    PSTAT_vTick(perf, now);
+
+    if ( PSCAN_iScan(scan, packets, check->psize, numPackets, firstPacketIndex) ) {
+        return -1;
+    }
+    check->rfSyncCt += scan->rfSyncCt;
+    perf->packetsChecked += numPackets;
+    perf->badPackets += numPackets - scan->validCt;
+    perf->rfSyncCt = check->rfSyncCt;
+
+    // bad packets and gaps are reported in packet order, bad first
+    i = PSCAN_u64RunEnd(scan, 0, 1);
+    j = 0;
+    while ( (i < numPackets) || (j < scan->jumpCt) ) {
+        jump = (j < scan->jumpCt) ? &scan->jumpList[j] : NULL;
+        if ( (i < numPackets) 
+             && ((NULL == jump) || ((firstPacketIndex + i) <= jump->packetIndex)) ) {
+            fprintf(stderr, "Bad packet found. Packet index: %llu, "
+                    "byte[%u] value: %2x\n",
+                    (long long unsigned)(firstPacketIndex + i),
+                    (unsigned)START_BYTE_IND,
+                    (unsigned)packets[i*check->psize + START_BYTE_IND] );
+            badEnd = PSCAN_u64RunEnd(scan, i, 0);
+            i = (i + 1 < badEnd) ? i + 1 : PSCAN_u64RunEnd(scan, badEnd, 1);
+            continue;
+        }
+        // a repeated timestamp isn't a gap, one that goes back is listed
+        // but drops nothing
+        if ( jump->timestamp != jump->prevTimestamp ) {
+            dropped = PSCAN_u64Dropped(jump);
+            if ( dropped ) {
+                ++perf->gapCt;
+                perf->droppedPackets += dropped;
+            }
+            else {
+                ++perf->discontinuityCt;
+            }
+            if ( check->printGaps ) {
+                vPrintGap(stdout, jump);
+            }
+        }
+        ++j;
+    }
+
+    if ( !check->printGaps && PSCAN_iAddScanGaps(&check->gaps, scan) ) {
+        return -2;
+    }
+    perf->validateSec += PSTAT_dNow() - now;
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iFastScanRange()
+// Description : Reads packets first to last whole and adds the gaps 
+//               inside them. Used for the bottom of the bisection and 
+//               for stretches where a probe finds no good packet
+// Parameters  : FastGapSearchType *fast - The search
+//               uint64_t first - First packet of the range
+//               uint64_t last - Last packet of the range
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+static int iFastScanRange(FastGapSearchType *fast, uint64_t first, 
+                          uint64_t last) {
+
+    uint64_t n, maxPackets = FAST_SCAN_BYTES / fast->psize;
+
+    // first is the end of the range before, its gaps are already in
+    fast->scan.haveTimestamp = 0;
+    while ( first <= last ) {
+        n = last - first + 1;
+        if ( n > maxPackets ) {
+            n = maxPackets;
+        }
+        if ( DISKIO_iReadPacket(fast->session, fast->buff, first, fast->psize, n) ) {
+            return -1;
+        }
+        ++fast->numReads;
+        fast->bytesRead += n * fast->psize;
+        if ( PSCAN_iScan(&fast->scan, fast->buff, fast->psize, n, first) 
+             || PSCAN_iAddScanGaps(&fast->gaps, &fast->scan) ) {
+            return -2;
+        }
+        fast->badCt += n - fast->scan.validCt;
+        first += n;
+    }
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iFastProbe()
+// Description : Reads a few packets at a bisection point and takes the
+//               timestamp of the first (or last) good one, so a corrupt
+//               packet can't throw the search off
+// Parameters  : FastGapSearchType *fast - The search
+//               uint64_t index - Packet to probe
+//               uint64_t limit - Probe no further than this packet
+//               int fromEnd - 1 to take the last good packet read
+//               uint64_t *foundIndex - Good packet found, on return
+//               uint64_t *timestamp - Its unwrapped timestamp, on return
+// Returns     : int - 0 if found, 1 if no good packet, negative on error
+//////////////////////////////////////////////////////////////////////////
+static int iFastProbe(FastGapSearchType *fast, uint64_t index, uint64_t limit,
+                      int fromEnd, uint64_t *foundIndex, uint64_t *timestamp) {
+
+    uint64_t i, k, n = FAST_PROBE_PACKETS;
+    uint8_t *packet;
+
+    if ( n > (limit - index) ) {
+        n = limit - index;
+    }
+    if ( DISKIO_iReadPacket(fast->session, fast->buff, index, fast->psize, n) ) {
+        return -1;
+    }
+    ++fast->numReads;
+    fast->bytesRead += n * fast->psize;
+    for (k = 0; k < n; k++) {
+        i = fromEnd ? n - 1 - k : k;
+        packet = fast->buff + i*fast->psize;
+        if ( packet[START_BYTE_IND] == START_BYTE_VAL ) {
+            *foundIndex = index + i;
+            *timestamp = PSCAN_u64TimeAt(&fast->scan, PSCAN_u32ReadTimestamp(packet),
+                                         index + i);
+            return 0;
+        }
+    }
+
+    return 1;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iFastBisect()
+// Description : Finds the gaps between two good packets. Packets are only
+//               dropped, never added, so timestamp - index never goes 
+//               down; if it is the same at both ends there is no gap in
+//               between and nothing needs reading. Otherwise the range is
+//               split at its middle, the same way lastPacket is found
+// Parameters  : FastGapSearchType *fast - The search
+//               uint64_t lo - Good packet at the start of the range
+//               uint64_t tsLo - Its unwrapped timestamp
+//               uint64_t hi - Good packet at the end of the range
+//               uint64_t tsHi - Its unwrapped timestamp
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+static int iFastBisect(FastGapSearchType *fast, uint64_t lo, uint64_t tsLo,
+                       uint64_t hi, uint64_t tsHi) {
+
+    uint64_t mid, found, tsMid;
+    int res;
+
+    if ( tsHi - hi == tsLo - lo ) {
+        return 0;
+    }
+    if ( ((hi - lo + 1) * fast->psize) <= FAST_SCAN_BYTES ) {
+        return iFastScanRange(fast, lo, hi);
+    }
+
+    mid = lo + (hi - lo)/2;
+    res = iFastProbe(fast, mid, hi, 0, &found, &tsMid);
+    if ( res < 0 ) {
+        return res;
+    }
+    if ( res ) {
+        // a run of corrupt packets, fall back to reading the range
+        return iFastScanRange(fast, lo, hi);
+    }
+
+    res = iFastBisect(fast, lo, tsLo, found, tsMid);
+    if ( 0 == res ) {
+        res = iFastBisect(fast, found, tsMid, hi, tsHi);
+    }
+
+    return res;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iFindGapsFast()
+// Description : Lists every gap on the card with a few reads per gap
+//               instead of reading the whole card
+// Parameters  : FastGapSearchType *fast - The search, session and psize
+//                                         set by the caller
+//               uint64_t lastPacket - Index of the last packet
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+static int iFindGapsFast(FastGapSearchType *fast, uint64_t lastPacket) {
+
+    uint64_t lo, hi, tsLo, tsHi;
+    int res;
+
+    fast->buff = malloc(FAST_SCAN_BYTES + fast->psize);
+    if ( NULL == fast->buff ) {
+        return -1;
+    }
+    PSCAN_vInit(&fast->scan);
+
+    // both ends have to be good packets. The first one sets the time
+    // base the way a full scan does, so --verify compares like with like
+    res = iFastProbe(fast, 0, lastPacket + 1, 0, &lo, &tsLo);
+    if ( 0 == res ) {
+        PSCAN_vSetTimeBase(&fast->scan, tsLo - lo);
+        hi = (lastPacket >= FAST_PROBE_PACKETS) ? lastPacket - FAST_PROBE_PACKETS + 1 : 0;
+        res = iFastProbe(fast, hi, lastPacket + 1, 1, &hi, &tsHi);
+    }
+    if ( res < 0 ) {
+        return res;
+    }
+    if ( res || (hi <= lo) ) {
+        res = iFastScanRange(fast, 0, lastPacket);
+    }
+    else {
+        if ( lo ) {
+            res = iFastScanRange(fast, 0, lo);
+        }
+        if ( 0 == res ) {
+            res = iFastBisect(fast, lo, tsLo, hi, tsHi);
+        }
+        if ( (0 == res) && (hi < lastPacket) ) {
+            res = iFastScanRange(fast, hi, lastPacket);
+        }
+    }
+
+    PSCAN_vFree(&fast->scan);
+    free(fast->buff);
+    fast->buff = NULL;
+
+    return res;
+
+}
 
 //////////////////////////////////////////////////////////////////////////
 // Function     : main()
@@ -22,44 +344,163 @@
 //                recorded on disk e.g. number of packets, dropped 
 //                packets, etc.
 // CL arguments : device file name
+//                -b, --block-size MB: size of each device read, optional
+//                -d, --direct: bypass the page cache when reading, optional
+//                -q, --queue-depth N: number of reads in flight, optional
+//                --io-threads: use a thread pool instead of io_uring, optional
+//                -f, --fast: find the gaps by bisection, optional
+//                --verify: check the fast result with a full scan, optional
+//                --stats FILE: write performance counters as JSON, optional
+//                --stats-fd N: write a JSON line of them every interval to
+//                descriptor N, optional
+//                --stats-interval SEC: time between those lines, optional
 // Returns      : int - 0 if success, 1 if usage screen was displayed, 
 //                negative value otherwise
 //////////////////////////////////////////////////////////////////////////
 int main (int argc, char *argv[])
 {
     char deviceFile[MAX_FNAME_LENGTH];
-    int i, readAccessRes, deviceInfoRes, readPacketRes, readDiskRes;
-    int rfSyncCt = 0;
+    char *endPtr, *statsFile;
+    int i, readAccessRes, deviceInfoRes, readDiskRes, endRes;
+    int walkRes, opt, nArgs, useDirectIO, fastGaps, verifyGaps, statsFd;
+    uint64_t g;
+    double startSec, walkSec, statsIntervalSec;
     uint8_t buff[BUFFER_LENGTH];
-    uint32_t shift, psize;
-    uint32_t lastTimestamp = 0, currentTimestamp = 0;
-    uint64_t lastPacket, maxNumPackets, nPacketsProgress;
-    uint64_t nDroppedPackets, timestampPacketIndexDiff;
-    uint64_t nDroppedPacketsCounted, packetIndex;
+    uint32_t psize, queueDepth;
+    uint64_t lastPacket, maxNumPackets, blockMB;
+    uint64_t nDroppedPackets;
     FilePermissionType permission;
-    DeviceInfoType deviceInfo;
-    FILE *fpDevice;
+    DiskSessionType session;
+    const RecordingEndType *recordingEnd;
+    BlockReaderType *reader;
+    BlockReaderBackendType backend;
+    CheckContextType check;
+    FastGapSearchType fast;
+    PerfStatsType perf;
+    static struct option longOptions[] = {
+        {"block-size", required_argument, 0, 'b'},
+        {"direct", no_argument, 0, 'd'},
+        {"queue-depth", required_argument, 0, 'q'},
+        {"io-threads", no_argument, 0, 't'},
+        {"fast", no_argument, 0, 'f'},
+        {"verify", no_argument, 0, 'v'},
+        {"stats", required_argument, 0, 'S'},
+        {"stats-fd", required_argument, 0, 'F'},
+        {"stats-interval", required_argument, 0, 'I'},
+        {0, 0, 0, 0}
+    };
 
     // turn off output buffering
     setvbuf(stdout, 0, _IONBF, 0);
     setvbuf(stderr, 0, _IONBF, 0);
 
-	fprintf(stdout, "\n*** pcheck 1.3 ***\n");
+	fprintf(stdout, "\n*** pcheck 1.4 ***\n");
+
+    blockMB = DEFAULT_BLOCK_MB;
+    useDirectIO = 0;
+    queueDepth = BLKRD_DEFAULT_QUEUE_DEPTH;
+    backend = BLKRD_BACKEND_AUTO;
+    fastGaps = 0;
+    verifyGaps = 0;
+    statsFile = NULL;
+    statsFd = -1;
+    statsIntervalSec = PSTAT_DEFAULT_INTERVAL_SEC;
+    PSTAT_vInit(&perf, "pcheck");
+    while ( -1 != (opt = getopt_long(argc, argv, "b:dfq:", longOptions, NULL)) ) {
+        switch (opt) {
+            case 'b':
+                blockMB = strtoull(optarg, &endPtr, 10);
+                if ( ('\0' != *endPtr) || (0 == blockMB) || (MAX_BLOCK_MB < blockMB) ) {
+                    fprintf(stderr, "\nBlock size must be between 1 and %d MB\n",
+                            MAX_BLOCK_MB);
+                    return -1;
+                }
+                break;
+            case 'd':
+                useDirectIO = 1;
+                break;
+            case 'q':
+                queueDepth = (uint32_t)strtoul(optarg, &endPtr, 10);
+                if ( ('\0' != *endPtr) || (0 == queueDepth) 
+                     || (BLKRD_MAX_QUEUE_DEPTH < queueDepth) ) {
+                    fprintf(stderr, "\nQueue depth must be between 1 and %d\n",
+                            BLKRD_MAX_QUEUE_DEPTH);
+                    return -1;
+                }
+                break;
+            case 't':
+                backend = BLKRD_BACKEND_THREADS;
+                break;
+            case 'f':
+                fastGaps = 1;
+                break;
+            case 'v':
+                fastGaps = 1;
+                verifyGaps = 1;
+                break;
+            case 'S':
+                statsFile = optarg;
+                break;
+            case 'F':
+                statsFd = (int)strtol(optarg, &endPtr, 10);
+                if ( ('\0' != *endPtr) || (statsFd < 1) ) {
+                    fprintf(stderr, "\nStats descriptor must be an open file"
+                            " descriptor, e.g. 1 for stdout\n");
+                    return -1;
+                }
+                break;
+            case 'I':
+                statsIntervalSec = strtod(optarg, &endPtr);
+                if ( ('\0' != *endPtr) || !(statsIntervalSec > 0) ) {
+                    fprintf(stderr, "\nStats interval must be more than 0 seconds\n");
+                    return -1;
+                }
+                break;
+            default:
+                return -1;
+        }
+    }
+    nArgs = argc - optind;
 
-    if ( 1 == argc) {
-        fprintf(stdout, "\nUsage: pcheck [DEVICE_FILENAME]\n");
+    if ( 0 == nArgs) {
+        fprintf(stdout, "\nUsage: pcheck [OPTIONS] [DEVICE_FILENAME]\n");
         fprintf(stdout, "Example: `pcheck /dev/sdb`\n");
+        fprintf(stdout, "Options:\n");
+        fprintf(stdout, "  -b, --block-size MB   size of each read from the device"
+                " (default %d)\n", DEFAULT_BLOCK_MB);
+        fprintf(stdout, "  -d, --direct          read with O_DIRECT so the card"
+                " doesn't fill the page cache\n");
+        fprintf(stdout, "  -q, --queue-depth N   number of reads kept in flight"
+                " (default %d)\n", BLKRD_DEFAULT_QUEUE_DEPTH);
+        fprintf(stdout, "      --io-threads      issue reads from a thread pool"
+                " instead of io_uring\n");
+        fprintf(stdout, "  -f, --fast            find the gaps with a few reads"
+                " each instead of reading the card\n");
+        fprintf(stdout, "      --verify          check the --fast gaps against"
+                " a full scan\n");
+        fprintf(stdout, "      --stats FILE      write read and check counters"
+                " of the full scan to FILE\n"
+                "                        as JSON\n");
+        fprintf(stdout, "      --stats-fd N      write a JSON line of them to"
+                " descriptor N every interval\n");
+        fprintf(stdout, "      --stats-interval SEC  time between those lines"
+                " (default %.0f)\n", PSTAT_DEFAULT_INTERVAL_SEC);
+        fprintf(stdout, "The end of the recording is found from the timestamps."
+                " Packets an older\nrecording left after it are only told apart"
+                " if their timestamps are behind\nthe new recording's. Ones"
+                " level with or ahead of them read as the recording\ncarrying"
+                " on, after a dropout if they are ahead.\n");
         return 1;
     }
-    else if ( 1 < argc ) {
-        if ( 2 < argc) {
-            fprintf(stderr, "\nYou specified %d arguments when read_config "
-                    "only uses 1. Ignoring extra arguments\n", argc - 1);
+    else if ( 0 < nArgs ) {
+        if ( 1 < nArgs) {
+            fprintf(stderr, "\nYou specified %d arguments when pcheck "
+                    "only uses 1. Ignoring extra arguments\n", nArgs);
         }
 
         // check file name length
-        strncpy(deviceFile, argv[1], MAX_FNAME_LENGTH);
-        if ( '\0' != deviceFile[MAX_FNAME_LENGTH-1] ) {
+        if ( snprintf(deviceFile, sizeof(deviceFile), "%s", argv[optind])
+             >= (int)sizeof(deviceFile) ) {
             fprintf(stderr, "\nMaximum device file name length exceeded.\n");
             return -1;
         }
@@ -74,23 +515,20 @@ int main (int argc, char *argv[])
             return -2;
         }
 
-        // check that device information can be determined
-        // have gotten strange results when using uninitialized deviceInfo so 
-        // initialize here. In general it never hurts to initialize anyway  
-        memset(&deviceInfo, 0, sizeof(deviceInfo));
-        deviceInfoRes = DISKIO_iGetDeviceInfo(deviceFile, &deviceInfo);
+        // open the device once and determine its information
+        deviceInfoRes = DISKIO_iOpenSession(deviceFile, READ_ACCESS, &session);
         if ( 0 != deviceInfoRes ) {
             fprintf(stderr, "\nError checking device info: return value"
-                    " of DISKIO_iGetDevice() is %d\n",
+                    " of DISKIO_iOpenSession() is %d\n",
                     deviceInfoRes);
             return -3;
         }        
 
         // read second and third sectors (first sector is configuration info)
-        readDiskRes = DISKIO_iReadDisk(deviceFile, buff, 1, 2, &deviceInfo);
+        readDiskRes = DISKIO_iReadSectors(&session, buff, 1, 2);
         if ( 0 != readDiskRes ) {
             fprintf(stderr, "\nError reading from device: "
-                    "return value of DISKIO_iReadDisk() is %d\n", readDiskRes);
+                    "return value of DISKIO_iReadSectors() is %d\n", readDiskRes);
             return -4;
         }
         // check first packet header
@@ -99,13 +537,14 @@ int main (int argc, char *argv[])
             return -5;
         }
         // search for the next packet header
+        i = 0;
         while (((buff[i] != START_BYTE_VAL) ||
                 (buff[i + TIMESTAMP_START_IND] != 0x01) ||
                 (buff[i + TIMESTAMP_START_IND + 1] != 0x00) ||
                 (buff[i + TIMESTAMP_START_IND + 2] != 0x00) ||
                 (buff[i + TIMESTAMP_START_IND + 3] != 0x00)) &&
-                (i++ < deviceInfo.sectorSize));
-        if (i >= deviceInfo.sectorSize) {
+                ((uint64_t)i++ < session.deviceInfo.sectorSize));
+        if ((uint64_t)i >= session.deviceInfo.sectorSize) {
             fprintf(stderr, "\nCan't find the second packet start!\n");
             return -6;
         } 
@@ -113,77 +552,39 @@ int main (int argc, char *argv[])
             psize = i;
         }
 
-        fpDevice = fopen(deviceFile, "r");
-        if ( NULL == fpDevice ) {
-            fprintf(stderr, "Could not open %s to check packets!\n", deviceFile);
-            return -7;
-        }
-
         fprintf(stdout, "Packet size: %u bytes/packet\n", (unsigned)psize);
 
         // Maximum packets is device size - size of one sector (one sector used to set
         // the configuration)
-        maxNumPackets = ( (deviceInfo.sectorCount -1) * deviceInfo.sectorSize)/psize;
+        maxNumPackets = ( (session.deviceInfo.sectorCount -1) * session.deviceInfo.sectorSize)/psize;
         fprintf(stdout, "Maximum packets on the disk = %llu (%.2f minutes) \n",
                 (long long unsigned)maxNumPackets, 
                 (double)(maxNumPackets)/SAMPLING_RATE/60.0 );
 
-        lastPacket = 1;
-        shift = 0;
-        // determine the most significant bit of the maximum packet index
-        while (lastPacket < maxNumPackets) {
-            shift++;
-            lastPacket = lastPacket<<1;
-        }
-        lastPacket = 0;
-        for (i = shift; i >= 0; i--) {
-            lastPacket |= (1<<i);
-            if (lastPacket >= maxNumPackets) {
-                lastPacket &= ~(1<<i);
-                continue;
-            }
-            readPacketRes = DISKIO_iReadPacket(fpDevice, buff,
-                                               lastPacket, psize, 1,
-                                               &deviceInfo);
-            if ( readPacketRes ) {
-                fprintf(stderr, "\nError reading packet %llu: return value"
-                        " of DISKIO_iReadPacket() is %d\n",
-                        (long long unsigned)lastPacket,
-                        readPacketRes);
-                return -8;
-            } 
-            else if (buff[START_BYTE_IND] != START_BYTE_VAL) {
-                // packet that was just read is greater than the actual last
-                // packet since the starting byte of the packet is not 
-                // START_BYTE_VAL. so set bit i to 0, set bits NOT i to 1, 
-                // and bit wise AND to keep all NOT i bits in lastPacket the 
-                // same as before. Next iteration of for loop will check 
-                // bit i-1 to see whether there is a valid packet.
-                lastPacket &= ~(1<<i);
-            }
-        }
-        if (lastPacket < (maxNumPackets-1)) {
-            // Disk not full, don't use the last recorded packet since it might not be complete
-            lastPacket--;
+        // find where the recording ends, leaving out anything an older
+        // recording left on the card after it
+        endRes = REND_iLocate(&session, psize, &recordingEnd);
+        if ( endRes ) {
+            fprintf(stderr, "\nError finding the end of the recording: return value"
+                    " of REND_iLocate() is %d\n", endRes);
+            return -8;
         }
-
-        fprintf(stdout, "Packets recorded on the disk = %lu (%.2f minutes)\n",
-                (long unsigned)(lastPacket + 1), 
+        lastPacket = recordingEnd->lastPacket;
+        fprintf(stdout, "Packets recorded on the disk = %llu (%.2f minutes)\n",
+                (long long unsigned)(lastPacket + 1), 
                 (double)(lastPacket + 1)/SAMPLING_RATE/60.0 );
-        readPacketRes = DISKIO_iReadPacket(fpDevice, buff, lastPacket, psize, 1, &deviceInfo);
-        if (readPacketRes) {
-            fprintf(stderr, "\nError reading last packet recorded on disk: return value"
-                    " of DISKIO_iReadPacket() is %d\n", readPacketRes);
-            return -9;
+        fprintf(stdout, "End of the recording found with %llu reads\n",
+                (long long unsigned)recordingEnd->numReads);
+        if ( recordingEnd->olderDataFound ) {
+            fprintf(stdout, "Packets of an older recording follow it on the"
+                    " disk, they are not checked\n");
         }
 
         // if there are dropped packets, the timestamp of the last packet will be greater
-        // than the number of packets recorded on disk
-        nDroppedPackets = (buff[TIMESTAMP_START_IND + 3] << 24 |
-                           buff[TIMESTAMP_START_IND + 2] << 16 |
-                           buff[TIMESTAMP_START_IND + 1] <<  8 |
-                           buff[TIMESTAMP_START_IND])
-                           - lastPacket;
+        // than the number of packets recorded on disk. Timestamps are 32 bits
+        // and wrap on the largest cards, so the last one is unwrapped first
+        nDroppedPackets = PSCAN_u64Unwrap((uint32_t)recordingEnd->lastTimestamp,
+                                          lastPacket) - lastPacket;
         if ( nDroppedPackets ) { 
             fprintf(stdout, "Dropped packets = %llu (%.2f msec = %.2f sec)\n",
                     (long long unsigned)nDroppedPackets,
@@ -194,73 +595,145 @@ int main (int argc, char *argv[])
             fprintf(stdout, "No dropped packets\n");
         }
 
-        fprintf(stdout, "Finding the gaps...\n");
-        fprintf(stdout, "Finding number of RF sync points...\n");
-            
-        // will be used to display how frequently progress occurs 
-        nPacketsProgress = floor(0.01 * lastPacket * PROGRESS_PERCENT);
-
-        // read NUM_PACKETS at a time
-        while ( (packetIndex + NUM_PACKETS) < lastPacket ) {
-            if ( packetIndex % nPacketsProgress == 0 ) {
-                fprintf(stdout, "%4.1f%% of packets read\n", (float)packetIndex / (float)lastPacket * 100);
+        if ( fastGaps ) {
+            fprintf(stdout, "Finding the gaps by bisection...\n");
+            memset(&fast, 0, sizeof(fast));
+            fast.session = &session;
+            fast.psize = psize;
+            startSec = dGetMonotonicSec();
+            if ( iFindGapsFast(&fast, lastPacket) ) {
+                fprintf(stderr, "Error finding the gaps\n");
+                return -13;
             }
-
-            readPacketRes = DISKIO_iReadPacket(fpDevice, buff, packetIndex,
-                                              psize, NUM_PACKETS, &deviceInfo);
-            if ( readPacketRes ) {
-                fprintf(stderr, "Error reading packets %llu to %llu!\n",
-                        (long long unsigned)packetIndex,
-                        (long long unsigned)(packetIndex + NUM_PACKETS - 1) );
-                return -10;
+            for (g = 0; g < fast.gaps.gapCt; g++) {
+                vPrintGap(stdout, &fast.gaps.gapList[g]);
+            }
+            fprintf(stdout, "%llu gaps, %llu dropped packets, found with %llu"
+                    " reads (%.2f MB) in %.2f sec\n",
+                    (long long unsigned)(fast.gaps.gapCt - fast.gaps.discontinuityCt),
+                    (long long unsigned)fast.gaps.droppedPackets,
+                    (long long unsigned)fast.numReads,
+                    (double)fast.bytesRead/BYTES_PER_MB,
+                    dGetMonotonicSec() - startSec);
+            if ( fast.badCt ) {
+                fprintf(stdout, "%llu bad packets in the stretches read\n",
+                        (long long unsigned)fast.badCt);
             }
+            // the gaps have to add up to what the last timestamp says
+            if ( fast.gaps.droppedPackets != nDroppedPackets ) {
+                fprintf(stderr, "Warning: gaps add up to %llu dropped packets but"
+                        " the last timestamp says %llu, use --verify\n",
+                        (long long unsigned)fast.gaps.droppedPackets,
+                        (long long unsigned)nDroppedPackets);
+            }
+            if ( !verifyGaps ) {
+                PSCAN_vFreeGapList(&fast.gaps);
+                if ( DISKIO_iCloseSession(&session) ) {
+                    fprintf(stderr, "Error closing %s\n", deviceFile);
+                    return -12;
+                }
+                fprintf(stdout, "\nDone!\n");
+                return 0;
+            }
+            fprintf(stdout, "Verifying with a full scan...\n");
+        }
+        else {
+            fprintf(stdout, "Finding the gaps...\n");
+        }
+        fprintf(stdout, "Finding number of RF sync points...\n");
+
+        if ( useDirectIO ) {
+            DISKIO_iEnableDirectIO(&session);
+        }
+        memset(&check, 0, sizeof(check));
+        PSCAN_vInit(&check.scan);
+        check.lastPacket = lastPacket;
+        check.psize = psize;
+        // when verifying, the full scan's gaps are compared, not printed
+        check.printGaps = !verifyGaps;
+        check.perf = &perf;
+        if ( (statsFd >= 0) && PSTAT_iOpenStream(&perf, statsFd, statsIntervalSec) ) {
+            return -15;
+        }
 
-            // check that value of start byte is as expected for sd recording
-            if ( buff[START_BYTE_IND] == START_BYTE_VAL ) {
-                if ( buff[FLAG_BYTE_IND] == RF_VALID_VAL ) {
-                    ++rfSyncCt;
+        // read the packets in large blocks, several reads in flight
+        walkRes = BLKRD_iOpen(&reader, &session, psize, 0, lastPacket + 1,
+                              blockMB * BYTES_PER_MB, queueDepth, backend);
+        if ( walkRes ) {
+            fprintf(stderr, "Error starting reads: return value of BLKRD_iOpen()"
+                    " is %d\n", walkRes);
+            return -10;
+        }
+        BLKRD_vSetStats(reader, &perf);
+        fprintf(stdout, "Reading with %s, %u reads in flight, %s packet checks\n",
+                BLKRD_pcBackendName(reader), (unsigned)queueDepth,
+                PSCAN_pcKernelName());
+        check.nextProgressSec = PSTAT_dNow();
+        walkSec = check.nextProgressSec;
+        walkRes = BLKRD_iWalkPackets(reader, iCheckSpan, &check);
+        BLKRD_vClose(reader);
+        // what isn't spent checking is spent waiting for reads
+        perf.readStallSec = PSTAT_dNow() - walkSec - perf.validateSec;
+        PSTAT_vClose(&perf);
+        PSCAN_vFree(&check.scan);
+        if ( walkRes ) {
+            fprintf(stderr, "Error reading packets: return value of"
+                    " BLKRD_iWalkPackets() is %d\n", walkRes);
+            return -11;
+        }
+
+        if ( DISKIO_iCloseSession(&session) ) {
+            fprintf(stderr, "Error closing %s after extracting data\n", deviceFile);
+            return -12;
+        }
+
+        if ( verifyGaps ) {
+            for (g = 0; (g < fast.gaps.gapCt) && (g < check.gaps.gapCt); g++) {
+                if ( memcmp(&fast.gaps.gapList[g], &check.gaps.gapList[g],
+                            sizeof(TimestampJumpType)) ) {
+                    break;
                 }
             }
+            if ( (g == fast.gaps.gapCt) && (g == check.gaps.gapCt) ) {
+                fprintf(stdout, "Verified: the full scan finds the same %llu gaps\n",
+                        (long long unsigned)g);
+            }
             else {
-                fprintf(stderr, "Bad packet found. Packet index: %llu, \
-                        byte[%u] value: %2x\n",
-                        (long long unsigned)packetIndex,
-                        (unsigned)START_BYTE_IND,
-                        (unsigned)buff[START_BYTE_IND] );
+                fprintf(stderr, "Verify failed: fast search found %llu gaps, full"
+                        " scan %llu. First difference at gap %llu:\n",
+                        (long long unsigned)fast.gaps.gapCt,
+                        (long long unsigned)check.gaps.gapCt,
+                        (long long unsigned)g);
+                if ( g < check.gaps.gapCt ) {
+                    fprintf(stderr, "  full scan: ");
+                    vPrintGap(stderr, &check.gaps.gapList[g]);
+                }
+                if ( g < fast.gaps.gapCt ) {
+                    fprintf(stderr, "  fast:      ");
+                    vPrintGap(stderr, &fast.gaps.gapList[g]);
+                }
+                return -14;
             }
+            PSCAN_vFreeGapList(&fast.gaps);
+            PSCAN_vFreeGapList(&check.gaps);
+        }
 
-            currentTimestamp = buff[TIMESTAMP_START_IND + 3] << 24 |
-                               buff[TIMESTAMP_START_IND + 2] << 16 |
-                               buff[TIMESTAMP_START_IND + 1] <<  8 |
-                               buff[TIMESTAMP_START_IND];
-            if ( packetIndex && ((currentTimestamp - lastTimestamp) > 1) ) {
-                fprintf(stdout, "%lu dropped packets after packet %lu \n",
-                        (long unsigned)(currentTimestamp - lastTimestamp - 1),
-                        (long unsigned)(packetIndex - 1) );
+        if ( statsFile ) {
+            if ( PSTAT_iWriteJson(&perf, statsFile) ) {
+                return -15;
             }
-            lastTimestamp = currentTimestamp;
-            packetIndex += NUM_PACKETS;
-
-        }
-        
-        // read the last block of packets
-        readPacketRes = DISKIO_iReadPacket(fpDevice, buff, packetIndex, psize,
-                                           lastPacket - packetIndex + 1, &deviceInfo);
-        if ( readPacketRes ) {
-            fprintf(stderr, "Error reading packets %llu to %llu!\n",
-                    (long long unsigned)packetIndex,
-                    (long long unsigned)lastPacket );
-            return -11;
+            fprintf(stdout, "Performance counters written to %s\n", statsFile);
         }
 
-        if ( fclose(fpDevice) ) {
-            fprintf(stderr, "Error closing %s after extracting data\n", deviceFile);
-            return -12;
+        if ( perf.discontinuityCt ) {
+            fprintf(stdout, "\n%llu timestamp discontinuities, not counted as"
+                    " dropped packets\n", (long long unsigned)perf.discontinuityCt);
         }
 
         // RF sync values found
-        if ( rfSyncCt ) {
-            fprintf(stdout, "\nFound %d RF sync values\n", rfSyncCt);
+        if ( check.rfSyncCt ) {
+            fprintf(stdout, "\nFound %llu RF sync values\n", 
+                    (long long unsigned)check.rfSyncCt);
         }
         else {
             fprintf(stderr, "\nError: Found 0 RF sync values!\n");
@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include "perf_stats.h"
+#include "card_constants.h"
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : PSTAT_dNow()
+// Description : Reads the monotonic clock
+// Parameters  : none
+// Returns     : double - seconds since an arbitrary fixed point
+//////////////////////////////////////////////////////////////////////////
+double PSTAT_dNow(void) {
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : PSTAT_vInit()
+// Description : Zeroes the counters and starts the clock
+// Parameters  : PerfStatsType *stats - The counters
+//               const char *tool - Name written in the JSON
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+void PSTAT_vInit(PerfStatsType *stats, const char *tool) {
+
+    memset(stats, 0, sizeof(*stats));
+    stats->tool = tool;
+    stats->startSec = PSTAT_dNow();
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : PSTAT_iOpenStream()
+// Description : Starts writing a JSON line of the totals so far to a file
+//               descriptor every interval, from PSTAT_vTick()
+// Parameters  : PerfStatsType *stats - The counters
+//               int fd - Descriptor to write to, left open on close if
+//                        it is stdout or stderr
+//               double intervalSec - Time between lines
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int PSTAT_iOpenStream(PerfStatsType *stats, int fd, double intervalSec) {
+
+    stats->fpStream = fdopen(fd, "w");
+    if ( NULL == stats->fpStream ) {
+        fprintf(stderr, "Error no %d opening stats descriptor %d: %s\n",
+                errno, fd, strerror(errno));
+        return -1;
+    }
+    setvbuf(stats->fpStream, NULL, _IOLBF, 0);
+    stats->intervalSec = intervalSec;
+    stats->lastLineSec = stats->startSec;
+    stats->nextLineSec = stats->startSec + intervalSec;
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : PSTAT_vAddRead()
+// Description : Counts a finished device read, safe from any thread
+// Parameters  : PerfStatsType *stats - The counters, NULL to do nothing
+//               uint64_t bytes - Bytes read
+//               double latencySec - From submitting the read to seeing it
+//                                   finish
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+void PSTAT_vAddRead(PerfStatsType *stats, uint64_t bytes, double latencySec) {
+
+    uint64_t usec;
+    int bucket;
+
+    if ( NULL == stats ) {
+        return;
+    }
+    usec = (latencySec > 0) ? (uint64_t)(latencySec * 1e6) : 0;
+    bucket = usec ? 64 - __builtin_clzll(usec) : 0;
+    if ( bucket >= PSTAT_LATENCY_BUCKETS ) {
+        bucket = PSTAT_LATENCY_BUCKETS - 1;
+    }
+    __atomic_fetch_add(&stats->bytesRead, bytes, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->readCalls, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->readUsec, usec, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->readLatency[bucket], 1, __ATOMIC_RELAXED);
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : PSTAT_vTick()
+// Description : Writes a JSON line if the interval has passed. Cheap
+//               enough to call for every block
+// Parameters  : PerfStatsType *stats - The counters
+//               double now - PSTAT_dNow()
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+void PSTAT_vTick(PerfStatsType *stats, double now) {
+
+    uint64_t bytesRead;
+
+    if ( (NULL == stats->fpStream) || (now < stats->nextLineSec) ) {
+        return;
+    }
+    bytesRead = __atomic_load_n(&stats->bytesRead, __ATOMIC_RELAXED);
+    fprintf(stats->fpStream, "{\"tool\": \"%s\", \"elapsed_sec\": %.3f,"
+            " \"bytes_read\": %llu, \"read_mb_per_sec\": %.1f,"
+            " \"packets_checked\": %llu, \"packets_written\": %llu,"
+            " \"bad_packets\": %llu, \"read_stall_sec\": %.3f,"
+            " \"write_stall_sec\": %.3f}\n",
+            stats->tool, now - stats->startSec,
+            (long long unsigned)bytesRead,
+            (double)(bytesRead - stats->lastBytesRead)/BYTES_PER_MB
+            / (now - stats->lastLineSec),
+            (long long unsigned)stats->packetsChecked,
+            (long long unsigned)stats->packetsWritten,
+            (long long unsigned)stats->badPackets,
+            stats->readStallSec, stats->writeStallSec);
+    stats->lastBytesRead = bytesRead;
+    stats->lastLineSec = now;
+    while ( stats->nextLineSec <= now ) {
+        stats->nextLineSec += stats->intervalSec;
+    }
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : PSTAT_iWriteJson()
+// Description : Writes the totals as one JSON object. The read latency
+//               histogram lists the buckets that have reads, each with
+//               the latency its reads stay under (the last bucket also
+//               holds any longer reads)
+// Parameters  : PerfStatsType *stats - The counters
+//               const char *path - File to write
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int PSTAT_iWriteJson(PerfStatsType *stats, const char *path) {
+
+    int b, first = 1;
+    double elapsedSec = PSTAT_dNow() - stats->startSec;
+    FILE *fp;
+
+    fp = fopen(path, "w");
+    if ( NULL == fp ) {
+        fprintf(stderr, "Error no %d opening stats file %s: %s\n",
+                errno, path, strerror(errno));
+        return -1;
+    }
+    fprintf(fp, "{\n  \"tool\": \"%s\",\n  \"elapsed_sec\": %.3f,\n", stats->tool,
+            elapsedSec);
+    fprintf(fp, "  \"bytes_read\": %llu,\n  \"read_calls\": %llu,\n"
+            "  \"read_mb_per_sec\": %.1f,\n  \"read_latency_mean_usec\": %.1f,\n",
+            (long long unsigned)stats->bytesRead,
+            (long long unsigned)stats->readCalls,
+            (elapsedSec > 0) ? (double)stats->bytesRead/BYTES_PER_MB/elapsedSec : 0.0,
+            stats->readCalls ? (double)stats->readUsec/stats->readCalls : 0.0);
+    fprintf(fp, "  \"read_latency_hist\": [");
+    for (b = 0; b < PSTAT_LATENCY_BUCKETS; b++) {
+        if ( stats->readLatency[b] ) {
+            fprintf(fp, "%s{\"below_usec\": %llu, \"count\": %llu}",
+                    first ? "" : ", ", 1ULL << b,
+                    (long long unsigned)stats->readLatency[b]);
+            first = 0;
+        }
+    }
+    fprintf(fp, "],\n");
+    fprintf(fp, "  \"packets_checked\": %llu,\n  \"packets_written\": %llu,\n"
+            "  \"bytes_written\": %llu,\n  \"bad_packets\": %llu,\n"
+            "  \"dropped_packets\": %llu,\n  \"gaps\": %llu,\n"
+            "  \"timestamp_discontinuities\": %llu,\n  \"rf_syncs\": %llu,\n",
+            (long long unsigned)stats->packetsChecked,
+            (long long unsigned)stats->packetsWritten,
+            (long long unsigned)stats->bytesWritten,
+            (long long unsigned)stats->badPackets,
+            (long long unsigned)stats->droppedPackets,
+            (long long unsigned)stats->gapCt,
+            (long long unsigned)stats->discontinuityCt,
+            (long long unsigned)stats->rfSyncCt);
+    fprintf(fp, "  \"validate_sec\": %.3f,\n  \"write_sec\": %.3f,\n"
+            "  \"read_stall_sec\": %.3f,\n  \"write_stall_sec\": %.3f\n}\n",
+            stats->validateSec, stats->writeSec, stats->readStallSec,
+            stats->writeStallSec);
+    if ( fclose(fp) ) {
+        fprintf(stderr, "Error writing stats file %s\n", path);
+        return -2;
+    }
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : PSTAT_vClose()
+// Description : Stops the JSON lines
+// Parameters  : PerfStatsType *stats - The counters
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+void PSTAT_vClose(PerfStatsType *stats) {
+
+    if ( stats->fpStream ) {
+        if ( fileno(stats->fpStream) > 2 ) {
+            fclose(stats->fpStream);
+        }
+        else {
+            fflush(stats->fpStream);
+        }
+        stats->fpStream = NULL;
+    }
+
+}
@@ -0,0 +1,65 @@
+#ifndef PERF_STATS_H
+#define PERF_STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define PSTAT_LATENCY_BUCKETS 24      // bucket b: reads of 2^(b-1) to 2^b usec
+#define PSTAT_DEFAULT_INTERVAL_SEC 1.0
+
+// Counters of where a tool's time goes, kept while it runs and written as
+// one JSON object with PSTAT_iWriteJson(). With PSTAT_iOpenStream() a JSON
+// line of the totals so far is also written every interval, so ingest
+// throughput can be graphed while a card is read. Reads are counted from
+// the block reader's threads, everything else from the checking thread.
+
+//////////////////////////////////////////////////////////////////////////
+//                      Public Data Types
+//////////////////////////////////////////////////////////////////////////
+typedef struct {
+    const char *tool;
+    double startSec;
+    // reads, added atomically
+    uint64_t bytesRead;
+    uint64_t readCalls;
+    uint64_t readUsec;              // summed latency of the reads
+    uint64_t readLatency[PSTAT_LATENCY_BUCKETS];
+    // checking and writing
+    uint64_t packetsChecked;
+    uint64_t packetsWritten;
+    uint64_t bytesWritten;
+    uint64_t badPackets;
+    uint64_t droppedPackets;
+    uint64_t gapCt;
+    uint64_t discontinuityCt;       // timestamps going back, not gaps
+    uint64_t rfSyncCt;
+    double validateSec;             // checking packets and queueing them
+    double writeSec;                // in write calls
+    double readStallSec;            // waiting on the device
+    double writeStallSec;           // waiting for the output to catch up
+    // JSON lines
+    FILE *fpStream;
+    double intervalSec;
+    double nextLineSec;
+    double lastLineSec;
+    uint64_t lastBytesRead;
+} PerfStatsType;
+
+//////////////////////////////////////////////////////////////////////////
+//                    Public Function Prototypes
+//////////////////////////////////////////////////////////////////////////
+double PSTAT_dNow(void);
+
+void PSTAT_vInit(PerfStatsType *stats, const char *tool);
+
+int PSTAT_iOpenStream(PerfStatsType *stats, int fd, double intervalSec);
+
+void PSTAT_vAddRead(PerfStatsType *stats, uint64_t bytes, double latencySec);
+
+void PSTAT_vTick(PerfStatsType *stats, double now);
+
+int PSTAT_iWriteJson(PerfStatsType *stats, const char *path);
+
+void PSTAT_vClose(PerfStatsType *stats);
+
+#endif // PERF_STATS_H
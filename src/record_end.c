@@ -0,0 +1,247 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "record_end.h"
+#include "packet_scan.h"
+
+typedef struct {
+    DiskSessionType *session;
+    uint32_t psize;
+    uint64_t timeBase;
+    uint64_t confirmedDropped;  // packets dropped before the last probe
+                                // found to be recorded
+    uint8_t *buff;
+    uint64_t blockOffset;   // device byte offset of buff[0]
+    uint64_t blockBytes;    // bytes read into buff, 0 before the first read
+    uint64_t numReads;
+} EndSearchType;
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iInBlock()
+// Description : Tells if a packet is in the block already read
+// Parameters  : const EndSearchType *search - The search
+//               uint64_t index - Packet index on the card
+// Returns     : int - 1 if it is, 0 otherwise
+//////////////////////////////////////////////////////////////////////////
+static int iInBlock(const EndSearchType *search, uint64_t index) {
+
+    uint64_t offset;
+
+    offset = search->session->deviceInfo.sectorSize + index * search->psize;
+
+    return (0 != search->blockBytes) && (offset >= search->blockOffset)
+           && (offset + search->psize <= search->blockOffset + search->blockBytes);
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iLoadPacket()
+// Description : Gives a packet, reading the block of the card it is in
+//               unless it was read already. The block starts at the
+//               sector of the first packet the search can still probe, so
+//               the probes after this one are likely to be in it too
+// Parameters  : EndSearchType *search - The search
+//               uint64_t index - Packet index on the card
+//               uint64_t from - First packet still to be probed, at most
+//                               index
+//               const uint8_t **packet - The packet on return
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+static int iLoadPacket(EndSearchType *search, uint64_t index, uint64_t from,
+                       const uint8_t **packet) {
+
+    uint64_t sectorSize, offset, start, numBytes, deviceBytes;
+
+    sectorSize = search->session->deviceInfo.sectorSize;
+    offset = sectorSize + index * search->psize;
+    if ( !iInBlock(search, index) ) {
+        start = sectorSize + from * search->psize;
+        if ( offset + search->psize > start + REND_PROBE_BYTES - sectorSize ) {
+            start = offset;
+        }
+        start -= start % sectorSize;
+        deviceBytes = search->session->deviceInfo.sectorCount * sectorSize;
+        numBytes = (start + REND_PROBE_BYTES <= deviceBytes) ? REND_PROBE_BYTES
+                                                             : deviceBytes - start;
+        if ( DISKIO_iReadBytes(search->session, search->buff, start, numBytes) ) {
+            search->blockBytes = 0;
+            return -1;
+        }
+        search->blockOffset = start;
+        search->blockBytes = numBytes;
+        search->numReads++;
+    }
+    *packet = search->buff + (offset - search->blockOffset);
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iIsRecorded()
+// Description : Tells if a packet is part of the recording: it has a good
+//               start byte and no fewer packets dropped before it than
+//               before the last probe found to be recorded. A bad start
+//               byte is common enough inside a recording that the next
+//               good packet in the block decides instead
+// Parameters  : EndSearchType *search - The search, its confirmed dropped
+//                                       count is this probe's if it decides
+//               uint64_t index - Packet index on the card
+//               uint64_t from - First packet still to be probed
+//               uint64_t endIndex - One past the last packet on the card
+// Returns     : int - 1 if it is recorded, 0 if not, negative value if a
+//               read failed
+//////////////////////////////////////////////////////////////////////////
+static int iIsRecorded(EndSearchType *search, uint64_t index, uint64_t from,
+                       uint64_t endIndex) {
+
+    uint64_t k, dropped;
+    const uint8_t *packet;
+
+    for (k = index; (k < endIndex) && (k < index + REND_BAD_RUN); k++) {
+        if ( (k > index) && !iInBlock(search, k) ) {
+            break;
+        }
+        if ( iLoadPacket(search, k, from, &packet) ) {
+            return -1;
+        }
+        if ( START_BYTE_VAL != packet[START_BYTE_IND] ) {
+            continue;
+        }
+        dropped = PSCAN_u64Unwrap(PSCAN_u32ReadTimestamp(packet), search->timeBase + k)
+                  - search->timeBase - k;
+        if ( (int64_t)(dropped - search->confirmedDropped) < 0 ) {
+            return 0;
+        }
+        if ( k == index ) {
+            search->confirmedDropped = dropped;
+        }
+        return 1;
+    }
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : REND_iLocate()
+// Description : Finds the last complete packet of the recording on the
+//               card, or gives the one found earlier in the session. The
+//               packet after the last one found is left out unless the
+//               card is full, since recording may have stopped part way
+//               through it
+// Parameters  : DiskSessionType *session - The open device
+//               uint32_t psize - Packet size in bytes
+//               const RecordingEndType **end - The session's recordingEnd
+//                                              on return
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int REND_iLocate(DiskSessionType *session, uint32_t psize,
+                 const RecordingEndType **end) {
+
+    int i, shift, res;
+    uint64_t maxNumPackets, lastPacket, probe;
+    const uint8_t *packet;
+    EndSearchType search;
+    RecordingEndType *found = &session->recordingEnd;
+
+    *end = found;
+    if ( psize == found->packetSize ) {
+        return 0;
+    }
+
+    maxNumPackets = ((session->deviceInfo.sectorCount - 1)
+                     * session->deviceInfo.sectorSize) / psize;
+    if ( maxNumPackets < 2 ) {
+        fprintf(stderr, "The device is too small to hold a recording\n");
+        return -1;
+    }
+    memset(&search, 0, sizeof(search));
+    search.session = session;
+    search.psize = psize;
+    search.buff = DISKIO_pu8AllocBuffer(session, REND_PROBE_BYTES);
+    if ( NULL == search.buff ) {
+        fprintf(stderr, "Error allocating the probe buffer\n");
+        return -2;
+    }
+
+    res = iLoadPacket(&search, 0, 0, &packet);
+    if ( (0 == res) && (START_BYTE_VAL != packet[START_BYTE_IND]) ) {
+        fprintf(stderr, "No start packet found\n");
+        res = -3;
+    }
+    if ( res ) {
+        free(search.buff);
+        return -3;
+    }
+    search.timeBase = PSCAN_u64TimeBaseOf(PSCAN_u32ReadTimestamp(packet), 0);
+
+    // gallop out from packet 0, so every probe is at most twice as far
+    // out as a packet already found to be recorded, and older data is
+    // checked against a dropped count from near the end. Then fix the lower
+    // bits of the last packet's index from the most significant down.
+    // Every later probe is between lastPacket and the current probe plus
+    // its bit, which soon all fits in one block
+    lastPacket = 0;
+    for (shift = 0; ((uint64_t)1 << shift) < maxNumPackets; shift++) {
+        probe = (uint64_t)1 << shift;
+        res = iIsRecorded(&search, probe, lastPacket, maxNumPackets);
+        if ( res < 0 ) {
+            free(search.buff);
+            return -4;
+        }
+        if ( 0 == res ) {
+            break;
+        }
+        lastPacket = probe;
+    }
+    for (i = shift - 2; i >= 0; i--) {
+        probe = lastPacket | ((uint64_t)1 << i);
+        if ( probe >= maxNumPackets ) {
+            continue;
+        }
+        res = iIsRecorded(&search, probe, lastPacket, maxNumPackets);
+        if ( res < 0 ) {
+            free(search.buff);
+            return -4;
+        }
+        if ( res ) {
+            lastPacket = probe;
+        }
+    }
+
+    // a start byte right after the end is what an older recording left
+    found->olderDataFound = 0;
+    if ( lastPacket + 1 < maxNumPackets ) {
+        if ( iLoadPacket(&search, lastPacket + 1, lastPacket, &packet) ) {
+            free(search.buff);
+            return -4;
+        }
+        found->olderDataFound = (START_BYTE_VAL == packet[START_BYTE_IND]);
+    }
+    if ( lastPacket < maxNumPackets - 1 ) {
+        // card not full, the last recorded packet might not be complete
+        if ( 0 == lastPacket ) {
+            fprintf(stderr, "No complete packets recorded\n");
+            free(search.buff);
+            return -5;
+        }
+        lastPacket--;
+    }
+    if ( iLoadPacket(&search, lastPacket, lastPacket, &packet) ) {
+        free(search.buff);
+        return -4;
+    }
+
+    found->lastPacket = lastPacket;
+    found->firstTimestamp = search.timeBase;
+    found->lastTimestamp = PSCAN_u64Unwrap(PSCAN_u32ReadTimestamp(packet),
+                                           search.timeBase + lastPacket);
+    found->numReads = search.numReads;
+    found->packetSize = psize;
+    free(search.buff);
+
+    return 0;
+
+}
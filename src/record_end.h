@@ -0,0 +1,31 @@
+#ifndef RECORD_END_H
+#define RECORD_END_H
+
+#include <stdint.h>
+#include "diskio_linux.h"
+
+#define REND_PROBE_BYTES (64*1024) // read at each probe of the search
+#define REND_BAD_RUN 8             // packets after a bad probe packet that vouch for it
+
+// Finds the last packet of the recording on a card. The search probes
+// packets 1, 2, 4, ... until one isn't recorded, then fixes the lower bits
+// of the index one at a time. Each probe reads a whole sector-aligned
+// block, and the probes that land close together are answered from the
+// block already read. A probe only counts as recorded if its timestamp fits
+// the packet's place on the card: packets are only ever dropped, so the
+// dropped count (unwrapped timestamp minus time base minus index) never
+// goes down within a recording. Packets left on a reused card by an
+// older, longer recording fail that test once their count is below one
+// already seen, and the search stops at the end of the new recording
+// instead of running on into the old one. Old data whose timestamps are
+// level with or ahead of the new recording's can't be told from the
+// recording carrying on, after a dropout however long, and is taken as
+// part of it. The result is kept in the session's recordingEnd.
+
+//////////////////////////////////////////////////////////////////////////
+//                    Public Function Prototypes
+//////////////////////////////////////////////////////////////////////////
+int REND_iLocate(DiskSessionType *session, uint32_t psize,
+                 const RecordingEndType **end);
+
+#endif // RECORD_END_H
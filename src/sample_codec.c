@@ -0,0 +1,313 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "sample_codec.h"
+#include "sample_writer.h"
+
+#define RICE_ESCAPE 16       // this many ones in a row, then 16 raw bits
+#define MAX_RICE_PARAM 15
+#define PARAM_ZERO_COLUMN 0x80
+#define PARAM_ORDER_SHIFT 4
+#define PARAM_RICE_MASK 0x0F
+#define NUM_ORDERS 3
+
+typedef struct {
+    uint8_t *out;
+    uint64_t acc;
+    uint32_t bits;           // bits waiting in acc, fewer than 32
+} BitWriterType;
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : u16ZigZag()
+// Description : Maps a residual to an unsigned value, small magnitudes
+//               of either sign to small values
+// Parameters  : uint16_t r - Residual, two's complement
+// Returns     : uint16_t - 0, -1, 1, -2 ... become 0, 1, 2, 3 ...
+//////////////////////////////////////////////////////////////////////////
+static inline uint16_t u16ZigZag(uint16_t r) {
+    return (uint16_t)((r << 1) ^ (uint16_t)((int16_t)r >> 15));
+}
+
+static inline uint16_t u16UnZigZag(uint16_t u) {
+    return (uint16_t)((u >> 1) ^ (uint16_t)-(u & 1));
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : u16Predict()
+// Description : Prediction of the next value of a column. Values before
+//               the start of a block count as 0 so blocks stand alone
+// Parameters  : uint32_t order - 0, 1 or 2
+//               uint16_t prev1 - Previous value
+//               uint16_t prev2 - The one before it
+// Returns     : uint16_t - the prediction
+//////////////////////////////////////////////////////////////////////////
+static inline uint16_t u16Predict(uint32_t order, uint16_t prev1, uint16_t prev2) {
+    return (0 == order) ? 0
+           : (1 == order) ? prev1
+           : (uint16_t)(2*prev1 - prev2);
+}
+
+static inline void vPutBits(BitWriterType *bw, uint64_t value, uint32_t numBits) {
+    bw->acc |= value << bw->bits;
+    bw->bits += numBits;
+    if ( bw->bits >= 32 ) {
+        memcpy(bw->out, &bw->acc, 4);
+        bw->out += 4;
+        bw->acc >>= 32;
+        bw->bits -= 32;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : u8ChooseParam()
+// Description : Picks the predictor and Rice parameter of a column by
+//               trying all three predictors over it
+// Parameters  : const int16_t *column - The column
+//               uint32_t n - Number of values
+// Returns     : uint8_t - the parameter byte
+//////////////////////////////////////////////////////////////////////////
+static uint8_t u8ChooseParam(const int16_t *column, uint32_t n) {
+
+    uint64_t cost[NUM_ORDERS] = {0, 0, 0};
+    uint16_t v, prev1 = 0, prev2 = 0;
+    uint32_t i, order, best, k;
+
+    for (i = 0; i < n; i++) {
+        v = (uint16_t)column[i];
+        cost[0] += u16ZigZag(v);
+        cost[1] += u16ZigZag((uint16_t)(v - prev1));
+        cost[2] += u16ZigZag((uint16_t)(v - 2*prev1 + prev2));
+        prev2 = prev1;
+        prev1 = v;
+    }
+    best = 0;
+    for (order = 1; order < NUM_ORDERS; order++) {
+        if ( cost[order] < cost[best] ) {
+            best = order;
+        }
+    }
+    if ( 0 == cost[best] ) {
+        return (uint8_t)(PARAM_ZERO_COLUMN | (best << PARAM_ORDER_SHIFT));
+    }
+    // about log2 of the mean residual
+    for (k = 0; (k < MAX_RICE_PARAM) && (((uint64_t)n << (k + 1)) <= cost[best]); k++);
+
+    return (uint8_t)((best << PARAM_ORDER_SHIFT) | k);
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : CODEC_iInit()
+// Description : Allocates the scratch space for coding blocks
+// Parameters  : CodecType *codec - The codec
+//               uint32_t psize - Number of bytes per packet, even
+//               uint32_t maxPackets - Most packets in a block
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int CODEC_iInit(CodecType *codec, uint32_t psize, uint32_t maxPackets) {
+
+    memset(codec, 0, sizeof(*codec));
+    if ( (0 == psize) || (psize & 1) || (0 == maxPackets) ) {
+        return -1;
+    }
+    codec->psize = psize;
+    codec->maxPackets = maxPackets;
+    codec->columns = malloc((uint64_t)psize * maxPackets);
+    if ( NULL == codec->columns ) {
+        return -2;
+    }
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : CODEC_vFree()
+// Description : Releases the scratch space
+// Parameters  : CodecType *codec - The codec
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+void CODEC_vFree(CodecType *codec) {
+
+    free(codec->columns);
+    memset(codec, 0, sizeof(*codec));
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : CODEC_u64MaxBlockBytes()
+// Description : Room needed for a block however badly it compresses
+// Parameters  : uint32_t psize - Number of bytes per packet
+//               uint32_t numPackets - Packets in the block
+// Returns     : uint64_t - bytes
+//////////////////////////////////////////////////////////////////////////
+uint64_t CODEC_u64MaxBlockBytes(uint32_t psize, uint32_t numPackets) {
+
+    // an escaped value takes 32 bits, the writer stores 4 bytes at a time
+    return sizeof(CodecBlockHeaderType) + psize/2
+           + (uint64_t)psize/2 * numPackets * 4 + 8;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : CODEC_iEncodeBlock()
+// Description : Compresses a run of packets into one block
+// Parameters  : CodecType *codec - The codec
+//               const uint8_t *packets - numPackets packets back to back
+//               uint32_t numPackets - Number of packets, at most maxPackets
+//               uint8_t *block - CODEC_u64MaxBlockBytes() of room
+//               uint64_t *blockBytes - Size of the block on return
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int CODEC_iEncodeBlock(CodecType *codec, const uint8_t *packets,
+                       uint32_t numPackets, uint8_t *block, uint64_t *blockBytes) {
+
+    uint32_t numColumns = codec->psize / 2;
+    uint32_t w, i, order, k;
+    uint16_t v, u, prev1, prev2;
+    uint8_t param;
+    const int16_t *column;
+    CodecBlockHeaderType header;
+    BitWriterType bw;
+
+    if ( (0 == numPackets) || (numPackets > codec->maxPackets) ) {
+        return -1;
+    }
+    SWR_vTransposeWords(packets, codec->psize, numPackets, codec->columns,
+                        codec->maxPackets);
+
+    bw.out = block + sizeof(header) + numColumns;
+    bw.acc = 0;
+    bw.bits = 0;
+    for (w = 0; w < numColumns; w++) {
+        column = codec->columns + (uint64_t)w*codec->maxPackets;
+        param = u8ChooseParam(column, numPackets);
+        block[sizeof(header) + w] = param;
+        if ( param & PARAM_ZERO_COLUMN ) {
+            continue;
+        }
+        order = (param >> PARAM_ORDER_SHIFT) & 0x03;
+        k = param & PARAM_RICE_MASK;
+        prev1 = 0;
+        prev2 = 0;
+        for (i = 0; i < numPackets; i++) {
+            v = (uint16_t)column[i];
+            u = u16ZigZag((uint16_t)(v - u16Predict(order, prev1, prev2)));
+            prev2 = prev1;
+            prev1 = v;
+            if ( (u >> k) < RICE_ESCAPE ) {
+                // (u >> k) ones, a zero, then the low k bits
+                vPutBits(&bw, (((uint64_t)1 << (u >> k)) - 1)
+                              | ((uint64_t)(u & ((1u << k) - 1)) << ((u >> k) + 1)),
+                         (u >> k) + 1 + k);
+            }
+            else {
+                vPutBits(&bw, ((uint64_t)1 << RICE_ESCAPE) - 1, RICE_ESCAPE);
+                vPutBits(&bw, u, 16);
+            }
+        }
+    }
+    if ( bw.bits ) {
+        memcpy(bw.out, &bw.acc, (bw.bits + 7) / 8);
+        bw.out += (bw.bits + 7) / 8;
+    }
+
+    header.blockBytes = (uint32_t)(bw.out - block);
+    header.numPackets = numPackets;
+    memcpy(block, &header, sizeof(header));
+    *blockBytes = header.blockBytes;
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : CODEC_iDecodeBlock()
+// Description : Restores the packets of one block
+// Parameters  : CodecType *codec - The codec
+//               const uint8_t *block - The block, followed by at least
+//                                      CODEC_READ_SLACK readable bytes
+//               uint64_t blockBytes - Bytes available at block
+//               uint8_t *packets - Room for maxPackets packets
+//               uint32_t *numPackets - Packets restored, on return
+// Returns     : int - 0 if success, negative value if the block is
+//               damaged
+//////////////////////////////////////////////////////////////////////////
+int CODEC_iDecodeBlock(CodecType *codec, const uint8_t *block, uint64_t blockBytes,
+                       uint8_t *packets, uint32_t *numPackets) {
+
+    uint32_t numColumns = codec->psize / 2;
+    uint32_t w, i, n, order, k, q;
+    uint16_t v, u, prev1, prev2;
+    uint64_t pos, endPos, window;
+    uint8_t param;
+    const uint8_t *stream;
+    int16_t *column;
+    CodecBlockHeaderType header;
+
+    if ( blockBytes < sizeof(header) + numColumns ) {
+        return -1;
+    }
+    memcpy(&header, block, sizeof(header));
+    n = header.numPackets;
+    if ( (header.blockBytes > blockBytes)
+         || (header.blockBytes < sizeof(header) + numColumns)
+         || (0 == n) || (n > codec->maxPackets) ) {
+        return -1;
+    }
+    stream = block + sizeof(header) + numColumns;
+    endPos = 8 * (uint64_t)(header.blockBytes - sizeof(header) - numColumns);
+
+    pos = 0;
+    for (w = 0; w < numColumns; w++) {
+        column = codec->columns + (uint64_t)w*codec->maxPackets;
+        param = block[sizeof(header) + w];
+        order = (param >> PARAM_ORDER_SHIFT) & 0x03;
+        k = param & PARAM_RICE_MASK;
+        if ( order >= NUM_ORDERS ) {
+            return -2;
+        }
+        prev1 = 0;
+        prev2 = 0;
+        for (i = 0; i < n; i++) {
+            u = 0;
+            if ( !(param & PARAM_ZERO_COLUMN) ) {
+                if ( pos >= endPos ) {
+                    return -3;
+                }
+                memcpy(&window, stream + (pos >> 3), sizeof(window));
+                window >>= (pos & 7);
+                q = (uint32_t)__builtin_ctzll(~window);
+                if ( q < RICE_ESCAPE ) {
+                    u = (uint16_t)(((uint32_t)q << k)
+                                   | ((window >> (q + 1)) & ((1u << k) - 1)));
+                    pos += q + 1 + k;
+                }
+                else {
+                    u = (uint16_t)(window >> RICE_ESCAPE);
+                    pos += RICE_ESCAPE + 16;
+                }
+            }
+            v = (uint16_t)(u16Predict(order, prev1, prev2) + u16UnZigZag(u));
+            column[i] = (int16_t)v;
+            prev2 = prev1;
+            prev1 = v;
+        }
+    }
+    if ( pos > endPos ) {
+        return -3;
+    }
+
+    // back to packets
+    for (i = 0; i < n; i++) {
+        for (w = 0; w < numColumns; w++) {
+            memcpy(packets + (uint64_t)i*codec->psize + 2*w,
+                   &codec->columns[(uint64_t)w*codec->maxPackets + i], 2);
+        }
+    }
+    *numPackets = n;
+
+    return 0;
+
+}
@@ -0,0 +1,60 @@
+#ifndef SAMPLE_CODEC_H
+#define SAMPLE_CODEC_H
+
+#include <stdint.h>
+
+#define CODEC_MAGIC "SDCODEC1"
+#define CODEC_READ_SLACK 8   // readable bytes needed after a block to decode it
+
+// Lossless codec for extracted packets. A compressed file is a
+// CodecFileHeaderType, numChannels uint16 channel ids, then blocks that
+// each decode on their own. A block is a CodecBlockHeaderType, one
+// parameter byte per 16 bit word of the packet, then a bit stream.
+// Every word position of the packet (header words included) is a column,
+// coded with the best of three predictors (0, previous value, linear
+// from the previous two) and Rice coded residuals. The parameter byte
+// holds the Rice parameter in bits 0-3, the predictor order in bits 4-5,
+// and bit 7 set if every residual of the column is 0 and nothing is
+// stored for it. Values are little endian, the bit stream is filled from
+// the least significant bit of each byte.
+
+//////////////////////////////////////////////////////////////////////////
+//                      Public Data Types
+//////////////////////////////////////////////////////////////////////////
+typedef struct {
+    char magic[8];
+    uint32_t psize;         // bytes per decoded packet
+    uint32_t blockPackets;  // packets in every block but the last
+    uint64_t numPackets;    // filled in when the file is closed
+    uint64_t numBlocks;     // filled in when the file is closed
+    uint32_t numChannels;
+    uint32_t reserved;
+} CodecFileHeaderType;
+
+typedef struct {
+    uint32_t blockBytes;    // the whole block, this header included
+    uint32_t numPackets;
+} CodecBlockHeaderType;
+
+typedef struct {
+    uint32_t psize;
+    uint32_t maxPackets;
+    int16_t *columns;       // psize/2 rows of maxPackets, scratch
+} CodecType;
+
+//////////////////////////////////////////////////////////////////////////
+//                    Public Function Prototypes
+//////////////////////////////////////////////////////////////////////////
+int CODEC_iInit(CodecType *codec, uint32_t psize, uint32_t maxPackets);
+
+void CODEC_vFree(CodecType *codec);
+
+uint64_t CODEC_u64MaxBlockBytes(uint32_t psize, uint32_t numPackets);
+
+int CODEC_iEncodeBlock(CodecType *codec, const uint8_t *packets,
+                       uint32_t numPackets, uint8_t *block, uint64_t *blockBytes);
+
+int CODEC_iDecodeBlock(CodecType *codec, const uint8_t *block, uint64_t blockBytes,
+                       uint8_t *packets, uint32_t *numPackets);
+
+#endif // SAMPLE_CODEC_H
@@ -0,0 +1,944 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sample_writer.h"
+#include "sample_codec.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SWR_HAVE_X86 1
+#endif
+
+#define TILE_PACKETS 128  // packets transposed together, kept in cache
+#define CHANNEL_FNAME_SUFFIX_LENGTH 16  // room for "_chNNN.i16" or ".hdr"
+
+// copies 16 bit words [0, numChannels) of packets [0, numPackets) into
+// rows of dst, dstStride words apart. packets points at the first word
+typedef void (*TransposeKernelFuncType)(const uint8_t *packets, uint32_t psize,
+                                        uint64_t numPackets, uint32_t numChannels,
+                                        int16_t *dst, uint64_t dstStride);
+
+struct SampleWriter {
+    SampleFormatType format;
+    uint32_t psize;
+    uint32_t numChannels;
+    uint16_t channelId[CFG_MAX_CHANNELS];
+    FILE *fpHeaders;
+    FILE *fpData;           // blocked or compressed file
+    FILE **fpChannels;
+    int16_t *samples;       // numChannels rows of SWR_BLOCK_PACKETS
+    uint8_t *headers;       // SWR_BLOCK_PACKETS packet headers
+    uint64_t fill;          // packets in the current block
+    uint64_t numPackets;
+    // compressed format
+    CodecType codec;
+    uint8_t *packets;       // SWR_BLOCK_PACKETS packets waiting to be coded
+    uint8_t *block;
+    uint64_t numBlocks;
+    // npy format
+    FILE *fpTimestamps;
+    uint64_t *timestamps;   // SWR_BLOCK_PACKETS unwrapped timestamps
+    int haveTimeBase;
+    uint64_t timeBase;      // expected time of the first packet written
+};
+
+// copies the header and the selected samples of packets [0, numPackets)
+// into packets of CFG_HEADER_BYTES + 2*numChannels bytes at dst. dst may
+// be packets itself, the packets are done in order and nothing is written
+// ahead of what has been read
+typedef void (*GatherKernelFuncType)(const uint8_t *packets, uint32_t psize,
+                                     uint64_t numPackets,
+                                     const ChannelSelectType *select, uint8_t *dst);
+
+static TransposeKernelFuncType transposeKernel = NULL;
+static GatherKernelFuncType gatherKernel = NULL;
+static const char *transposeKernelName = "none";
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : vTransposeRange()
+// Description : Scalar transpose of packets [start, numPackets), channels
+//               [firstChannel, numChannels). Also used by the vector
+//               kernels for the edges that don't fill a whole tile
+// Parameters  : See TransposeKernelFuncType, plus
+//               uint64_t start - First packet to copy
+//               uint32_t firstChannel - First channel to copy
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+static void vTransposeRange(const uint8_t *packets, uint32_t psize,
+                            uint64_t start, uint64_t numPackets,
+                            uint32_t firstChannel, uint32_t numChannels,
+                            int16_t *dst, uint64_t dstStride) {
+
+    const uint8_t *sample;
+    uint64_t i;
+    uint32_t c;
+
+    for (i = start; i < numPackets; i++) {
+        sample = packets + i*psize + firstChannel*CFG_SAMPLE_BYTES;
+        for (c = firstChannel; c < numChannels; c++) {
+            memcpy(&dst[c*dstStride + i], sample, CFG_SAMPLE_BYTES);
+            sample += CFG_SAMPLE_BYTES;
+        }
+    }
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : vTransposeScalar()
+// Description : Portable kernel, one sample at a time
+// Parameters  : See TransposeKernelFuncType
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+static void vTransposeScalar(const uint8_t *packets, uint32_t psize,
+                             uint64_t numPackets, uint32_t numChannels,
+                             int16_t *dst, uint64_t dstStride) {
+
+    vTransposeRange(packets, psize, 0, numPackets, 0, numChannels, dst, dstStride);
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : vGatherRange()
+// Description : Copies the selected samples of one packet from selected
+//               channel firstChannel on. Also does the channels left over
+//               after the last whole vector for the AVX2 kernel
+// Parameters  : const uint8_t *packet - The packet
+//               const ChannelSelectType *select - Slots to copy
+//               uint32_t firstChannel - First selected channel to copy
+//               uint8_t *dst - The packet with only the selected samples
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+static void vGatherRange(const uint8_t *packet, const ChannelSelectType *select,
+                         uint32_t firstChannel, uint8_t *dst) {
+
+    const uint8_t *samples = packet + CFG_HEADER_BYTES;
+    uint32_t c;
+
+    dst += CFG_HEADER_BYTES;
+    for (c = firstChannel; c < select->numChannels; c++) {
+        memmove(dst + c*CFG_SAMPLE_BYTES, samples + select->slot[c]*CFG_SAMPLE_BYTES,
+                CFG_SAMPLE_BYTES);
+    }
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : vGatherScalar()
+// Description : Portable kernel, one sample at a time
+// Parameters  : See GatherKernelFuncType
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+static void vGatherScalar(const uint8_t *packets, uint32_t psize,
+                          uint64_t numPackets, const ChannelSelectType *select,
+                          uint8_t *dst) {
+
+    uint32_t outSize = CFG_HEADER_BYTES + select->numChannels*CFG_SAMPLE_BYTES;
+    uint64_t i;
+
+    for (i = 0; i < numPackets; i++) {
+        memmove(dst + i*outSize, packets + i*psize, CFG_HEADER_BYTES);
+        vGatherRange(packets + i*psize, select, 0, dst + i*outSize);
+    }
+
+}
+
+#ifdef SWR_HAVE_X86
+//////////////////////////////////////////////////////////////////////////
+// Function    : vTransposeSse2()
+// Description : SSE2 kernel. An 8 packet by 8 channel tile is eight 16
+//               byte loads, a 3 level unpack network and eight 16 byte
+//               stores. Packets are taken TILE_PACKETS at a time so they
+//               stay in cache while every channel of them is done, and each
+//               channel row is written in TILE_PACKETS sample runs
+// Parameters  : See TransposeKernelFuncType
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+__attribute__((target("sse2")))
+static void vTransposeSse2(const uint8_t *packets, uint32_t psize,
+                           uint64_t numPackets, uint32_t numChannels,
+                           int16_t *dst, uint64_t dstStride) {
+
+    const uint8_t *p;
+    uint64_t tile, tileEnd, i, vecPackets = numPackets & ~(uint64_t)7;
+    uint32_t c, k, vecChannels = numChannels & ~7u;
+    __m128i r[8], a[8], b[8];
+
+    for (tile = 0; tile < vecPackets; tile = tileEnd) {
+        tileEnd = tile + TILE_PACKETS;
+        if ( tileEnd > vecPackets ) {
+            tileEnd = vecPackets;
+        }
+        for (c = 0; c < vecChannels; c += 8) {
+            for (i = tile; i < tileEnd; i += 8) {
+                p = packets + i*psize + c*CFG_SAMPLE_BYTES;
+                for (k = 0; k < 8; k++) {
+                    r[k] = _mm_loadu_si128((const __m128i *)(p + k*psize));
+                }
+                for (k = 0; k < 4; k++) {
+                    a[2*k] = _mm_unpacklo_epi16(r[2*k], r[2*k + 1]);
+                    a[2*k + 1] = _mm_unpackhi_epi16(r[2*k], r[2*k + 1]);
+                }
+                b[0] = _mm_unpacklo_epi32(a[0], a[2]);
+                b[1] = _mm_unpackhi_epi32(a[0], a[2]);
+                b[2] = _mm_unpacklo_epi32(a[1], a[3]);
+                b[3] = _mm_unpackhi_epi32(a[1], a[3]);
+                b[4] = _mm_unpacklo_epi32(a[4], a[6]);
+                b[5] = _mm_unpackhi_epi32(a[4], a[6]);
+                b[6] = _mm_unpacklo_epi32(a[5], a[7]);
+                b[7] = _mm_unpackhi_epi32(a[5], a[7]);
+                for (k = 0; k < 4; k++) {
+                    _mm_storeu_si128((__m128i *)&dst[(c + 2*k)*dstStride + i],
+                                     _mm_unpacklo_epi64(b[k], b[k + 4]));
+                    _mm_storeu_si128((__m128i *)&dst[(c + 2*k + 1)*dstStride + i],
+                                     _mm_unpackhi_epi64(b[k], b[k + 4]));
+                }
+            }
+        }
+        vTransposeRange(packets, psize, tile, tileEnd, vecChannels, numChannels,
+                        dst, dstStride);
+    }
+
+    vTransposeRange(packets, psize, vecPackets, numPackets, 0, numChannels,
+                    dst, dstStride);
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : vTransposeAvx2()
+// Description : AVX2 kernel. Same tiling and unpack network as SSE2, with
+//               packets i and i+8 sharing a register so each store writes
+//               16 samples of one channel
+// Parameters  : See TransposeKernelFuncType
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+__attribute__((target("avx2")))
+static void vTransposeAvx2(const uint8_t *packets, uint32_t psize,
+                           uint64_t numPackets, uint32_t numChannels,
+                           int16_t *dst, uint64_t dstStride) {
+
+    const uint8_t *p;
+    uint64_t tile, tileEnd, i, vecPackets = numPackets & ~(uint64_t)15;
+    uint32_t c, k, vecChannels = numChannels & ~7u;
+    __m256i r[8], a[8], b[8];
+
+    for (tile = 0; tile < vecPackets; tile = tileEnd) {
+        tileEnd = tile + TILE_PACKETS;
+        if ( tileEnd > vecPackets ) {
+            tileEnd = vecPackets;
+        }
+        for (c = 0; c < vecChannels; c += 8) {
+            for (i = tile; i < tileEnd; i += 16) {
+                p = packets + i*psize + c*CFG_SAMPLE_BYTES;
+                for (k = 0; k < 8; k++) {
+                    r[k] = _mm256_inserti128_si256(
+                               _mm256_castsi128_si256(
+                                   _mm_loadu_si128((const __m128i *)(p + k*psize))),
+                               _mm_loadu_si128((const __m128i *)(p + (k + 8)*psize)), 1);
+                }
+                for (k = 0; k < 4; k++) {
+                    a[2*k] = _mm256_unpacklo_epi16(r[2*k], r[2*k + 1]);
+                    a[2*k + 1] = _mm256_unpackhi_epi16(r[2*k], r[2*k + 1]);
+                }
+                b[0] = _mm256_unpacklo_epi32(a[0], a[2]);
+                b[1] = _mm256_unpackhi_epi32(a[0], a[2]);
+                b[2] = _mm256_unpacklo_epi32(a[1], a[3]);
+                b[3] = _mm256_unpackhi_epi32(a[1], a[3]);
+                b[4] = _mm256_unpacklo_epi32(a[4], a[6]);
+                b[5] = _mm256_unpackhi_epi32(a[4], a[6]);
+                b[6] = _mm256_unpacklo_epi32(a[5], a[7]);
+                b[7] = _mm256_unpackhi_epi32(a[5], a[7]);
+                for (k = 0; k < 4; k++) {
+                    _mm256_storeu_si256((__m256i *)&dst[(c + 2*k)*dstStride + i],
+                                        _mm256_unpacklo_epi64(b[k], b[k + 4]));
+                    _mm256_storeu_si256((__m256i *)&dst[(c + 2*k + 1)*dstStride + i],
+                                        _mm256_unpackhi_epi64(b[k], b[k + 4]));
+                }
+            }
+        }
+        vTransposeRange(packets, psize, tile, tileEnd, vecChannels, numChannels,
+                        dst, dstStride);
+    }
+
+    vTransposeSse2(packets + vecPackets*psize, psize, numPackets - vecPackets,
+                   numChannels, dst + vecPackets, dstStride);
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : vGatherAvx2()
+// Description : AVX2 kernel. Gathers 8 selected samples per instruction.
+//               Each lane loads the 32 bit word ending with its sample, 
+//               which never reaches past the packet, and the high halves
+//               are packed into one 16 byte store
+// Parameters  : See GatherKernelFuncType
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+__attribute__((target("avx2")))
+static void vGatherAvx2(const uint8_t *packets, uint32_t psize,
+                        uint64_t numPackets, const ChannelSelectType *select,
+                        uint8_t *dst) {
+
+    int32_t offsets[CFG_MAX_CHANNELS];
+    uint32_t outSize = CFG_HEADER_BYTES + select->numChannels*CFG_SAMPLE_BYTES;
+    uint32_t c, vecChannels = select->numChannels & ~7u;
+    uint64_t i;
+    const uint8_t *packet;
+    uint8_t *out;
+    __m256i v;
+
+    for (c = 0; c < vecChannels; c++) {
+        offsets[c] = CFG_HEADER_BYTES + select->slot[c]*CFG_SAMPLE_BYTES - 2;
+    }
+    for (i = 0; i < numPackets; i++) {
+        packet = packets + i*psize;
+        out = dst + i*outSize;
+        // a store never reaches a sample still to be loaded, so this
+        // works in place
+        memmove(out, packet, CFG_HEADER_BYTES);
+        for (c = 0; c < vecChannels; c += 8) {
+            v = _mm256_i32gather_epi32((const int *)packet,
+                    _mm256_loadu_si256((const __m256i *)&offsets[c]), 1);
+            v = _mm256_srli_epi32(v, 16);
+            v = _mm256_permute4x64_epi64(_mm256_packus_epi32(v, v), 0x08);
+            _mm_storeu_si128((__m128i *)(out + CFG_HEADER_BYTES + c*CFG_SAMPLE_BYTES),
+                             _mm256_castsi256_si128(v));
+        }
+        vGatherRange(packet, select, vecChannels, out);
+    }
+
+}
+#endif // SWR_HAVE_X86
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : SWR_iSelectKernel()
+// Description : Picks the transpose and gather kernels, AUTO takes the
+//               fastest ones the CPU supports. SSE2 has no gather, so it
+//               gathers with the scalar kernel
+// Parameters  : PacketScanKernelType kernel - Kernel to use
+// Returns     : int - 0 if success, negative value if the CPU or build
+//               doesn't support the kernel
+//////////////////////////////////////////////////////////////////////////
+int SWR_iSelectKernel(PacketScanKernelType kernel) {
+
+    switch (kernel) {
+        case PSCAN_KERNEL_AUTO:
+#ifdef SWR_HAVE_X86
+            if ( 0 == SWR_iSelectKernel(PSCAN_KERNEL_AVX2) ) {
+                return 0;
+            }
+            if ( 0 == SWR_iSelectKernel(PSCAN_KERNEL_SSE2) ) {
+                return 0;
+            }
+#endif
+            return SWR_iSelectKernel(PSCAN_KERNEL_SCALAR);
+        case PSCAN_KERNEL_SCALAR:
+            gatherKernel = vGatherScalar;
+            transposeKernel = vTransposeScalar;
+            transposeKernelName = "scalar";
+            return 0;
+#ifdef SWR_HAVE_X86
+        case PSCAN_KERNEL_SSE2:
+            __builtin_cpu_init();
+            if ( !__builtin_cpu_supports("sse2") ) {
+                return -1;
+            }
+            gatherKernel = vGatherScalar;
+            transposeKernel = vTransposeSse2;
+            transposeKernelName = "sse2";
+            return 0;
+        case PSCAN_KERNEL_AVX2:
+            __builtin_cpu_init();
+            if ( !__builtin_cpu_supports("avx2") ) {
+                return -1;
+            }
+            gatherKernel = vGatherAvx2;
+            transposeKernel = vTransposeAvx2;
+            transposeKernelName = "avx2";
+            return 0;
+#endif
+        default:
+            return -1;
+    }
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : SWR_pcKernelName()
+// Description : Name of the kernels in use, for log output
+// Parameters  : none
+// Returns     : const char * - the name
+//////////////////////////////////////////////////////////////////////////
+const char *SWR_pcKernelName(void) {
+
+    if ( NULL == transposeKernel ) {
+        SWR_iSelectKernel(PSCAN_KERNEL_AUTO);
+    }
+
+    return transposeKernelName;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : SWR_vTranspose()
+// Description : Splits the samples of a run of packets into one row per
+//               packet slot
+// Parameters  : const uint8_t *packets - numPackets packets back to back
+//               uint32_t psize - Number of bytes per packet
+//               uint64_t numPackets - Number of packets
+//               uint32_t numChannels - Samples per packet
+//               int16_t *dst - Row of the first channel, sample of the
+//                              first packet
+//               uint64_t dstStride - Samples from one row to the next
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+void SWR_vTranspose(const uint8_t *packets, uint32_t psize, uint64_t numPackets,
+                    uint32_t numChannels, int16_t *dst, uint64_t dstStride) {
+
+    if ( NULL == transposeKernel ) {
+        SWR_iSelectKernel(PSCAN_KERNEL_AUTO);
+    }
+    transposeKernel(packets + CFG_HEADER_BYTES, psize, numPackets, numChannels,
+                    dst, dstStride);
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : SWR_vTransposeWords()
+// Description : Splits whole packets, header included, into one row per
+//               16 bit word
+// Parameters  : const uint8_t *packets - numPackets packets back to back
+//               uint32_t psize - Number of bytes per packet, even
+//               uint64_t numPackets - Number of packets
+//               int16_t *dst - Row of the first word
+//               uint64_t dstStride - Words from one row to the next
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+void SWR_vTransposeWords(const uint8_t *packets, uint32_t psize, uint64_t numPackets,
+                         int16_t *dst, uint64_t dstStride) {
+
+    if ( NULL == transposeKernel ) {
+        SWR_iSelectKernel(PSCAN_KERNEL_AUTO);
+    }
+    transposeKernel(packets, psize, numPackets, psize / CFG_SAMPLE_BYTES,
+                    dst, dstStride);
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : SWR_vGather()
+// Description : Cuts packets down to their header and selected channels
+// Parameters  : const uint8_t *packets - numPackets packets back to back
+//               uint32_t psize - Number of bytes per packet
+//               uint64_t numPackets - Number of packets
+//               const ChannelSelectType *select - Slots to keep
+//               uint8_t *dst - Where the cut down packets go, may be
+//                              packets itself
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+void SWR_vGather(const uint8_t *packets, uint32_t psize, uint64_t numPackets,
+                 const ChannelSelectType *select, uint8_t *dst) {
+
+    if ( NULL == gatherKernel ) {
+        SWR_iSelectKernel(PSCAN_KERNEL_AUTO);
+    }
+    gatherKernel(packets, psize, numPackets, select, dst);
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : SWR_iParseFormat()
+// Description : Reads an output format name from the command line
+// Parameters  : const char *name - packets, channels, blocked,
+//                                 compressed, container or npy
+//               SampleFormatType *format - The format
+// Returns     : int - 0 if success, negative value if the name is unknown
+//////////////////////////////////////////////////////////////////////////
+int SWR_iParseFormat(const char *name, SampleFormatType *format) {
+
+    if ( 0 == strcmp(name, "packets") ) {
+        *format = SWR_FORMAT_PACKETS;
+    }
+    else if ( 0 == strcmp(name, "channels") ) {
+        *format = SWR_FORMAT_CHANNELS;
+    }
+    else if ( 0 == strcmp(name, "blocked") ) {
+        *format = SWR_FORMAT_BLOCKED;
+    }
+    else if ( 0 == strcmp(name, "compressed") ) {
+        *format = SWR_FORMAT_COMPRESSED;
+    }
+    else if ( 0 == strcmp(name, "container") ) {
+        *format = SWR_FORMAT_CONTAINER;
+    }
+    else if ( 0 == strcmp(name, "npy") ) {
+        *format = SWR_FORMAT_NPY;
+    }
+    else {
+        return -1;
+    }
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : fpOpenDerived()
+// Description : Opens PATH followed by a suffix for writing
+// Parameters  : const char *path - Output path given by the user
+//               const char *suffix - Appended to path
+// Returns     : FILE * - the open file, NULL on error
+//////////////////////////////////////////////////////////////////////////
+static FILE *fpOpenDerived(const char *path, const char *suffix) {
+
+    char *fname;
+    size_t length = strlen(path) + strlen(suffix) + 1;
+    FILE *fp;
+
+    fname = malloc(length);
+    if ( NULL == fname ) {
+        return NULL;
+    }
+    snprintf(fname, length, "%s%s", path, suffix);
+    fp = fopen(fname, "w");
+    if ( NULL == fp ) {
+        fprintf(stderr, "Error opening file %s to extract data to!\n", fname);
+    }
+    free(fname);
+
+    return fp;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iWriteNpyHeader()
+// Description : Writes a version 1.0 .npy header at the start of a file,
+//               padded to SWR_NPY_HEADER_BYTES so it can be rewritten with
+//               the final shape once the data is in
+// Parameters  : FILE *fp - The .npy file
+//               const char *descr - NumPy dtype, e.g. <i2
+//               uint64_t numRows - First dimension
+//               uint32_t numColumns - Second dimension, 0 for a 1-d array
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+static int iWriteNpyHeader(FILE *fp, const char *descr, uint64_t numRows,
+                           uint32_t numColumns) {
+
+    char header[SWR_NPY_HEADER_BYTES + 1];
+    char shape[48];
+    uint16_t dictBytes = SWR_NPY_HEADER_BYTES - 10;
+    int length;
+
+    if ( numColumns ) {
+        snprintf(shape, sizeof(shape), "(%llu, %u)", (long long unsigned)numRows,
+                 (unsigned)numColumns);
+    }
+    else {
+        snprintf(shape, sizeof(shape), "(%llu,)", (long long unsigned)numRows);
+    }
+    memcpy(header, "\x93NUMPY\x01\x00", 8);
+    header[8] = (char)(dictBytes & 0xFF);
+    header[9] = (char)(dictBytes >> 8);
+    length = snprintf(header + 10, sizeof(header) - 10,
+                      "{'descr': '%s', 'fortran_order': False, 'shape': %s, }",
+                      descr, shape);
+    if ( (length < 0) || (length >= dictBytes) ) {
+        return -1;
+    }
+    // spaces up to the newline that ends the header
+    memset(header + 10 + length, ' ', dictBytes - length - 1);
+    header[SWR_NPY_HEADER_BYTES - 1] = '\n';
+    if ( fseeko(fp, 0, SEEK_SET)
+         || (fwrite(header, 1, SWR_NPY_HEADER_BYTES, fp) != SWR_NPY_HEADER_BYTES) ) {
+        return -2;
+    }
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iFlushBlock()
+// Description : Writes out the packets transposed, or held for coding,
+//               so far
+// Parameters  : SampleWriterType *writer - The writer
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+static int iFlushBlock(SampleWriterType *writer) {
+
+    uint64_t n = writer->fill;
+    uint64_t blockBytes;
+    uint32_t c;
+
+    if ( 0 == n ) {
+        return 0;
+    }
+    if ( SWR_FORMAT_COMPRESSED == writer->format ) {
+        if ( CODEC_iEncodeBlock(&writer->codec, writer->packets, (uint32_t)n,
+                                writer->block, &blockBytes) ) {
+            fprintf(stderr, "Error compressing block %llu\n",
+                    (long long unsigned)writer->numBlocks);
+            return -3;
+        }
+        if ( fwrite(writer->block, 1, blockBytes, writer->fpData) != blockBytes ) {
+            fprintf(stderr, "Error writing compressed block\n");
+            return -2;
+        }
+        ++writer->numBlocks;
+        writer->fill = 0;
+        return 0;
+    }
+    if ( SWR_FORMAT_NPY == writer->format ) {
+        if ( (fwrite(writer->samples, CFG_SAMPLE_BYTES, n*writer->numChannels,
+                     writer->fpData) != n*writer->numChannels)
+             || (fwrite(writer->timestamps, sizeof(uint64_t), n,
+                        writer->fpTimestamps) != n) ) {
+            fprintf(stderr, "Error writing .npy samples\n");
+            return -2;
+        }
+        writer->fill = 0;
+        return 0;
+    }
+
+    if ( fwrite(writer->headers, CFG_HEADER_BYTES, n, writer->fpHeaders) != n ) {
+        fprintf(stderr, "Error writing packet headers\n");
+        return -1;
+    }
+
+    if ( (SWR_FORMAT_BLOCKED == writer->format) && (SWR_BLOCK_PACKETS == n) ) {
+        // rows are back to back, the whole block goes in one write
+        if ( fwrite(writer->samples, CFG_SAMPLE_BYTES, n*writer->numChannels,
+                    writer->fpData) != n*writer->numChannels ) {
+            fprintf(stderr, "Error writing channel block\n");
+            return -2;
+        }
+    }
+    else {
+        for (c = 0; c < writer->numChannels; c++) {
+            if ( fwrite(writer->samples + (uint64_t)c*SWR_BLOCK_PACKETS,
+                        CFG_SAMPLE_BYTES, n,
+                        (SWR_FORMAT_BLOCKED == writer->format)
+                        ? writer->fpData : writer->fpChannels[c]) != n ) {
+                fprintf(stderr, "Error writing samples of channel %u\n",
+                        (unsigned)writer->channelId[c]);
+                return -2;
+            }
+        }
+    }
+    writer->fill = 0;
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : SWR_iOpen()
+// Description : Creates the output files of a channel-major, compressed
+//               or npy format
+// Parameters  : SampleWriterType **writerPtr - The new writer
+//               SampleFormatType format - channels, blocked, compressed or
+//                                         npy
+//               const char *path - Output path given by the user
+//               uint32_t psize - Number of bytes per packet
+//               const ChannelMapType *map - Channels in the packets
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int SWR_iOpen(SampleWriterType **writerPtr, SampleFormatType format,
+              const char *path, uint32_t psize, const ChannelMapType *map) {
+
+    char suffix[CHANNEL_FNAME_SUFFIX_LENGTH];
+    char *base;
+    size_t length;
+    uint32_t c;
+    BlockedFileHeaderType header;
+    CodecFileHeaderType codecHeader;
+    SampleWriterType *writer;
+
+    *writerPtr = NULL;
+    if ( (SWR_FORMAT_PACKETS == format) || (CFG_u32PacketSize(map) != psize) ) {
+        return -1;
+    }
+    writer = calloc(1, sizeof(*writer));
+    if ( NULL == writer ) {
+        return -2;
+    }
+    writer->format = format;
+    writer->psize = psize;
+    writer->numChannels = map->numChannels;
+    memcpy(writer->channelId, map->channelId, sizeof(writer->channelId));
+    *writerPtr = writer;
+
+    if ( SWR_FORMAT_COMPRESSED == format ) {
+        writer->packets = malloc((uint64_t)SWR_BLOCK_PACKETS * psize);
+        writer->block = malloc(CODEC_u64MaxBlockBytes(psize, SWR_BLOCK_PACKETS));
+        if ( (NULL == writer->packets) || (NULL == writer->block)
+             || CODEC_iInit(&writer->codec, psize, SWR_BLOCK_PACKETS) ) {
+            return -2;
+        }
+        writer->fpData = fopen(path, "w");
+        if ( NULL == writer->fpData ) {
+            fprintf(stderr, "Error opening file %s to extract data to!\n", path);
+            return -3;
+        }
+        // the counts are patched in on close
+        memset(&codecHeader, 0, sizeof(codecHeader));
+        memcpy(codecHeader.magic, CODEC_MAGIC, sizeof(codecHeader.magic));
+        codecHeader.psize = psize;
+        codecHeader.blockPackets = SWR_BLOCK_PACKETS;
+        codecHeader.numChannels = map->numChannels;
+        if ( (fwrite(&codecHeader, sizeof(codecHeader), 1, writer->fpData) != 1)
+             || (fwrite(map->channelId, sizeof(map->channelId[0]), map->numChannels,
+                        writer->fpData) != map->numChannels) ) {
+            fprintf(stderr, "Error writing header of %s\n", path);
+            return -4;
+        }
+        return 0;
+    }
+
+    writer->samples = malloc((uint64_t)map->numChannels * SWR_BLOCK_PACKETS
+                             * CFG_SAMPLE_BYTES);
+    if ( SWR_FORMAT_NPY == format ) {
+        writer->timestamps = malloc(SWR_BLOCK_PACKETS * sizeof(uint64_t));
+        if ( (NULL == writer->samples) || (NULL == writer->timestamps) ) {
+            return -2;
+        }
+        writer->fpData = fopen(path, "w");
+        if ( NULL == writer->fpData ) {
+            fprintf(stderr, "Error opening file %s to extract data to!\n", path);
+            return -3;
+        }
+        // rec.npy gets rec_ts.npy
+        length = strlen(path);
+        base = strdup(path);
+        if ( NULL == base ) {
+            return -2;
+        }
+        if ( (length > 4) && (0 == strcmp(path + length - 4, ".npy")) ) {
+            base[length - 4] = '\0';
+        }
+        writer->fpTimestamps = fpOpenDerived(base, "_ts.npy");
+        free(base);
+        if ( NULL == writer->fpTimestamps ) {
+            return -3;
+        }
+        // the shapes are patched in on close
+        if ( iWriteNpyHeader(writer->fpData, "<i2", 0, map->numChannels)
+             || iWriteNpyHeader(writer->fpTimestamps, "<u8", 0, 0) ) {
+            fprintf(stderr, "Error writing header of %s\n", path);
+            return -4;
+        }
+        return 0;
+    }
+    writer->headers = malloc((uint64_t)SWR_BLOCK_PACKETS * CFG_HEADER_BYTES);
+    if ( (NULL == writer->samples) || (NULL == writer->headers) ) {
+        return -2;
+    }
+
+    writer->fpHeaders = fpOpenDerived(path, ".hdr");
+    if ( NULL == writer->fpHeaders ) {
+        return -3;
+    }
+    if ( SWR_FORMAT_BLOCKED == format ) {
+        writer->fpData = fopen(path, "w");
+        if ( NULL == writer->fpData ) {
+            fprintf(stderr, "Error opening file %s to extract data to!\n", path);
+            return -3;
+        }
+        // numPackets is patched in on close
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, SWR_BLOCKED_MAGIC, sizeof(header.magic));
+        header.numChannels = map->numChannels;
+        header.blockPackets = SWR_BLOCK_PACKETS;
+        if ( (fwrite(&header, sizeof(header), 1, writer->fpData) != 1)
+             || (fwrite(map->channelId, sizeof(map->channelId[0]), map->numChannels,
+                        writer->fpData) != map->numChannels) ) {
+            fprintf(stderr, "Error writing header of %s\n", path);
+            return -4;
+        }
+    }
+    else {
+        writer->fpChannels = calloc(map->numChannels, sizeof(FILE *));
+        if ( NULL == writer->fpChannels ) {
+            return -2;
+        }
+        for (c = 0; c < map->numChannels; c++) {
+            snprintf(suffix, sizeof(suffix), "_ch%03u.i16",
+                     (unsigned)map->channelId[c]);
+            writer->fpChannels[c] = fpOpenDerived(path, suffix);
+            if ( NULL == writer->fpChannels[c] ) {
+                return -3;
+            }
+        }
+    }
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : SWR_vSetTimeBase()
+// Description : Says what unwrapped time the first packet written should
+//               have, so npy timestamps match the rest of the extraction.
+//               Without it the first packet's own timestamp is used
+// Parameters  : SampleWriterType *writer - The writer
+//               uint64_t firstTime - Expected time of the first packet
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+void SWR_vSetTimeBase(SampleWriterType *writer, uint64_t firstTime) {
+
+    writer->timeBase = firstTime;
+    writer->haveTimeBase = 1;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : SWR_iWrite()
+// Description : Adds a run of valid packets to the output. Packets are
+//               transposed into the block buffer straight from the
+//               caller's buffer, held to be compressed, or stripped of
+//               their headers for npy, and written out a block at a time
+// Parameters  : SampleWriterType *writer - The writer
+//               const uint8_t *packets - numPackets packets back to back
+//               uint64_t numPackets - Number of packets
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int SWR_iWrite(SampleWriterType *writer, const uint8_t *packets,
+               uint64_t numPackets) {
+
+    uint64_t n, i;
+    uint8_t *header;
+
+    while ( numPackets ) {
+        n = SWR_BLOCK_PACKETS - writer->fill;
+        if ( n > numPackets ) {
+            n = numPackets;
+        }
+        if ( SWR_FORMAT_COMPRESSED == writer->format ) {
+            memcpy(writer->packets + writer->fill*writer->psize, packets,
+                   n*writer->psize);
+        }
+        else if ( SWR_FORMAT_NPY == writer->format ) {
+            if ( !writer->haveTimeBase ) {
+                SWR_vSetTimeBase(writer, PSCAN_u32ReadTimestamp(packets));
+            }
+            // rows are the packets minus their headers. Timestamps are
+            // unwrapped against where the packet is in the output
+            for (i = 0; i < n; i++) {
+                memcpy(writer->samples + (writer->fill + i)*writer->numChannels,
+                       packets + i*writer->psize + CFG_HEADER_BYTES,
+                       CFG_SAMPLE_BYTES*writer->numChannels);
+                writer->timestamps[writer->fill + i] = PSCAN_u64Unwrap(
+                    PSCAN_u32ReadTimestamp(packets + i*writer->psize),
+                    writer->timeBase + writer->numPackets + i);
+            }
+        }
+        else {
+            SWR_vTranspose(packets, writer->psize, n, writer->numChannels,
+                           writer->samples + writer->fill, SWR_BLOCK_PACKETS);
+            header = writer->headers + writer->fill*CFG_HEADER_BYTES;
+            for (i = 0; i < n; i++) {
+                memcpy(header, packets + i*writer->psize, CFG_HEADER_BYTES);
+                header += CFG_HEADER_BYTES;
+            }
+        }
+        writer->fill += n;
+        writer->numPackets += n;
+        packets += n*writer->psize;
+        numPackets -= n;
+
+        if ( SWR_BLOCK_PACKETS == writer->fill ) {
+            if ( iFlushBlock(writer) ) {
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : SWR_iClose()
+// Description : Writes out the last partial block, completes the blocked,
+//               compressed or npy file headers, closes the files and frees
+//               the writer.
+//               Also cleans up after a failed SWR_iOpen()
+// Parameters  : SampleWriterType *writer - The writer, may be NULL
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int SWR_iClose(SampleWriterType *writer) {
+
+    int res = 0;
+    uint32_t c;
+    size_t offset, numCounts = 0;
+    uint64_t counts[2];
+
+    if ( NULL == writer ) {
+        return 0;
+    }
+    if ( iFlushBlock(writer) ) {
+        res = -1;
+    }
+
+    if ( SWR_FORMAT_NPY == writer->format ) {
+        if ( (0 == res)
+             && ( (NULL == writer->fpTimestamps)
+                  || iWriteNpyHeader(writer->fpData, "<i2", writer->numPackets,
+                                     writer->numChannels)
+                  || iWriteNpyHeader(writer->fpTimestamps, "<u8",
+                                     writer->numPackets, 0) ) ) {
+            fprintf(stderr, "Error completing the .npy headers\n");
+            res = -2;
+        }
+        if ( writer->fpTimestamps && fclose(writer->fpTimestamps) ) {
+            res = -3;
+        }
+        if ( writer->fpData && fclose(writer->fpData) ) {
+            res = -3;
+        }
+        writer->fpData = NULL;
+    }
+    if ( writer->fpData ) {
+        if ( SWR_FORMAT_COMPRESSED == writer->format ) {
+            offset = offsetof(CodecFileHeaderType, numPackets);
+            counts[numCounts++] = writer->numPackets;
+            counts[numCounts++] = writer->numBlocks;
+        }
+        else {
+            offset = offsetof(BlockedFileHeaderType, numPackets);
+            counts[numCounts++] = writer->numPackets;
+        }
+        if ( (0 == res)
+             && ( fseeko(writer->fpData, (off_t)offset, SEEK_SET)
+                  || (fwrite(counts, sizeof(counts[0]), numCounts,
+                             writer->fpData) != numCounts) ) ) {
+            fprintf(stderr, "Error completing the output file header\n");
+            res = -2;
+        }
+        if ( fclose(writer->fpData) ) {
+            res = -3;
+        }
+    }
+    if ( writer->fpChannels ) {
+        for (c = 0; c < writer->numChannels; c++) {
+            if ( writer->fpChannels[c] && fclose(writer->fpChannels[c]) ) {
+                res = -3;
+            }
+        }
+        free(writer->fpChannels);
+    }
+    if ( writer->fpHeaders && fclose(writer->fpHeaders) ) {
+        res = -3;
+    }
+    free(writer->samples);
+    free(writer->headers);
+    free(writer->packets);
+    free(writer->block);
+    free(writer->timestamps);
+    CODEC_vFree(&writer->codec);
+    free(writer);
+
+    return res;
+
+}
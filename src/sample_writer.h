@@ -0,0 +1,79 @@
+#ifndef SAMPLE_WRITER_H
+#define SAMPLE_WRITER_H
+
+#include <stdint.h>
+#include "card_config.h"
+#include "packet_scan.h"
+
+#define SWR_BLOCK_PACKETS 4096   // packets transposed per output block
+#define SWR_BLOCKED_MAGIC "SDCHBLK1"
+#define SWR_NPY_HEADER_BYTES 128 // magic, version, length and padded dict
+
+// Channel-major output. Next to the sample data, PATH.hdr holds the 14 byte
+// header of every packet written, in order, so timestamps and RF flags stay
+// with the data.
+//   channels: PATH_chNNN.i16 per hardware channel NNN, int16 samples
+//   blocked:  PATH is one file, a BlockedFileHeaderType followed by the
+//             channel ids (uint16 each) and then blocks of
+//             SWR_BLOCK_PACKETS packets, stored channel after channel in
+//             packet slot order. The last block is shorter, it holds
+//             numPackets % blockPackets packets per channel
+//   compressed: PATH is a sample_codec.h file of the packets, no PATH.hdr
+//   npy:      PATH is a NumPy .npy int16 array of shape (packets, channels),
+//             the samples of each packet in slot order, and PATH_ts.npy
+//             (PATH without .npy) the timestamps unwrapped to uint64,
+//             shape (packets,).
+//             Both have a SWR_NPY_HEADER_BYTES header so np.load() with
+//             mmap_mode maps the data in place, no PATH.hdr
+// All values are little endian.
+
+//////////////////////////////////////////////////////////////////////////
+//                      Public Data Types
+//////////////////////////////////////////////////////////////////////////
+typedef enum {
+    SWR_FORMAT_PACKETS,     // packets as recorded, not handled here
+    SWR_FORMAT_CHANNELS,
+    SWR_FORMAT_BLOCKED,
+    SWR_FORMAT_COMPRESSED,  // packets through the lossless codec, sample_codec.h
+    SWR_FORMAT_CONTAINER,   // packets in chunks, written by container.c
+    SWR_FORMAT_NPY
+} SampleFormatType;
+
+typedef struct {
+    char magic[8];
+    uint32_t numChannels;
+    uint32_t blockPackets;
+    uint64_t numPackets;    // filled in when the file is closed
+} BlockedFileHeaderType;
+
+typedef struct SampleWriter SampleWriterType;
+
+//////////////////////////////////////////////////////////////////////////
+//                    Public Function Prototypes
+//////////////////////////////////////////////////////////////////////////
+int SWR_iParseFormat(const char *name, SampleFormatType *format);
+
+int SWR_iSelectKernel(PacketScanKernelType kernel);
+
+const char *SWR_pcKernelName(void);
+
+void SWR_vTranspose(const uint8_t *packets, uint32_t psize, uint64_t numPackets,
+                    uint32_t numChannels, int16_t *dst, uint64_t dstStride);
+
+void SWR_vTransposeWords(const uint8_t *packets, uint32_t psize, uint64_t numPackets,
+                         int16_t *dst, uint64_t dstStride);
+
+void SWR_vGather(const uint8_t *packets, uint32_t psize, uint64_t numPackets,
+                 const ChannelSelectType *select, uint8_t *dst);
+
+int SWR_iOpen(SampleWriterType **writerPtr, SampleFormatType format,
+              const char *path, uint32_t psize, const ChannelMapType *map);
+
+void SWR_vSetTimeBase(SampleWriterType *writer, uint64_t firstTime);
+
+int SWR_iWrite(SampleWriterType *writer, const uint8_t *packets,
+               uint64_t numPackets);
+
+int SWR_iClose(SampleWriterType *writer);
+
+#endif // SAMPLE_WRITER_H
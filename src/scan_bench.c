@@ -0,0 +1,390 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "packet_scan.h"
+#include "sample_writer.h"
+#include "sample_codec.h"
+
+#define DEFAULT_CHANNELS 128
+#define DEFAULT_PACKETS 1000000
+#define DEFAULT_REPEATS 20
+#define SCAN_CHUNK_PACKETS 65536 // packets handed to each PSCAN_iScan() call
+#define BAD_PACKET_EVERY 9973
+#define GAP_EVERY 30011
+#define RF_SYNC_EVERY 1000
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : dGetMonotonicSec()
+// Description : Reads the monotonic clock
+// Parameters  : none
+// Returns     : double - seconds since an arbitrary fixed point
+//////////////////////////////////////////////////////////////////////////
+static double dGetMonotonicSec(void) {
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : vFillPackets()
+// Description : Builds a recording in memory with a sprinkling of bad
+//               packets, gaps and RF syncs for the kernels to find
+// Parameters  : uint8_t *packets - Where to build the packets
+//               uint32_t psize - Number of bytes per packet
+//               uint64_t numPackets - Number of packets to build
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+static void vFillPackets(uint8_t *packets, uint32_t psize, uint64_t numPackets) {
+
+    uint8_t *packet;
+    uint32_t timestamp = 1;
+    uint64_t i;
+
+    for (i = 0; i < numPackets; i++) {
+        packet = packets + i*psize;
+        memset(packet, (int)(i & 0xFF), psize);
+        packet[START_BYTE_IND] = ( (i % BAD_PACKET_EVERY) == 5 ) ? 0x12 : START_BYTE_VAL;
+        packet[FLAG_BYTE_IND] = ( (i % RF_SYNC_EVERY) == 0 ) ? RF_VALID_VAL : 0;
+        if ( (i % GAP_EVERY) == 7 ) {
+            timestamp += 40;
+        }
+        packet[TIMESTAMP_START_IND] = (uint8_t)timestamp;
+        packet[TIMESTAMP_START_IND + 1] = (uint8_t)(timestamp >> 8);
+        packet[TIMESTAMP_START_IND + 2] = (uint8_t)(timestamp >> 16);
+        packet[TIMESTAMP_START_IND + 3] = (uint8_t)(timestamp >> 24);
+        ++timestamp;
+    }
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iRunKernel()
+// Description : Scans the buffer with the selected kernel, adding up what
+//               it found so the kernels can be checked against each other
+// Parameters  : uint8_t *packets - The recording
+//               uint32_t psize - Number of bytes per packet
+//               uint64_t numPackets - Number of packets
+//               uint64_t *totals - valid, RF sync, jump counts and a hash
+//                                  of the positions, filled in on return
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+static int iRunKernel(uint8_t *packets, uint32_t psize, uint64_t numPackets,
+                      uint64_t *totals) {
+
+    PacketScanType scan;
+    uint64_t first, n, i;
+
+    memset(totals, 0, 4*sizeof(uint64_t));
+    PSCAN_vInit(&scan);
+    for (first = 0; first < numPackets; first += n) {
+        n = numPackets - first;
+        if ( n > SCAN_CHUNK_PACKETS ) {
+            n = SCAN_CHUNK_PACKETS;
+        }
+        if ( PSCAN_iScan(&scan, packets + first*psize, psize, n, first) ) {
+            PSCAN_vFree(&scan);
+            return -1;
+        }
+        totals[0] += scan.validCt;
+        totals[1] += scan.rfSyncCt;
+        totals[2] += scan.jumpCt;
+        for (i = 0; i < scan.rfSyncCt; i++) {
+            totals[3] = totals[3]*31 + scan.rfSyncList[i];
+        }
+        for (i = 0; i < scan.jumpCt; i++) {
+            totals[3] = totals[3]*31 + scan.jumpList[i].packetIndex
+                        + scan.jumpList[i].timestamp;
+        }
+    }
+    PSCAN_vFree(&scan);
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : vRunTranspose()
+// Description : Transposes the buffer a block at a time, the way the
+//               channel-major output does, adding up a hash of the 
+//               samples so the kernels can be checked against each other
+// Parameters  : uint8_t *packets - The recording
+//               uint32_t psize - Number of bytes per packet
+//               uint64_t numPackets - Number of packets
+//               int16_t *rows - One block of channel rows
+//               uint64_t *hash - Filled in on return
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+static void vRunTranspose(uint8_t *packets, uint32_t psize, uint64_t numPackets,
+                          int16_t *rows, uint64_t *hash) {
+
+    uint32_t numChannels = (psize - CFG_HEADER_BYTES) / CFG_SAMPLE_BYTES;
+    uint64_t first, n, i;
+    uint32_t c;
+
+    *hash = 0;
+    for (first = 0; first < numPackets; first += n) {
+        n = numPackets - first;
+        if ( n > SWR_BLOCK_PACKETS ) {
+            n = SWR_BLOCK_PACKETS;
+        }
+        SWR_vTranspose(packets + first*psize, psize, n, numChannels,
+                       rows, SWR_BLOCK_PACKETS);
+        for (c = 0; c < numChannels; c++) {
+            for (i = 0; i < n; i += 61) {
+                *hash = *hash*31 + (uint16_t)rows[c*SWR_BLOCK_PACKETS + i];
+            }
+        }
+    }
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : vRunGather()
+// Description : Cuts the buffer down to the selected channels, adding up
+//               a hash of the result so the kernels can be checked
+//               against each other
+// Parameters  : uint8_t *packets - The recording
+//               uint32_t psize - Number of bytes per packet
+//               uint64_t numPackets - Number of packets
+//               const ChannelSelectType *select - Channels to keep
+//               uint8_t *out - Room for the cut down packets
+//               uint64_t *hash - Filled in on return
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+static void vRunGather(uint8_t *packets, uint32_t psize, uint64_t numPackets,
+                       const ChannelSelectType *select, uint8_t *out,
+                       uint64_t *hash) {
+
+    uint64_t i, numBytes;
+
+    SWR_vGather(packets, psize, numPackets, select, out);
+    numBytes = numPackets * (CFG_HEADER_BYTES + select->numChannels*CFG_SAMPLE_BYTES);
+    *hash = 0;
+    for (i = 0; i < numBytes; i += 61) {
+        *hash = *hash*31 + out[i];
+    }
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function     : main()
+// Description  : Microbenchmark for the packet scan kernels. Times every
+//                kernel the CPU supports on one core and checks that they
+//                all find the same packets, then does the same for the
+//                channel-major transpose kernels and the channel gather,
+//                which keeps every third channel
+// CL arguments : number of channels, optional
+//                number of packets, optional
+//                number of repeats, optional
+// Returns      : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+// Function    : iRunRoundTrip()
+// Description : Compresses the buffer one block at a time and decodes each
+//               block straight back, checking it comes back the same
+// Parameters  : const uint8_t *packets - The recording
+//               uint32_t psize - Number of bytes per packet
+//               uint64_t numPackets - Number of packets
+//               double *seconds - Time spent encoding and decoding,
+//                                 filled in on return
+//               uint64_t *compressedBytes - Filled in on return
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+static int iRunRoundTrip(const uint8_t *packets, uint32_t psize, uint64_t numPackets,
+                         double seconds[2], uint64_t *compressedBytes) {
+
+    CodecType codec;
+    uint8_t *block, *decoded;
+    uint64_t i, blockBytes;
+    uint32_t n, numDecoded;
+    double startSec;
+    int res = 0;
+
+    block = malloc(CODEC_u64MaxBlockBytes(psize, SWR_BLOCK_PACKETS) + CODEC_READ_SLACK);
+    decoded = malloc((uint64_t)psize * SWR_BLOCK_PACKETS);
+    if ( (NULL == block) || (NULL == decoded)
+         || CODEC_iInit(&codec, psize, SWR_BLOCK_PACKETS) ) {
+        free(block);
+        free(decoded);
+        return -1;
+    }
+    seconds[0] = 0;
+    seconds[1] = 0;
+    *compressedBytes = 0;
+    for (i = 0; i < numPackets; i += n) {
+        n = (numPackets - i < SWR_BLOCK_PACKETS)
+            ? (uint32_t)(numPackets - i) : SWR_BLOCK_PACKETS;
+        startSec = dGetMonotonicSec();
+        CODEC_iEncodeBlock(&codec, packets + i*psize, n, block, &blockBytes);
+        seconds[0] += dGetMonotonicSec() - startSec;
+        *compressedBytes += blockBytes;
+
+        memset(block + blockBytes, 0, CODEC_READ_SLACK);
+        startSec = dGetMonotonicSec();
+        res = CODEC_iDecodeBlock(&codec, block, blockBytes, decoded, &numDecoded);
+        seconds[1] += dGetMonotonicSec() - startSec;
+        if ( res || (numDecoded != n) || memcmp(decoded, packets + i*psize,
+                                                (uint64_t)n*psize) ) {
+            fprintf(stderr, "Error: packets from %llu don't survive compression\n",
+                    (long long unsigned)i);
+            res = -2;
+            break;
+        }
+    }
+
+    CODEC_vFree(&codec);
+    free(decoded);
+    free(block);
+    return res;
+
+}
+
+int main (int argc, char *argv[])
+{
+    static const PacketScanKernelType kernels[] = {
+        PSCAN_KERNEL_SCALAR, PSCAN_KERNEL_SSE2, PSCAN_KERNEL_AVX2
+    };
+    uint8_t *packets, *gathered;
+    int16_t *rows;
+    uint32_t numChannels, psize;
+    uint64_t compressedBytes;
+    double codecSec[2];
+    uint64_t numPackets, numRepeats, r, k;
+    uint64_t totals[4], reference[4], hash, referenceHash = 0;
+    ChannelSelectType select;
+    double startSec, elapsedSec;
+    int res = 0;
+
+    fprintf(stdout, "\n*** scan_bench 1.1 ***\n");
+
+    numChannels = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 10) : DEFAULT_CHANNELS;
+    numPackets = (argc > 2) ? strtoull(argv[2], NULL, 10) : DEFAULT_PACKETS;
+    numRepeats = (argc > 3) ? strtoull(argv[3], NULL, 10) : DEFAULT_REPEATS;
+    if ( (0 == numChannels) || (CFG_MAX_CHANNELS < numChannels) 
+         || (0 == numPackets) || (0 == numRepeats) ) {
+        fprintf(stdout, "\nUsage: scan_bench [CHANNELS] [PACKETS] [REPEATS]\n");
+        return 1;
+    }
+    psize = 2*numChannels + 14;
+
+    packets = malloc(numPackets * psize);
+    rows = malloc((uint64_t)numChannels * SWR_BLOCK_PACKETS * sizeof(int16_t));
+    gathered = malloc(numPackets * psize);
+    if ( (NULL == packets) || (NULL == rows) || (NULL == gathered) ) {
+        fprintf(stderr, "Error allocating %llu packets\n",
+                (long long unsigned)numPackets);
+        return -1;
+    }
+    vFillPackets(packets, psize, numPackets);
+    fprintf(stdout, "%u channels, %u bytes/packet, %llu packets x %llu\n",
+            (unsigned)numChannels, (unsigned)psize,
+            (long long unsigned)numPackets, (long long unsigned)numRepeats);
+
+    for (k = 0; k < sizeof(kernels)/sizeof(kernels[0]); k++) {
+        if ( PSCAN_iSelectKernel(kernels[k]) ) {
+            continue;
+        }
+        if ( iRunKernel(packets, psize, numPackets, totals) ) {
+            res = -2;
+            break;
+        }
+        if ( 0 == k ) {
+            memcpy(reference, totals, sizeof(reference));
+        }
+        else if ( memcmp(reference, totals, sizeof(reference)) ) {
+            fprintf(stderr, "Error: %s kernel disagrees with scalar\n",
+                    PSCAN_pcKernelName());
+            res = -3;
+        }
+
+        startSec = dGetMonotonicSec();
+        for (r = 0; r < numRepeats; r++) {
+            iRunKernel(packets, psize, numPackets, totals);
+        }
+        elapsedSec = dGetMonotonicSec() - startSec;
+        fprintf(stdout, "%-7s %8.1f Mpackets/s %8.1f MB/s per core"
+                " (%llu valid, %llu RF syncs, %llu jumps)\n",
+                PSCAN_pcKernelName(),
+                (double)numPackets*numRepeats/elapsedSec/1e6,
+                (double)numPackets*numRepeats*psize/elapsedSec/(1024*1024),
+                (long long unsigned)totals[0], (long long unsigned)totals[1],
+                (long long unsigned)totals[2]);
+    }
+
+    for (k = 0; k < sizeof(kernels)/sizeof(kernels[0]); k++) {
+        if ( SWR_iSelectKernel(kernels[k]) ) {
+            continue;
+        }
+        vRunTranspose(packets, psize, numPackets, rows, &hash);
+        if ( 0 == k ) {
+            referenceHash = hash;
+        }
+        else if ( hash != referenceHash ) {
+            fprintf(stderr, "Error: %s transpose disagrees with scalar\n",
+                    SWR_pcKernelName());
+            res = -3;
+        }
+
+        startSec = dGetMonotonicSec();
+        for (r = 0; r < numRepeats; r++) {
+            vRunTranspose(packets, psize, numPackets, rows, &hash);
+        }
+        elapsedSec = dGetMonotonicSec() - startSec;
+        fprintf(stdout, "%-7s %8.1f Mpackets/s %8.1f MB/s per core transposed\n",
+                SWR_pcKernelName(),
+                (double)numPackets*numRepeats/elapsedSec/1e6,
+                (double)numPackets*numRepeats*psize/elapsedSec/(1024*1024));
+    }
+
+    memset(&select, 0, sizeof(select));
+    for (k = 0; k < numChannels; k += 3) {
+        select.slot[select.numChannels++] = (uint16_t)k;
+    }
+    for (k = 0; k < sizeof(kernels)/sizeof(kernels[0]); k++) {
+        if ( SWR_iSelectKernel(kernels[k]) ) {
+            continue;
+        }
+        vRunGather(packets, psize, numPackets, &select, gathered, &hash);
+        if ( 0 == k ) {
+            referenceHash = hash;
+        }
+        else if ( hash != referenceHash ) {
+            fprintf(stderr, "Error: %s gather disagrees with scalar\n",
+                    SWR_pcKernelName());
+            res = -3;
+        }
+
+        startSec = dGetMonotonicSec();
+        for (r = 0; r < numRepeats; r++) {
+            vRunGather(packets, psize, numPackets, &select, gathered, &hash);
+        }
+        elapsedSec = dGetMonotonicSec() - startSec;
+        fprintf(stdout, "%-7s %8.1f Mpackets/s %8.1f MB/s per core gathering"
+                " %u channels\n",
+                SWR_pcKernelName(),
+                (double)numPackets*numRepeats/elapsedSec/1e6,
+                (double)numPackets*numRepeats*psize/elapsedSec/(1024*1024),
+                (unsigned)select.numChannels);
+    }
+
+    if ( iRunRoundTrip(packets, psize, numPackets, codecSec, &compressedBytes) ) {
+        res = -4;
+    }
+    else {
+        fprintf(stdout, "codec   ratio %.2f, %8.1f MB/s encoding, %8.1f MB/s"
+                " decoding per core\n",
+                (double)numPackets*psize/compressedBytes,
+                (double)numPackets*psize/codecSec[0]/(1024*1024),
+                (double)numPackets*psize/codecSec[1]/(1024*1024));
+    }
+
+    free(gathered);
+    free(rows);
+    free(packets);
+    return res;
+}
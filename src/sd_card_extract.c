@@ -1,28 +1,1814 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <math.h>
 #include <time.h>
+#include <getopt.h>
+#include <pthread.h>
 #include "diskio_linux.h"
+#include "block_reader.h"
+#include "spsc_ring.h"
+#include "packet_scan.h"
+#include "card_config.h"
+#include "sample_writer.h"
+#include "packet_index.h"
+#include "container.h"
+#include "perf_stats.h"
+#include "record_end.h"
+#include "extract_queue.h"
+#include "card_constants.h"
 
 #define BUFFER_LENGTH 65536
-#define MAX_FNAME_LENGTH 1000
-#define NUM_PACKETS 1       // number of packets to read at a time
-#define PROGRESS_PERCENT 5
-#define SAMPLING_RATE 30000   // samples/sec
-#define START_BYTE_IND 0
-#define FLAG_BYTE_IND 2
-#define TIMESTAMP_START_IND 10
-#define START_BYTE_VAL 0x55
-#define RF_VALID_VAL 0x1
-#define SEC_PER_MIN 60
+#define PROGRESS_SEC 5.0      // between progress lines
+#define DEFAULT_BLOCK_MB 16   // size of each read from the device
+#define MAX_BLOCK_MB 1024
+#define MAX_EXTRACT_THREADS 256
+#define SEEK_PROBE_PACKETS 16 // packets read at each step of a time search
+
+typedef struct {
+    uint64_t segment;        // covers packets [first, first + numPackets)
+    uint64_t first;
+    uint64_t numPackets;
+    uint64_t firstTimestamp; // unwrapped
+    uint64_t lastTimestamp;
+    int fd;                  // set by the serial step of each round
+    uint64_t offset;
+} SegmentPieceType;
+
+typedef struct {
+    uint64_t packetIndex;
+    uint8_t startByte;
+} BadPacketType;
+
+typedef struct {
+    int given;
+    int isTimestamp;   // value is a sample timestamp, not seconds
+    double value;
+} TimeLimitType;
+
+typedef struct {
+    // what to extract and how, as main() worked it out from the options
+    FILE *fpOutput;
+    SampleWriterType *samples;      // channel-major output, NULL for packets
+    ContainerWriterType *container; // chunked output, NULL otherwise
+    SegmentSetType *segments;       // NULL unless --segment-minutes
+    const ChannelSelectType *select; // NULL keeps every channel
+    uint32_t psize;
+    uint64_t firstPacket;
+    uint64_t lastPacket;
+    uint64_t timeBase;              // unwrapped timestamp of packet 0
+    uint64_t blockSize;             // bytes per read
+    uint32_t queueDepth;            // reads kept in flight
+    BlockReaderBackendType backend;
+    uint32_t numThreads;            // more than 1 for iExtractParallel()
+    IntegrityLogType *integrity;    // NULL if no report was asked for
+    FillModeType fillGaps;
+    PacketIndexType *index;         // NULL if no index was asked for
+    int zeroCopy;
+} ExtractOptionsType;
+
+struct ParallelExtract;
+
+typedef struct {
+    // one per thread, owned by that thread except where noted
+    struct ParallelExtract *shared;
+    uint32_t threadIndex;
+    pthread_t thread;
+    uint8_t *buff;
+    uint64_t firstPacket;   // chunk of the current round
+    uint64_t numPackets;
+    uint8_t *packets;       // first packet of the chunk inside buff
+    uint64_t validPackets;  // valid packets moved to the front of packets
+    uint64_t rfSyncCt;
+    uint64_t firstValidPacket; // the first good packet of the chunk
+    uint64_t firstTimestamp; // unwrapped, of firstValidPacket
+    PacketScanType scan;
+    BadPacketType *badList;
+    uint64_t badCt;
+    uint64_t badCapacity;
+    uint64_t outOffset;     // set by the serial step of each round
+    ContainerChunkHeaderType chunkHeader; // of the chunk, for a container
+    SegmentPieceType *pieceList; // valid packets split by segment
+    uint64_t pieceCt;
+    uint64_t pieceCapacity;
+    double readSec;
+    double checkSec;
+    double writeSec;
+    int res;
+} ParallelWorkerType;
+
+typedef struct ParallelExtract {
+    DiskSessionType *session;
+    int outFd;
+    uint32_t psize;
+    uint32_t outPsize;
+    const ChannelSelectType *select;
+    ContainerWriterType *container; // chunks placed in it, NULL for packets
+    SegmentSetType *segments;   // NULL unless --segment-minutes
+    uint64_t round;             // of the serial step
+    uint32_t numThreads;
+    uint64_t firstPacket;
+    uint64_t lastPacket;
+    uint64_t chunkPackets;
+    uint64_t numRounds;
+    uint64_t outBytes;      // output written by all earlier chunks
+    double nextProgressSec;
+    double startSec;
+    int haveTimestamp;      // lastTimestamp is set
+    uint64_t lastValidPacket; // the last good packet of the chunks placed
+    uint64_t lastTimestamp; // unwrapped, of lastValidPacket
+    int abortFlag;
+    int started;            // set once every thread is running
+    pthread_mutex_t startLock;
+    pthread_cond_t startCond;
+    pthread_barrier_t checked;
+    pthread_barrier_t placed;
+    ExtractStatsType *stats;
+    PerfStatsType *perf;
+    IntegrityLogType *integrity;
+    ParallelWorkerType *workers;
+} ParallelExtractType;
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : dGetMonotonicSec()
+// Description : Reads the monotonic clock, used for throughput reporting
+// Parameters  : none
+// Returns     : double - seconds since an arbitrary fixed point
+//////////////////////////////////////////////////////////////////////////
+static double dGetMonotonicSec(void) {
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iWriteAt()
+// Description : pwrite() wrapper that retries after interrupts and short
+//               writes until all bytes are out
+// Parameters  : int fd - File descriptor to write to
+//               uint8_t *buff - Bytes to write
+//               uint64_t numBytes - Number of bytes to write
+//               uint64_t offset - Byte offset in the file to write at
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+static int iWriteAt(int fd, uint8_t *buff, uint64_t numBytes, uint64_t offset) {
+
+    ssize_t res;
+    uint64_t done = 0;
+
+    while ( done < numBytes ) {
+        res = pwrite(fd, buff + done, numBytes - done, (off_t)(offset + done));
+        if ( res < 0 ) {
+            if ( EINTR == errno ) {
+                continue;
+            }
+            fprintf(stderr, "Error %d writing %llu bytes at output offset"
+                    " %llu: %s\n", errno, (long long unsigned)numBytes,
+                    (long long unsigned)offset, strerror(errno));
+            return -1;
+        }
+        if ( 0 == res ) {
+            // nothing written and no error, don't spin on it
+            fprintf(stderr, "Error writing %llu bytes at output offset %llu:"
+                    " no bytes written\n", (long long unsigned)numBytes,
+                    (long long unsigned)offset);
+            return -1;
+        }
+        done += (uint64_t)res;
+    }
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iOpenSegmentSet()
+// Description : Starts segmented output. Segment files are PATH with
+//               _segNNNN before its extension, and PATH.manifest lists
+//               each one as it is finished
+// Parameters  : SegmentSetType *set - The segments
+//               const char *path - Output path given by the user
+//               uint64_t origin - Unwrapped time of the first packet on
+//                                 the card
+//               uint64_t segmentPackets - Timestamps per segment
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+static int iOpenSegmentSet(SegmentSetType *set, const char *path, uint64_t origin,
+                           uint64_t segmentPackets) {
+
+    char manifestFile[MAX_FNAME_LENGTH + 16];
+
+    memset(set, 0, sizeof(*set));
+    set->path = path;
+    set->origin = origin;
+    set->segmentPackets = segmentPackets;
+    snprintf(manifestFile, sizeof(manifestFile), "%s.manifest", path);
+    set->fpManifest = fopen(manifestFile, "w");
+    if ( NULL == set->fpManifest ) {
+        fprintf(stderr, "Error opening file %s to list the segments in!\n",
+                manifestFile);
+        return -1;
+    }
+    fprintf(set->fpManifest, "# segment\tfile\tfirst_timestamp\tlast_timestamp"
+            "\tpackets\n");
+    fflush(set->fpManifest);
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iStartSegment()
+// Description : Creates the file of a segment and adds it to the list
+// Parameters  : SegmentSetType *set - The segments
+//               uint64_t segment - Segment number
+//               uint64_t firstTimestamp - Of its first packet, unwrapped
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+static int iStartSegment(SegmentSetType *set, uint64_t segment, uint64_t firstTimestamp) {
+
+    const char *dot = strrchr(set->path, '.');
+    const char *slash = strrchr(set->path, '/');
+    SegmentType *entry;
+    int nameLength;
+
+    if ( PSCAN_iGrowList((void **)&set->segmentList, &set->segmentCapacity,
+                         set->segmentCt, sizeof(SegmentType)) ) {
+        return -1;
+    }
+    entry = &set->segmentList[set->segmentCt];
+    memset(entry, 0, sizeof(*entry));
+    // the number goes before the extension: rec.dat -> rec_seg0003.dat
+    if ( (NULL == dot) || (slash && (dot < slash)) || (dot == set->path) ) {
+        dot = set->path + strlen(set->path);
+    }
+    nameLength = (int)(dot - set->path);
+    snprintf(entry->fname, sizeof(entry->fname), "%.*s_seg%04llu%s", nameLength,
+             set->path, (long long unsigned)segment, dot);
+    entry->fd = open(entry->fname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if ( entry->fd < 0 ) {
+        fprintf(stderr, "Error opening file %s to extract data to!\n", entry->fname);
+        return -2;
+    }
+    entry->segment = segment;
+    entry->firstTimestamp = firstTimestamp;
+    ++set->segmentCt;
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iFinishSegment()
+// Description : Closes a segment's file and lists it in the manifest, so
+//               it can be picked up while later segments are written
+// Parameters  : SegmentSetType *set - The segments
+//               uint64_t k - Index of the segment in the list
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+static int iFinishSegment(SegmentSetType *set, uint64_t k) {
+
+    SegmentType *entry = &set->segmentList[k];
+    const char *fname = strrchr(entry->fname, '/');
+    int res = 0;
+
+    if ( entry->fd < 0 ) {
+        return 0;
+    }
+    if ( close(entry->fd) ) {
+        fprintf(stderr, "Error closing %s\n", entry->fname);
+        res = -1;
+    }
+    entry->fd = -1;
+    fprintf(set->fpManifest, "%llu\t%s\t%llu\t%llu\t%llu\n",
+            (long long unsigned)entry->segment, fname ? fname + 1 : entry->fname,
+            (long long unsigned)entry->firstTimestamp,
+            (long long unsigned)entry->lastTimestamp,
+            (long long unsigned)entry->numPackets);
+    if ( fflush(set->fpManifest) ) {
+        res = -2;
+    }
+
+    return res;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iCloseSegmentSet()
+// Description : Finishes the segments still open and closes the manifest
+// Parameters  : SegmentSetType *set - The segments
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+static int iCloseSegmentSet(SegmentSetType *set) {
+
+    uint64_t k;
+    int res = 0;
+
+    for (k = 0; k < set->segmentCt; k++) {
+        if ( iFinishSegment(set, k) ) {
+            res = -1;
+        }
+    }
+    if ( set->fpManifest && fclose(set->fpManifest) ) {
+        res = -2;
+    }
+    free(set->segmentList);
+    set->segmentList = NULL;
+    set->fpManifest = NULL;
+
+    return res;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : vCountJump()
+// Description : Adds a timestamp jump to the counters. A repeated
+//               timestamp isn't a gap, one that goes back is counted as a
+//               discontinuity and drops no packets
+// Parameters  : PerfStatsType *perf - The counters
+//               const TimestampJumpType *jump - The jump
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+static void vCountJump(PerfStatsType *perf, const TimestampJumpType *jump) {
+
+    uint64_t dropped;
+
+    if ( jump->timestamp == jump->prevTimestamp ) {
+        return;
+    }
+    dropped = PSCAN_u64Dropped(jump);
+    if ( dropped ) {
+        ++perf->gapCt;
+        perf->droppedPackets += dropped;
+    }
+    else {
+        ++perf->discontinuityCt;
+    }
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : vReportBadPacket()
+// Description : Prints the message for a packet that is left out of the
+//               output
+// Parameters  : uint64_t packetIndex - Index of the packet on the disk
+//               uint8_t startByte - Value found in place of the start byte
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+static void vReportBadPacket(uint64_t packetIndex, uint8_t startByte) {
+
+    fprintf(stderr, "Bad packet found. Packet index: %llu, "
+            "byte[%u] value: %2x. Not saving bad packet to output file\n",
+            (long long unsigned)packetIndex,
+            (unsigned)START_BYTE_IND,
+            (unsigned)startByte );
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iLogBadPacket()
+// Description : Adds a bad packet to the integrity log
+// Parameters  : IntegrityLogType *integrity - The log
+//               uint64_t packetIndex - Index of the packet on the disk
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+static int iLogBadPacket(IntegrityLogType *integrity, uint64_t packetIndex) {
+
+    if ( PSCAN_iGrowList((void **)&integrity->badList, &integrity->badCapacity,
+                   integrity->badCt, sizeof(uint64_t)) ) {
+        return -1;
+    }
+    integrity->badList[integrity->badCt++] = packetIndex;
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iLogScan()
+// Description : Adds the gaps and RF syncs found by a packet scan to the
+//               integrity log
+// Parameters  : IntegrityLogType *integrity - The log
+//               const PacketScanType *scan - The scan
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+static int iLogScan(IntegrityLogType *integrity, const PacketScanType *scan) {
+
+    uint64_t i;
+
+    if ( PSCAN_iAddScanGaps(&integrity->gaps, scan) ) {
+        return -1;
+    }
+    for (i = 0; i < scan->rfSyncCt; i++) {
+        if ( PSCAN_iGrowList((void **)&integrity->rfSyncList, &integrity->rfSyncCapacity,
+                       integrity->rfSyncCt, sizeof(uint64_t)) ) {
+            return -1;
+        }
+        integrity->rfSyncList[integrity->rfSyncCt++] = scan->rfSyncList[i];
+    }
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : vFreeIntegrityLog()
+// Description : Releases the lists held by the integrity log
+// Parameters  : IntegrityLogType *integrity - The log
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+static void vFreeIntegrityLog(IntegrityLogType *integrity) {
+
+    PSCAN_vFreeGapList(&integrity->gaps);
+    free(integrity->badList);
+    free(integrity->rfSyncList);
+    memset(integrity, 0, sizeof(*integrity));
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iQueueChunkEnd()
+// Description : Ends the container chunk at nextChunkEnd. The buffer
+//               being filled goes to the writer marked with the end, so
+//               the writer closes the chunk right after its packets
+// Parameters  : ExtractContextType *extract - The extraction
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+static int iQueueChunkEnd(ExtractContextType *extract) {
+
+    ++extract->current->chunkEnds;
+    extract->nextChunkEnd += extract->chunkPackets;
+
+    return EXQ_iHandOver(extract);
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iExtractSpan()
+// Description : Validation stage. Checks a run of packets straight out of
+//               a read block and queues the valid ones for the writer
+// Parameters  : void *ctx - ExtractContextType of the extraction
+//               uint8_t *packets - First byte of the first packet
+//               uint64_t numPackets - Number of packets in the run
+//               uint64_t firstPacketIndex - Index of the first packet
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+static int iExtractSpan(void *ctx, uint8_t *packets, uint64_t numPackets,
+                        uint64_t firstPacketIndex) {
+
+    int res;
+    ExtractContextType *extract = (ExtractContextType *)ctx;
+    uint32_t psize = extract->psize;
+    PacketScanType *scan = &extract->scan;
+    PerfStatsType *perf = extract->perf;
+    uint64_t i, runEnd;
+    double now = PSTAT_dNow();
+
+    if ( now >= extract->nextProgressSec ) {
+        fprintf(stdout, "%5.1f%% completed, elapsed time: %5.1f minutes\n", 
+               (float)(firstPacketIndex - extract->firstPacket) 
+               / (float)(extract->lastPacket - extract->firstPacket + 1) * 100,
+               (float)(now - extract->startSec)/SEC_PER_MIN );
+        extract->nextProgressSec = now + PROGRESS_SEC;
+    }
+    PSTAT_vTick(perf, now);
+
+    if ( PSCAN_iScan(scan, packets, psize, numPackets, firstPacketIndex) ) {
+        return -2;
+    }
+    extract->stats->rfSyncCt += scan->rfSyncCt;
+    extract->stats->badPackets += numPackets - scan->validCt;
+    perf->packetsChecked += numPackets;
+    perf->packetsWritten = extract->stats->packetsWritten;
+    perf->badPackets = extract->stats->badPackets;
+    perf->rfSyncCt = extract->stats->rfSyncCt;
+    for (i = 0; i < scan->jumpCt; i++) {
+        vCountJump(perf, &scan->jumpList[i]);
+    }
+    if ( extract->integrity && iLogScan(extract->integrity, scan) ) {
+        return -3;
+    }
+
+    // queue each run of valid packets, report the bad ones between them.
+    // Runs stop at container chunk ends
+    i = 0;
+    extract->nextJump = 0;
+    extract->nextRfSync = 0;
+    while ( i < numPackets ) {
+        runEnd = PSCAN_u64RunEnd(scan, i, 1);
+        if ( extract->container && (firstPacketIndex + runEnd > extract->nextChunkEnd) ) {
+            runEnd = extract->nextChunkEnd - firstPacketIndex;
+        }
+        switch (extract->queueMode) {
+            case QUEUE_RANGES:
+                res = EXQ_iQueueRange(extract, packets + i*psize, firstPacketIndex + i,
+                                      runEnd - i);
+                break;
+            case QUEUE_SEGMENTED:
+                res = EXQ_iQueueSegmented(extract, packets, i, runEnd);
+                break;
+            case QUEUE_TIMED:
+                res = EXQ_iQueueTimed(extract, packets, i, runEnd);
+                break;
+            default:
+                res = EXQ_iQueueRun(extract, packets + i*psize, runEnd - i);
+                break;
+        }
+        if ( res ) {
+            return -1;
+        }
+        i = runEnd;
+        runEnd = PSCAN_u64RunEnd(scan, i, 0);
+        if ( extract->container && (firstPacketIndex + runEnd > extract->nextChunkEnd) ) {
+            runEnd = extract->nextChunkEnd - firstPacketIndex;
+        }
+        for (; i < runEnd; i++) {
+            vReportBadPacket(firstPacketIndex + i, packets[i*psize + START_BYTE_IND]);
+            if ( extract->integrity 
+                 && iLogBadPacket(extract->integrity, firstPacketIndex + i) ) {
+                return -3;
+            }
+        }
+        if ( extract->container && (firstPacketIndex + i == extract->nextChunkEnd)
+             && iQueueChunkEnd(extract) ) {
+            return -1;
+        }
+    }
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : pvReaderStage()
+// Description : Reader thread. Pulls blocks off the block reader in 
+//               device order and passes them to the validator, recycling
+//               the blocks the validator hands back
+// Parameters  : void *ctx - ExtractContextType of the extraction
+// Returns     : void * - NULL, the result is left in readerRes
+//////////////////////////////////////////////////////////////////////////
+static void *pvReaderStage(void *ctx) {
+
+    ExtractContextType *extract = (ExtractContextType *)ctx;
+    uint32_t outstanding = 0;
+    double waitStart;
+    BlockType *block;
+
+    while ( 1 ) {
+        // give finished blocks back so their reads can be reissued
+        while ( 0 == RING_iTryPop(&extract->blockFreeRing, (void **)&block) ) {
+            BLKRD_iReleaseBlock(extract->reader, block);
+            --outstanding;
+        }
+        if ( outstanding == extract->queueDepth ) {
+            if ( RING_iPop(&extract->blockFreeRing, (void **)&block, 
+                           &extract->abortFlag) ) {
+                extract->readerRes = -1;
+                break;
+            }
+            BLKRD_iReleaseBlock(extract->reader, block);
+            --outstanding;
+        }
+
+        waitStart = dGetMonotonicSec();
+        if ( BLKRD_iNextBlock(extract->reader, &block) ) {
+            extract->readerRes = -2;
+            __atomic_store_n(&extract->abortFlag, 1, __ATOMIC_RELEASE);
+            break;
+        }
+        extract->readWaitSec += dGetMonotonicSec() - waitStart;
+
+        // a NULL block tells the validator the span is done
+        if ( RING_iPush(&extract->blockRing, block, &extract->abortFlag) ) {
+            extract->readerRes = -1;
+            break;
+        }
+        if ( NULL == block ) {
+            break;
+        }
+        ++outstanding;
+    }
+
+    return NULL;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iWriteSegment()
+// Description : Writes an output buffer to the file of its segment,
+//               finishing the previous segment when a new one starts
+// Parameters  : ExtractContextType *extract - The extraction
+//               OutputBufferType *out - Buffer of packets, one segment
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+static int iWriteSegment(ExtractContextType *extract, OutputBufferType *out) {
+
+    SegmentSetType *set = extract->segments;
+    SegmentType *entry;
+    uint64_t numPackets = out->numBytes / extract->outPsize;
+    uint64_t firstTimestamp;
+
+    if ( 0 == numPackets ) {
+        return 0;
+    }
+    if ( !extract->haveSegment
+         || (set->segmentList[set->segmentCt - 1].segment != out->segment) ) {
+        if ( (extract->haveSegment && iFinishSegment(set, set->segmentCt - 1))
+             || iStartSegment(set, out->segment, out->firstTimestamp) ) {
+            return -1;
+        }
+        extract->haveSegment = 1;
+        firstTimestamp = out->firstTimestamp;
+    }
+    else {
+        // carries on from the buffer before
+        firstTimestamp = PSCAN_u64Unwrap(PSCAN_u32ReadTimestamp(out->buff),
+                            set->segmentList[set->segmentCt - 1].lastTimestamp + 1);
+    }
+    entry = &set->segmentList[set->segmentCt - 1];
+    if ( iWriteAt(entry->fd, out->buff, out->numBytes,
+                  entry->numPackets * extract->outPsize) ) {
+        return -2;
+    }
+    entry->numPackets += numPackets;
+    entry->lastTimestamp = PSCAN_u64Unwrap(
+        PSCAN_u32ReadTimestamp(out->buff + (numPackets - 1)*extract->outPsize),
+        firstTimestamp + numPackets - 1);
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : pvWriterStage()
+// Description : Writer thread. Writes each full output buffer with one 
+//               fwrite, transposes it into the channel-major output or
+//               adds it to the container, and hands it back to the
+//               validator
+// Parameters  : void *ctx - ExtractContextType of the extraction
+// Returns     : void * - NULL, the result is left in writerRes
+//////////////////////////////////////////////////////////////////////////
+static void *pvWriterStage(void *ctx) {
+
+    ExtractContextType *extract = (ExtractContextType *)ctx;
+    double writeStart;
+    uint64_t bytesWritten;
+    OutputBufferType *out;
+
+    while ( 1 ) {
+        if ( RING_iPop(&extract->outRing, (void **)&out, &extract->abortFlag) ) {
+            extract->writerRes = -1;
+            break;
+        }
+        // a NULL buffer means everything has been queued
+        if ( NULL == out ) {
+            break;
+        }
+
+        writeStart = dGetMonotonicSec();
+        if ( extract->samples ) {
+            if ( SWR_iWrite(extract->samples, out->buff, 
+                            out->numBytes / extract->outPsize) ) {
+                extract->writerRes = -2;
+                __atomic_store_n(&extract->abortFlag, 1, __ATOMIC_RELEASE);
+                break;
+            }
+            bytesWritten = out->numBytes;
+        }
+        else if ( extract->container ) {
+            if ( CNT_iAppend(extract->container, out->buff,
+                             out->numBytes / extract->outPsize) ) {
+                extract->writerRes = -2;
+                __atomic_store_n(&extract->abortFlag, 1, __ATOMIC_RELEASE);
+                break;
+            }
+            for (; out->chunkEnds; out->chunkEnds--) {
+                if ( CNT_iEndChunk(extract->container) ) {
+                    break;
+                }
+            }
+            if ( out->chunkEnds ) {
+                extract->writerRes = -2;
+                __atomic_store_n(&extract->abortFlag, 1, __ATOMIC_RELEASE);
+                break;
+            }
+            bytesWritten = out->numBytes;
+        }
+        else if ( out->rangeCt ) {
+            if ( EXQ_iWriteRanges(extract, out) ) {
+                extract->writerRes = -2;
+                __atomic_store_n(&extract->abortFlag, 1, __ATOMIC_RELEASE);
+                break;
+            }
+            bytesWritten = out->numBytes;
+        }
+        else if ( extract->segments ) {
+            if ( iWriteSegment(extract, out) ) {
+                extract->writerRes = -2;
+                __atomic_store_n(&extract->abortFlag, 1, __ATOMIC_RELEASE);
+                break;
+            }
+            bytesWritten = out->numBytes;
+        }
+        else {
+            bytesWritten = (uint64_t)fwrite(out->buff, 1, out->numBytes, 
+                                            extract->fpOutput);
+            // the hole becomes part of the file once the next data lands
+            // past it
+            if ( out->holeBytes 
+                 && fseeko(extract->fpOutput, (off_t)out->holeBytes, SEEK_CUR) ) {
+                fprintf(stderr, "Error seeking past %llu bytes of dropped"
+                        " packets: %s\n", (long long unsigned)out->holeBytes,
+                        strerror(errno));
+                extract->writerRes = -2;
+                __atomic_store_n(&extract->abortFlag, 1, __ATOMIC_RELEASE);
+                break;
+            }
+        }
+        extract->writeSec += dGetMonotonicSec() - writeStart;
+        extract->perf->bytesWritten += bytesWritten + out->rangeBytes;
+        if ( out->numBytes != bytesWritten ) {
+            fprintf(stderr, "Error: %llu bytes requested to write but %llu"
+                    " bytes actually written\n",
+                    (long long unsigned)out->numBytes,
+                    (long long unsigned)bytesWritten );
+            extract->writerRes = -2;
+            __atomic_store_n(&extract->abortFlag, 1, __ATOMIC_RELEASE);
+            break;
+        }
+        out->numBytes = 0;
+        out->holeBytes = 0;
+        out->rangeCt = 0;
+        out->rangeBytes = 0;
+
+        if ( RING_iPush(&extract->outFreeRing, out, &extract->abortFlag) ) {
+            extract->writerRes = -1;
+            break;
+        }
+    }
+
+    return NULL;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iExtractBlocks()
+// Description : Copies packets firstPacket to lastPacket from the device
+//               to the output file with three overlapped stages: a reader thread
+//               keeping several large reads in flight, validation on the
+//               calling thread, and a writer thread. The stages pass 
+//               preallocated buffers to each other through lock-free 
+//               rings, so nothing is allocated while data is moving and
+//               the card keeps reading while the output disk is busy
+// Parameters  : DiskSessionType *session - The open device
+//               const ExtractOptionsType *opts - What to extract and where
+//                                                to write it
+//               ExtractStatsType *stats - Totals filled in on return
+//               PerfStatsType *perf - Counters of where the time goes,
+//                                     added to as the extraction runs
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+static int iExtractBlocks(DiskSessionType *session, const ExtractOptionsType *opts,
+                          ExtractStatsType *stats, PerfStatsType *perf) {
+
+    int i, res = 0;
+    int readerStarted = 0, writerStarted = 0;
+    double walkStart, stallStart;
+    pthread_t readerThread, writerThread;
+    BlockType *block;
+    PacketWalkerType walker;
+    ExtractContextType *extract;
+    const char *copyName;
+
+    memset(stats, 0, sizeof(*stats));
+    extract = calloc(1, sizeof(*extract));
+    if ( NULL == extract ) {
+        return -1;
+    }
+    PSCAN_vInit(&extract->scan);
+    PSCAN_vSetTimeBase(&extract->scan, opts->timeBase);
+    extract->fpOutput = opts->fpOutput;
+    extract->samples = opts->samples;
+    extract->container = opts->container;
+    extract->segments = opts->segments;
+    extract->select = opts->select;
+    extract->psize = opts->psize;
+    extract->outPsize = opts->select
+                        ? CFG_HEADER_BYTES + opts->select->numChannels*CFG_SAMPLE_BYTES
+                        : opts->psize;
+    extract->queueDepth = opts->queueDepth;
+    extract->firstPacket = opts->firstPacket;
+    extract->lastPacket = opts->lastPacket;
+    extract->stats = stats;
+    extract->perf = perf;
+    extract->integrity = opts->integrity;
+    extract->fillGaps = opts->fillGaps;
+    extract->index = opts->index;
+    extract->startSec = dGetMonotonicSec();
+    extract->nextProgressSec = extract->startSec;
+    extract->outCapacity = opts->blockSize;
+    extract->dataOffset = session->deviceInfo.sectorSize;
+    extract->srcFd = session->fd;
+    extract->copyMethod = COPY_RANGE;
+    extract->pipeFd[0] = -1;
+    extract->pipeFd[1] = -1;
+    // how runs of valid packets get queued, --zero-copy is packets format
+    // only and the rest don't combine with it
+    if ( opts->zeroCopy ) {
+        extract->queueMode = QUEUE_RANGES;
+    }
+    else if ( opts->segments ) {
+        extract->queueMode = QUEUE_SEGMENTED;
+    }
+    else if ( opts->fillGaps || opts->index ) {
+        extract->queueMode = QUEUE_TIMED;
+    }
+    else {
+        extract->queueMode = QUEUE_PACKETS;
+    }
+    if ( opts->container ) {
+        extract->chunkPackets = opts->container->chunkPackets;
+        extract->nextChunkEnd = opts->firstPacket + extract->chunkPackets;
+    }
+
+    // all buffers are allocated up front, a NULL in a ring marks the end
+    // of the stream so each ring needs room for one more than its buffers
+    if ( RING_iInit(&extract->blockRing, opts->queueDepth + 1)
+         || RING_iInit(&extract->blockFreeRing, opts->queueDepth + 1)
+         || RING_iInit(&extract->outRing, NUM_OUTPUT_BUFFERS + 1)
+         || RING_iInit(&extract->outFreeRing, NUM_OUTPUT_BUFFERS + 1) ) {
+        res = -1;
+        goto cleanup;
+    }
+    for (i = 0; i < NUM_OUTPUT_BUFFERS; i++) {
+        extract->outBuffers[i].buff = malloc(opts->blockSize);
+        if ( NULL == extract->outBuffers[i].buff ) {
+            fprintf(stderr, "Error allocating %llu byte output buffer\n",
+                    (long long unsigned)opts->blockSize);
+            res = -1;
+            goto cleanup;
+        }
+        if ( opts->zeroCopy ) {
+            extract->outBuffers[i].rangeList = malloc(MAX_RANGES * sizeof(CopyRangeType));
+            if ( NULL == extract->outBuffers[i].rangeList ) {
+                res = -1;
+                goto cleanup;
+            }
+        }
+        if ( i ) {
+            RING_iTryPush(&extract->outFreeRing, &extract->outBuffers[i]);
+        }
+    }
+    extract->current = &extract->outBuffers[0];
+    if ( opts->fillGaps ) {
+        extract->fillBuff = malloc((uint64_t)FILL_CHUNK_PACKETS * opts->psize);
+        if ( NULL == extract->fillBuff ) {
+            res = -1;
+            goto cleanup;
+        }
+    }
+    if ( opts->fillGaps || opts->index ) {
+        extract->lastWritten = malloc(opts->psize);
+        if ( NULL == extract->lastWritten ) {
+            res = -1;
+            goto cleanup;
+        }
+    }
+
+    res = BLKRD_iOpen(&extract->reader, session, opts->psize, opts->firstPacket, 
+                      opts->lastPacket - opts->firstPacket + 1,
+                      opts->blockSize, opts->queueDepth, opts->backend);
+    if ( res ) {
+        fprintf(stderr, "Error starting reads: return value of BLKRD_iOpen()"
+                " is %d\n", res);
+        res = -2;
+        goto cleanup;
+    }
+    BLKRD_vSetStats(extract->reader, perf);
+    fprintf(stdout, "Reading with %s, %u reads in flight, %s packet checks\n",
+            BLKRD_pcBackendName(extract->reader), (unsigned)opts->queueDepth,
+            PSCAN_pcKernelName());
+    if ( BLKRD_iInitWalker(extract->reader, &walker) ) {
+        res = -1;
+        goto cleanup;
+    }
+
+    if ( pthread_create(&readerThread, NULL, pvReaderStage, extract) ) {
+        res = -3;
+        goto stop;
+    }
+    readerStarted = 1;
+    if ( pthread_create(&writerThread, NULL, pvWriterStage, extract) ) {
+        res = -3;
+        goto stop;
+    }
+    writerStarted = 1;
+
+    // validation stage
+    while ( 1 ) {
+        stallStart = PSTAT_dNow();
+        if ( RING_iPop(&extract->blockRing, (void **)&block, &extract->abortFlag) ) {
+            res = -4;
+            break;
+        }
+        walkStart = PSTAT_dNow();
+        perf->readStallSec += walkStart - stallStart;
+        if ( NULL == block ) {
+            break;
+        }
+        // less the time handing buffers to the writer, which is counted
+        // as the writer's stall
+        stallStart = perf->writeStallSec;
+        if ( BLKRD_iWalkBlock(&walker, block, iExtractSpan, extract) ) {
+            res = -5;
+            break;
+        }
+        perf->validateSec += PSTAT_dNow() - walkStart - (perf->writeStallSec - stallStart);
+        if ( RING_iPush(&extract->blockFreeRing, block, &extract->abortFlag) ) {
+            res = -4;
+            break;
+        }
+    }
+    if ( (0 == res) && (walker.packetIndex != (opts->lastPacket + 1)) ) {
+        fprintf(stderr, "Error: ran out of data at packet %llu\n",
+                (long long unsigned)walker.packetIndex);
+        res = -6;
+    }
+
+    // hand over the partly filled buffer and end the last chunk, then
+    // tell the writer to finish
+    if ( opts->container
+         && (extract->nextChunkEnd - extract->chunkPackets <= opts->lastPacket) ) {
+        ++extract->current->chunkEnds;
+    }
+    extract->current->segment = extract->segment;
+    if ( (0 == res) && (extract->current->numBytes || extract->current->rangeCt
+                        || extract->current->chunkEnds) ) {
+        if ( RING_iPush(&extract->outRing, extract->current, &extract->abortFlag) ) {
+            res = -4;
+        }
+    }
+    if ( 0 == res ) {
+        RING_iPush(&extract->outRing, NULL, &extract->abortFlag);
+    }
+
+stop:
+    if ( res ) {
+        __atomic_store_n(&extract->abortFlag, 1, __ATOMIC_RELEASE);
+    }
+    if ( readerStarted ) {
+        pthread_join(readerThread, NULL);
+    }
+    if ( writerStarted ) {
+        pthread_join(writerThread, NULL);
+    }
+    if ( (0 == res) && (extract->readerRes || extract->writerRes) ) {
+        res = -7;
+    }
+    BLKRD_vFreeWalker(&walker);
+    stats->bytesRead = BLKRD_u64BytesRead(extract->reader);
+    stats->elapsedSec = dGetMonotonicSec() - extract->startSec;
+    stats->readWaitSec = extract->readWaitSec;
+    stats->writeSec = extract->writeSec;
+    stats->bytesCopied = extract->bytesCopied;
+    perf->packetsWritten = stats->packetsWritten;
+    perf->badPackets = stats->badPackets;
+    perf->rfSyncCt = stats->rfSyncCt;
+    perf->writeSec = extract->writeSec;
+    if ( opts->zeroCopy ) {
+        switch (extract->copyMethod) {
+            case COPY_RANGE:
+                copyName = "copy_file_range()";
+                break;
+            case COPY_SPLICE:
+                copyName = "splice()";
+                break;
+            default:
+                copyName = "pread() and write()";
+                break;
+        }
+        fprintf(stdout, "Copied %.2f MB from the device with %s\n",
+                (double)extract->bytesCopied/BYTES_PER_MB, copyName);
+    }
+
+cleanup:
+    BLKRD_vClose(extract->reader);
+    RING_vFree(&extract->blockRing);
+    RING_vFree(&extract->blockFreeRing);
+    RING_vFree(&extract->outRing);
+    RING_vFree(&extract->outFreeRing);
+    PSCAN_vFree(&extract->scan);
+    for (i = 0; i < NUM_OUTPUT_BUFFERS; i++) {
+        free(extract->outBuffers[i].buff);
+        free(extract->outBuffers[i].rangeList);
+    }
+    if ( extract->pipeFd[0] >= 0 ) {
+        close(extract->pipeFd[0]);
+        close(extract->pipeFd[1]);
+    }
+    free(extract->bounce);
+    free(extract->fillBuff);
+    free(extract->lastWritten);
+    free(extract);
+
+    return res;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iCheckChunk()
+// Description : Validates the chunk a worker just read, moving the valid
+//               packets to the front so they can go out in one write, and
+//               keeping the bad ones for the serial step to report in order.
+//               With a channel selection the packets are cut down as they
+//               are moved
+// Parameters  : ParallelWorkerType *worker - The worker owning the chunk
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+static int iCheckChunk(ParallelWorkerType *worker) {
+
+    uint32_t psize = worker->shared->psize;
+    uint32_t outPsize = worker->shared->outPsize;
+    PacketScanType *scan = &worker->scan;
+    uint64_t i, runEnd, first;
+
+    worker->validPackets = 0;
+    worker->badCt = 0;
+    // chunks aren't contiguous, the serial step checks their edges
+    scan->haveTimestamp = 0;
+    if ( PSCAN_iScan(scan, worker->packets, psize, worker->numPackets,
+                     worker->firstPacket) ) {
+        return -1;
+    }
+    worker->rfSyncCt += scan->rfSyncCt;
+    // the first good packet may get overwritten below
+    first = PSCAN_u64RunEnd(scan, 0, 0);
+    if ( first < worker->numPackets ) {
+        worker->firstValidPacket = worker->firstPacket + first;
+        worker->firstTimestamp = PSCAN_u64TimeAt(scan,
+                                     PSCAN_u32ReadTimestamp(worker->packets + first*psize),
+                                     worker->firstValidPacket);
+    }
+
+    i = 0;
+    while ( i < worker->numPackets ) {
+        runEnd = PSCAN_u64RunEnd(scan, i, 1);
+        if ( worker->shared->select ) {
+            SWR_vGather(worker->packets + i*psize, psize, runEnd - i,
+                        worker->shared->select, 
+                        worker->packets + worker->validPackets*outPsize);
+        }
+        // only moves anything once a bad packet has been seen
+        else if ( worker->validPackets != i ) {
+            memmove(worker->packets + worker->validPackets*psize, 
+                    worker->packets + i*psize, (runEnd - i)*psize);
+        }
+        worker->validPackets += runEnd - i;
+        i = runEnd;
+
+        // the start bytes are kept now, the packets get overwritten
+        runEnd = PSCAN_u64RunEnd(scan, i, 0);
+        for (; i < runEnd; i++) {
+            if ( PSCAN_iGrowList((void **)&worker->badList, &worker->badCapacity,
+                                 worker->badCt, sizeof(BadPacketType)) ) {
+                return -1;
+            }
+            worker->badList[worker->badCt].packetIndex = worker->firstPacket + i;
+            worker->badList[worker->badCt].startByte = 
+                worker->packets[i*psize + START_BYTE_IND];
+            ++worker->badCt;
+        }
+    }
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iReadChunk()
+// Description : Reads the packets of a worker's chunk with one read. The
+//               read is widened to the session's I/O alignment so chunks
+//               can go through the direct descriptor
+// Parameters  : ParallelWorkerType *worker - The worker owning the chunk
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+static int iReadChunk(ParallelWorkerType *worker) {
+
+    ParallelExtractType *par = worker->shared;
+    uint64_t align = par->session->ioAlign;
+    uint64_t start, end, readStart, readEnd;
+    double readBeginSec;
+
+    start = par->session->deviceInfo.sectorSize 
+            + worker->firstPacket * par->psize;
+    end = start + worker->numPackets * par->psize;
+    readStart = start - (start % align);
+    readEnd = end + (align - (end % align)) % align;
+    // an unaligned tail at the end of an image just goes through the 
+    // buffered descriptor
+    if ( readEnd > par->session->deviceInfo.deviceSize ) {
+        readEnd = end;
+    }
+
+    readBeginSec = dGetMonotonicSec();
+    if ( DISKIO_iReadBytes(par->session, worker->buff, readStart, 
+                           readEnd - readStart) ) {
+        return -1;
+    }
+    worker->readSec += dGetMonotonicSec() - readBeginSec;
+    PSTAT_vAddRead(par->perf, readEnd - readStart, dGetMonotonicSec() - readBeginSec);
+    worker->packets = worker->buff + (start - readStart);
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iSplitSegments()
+// Description : Splits the valid packets of a worker's chunk by segment
+// Parameters  : ParallelWorkerType *worker - The worker owning the chunk
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+static int iSplitSegments(ParallelWorkerType *worker) {
+
+    ParallelExtractType *par = worker->shared;
+    SegmentPieceType *piece;
+    uint64_t i, pieceEnd, timestamp;
+
+    worker->pieceCt = 0;
+    for (i = 0; i < worker->validPackets; i = pieceEnd) {
+        // valid packet i was at least i packets into the chunk
+        timestamp = PSCAN_u64TimeAt(&worker->scan,
+                                    PSCAN_u32ReadTimestamp(worker->packets
+                                                           + i*par->outPsize),
+                                    worker->firstPacket + i);
+        pieceEnd = EXQ_u64SegmentEnd(par->segments, worker->packets, par->outPsize, i,
+                                     worker->validPackets, timestamp);
+        if ( PSCAN_iGrowList((void **)&worker->pieceList, &worker->pieceCapacity,
+                             worker->pieceCt, sizeof(SegmentPieceType)) ) {
+            return -1;
+        }
+        piece = &worker->pieceList[worker->pieceCt++];
+        piece->segment = EXQ_u64SegmentOf(par->segments, timestamp);
+        piece->first = i;
+        piece->numPackets = pieceEnd - i;
+        piece->firstTimestamp = timestamp;
+        piece->lastTimestamp = PSCAN_u64Unwrap(PSCAN_u32ReadTimestamp(worker->packets
+                                                   + (pieceEnd - 1)*par->outPsize),
+                                               timestamp + (pieceEnd - 1 - i));
+    }
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iPlaceSegments()
+// Description : Part of the serial step. Gives each piece of a worker's
+//               chunk its segment file and offset, starting new segments
+//               as they come up
+// Parameters  : ParallelExtractType *par - The extraction
+//               ParallelWorkerType *worker - The worker owning the chunk
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+static int iPlaceSegments(ParallelExtractType *par, ParallelWorkerType *worker) {
+
+    SegmentSetType *set = par->segments;
+    SegmentPieceType *piece;
+    SegmentType *entry;
+    uint64_t k;
+
+    for (k = 0; k < worker->pieceCt; k++) {
+        piece = &worker->pieceList[k];
+        // a timestamp going back stays in the segment being written
+        if ( (0 == set->segmentCt)
+             || (piece->segment > set->segmentList[set->segmentCt - 1].segment) ) {
+            if ( iStartSegment(set, piece->segment, piece->firstTimestamp) ) {
+                return -1;
+            }
+        }
+        entry = &set->segmentList[set->segmentCt - 1];
+        piece->fd = entry->fd;
+        piece->offset = entry->numPackets * par->outPsize;
+        entry->numPackets += piece->numPackets;
+        entry->lastTimestamp = piece->lastTimestamp;
+        entry->lastRound = par->round;
+    }
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : vPlaceRound()
+// Description : Serial step between validating and writing a round. Runs
+//               on one thread while the rest wait at the barrier. Gives 
+//               each chunk its output offset with a prefix sum over the
+//               valid packet counts, its place in the container, or its
+//               segment files, and reports bad packets and progress in
+//               disk order so the log matches a single threaded run
+// Parameters  : ParallelExtractType *par - The extraction
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+static void vPlaceRound(ParallelExtractType *par) {
+
+    uint32_t t;
+    uint64_t i;
+    double now = dGetMonotonicSec();
+    TimestampJumpType edge;
+    ParallelWorkerType *worker;
+    PerfStatsType *perf = par->perf;
+
+    // every write of the earlier rounds is done, so segments before the
+    // one being written can be listed
+    if ( par->segments && par->segments->segmentCt ) {
+        for (i = 0; i + 1 < par->segments->segmentCt; i++) {
+            if ( (par->segments->segmentList[i].lastRound < par->round)
+                 && iFinishSegment(par->segments, i) ) {
+                par->abortFlag = 1;
+            }
+        }
+    }
+
+    for (t = 0; t < par->numThreads; t++) {
+        worker = &par->workers[t];
+        if ( worker->res ) {
+            par->abortFlag = 1;
+        }
+        if ( 0 == worker->numPackets ) {
+            continue;
+        }
+        if ( now >= par->nextProgressSec ) {
+            fprintf(stdout, "%5.1f%% completed, elapsed time: %5.1f minutes\n", 
+                   (float)(worker->firstPacket - par->firstPacket) 
+                   / (float)(par->lastPacket - par->firstPacket + 1) * 100,
+                   (float)(now - par->startSec)/SEC_PER_MIN );
+            par->nextProgressSec = now + PROGRESS_SEC;
+        }
+        // the gap between two chunks is only seen here, from the last
+        // good packet placed to the chunk's first good one
+        if ( par->haveTimestamp && worker->scan.haveTimestamp ) {
+            edge.packetIndex = worker->firstValidPacket;
+            edge.prevTimestamp = par->lastTimestamp
+                                 + (worker->firstValidPacket - 1 - par->lastValidPacket);
+            edge.timestamp = worker->firstTimestamp;
+            if ( (edge.timestamp - edge.prevTimestamp) != 1 ) {
+                if ( par->integrity && PSCAN_iAddGap(&par->integrity->gaps, &edge) ) {
+                    par->abortFlag = 1;
+                }
+                vCountJump(perf, &edge);
+            }
+        }
+        if ( par->integrity && iLogScan(par->integrity, &worker->scan) ) {
+            par->abortFlag = 1;
+        }
+        if ( worker->scan.haveTimestamp ) {
+            par->haveTimestamp = 1;
+            par->lastValidPacket = worker->scan.lastValidPacket;
+            par->lastTimestamp = worker->scan.lastTime;
+        }
+        for (i = 0; i < worker->scan.jumpCt; i++) {
+            vCountJump(perf, &worker->scan.jumpList[i]);
+        }
+        for (i = 0; i < worker->badCt; i++) {
+            vReportBadPacket(worker->badList[i].packetIndex, 
+                             worker->badList[i].startByte);
+            if ( par->integrity 
+                 && iLogBadPacket(par->integrity, worker->badList[i].packetIndex) ) {
+                par->abortFlag = 1;
+            }
+        }
+        par->stats->badPackets += worker->badCt;
+        par->stats->packetsWritten += worker->validPackets;
+        par->stats->bytesRead += worker->numPackets * par->psize;
+        perf->packetsChecked += worker->numPackets;
+        perf->packetsWritten = par->stats->packetsWritten;
+        perf->badPackets = par->stats->badPackets;
+        perf->bytesWritten += worker->validPackets * par->outPsize;
+
+        if ( par->container ) {
+            if ( CNT_iPlaceChunk(par->container, &worker->chunkHeader,
+                                 &worker->outOffset) ) {
+                par->abortFlag = 1;
+            }
+            continue;
+        }
+        if ( par->segments ) {
+            if ( iPlaceSegments(par, worker) ) {
+                par->abortFlag = 1;
+            }
+            continue;
+        }
+        worker->outOffset = par->outBytes;
+        par->outBytes += worker->validPackets * par->outPsize;
+    }
+    PSTAT_vTick(perf, now);
+    ++par->round;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : pvParallelWorker()
+// Description : Body of each extraction thread. Every round each thread
+//               reads and validates its own chunk, waits for the offsets
+//               to be placed, then writes its valid packets straight to
+//               their spot in the output file
+// Parameters  : void *ctx - ParallelWorkerType of the thread
+// Returns     : void * - NULL, the result is left in the worker
+//////////////////////////////////////////////////////////////////////////
+static void *pvParallelWorker(void *ctx) {
+
+    ParallelWorkerType *worker = (ParallelWorkerType *)ctx;
+    ParallelExtractType *par = worker->shared;
+    uint64_t round, chunk, numPackets, i;
+    SegmentPieceType *piece;
+    int barrierRes;
+    double stepStart, readSec;
+
+    // the barriers need every thread, so nobody starts until all exist
+    pthread_mutex_lock(&par->startLock);
+    while ( !par->started ) {
+        pthread_cond_wait(&par->startCond, &par->startLock);
+    }
+    pthread_mutex_unlock(&par->startLock);
+
+    if ( par->abortFlag ) {
+        return NULL;
+    }
+
+    for (round = 0; round < par->numRounds; round++) {
+        chunk = round * par->numThreads + worker->threadIndex;
+        worker->firstPacket = par->firstPacket + chunk * par->chunkPackets;
+        numPackets = 0;
+        if ( worker->firstPacket <= par->lastPacket ) {
+            numPackets = par->lastPacket + 1 - worker->firstPacket;
+            if ( numPackets > par->chunkPackets ) {
+                numPackets = par->chunkPackets;
+            }
+        }
+        worker->numPackets = numPackets;
+        worker->validPackets = 0;
+        worker->badCt = 0;
+        worker->pieceCt = 0;
+
+        if ( numPackets && (0 == worker->res) ) {
+            stepStart = dGetMonotonicSec();
+            readSec = worker->readSec;
+            if ( iReadChunk(worker) ) {
+                worker->res = -1;
+            }
+            else if ( iCheckChunk(worker) ) {
+                worker->res = -2;
+            }
+            else if ( par->container ) {
+                CNT_vMakeChunkHeader(par->container, &worker->chunkHeader, chunk,
+                                     worker->packets, worker->validPackets);
+            }
+            else if ( par->segments && iSplitSegments(worker) ) {
+                worker->res = -2;
+            }
+            worker->checkSec += dGetMonotonicSec() - stepStart
+                                - (worker->readSec - readSec);
+        }
+
+        barrierRes = pthread_barrier_wait(&par->checked);
+        if ( PTHREAD_BARRIER_SERIAL_THREAD == barrierRes ) {
+            vPlaceRound(par);
+        }
+        pthread_barrier_wait(&par->placed);
+        if ( par->abortFlag ) {
+            break;
+        }
+
+        stepStart = dGetMonotonicSec();
+        if ( par->segments ) {
+            for (i = 0; i < worker->pieceCt; i++) {
+                piece = &worker->pieceList[i];
+                if ( iWriteAt(piece->fd, worker->packets + piece->first*par->outPsize,
+                              piece->numPackets * par->outPsize, piece->offset) ) {
+                    worker->res = -3;
+                    break;
+                }
+            }
+        }
+        else if ( par->container ) {
+            if ( numPackets
+                 && CNT_iWriteChunk(par->outFd, worker->outOffset, &worker->chunkHeader,
+                                    worker->packets, par->outPsize) ) {
+                worker->res = -3;
+            }
+        }
+        else if ( worker->validPackets 
+                  && iWriteAt(par->outFd, worker->packets, 
+                              worker->validPackets * par->outPsize, worker->outOffset) ) {
+            // picked up by the next serial step, or by the caller
+            worker->res = -3;
+        }
+        worker->writeSec += dGetMonotonicSec() - stepStart;
+    }
+
+    return NULL;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iExtractParallel()
+// Description : Copies packets firstPacket to lastPacket from the device
+//               to the output file with several threads. Packets are fixed size
+//               so the span splits into independent chunks; each round
+//               every thread takes the next chunk, the chunks' output
+//               offsets come from a prefix sum of their valid packet
+//               counts and each thread writes its own chunk with pwrite().
+//               The output is identical to iExtractBlocks()
+// Parameters  : DiskSessionType *session - The open device
+//               const ExtractOptionsType *opts - What to extract and where
+//                                                to write it
+//               ExtractStatsType *stats - Totals filled in on return
+//               PerfStatsType *perf - Counters of where the time goes,
+//                                     the times summed over the threads
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+static int iExtractParallel(DiskSessionType *session, const ExtractOptionsType *opts,
+                            ExtractStatsType *stats, PerfStatsType *perf) {
+
+    int res = 0;
+    uint32_t t, started = 0;
+    uint64_t numChunks;
+    ParallelExtractType par;
+    ParallelWorkerType *worker;
+
+    memset(stats, 0, sizeof(*stats));
+    memset(&par, 0, sizeof(par));
+    par.session = session;
+    par.outFd = opts->fpOutput ? fileno(opts->fpOutput) : -1;
+    par.select = opts->select;
+    par.psize = opts->psize;
+    par.outPsize = opts->select
+                   ? CFG_HEADER_BYTES + opts->select->numChannels*CFG_SAMPLE_BYTES
+                   : opts->psize;
+    par.numThreads = opts->numThreads;
+    par.firstPacket = opts->firstPacket;
+    par.lastPacket = opts->lastPacket;
+    par.stats = stats;
+    par.perf = perf;
+    par.integrity = opts->integrity;
+    par.startSec = dGetMonotonicSec();
+    par.nextProgressSec = par.startSec;
+    par.container = opts->container;
+    par.segments = opts->segments;
+    par.chunkPackets = opts->container ? opts->container->chunkPackets
+                                       : opts->blockSize / opts->psize;
+    numChunks = (opts->lastPacket - opts->firstPacket + par.chunkPackets) / par.chunkPackets;
+    par.numRounds = (numChunks + opts->numThreads - 1) / opts->numThreads;
+
+    par.workers = calloc(opts->numThreads, sizeof(*par.workers));
+    if ( NULL == par.workers ) {
+        return -1;
+    }
+    pthread_mutex_init(&par.startLock, NULL);
+    pthread_cond_init(&par.startCond, NULL);
+    for (t = 0; t < opts->numThreads; t++) {
+        worker = &par.workers[t];
+        worker->shared = &par;
+        worker->threadIndex = t;
+        PSCAN_vInit(&worker->scan);
+        PSCAN_vSetTimeBase(&worker->scan, opts->timeBase);
+        // room to widen a chunk's read to the I/O alignment at both ends
+        worker->buff = DISKIO_pu8AllocBuffer(session, 
+                           par.chunkPackets * opts->psize + 2*session->ioAlign);
+        if ( NULL == worker->buff ) {
+            fprintf(stderr, "Error allocating read buffer for thread %u\n",
+                    (unsigned)t);
+            res = -1;
+            goto cleanup;
+        }
+    }
+    if ( pthread_barrier_init(&par.checked, NULL, opts->numThreads) ) {
+        res = -2;
+        goto cleanup;
+    }
+    if ( pthread_barrier_init(&par.placed, NULL, opts->numThreads) ) {
+        pthread_barrier_destroy(&par.checked);
+        res = -2;
+        goto cleanup;
+    }
+
+    fprintf(stdout, "Extracting with %u threads, %s packet checks\n", 
+            (unsigned)opts->numThreads, PSCAN_pcKernelName());
+    for (t = 0; t < opts->numThreads; t++) {
+        if ( pthread_create(&par.workers[t].thread, NULL, pvParallelWorker, 
+                            &par.workers[t]) ) {
+            break;
+        }
+        ++started;
+    }
+    pthread_mutex_lock(&par.startLock);
+    if ( started != opts->numThreads ) {
+        // the barriers can't be passed with a thread missing
+        fprintf(stderr, "Error starting extraction thread %u\n", (unsigned)started);
+        par.abortFlag = 1;
+        res = -3;
+    }
+    par.started = 1;
+    pthread_cond_broadcast(&par.startCond);
+    pthread_mutex_unlock(&par.startLock);
+    for (t = 0; t < started; t++) {
+        pthread_join(par.workers[t].thread, NULL);
+    }
+    pthread_barrier_destroy(&par.checked);
+    pthread_barrier_destroy(&par.placed);
+
+    for (t = 0; t < opts->numThreads; t++) {
+        worker = &par.workers[t];
+        if ( (0 == res) && worker->res ) {
+            res = -4;
+        }
+        stats->rfSyncCt += worker->rfSyncCt;
+        stats->readWaitSec += worker->readSec;
+        perf->validateSec += worker->checkSec;
+        perf->writeSec += worker->writeSec;
+    }
+    perf->rfSyncCt = stats->rfSyncCt;
+    stats->elapsedSec = dGetMonotonicSec() - par.startSec;
+
+cleanup:
+    pthread_mutex_destroy(&par.startLock);
+    pthread_cond_destroy(&par.startCond);
+    for (t = 0; t < opts->numThreads; t++) {
+        free(par.workers[t].buff);
+        free(par.workers[t].badList);
+        free(par.workers[t].pieceList);
+        PSCAN_vFree(&par.workers[t].scan);
+    }
+    free(par.workers);
+
+    return res;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iParseTimeLimit()
+// Description : Parses a --start/--end value: seconds from the start of 
+//               the recording, or a sample timestamp with a "ts" suffix
+// Parameters  : const char *arg - The option value
+//               TimeLimitType *limit - The parsed limit
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+static int iParseTimeLimit(const char *arg, TimeLimitType *limit) {
+
+    char *endPtr;
+
+    limit->value = strtod(arg, &endPtr);
+    if ( (endPtr == arg) || (limit->value < 0) ) {
+        return -1;
+    }
+    if ( 0 == strcmp(endPtr, "ts") ) {
+        limit->isTimestamp = 1;
+    }
+    else if ( ('\0' == *endPtr) || (0 == strcmp(endPtr, "s")) ) {
+        limit->isTimestamp = 0;
+    }
+    else {
+        return -1;
+    }
+    limit->given = 1;
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : u64LimitTarget()
+// Description : Turns a --start/--end limit into samples after packet 0's
+//               timestamp. A timestamp from before the recording started
+//               is taken as its start
+// Parameters  : const TimeLimitType *limit - The parsed limit
+//               uint64_t firstTimestamp - Unwrapped timestamp of packet 0
+//               const char *name - Option name for the message
+// Returns     : uint64_t - Target in samples from the recording start
+//////////////////////////////////////////////////////////////////////////
+static uint64_t u64LimitTarget(const TimeLimitType *limit, 
+                               uint64_t firstTimestamp, const char *name) {
+
+    if ( !limit->isTimestamp ) {
+        return (uint64_t)llround(limit->value * SAMPLING_RATE);
+    }
+    if ( (uint64_t)limit->value < firstTimestamp ) {
+        fprintf(stdout, "--%s %.0fts is before the recording's first timestamp"
+                " %llu, using the start of the recording\n", name, limit->value,
+                (long long unsigned)firstTimestamp);
+        return 0;
+    }
+
+    return (uint64_t)limit->value - firstTimestamp;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iSeekTimestamp()
+// Description : Finds the first packet whose timestamp is at or after a 
+//               target by binary search over the timestamps on the card.
+//               Packet i has timestamp between i and i + nDroppedPackets
+//               (relative to packet 0), which bounds the search to the 
+//               packets that could hold the target before anything is
+//               read. Each step reads a few packets and uses the first
+//               good one, so a corrupt packet doesn't derail the search
+// Parameters  : DiskSessionType *session - The open device
+//               uint32_t psize - Number of bytes per packet
+//               uint64_t lastPacket - Index of the last packet
+//               uint64_t nDroppedPackets - Dropped packets on the card
+//               uint64_t firstTimestamp - Unwrapped timestamp of packet 0
+//               uint64_t target - Timestamp to find, relative to packet 0
+//               uint64_t *packetIndex - The packet, lastPacket + 1 if the
+//                                       recording ends before the target
+//               uint64_t *numReads - Reads made, added to
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+static int iSeekTimestamp(DiskSessionType *session, uint32_t psize, 
+                          uint64_t lastPacket, uint64_t nDroppedPackets,
+                          uint64_t firstTimestamp, uint64_t target,
+                          uint64_t *packetIndex, uint64_t *numReads) {
+
+    uint8_t *buff, *packet;
+    uint64_t lo, hi, mid, n, k;
+    int found, res = 0;
+
+    hi = (target < lastPacket + 1) ? target : lastPacket + 1;
+    lo = (target > nDroppedPackets) ? target - nDroppedPackets : 0;
+    if ( lo > hi ) {
+        lo = hi;
+    }
+    buff = malloc(SEEK_PROBE_PACKETS * psize);
+    if ( NULL == buff ) {
+        return -1;
+    }
+
+    while ( lo < hi ) {
+        mid = lo + (hi - lo)/2;
+        n = lastPacket + 1 - mid;
+        if ( n > SEEK_PROBE_PACKETS ) {
+            n = SEEK_PROBE_PACKETS;
+        }
+        if ( DISKIO_iReadPacket(session, buff, mid, psize, n) ) {
+            res = -2;
+            break;
+        }
+        ++*numReads;
+
+        found = 0;
+        for (k = 0; k < n; k++) {
+            packet = buff + k*psize;
+            if ( packet[START_BYTE_IND] == START_BYTE_VAL ) {
+                found = 1;
+                break;
+            }
+        }
+        // unwrapped against where the packet is, so the search works
+        // across the 32 bit counter's wrap
+        if ( found 
+             && (PSCAN_u64Unwrap(PSCAN_u32ReadTimestamp(packet), firstTimestamp + mid + k)
+                 - firstTimestamp >= target) ) {
+            hi = mid;
+        }
+        else {
+            // anything up to the good packet is before the target, a run
+            // of bad packets is skipped over
+            lo = mid + (found ? k : 0) + 1;
+            if ( lo > hi ) {
+                lo = hi;
+            }
+        }
+    }
+    *packetIndex = lo;
+    free(buff);
+
+    return res;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iWriteReport()
+// Description : Writes the integrity report collected while extracting:
+//               totals, then the gaps as pcheck prints them, the bad 
+//               packets and the RF sync packets
+// Parameters  : char *reportFile - Name of the report file
+//               char *deviceFile - Device the data was extracted from
+//               uint32_t psize - Number of bytes per packet
+//               uint64_t firstPacket - Index of the first packet extracted
+//               uint64_t lastPacket - Index of the last packet extracted
+//               ExtractStatsType *stats - Totals of the extraction
+//               IntegrityLogType *integrity - What was found
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+static int iWriteReport(char *reportFile, char *deviceFile, uint32_t psize,
+                        uint64_t firstPacket, uint64_t lastPacket, 
+                        ExtractStatsType *stats, IntegrityLogType *integrity) {
+
+    FILE *fpReport;
+    uint64_t i;
+    TimestampJumpType *gap;
+    double elapsedSec = stats->elapsedSec;
+
+    fpReport = fopen(reportFile, "w");
+    if ( NULL == fpReport ) {
+        fprintf(stderr, "Error opening report file %s: %s\n", 
+                reportFile, strerror(errno));
+        return -1;
+    }
+
+    fprintf(fpReport, "Device: %s\n", deviceFile);
+    fprintf(fpReport, "Packet size: %u bytes/packet\n", (unsigned)psize);
+    fprintf(fpReport, "Packets checked: %llu, %llu to %llu (%.2f minutes)\n",
+            (long long unsigned)(lastPacket - firstPacket + 1),
+            (long long unsigned)firstPacket, (long long unsigned)lastPacket,
+            (double)(lastPacket - firstPacket + 1)/SAMPLING_RATE/SEC_PER_MIN);
+    fprintf(fpReport, "Packets written: %llu\n", 
+            (long long unsigned)stats->packetsWritten);
+    if ( stats->packetsFilled ) {
+        fprintf(fpReport, "Placeholders for dropped and bad packets: %llu\n",
+                (long long unsigned)stats->packetsFilled);
+    }
+    fprintf(fpReport, "Dropped packets: %llu (%.2f sec) in %llu gaps\n",
+            (long long unsigned)integrity->gaps.droppedPackets,
+            (double)integrity->gaps.droppedPackets/SAMPLING_RATE,
+            (long long unsigned)(integrity->gaps.gapCt
+                                 - integrity->gaps.discontinuityCt));
+    if ( integrity->gaps.discontinuityCt ) {
+        fprintf(fpReport, "Timestamp discontinuities: %llu, not counted as"
+                " dropped packets\n",
+                (long long unsigned)integrity->gaps.discontinuityCt);
+    }
+    fprintf(fpReport, "Bad packets: %llu\n", (long long unsigned)integrity->badCt);
+    fprintf(fpReport, "RF sync values: %llu\n", 
+            (long long unsigned)integrity->rfSyncCt);
+    fprintf(fpReport, "Read %.2f MB in %.1f sec (%.1f MB/s)\n",
+            (double)stats->bytesRead/BYTES_PER_MB, elapsedSec,
+            (elapsedSec > 0) ? (double)stats->bytesRead/BYTES_PER_MB/elapsedSec : 0.0);
+
+    fprintf(fpReport, "\nGaps:\n");
+    for (i = 0; i < integrity->gaps.gapCt; i++) {
+        gap = &integrity->gaps.gapList[i];
+        if ( (int64_t)(gap->timestamp - gap->prevTimestamp) < 0 ) {
+            fprintf(fpReport, "Timestamp goes back by %llu after packet %llu \n",
+                    (long long unsigned)(gap->prevTimestamp - gap->timestamp),
+                    (long long unsigned)(gap->packetIndex - 1) );
+            continue;
+        }
+        fprintf(fpReport, "%llu dropped packets after packet %llu \n",
+                (long long unsigned)PSCAN_u64Dropped(gap),
+                (long long unsigned)(gap->packetIndex - 1) );
+    }
+    fprintf(fpReport, "\nBad packets:\n");
+    for (i = 0; i < integrity->badCt; i++) {
+        fprintf(fpReport, "%llu\n", (long long unsigned)integrity->badList[i]);
+    }
+    fprintf(fpReport, "\nRF sync packets:\n");
+    for (i = 0; i < integrity->rfSyncCt; i++) {
+        fprintf(fpReport, "%llu\n", (long long unsigned)integrity->rfSyncList[i]);
+    }
+
+    if ( fclose(fpReport) ) {
+        fprintf(stderr, "Error closing report file %s\n", reportFile);
+        return -2;
+    }
+
+    return 0;
+
+}
 
 //////////////////////////////////////////////////////////////////////////
 // Function     : main()
 // Description  : main function for extracting data recorded on disk
 // CL arguments : device file name
 //                file name for extracted data
+//                -b, --block-size MB: size of each device read, optional
+//                -d, --direct: bypass the page cache when reading, optional
+//                -q, --queue-depth N: number of reads in flight, optional
+//                --io-threads: use a thread pool instead of io_uring, optional
+//                --threads N: extract with N threads, optional
+//                -r, --report FILE: write an integrity report, optional
+//                --start T, --end T: extract only this time range, optional
+//                --format NAME: packets, channels, blocked, compressed,
+//                container or npy, optional
+//                --channels LIST: extract only these channels, optional
+//                --fill-gaps MODE: zero, last or sparse, write a placeholder
+//                for each missing timestamp, optional
+//                --index: write a timestamp index to OUTPUT.idx, optional
+//                --segment-minutes N: one output file per N minutes, listed
+//                in OUTPUT.manifest, optional
+//                --zero-copy: have the kernel copy runs of valid packets,
+//                optional
+//                --stats FILE: write performance counters as JSON, optional
+//                --stats-fd N: write a JSON line of them every interval to
+//                descriptor N, optional
+//                --stats-interval SEC: time between those lines, optional
 // Returns      : int - 0 if success, 1 if usage screen was displayed, 
 //                negative value otherwise
 //////////////////////////////////////////////////////////////////////////
@@ -30,51 +1816,317 @@ int main (int argc, char *argv[])
 {
     char deviceFile[MAX_FNAME_LENGTH];
     char outputFile[MAX_FNAME_LENGTH];
-    int i, readAccessRes, deviceInfoRes, readPacketRes, readDiskRes;
-    int rfSyncCt;
-    time_t startTime;
+    char indexFile[MAX_FNAME_LENGTH + 4];
+    char *endPtr, *reportFile, *statsFile;
+    int i, readAccessRes, deviceInfoRes, readDiskRes, endRes;
+    int extractRes, opt, nArgs, useDirectIO, statsFd;
+    uint64_t rfSyncCt;
+    double elapsedSec, statsIntervalSec;
     uint8_t buff[BUFFER_LENGTH];
-    uint32_t shift, psize;
-    uint64_t bytesWritten;
-    uint64_t lastPacket, maxNumPackets, nPacketsProgress;
-    uint64_t nDroppedPackets;
-    uint64_t nDroppedPacketsCounted, packetIndex;
+    uint32_t psize;
+    uint32_t queueDepth, numThreads;
+    uint64_t lastPacket, maxNumPackets, blockSize, blockMB;
+    uint64_t nDroppedPackets, firstPacket, endPacket, target, numSeekReads;
+    uint64_t firstTimestamp;
+    TimeLimitType startLimit, endLimit;
     FilePermissionType permission;
-    DeviceInfoType deviceInfo;
-    FILE *fpDevice, *fpOutput;
+    DiskSessionType session;
+    const RecordingEndType *recordingEnd;
+    ExtractStatsType extractStats;
+    ExtractOptionsType opts;
+    PerfStatsType perf;
+    IntegrityLogType integrity;
+    BlockReaderBackendType backend;
+    SampleFormatType format;
+    ChannelMapType channelMap, outputMap;
+    ChannelSelectType channelSelect;
+    uint8_t wantedChannels[CFG_MAX_CHANNELS];
+    int selectChannels;
+    FillModeType fillGaps;
+    int writeIndex;
+    PacketIndexType index;
+    SampleWriterType *samples;
+    ContainerHeaderType containerHeader;
+    ContainerWriterType container;
+    uint32_t segmentMinutes;
+    SegmentSetType segments;
+    int zeroCopy;
+    FILE *fpOutput;
+    static struct option longOptions[] = {
+        {"block-size", required_argument, 0, 'b'},
+        {"direct", no_argument, 0, 'd'},
+        {"queue-depth", required_argument, 0, 'q'},
+        {"io-threads", no_argument, 0, 't'},
+        {"threads", required_argument, 0, 'j'},
+        {"report", required_argument, 0, 'r'},
+        {"start", required_argument, 0, 's'},
+        {"end", required_argument, 0, 'e'},
+        {"format", required_argument, 0, 'f'},
+        {"channels", required_argument, 0, 'c'},
+        {"fill-gaps", required_argument, 0, 'g'},
+        {"index", no_argument, 0, 'i'},
+        {"segment-minutes", required_argument, 0, 'm'},
+        {"zero-copy", no_argument, 0, 'z'},
+        {"stats", required_argument, 0, 'S'},
+        {"stats-fd", required_argument, 0, 'F'},
+        {"stats-interval", required_argument, 0, 'I'},
+        {0, 0, 0, 0}
+    };
 
     // turn off output buffering
     setvbuf(stdout, 0, _IONBF, 0);
     setvbuf(stderr, 0, _IONBF, 0);
 
-    startTime = time(NULL);
+    fprintf(stdout, "\n*** sd_card_extract 1.1 ***\n");
 
-    fprintf(stdout, "\n*** sd_card_extract 1.0 ***\n");
+    blockMB = DEFAULT_BLOCK_MB;
+    useDirectIO = 0;
+    queueDepth = BLKRD_DEFAULT_QUEUE_DEPTH;
+    backend = BLKRD_BACKEND_AUTO;
+    numThreads = 1;
+    reportFile = NULL;
+    format = SWR_FORMAT_PACKETS;
+    selectChannels = 0;
+    fillGaps = FILL_NONE;
+    writeIndex = 0;
+    segmentMinutes = 0;
+    zeroCopy = 0;
+    statsFile = NULL;
+    statsFd = -1;
+    statsIntervalSec = PSTAT_DEFAULT_INTERVAL_SEC;
+    PSTAT_vInit(&perf, "sd_card_extract");
+    samples = NULL;
+    fpOutput = NULL;
+    memset(&containerHeader, 0, sizeof(containerHeader));
+    memset(&startLimit, 0, sizeof(startLimit));
+    memset(&endLimit, 0, sizeof(endLimit));
+    while ( -1 != (opt = getopt_long(argc, argv, "b:dq:r:", longOptions, NULL)) ) {
+        switch (opt) {
+            case 'b':
+                blockMB = strtoull(optarg, &endPtr, 10);
+                if ( ('\0' != *endPtr) || (0 == blockMB) || (MAX_BLOCK_MB < blockMB) ) {
+                    fprintf(stderr, "\nBlock size must be between 1 and %d MB\n",
+                            MAX_BLOCK_MB);
+                    return -1;
+                }
+                break;
+            case 'd':
+                useDirectIO = 1;
+                break;
+            case 'q':
+                queueDepth = (uint32_t)strtoul(optarg, &endPtr, 10);
+                if ( ('\0' != *endPtr) || (0 == queueDepth) 
+                     || (BLKRD_MAX_QUEUE_DEPTH < queueDepth) ) {
+                    fprintf(stderr, "\nQueue depth must be between 1 and %d\n",
+                            BLKRD_MAX_QUEUE_DEPTH);
+                    return -1;
+                }
+                break;
+            case 't':
+                backend = BLKRD_BACKEND_THREADS;
+                break;
+            case 'r':
+                reportFile = optarg;
+                break;
+            case 's':
+            case 'e':
+                if ( iParseTimeLimit(optarg, ('s' == opt) ? &startLimit : &endLimit) ) {
+                    fprintf(stderr, "\nTimes are seconds from the start of the"
+                            " recording, or a sample timestamp ending in ts"
+                            " e.g. 1800000ts\n");
+                    return -1;
+                }
+                break;
+            case 'j':
+                numThreads = (uint32_t)strtoul(optarg, &endPtr, 10);
+                if ( ('\0' != *endPtr) || (0 == numThreads) 
+                     || (MAX_EXTRACT_THREADS < numThreads) ) {
+                    fprintf(stderr, "\nNumber of threads must be between 1 and %d\n",
+                            MAX_EXTRACT_THREADS);
+                    return -1;
+                }
+                break;
+            case 'f':
+                if ( SWR_iParseFormat(optarg, &format) ) {
+                    fprintf(stderr, "\nFormat must be packets, channels, blocked,"
+                            " compressed, container or npy\n");
+                    return -1;
+                }
+                break;
+            case 'c':
+                if ( CFG_iParseChannelList(optarg, wantedChannels) ) {
+                    fprintf(stderr, "\nChannels are a list of channels 0-%d and"
+                            " ranges, e.g. 0-3,64, or a hex mask e.g. 0xF000F\n",
+                            CFG_MAX_CHANNELS - 1);
+                    return -1;
+                }
+                selectChannels = 1;
+                break;
+            case 'g':
+                if ( 0 == strcmp(optarg, "zero") ) {
+                    fillGaps = FILL_ZERO;
+                }
+                else if ( 0 == strcmp(optarg, "last") ) {
+                    fillGaps = FILL_LAST;
+                }
+                else if ( 0 == strcmp(optarg, "sparse") ) {
+                    fillGaps = FILL_SPARSE;
+                }
+                else {
+                    fprintf(stderr, "\nGaps are filled with zero, last or sparse\n");
+                    return -1;
+                }
+                break;
+            case 'i':
+                writeIndex = 1;
+                break;
+            case 'm':
+                segmentMinutes = (uint32_t)strtoul(optarg, &endPtr, 10);
+                if ( ('\0' != *endPtr) || (0 == segmentMinutes) ) {
+                    fprintf(stderr, "\nSegments must be at least 1 minute\n");
+                    return -1;
+                }
+                break;
+            case 'z':
+                zeroCopy = 1;
+                break;
+            case 'S':
+                statsFile = optarg;
+                break;
+            case 'F':
+                statsFd = (int)strtol(optarg, &endPtr, 10);
+                if ( ('\0' != *endPtr) || (statsFd < 1) ) {
+                    fprintf(stderr, "\nStats descriptor must be an open file"
+                            " descriptor, e.g. 1 for stdout\n");
+                    return -1;
+                }
+                break;
+            case 'I':
+                statsIntervalSec = strtod(optarg, &endPtr);
+                if ( ('\0' != *endPtr) || !(statsIntervalSec > 0) ) {
+                    fprintf(stderr, "\nStats interval must be more than 0 seconds\n");
+                    return -1;
+                }
+                break;
+            default:
+                return -1;
+        }
+    }
+    nArgs = argc - optind;
+    if ( (SWR_FORMAT_PACKETS != format) && (SWR_FORMAT_CONTAINER != format)
+         && (numThreads > 1) ) {
+        fprintf(stderr, "\n--threads only writes the packets and container formats\n");
+        return -1;
+    }
+    if ( fillGaps && (numThreads > 1) ) {
+        fprintf(stderr, "\n--fill-gaps doesn't work with --threads\n");
+        return -1;
+    }
+    if ( writeIndex && (numThreads > 1) ) {
+        fprintf(stderr, "\n--index doesn't work with --threads\n");
+        return -1;
+    }
+    if ( (FILL_SPARSE == fillGaps) && (SWR_FORMAT_PACKETS != format) ) {
+        fprintf(stderr, "\n--fill-gaps sparse only writes the packets format\n");
+        return -1;
+    }
+    if ( (SWR_FORMAT_CONTAINER == format) && (fillGaps || writeIndex) ) {
+        fprintf(stderr, "\nThe container keeps its own index and doesn't fill gaps\n");
+        return -1;
+    }
+    if ( segmentMinutes
+         && ((SWR_FORMAT_PACKETS != format) || fillGaps || writeIndex) ) {
+        fprintf(stderr, "\n--segment-minutes only writes the packets format, without"
+                " --fill-gaps or --index\n");
+        return -1;
+    }
+    // the kernel copies whole packets from the card as they are
+    if ( zeroCopy
+         && ((SWR_FORMAT_PACKETS != format) || selectChannels || fillGaps
+             || writeIndex || segmentMinutes || (numThreads > 1)) ) {
+        fprintf(stderr, "\n--zero-copy only writes all channels in the packets"
+                " format, without --fill-gaps,\n--index, --segment-minutes or"
+                " --threads\n");
+        return -1;
+    }
+    // copies are read through the page cache, where the checks left the data
+    if ( zeroCopy && useDirectIO ) {
+        fprintf(stderr, "\n--zero-copy doesn't work with --direct\n");
+        return -1;
+    }
 
-    if ( 1 == argc) {
-        fprintf(stdout, "\nUsage: sd_card_extract [DEVICE_FILENAME]" 
+    if ( 0 == nArgs) {
+        fprintf(stdout, "\nUsage: sd_card_extract [OPTIONS] [DEVICE_FILENAME]" 
                 " [EXTRACTED_DATA_FILENAME]\n");
         fprintf(stdout, "Example: `sd_card_extract /dev/sdb extracted_data.dat`\n");
+        fprintf(stdout, "Options:\n");
+        fprintf(stdout, "  -b, --block-size MB   size of each read from the device"
+                " (default %d)\n", DEFAULT_BLOCK_MB);
+        fprintf(stdout, "  -d, --direct          read with O_DIRECT so the card"
+                " doesn't fill the page cache\n");
+        fprintf(stdout, "  -q, --queue-depth N   number of reads kept in flight"
+                " (default %d)\n", BLKRD_DEFAULT_QUEUE_DEPTH);
+        fprintf(stdout, "      --io-threads      issue reads from a thread pool"
+                " instead of io_uring\n");
+        fprintf(stdout, "      --threads N       read, check and write N blocks"
+                " at once (default 1)\n");
+        fprintf(stdout, "  -r, --report FILE     also write the gaps, bad packets"
+                " and RF syncs to FILE\n");
+        fprintf(stdout, "      --start T         extract from time T, in seconds"
+                " or a timestamp e.g. 1800000ts\n");
+        fprintf(stdout, "      --end T           extract up to, not including,"
+                " time T\n");
+        fprintf(stdout, "      --format NAME     packets (default), channels: one"
+                " file per channel,\n"
+                "                        blocked: one channel-major file. Both"
+                " add FILE.hdr\n"
+                "                        compressed: lossless, read back with"
+                " sd_decompress\n"
+                "                        container: chunks of %d sec with an"
+                " index and the card\n"
+                "                        configuration\n"
+                "                        npy: int16 (packets, channels) array"
+                " and FILE_ts.npy\n", CNT_CHUNK_SEC);
+        fprintf(stdout, "      --channels LIST   extract only these channels,"
+                " e.g. 0-3,64 or 0xF000F\n");
+        fprintf(stdout, "      --fill-gaps MODE  one packet per timestamp, dropped"
+                " ones made up with\n"
+                "                        zero or last samples, or sparse:"
+                " left as holes in FILE\n");
+        fprintf(stdout, "      --index           also write FILE.idx to find"
+                " timestamps without a scan\n");
+        fprintf(stdout, "      --segment-minutes N  one file per N minutes,"
+                " FILE_segNNNN, listed in\n"
+                "                        FILE.manifest\n");
+        fprintf(stdout, "      --zero-copy       have the kernel copy runs of"
+                " valid packets from the\n"
+                "                        device to FILE\n");
+        fprintf(stdout, "      --stats FILE      write read, check and write"
+                " counters to FILE as JSON\n");
+        fprintf(stdout, "      --stats-fd N      write a JSON line of them to"
+                " descriptor N every interval\n");
+        fprintf(stdout, "      --stats-interval SEC  time between those lines"
+                " (default %.0f)\n", PSTAT_DEFAULT_INTERVAL_SEC);
         return 1;
     }
-    else if ( 2 == argc) {
+    else if ( 1 == nArgs) {
         fprintf(stderr, "\nNot enough arguments!\n");
         return -1;
     }
-    else if ( 2 < argc ) {
-        if ( 3 < argc) {
+    else if ( 1 < nArgs ) {
+        if ( 2 < nArgs) {
             fprintf(stderr, "\nYou specified %d arguments when sd_card_extract "
-                    "only uses 2. Ignoring extra arguments\n", argc - 1);
+                    "only uses 2. Ignoring extra arguments\n", nArgs);
         }
 
         // check file name lengths
-        strncpy(deviceFile, argv[1], MAX_FNAME_LENGTH);
-        strncpy(outputFile, argv[2], MAX_FNAME_LENGTH);
-        if ( '\0' != deviceFile[MAX_FNAME_LENGTH-1] ) {
+        if ( snprintf(deviceFile, sizeof(deviceFile), "%s", argv[optind])
+             >= (int)sizeof(deviceFile) ) {
             fprintf(stderr, "\nMaximum device file name length exceeded.\n");
             return -2;
         }
-        if ( '\0' != outputFile[MAX_FNAME_LENGTH-1] ) {
+        if ( snprintf(outputFile, sizeof(outputFile), "%s", argv[optind + 1])
+             >= (int)sizeof(outputFile) ) {
             fprintf(stderr, "\nMaximum output file name length exceeded.\n");
             return -3;
         }
@@ -89,23 +2141,20 @@ int main (int argc, char *argv[])
             return -4;
         }
 
-        // check that device information can be determined
-        // have gotten strange results when using uninitialized deviceInfo so 
-        // initialize here. In general it never hurts to initialize anyway  
-        memset(&deviceInfo, 0, sizeof(deviceInfo));
-        deviceInfoRes = DISKIO_iGetDeviceInfo(deviceFile, &deviceInfo);
+        // open the device once and determine its information
+        deviceInfoRes = DISKIO_iOpenSession(deviceFile, READ_ACCESS, &session);
         if ( 0 != deviceInfoRes ) {
             fprintf(stderr, "\nError checking device info: return value"
-                    " of DISKIO_iGetDevice() is %d\n",
+                    " of DISKIO_iOpenSession() is %d\n",
                     deviceInfoRes);
             return -5;
         }        
 
         // read second and third sectors (first sector is configuration info)
-        readDiskRes = DISKIO_iReadDisk(deviceFile, buff, 1, 2, &deviceInfo);
+        readDiskRes = DISKIO_iReadSectors(&session, buff, 1, 2);
         if ( 0 != readDiskRes ) {
             fprintf(stderr, "\nError reading from device: "
-                    "return value of DISKIO_iReadDisk() is %d\n", readDiskRes);
+                    "return value of DISKIO_iReadSectors() is %d\n", readDiskRes);
             return -6;
         }
         // check first packet header
@@ -114,13 +2163,14 @@ int main (int argc, char *argv[])
             return -7;
         }
         // search for the next packet header
+        i = 0;
         while (((buff[i] != START_BYTE_VAL) ||
                 (buff[i + TIMESTAMP_START_IND] != 0x01) ||
                 (buff[i + TIMESTAMP_START_IND + 1] != 0x00) ||
                 (buff[i + TIMESTAMP_START_IND + 2] != 0x00) ||
                 (buff[i + TIMESTAMP_START_IND + 3] != 0x00)) &&
-                (i++ < deviceInfo.sectorSize));
-        if (i >= deviceInfo.sectorSize) {
+                ((uint64_t)i++ < session.deviceInfo.sectorSize));
+        if ((uint64_t)i >= session.deviceInfo.sectorSize) {
             fprintf(stderr, "\nCan't find the second packet start!\n");
             return -6;
         } 
@@ -128,76 +2178,69 @@ int main (int argc, char *argv[])
             psize = i;
         }
 
-        fpDevice = fopen(deviceFile, "r");
-        if ( NULL == fpDevice ) {
-            fprintf(stderr, "Could not open %s to extract data!\n", deviceFile);
-            return -8;
-        }
-
         fprintf(stdout, "Packet size: %u bytes/packet\n", (unsigned)psize);
 
+        // channel-major output, channel selection and the index need to
+        // know which channel is in each slot
+        if ( (SWR_FORMAT_PACKETS != format) || selectChannels || writeIndex ) {
+            readDiskRes = DISKIO_iReadSectors(&session, buff, 0, 1);
+            if ( 0 != readDiskRes ) {
+                fprintf(stderr, "\nError reading the configuration sector: "
+                        "return value of DISKIO_iReadSectors() is %d\n", readDiskRes);
+                return -6;
+            }
+            if ( CFG_iDecodeChannelMap(buff, &channelMap)
+                 || (CFG_u32PacketSize(&channelMap) != psize) ) {
+                fprintf(stderr, "\nThe configuration sector doesn't match the"
+                        " packet size (%u channels enabled)\n",
+                        (unsigned)channelMap.numChannels);
+                return -21;
+            }
+            outputMap = channelMap;
+            memcpy(containerHeader.configSector, buff,
+                   sizeof(containerHeader.configSector));
+        }
+        if ( selectChannels ) {
+            if ( CFG_iSelectChannels(&channelMap, wantedChannels, &channelSelect,
+                                     &outputMap) ) {
+                fprintf(stderr, "\nCan't extract the requested channels\n");
+                return -22;
+            }
+            fprintf(stdout, "Extracting %u of %u channels, %u bytes/packet out\n",
+                    (unsigned)outputMap.numChannels, (unsigned)channelMap.numChannels,
+                    (unsigned)CFG_u32PacketSize(&outputMap));
+        }
+
         // Maximum packets is device size - size of one sector 
-        maxNumPackets = ( (deviceInfo.sectorCount -1) * deviceInfo.sectorSize)/psize;
+        maxNumPackets = ( (session.deviceInfo.sectorCount -1) * session.deviceInfo.sectorSize)/psize;
         fprintf(stdout, "Maximum packets on the disk = %llu (%.2f minutes)\n",
                 (long long unsigned)maxNumPackets,
                 (double)maxNumPackets/SAMPLING_RATE/60.0 );
 
-        lastPacket = 1;
-        shift = 0;
-        // determine the most significant bit of the maximum packet index
-        while (lastPacket < maxNumPackets) {
-            shift++;
-            lastPacket = lastPacket<<1;
-        }
-        lastPacket = 0;
-        for (i = shift; i >= 0; i--) {
-            lastPacket |= (1<<i);
-            if (lastPacket >= maxNumPackets) {
-                lastPacket &= ~(1<<i);
-                continue;
-            }
-            readPacketRes = DISKIO_iReadPacket(fpDevice, buff, 
-                                               lastPacket, psize, 1,
-                                               &deviceInfo);
-            if ( readPacketRes ) {
-                fprintf(stderr, "\nError reading packet %llu: return value"
-                        " of DISKIO_iReadPacket() is %d\n", 
-                        (long long unsigned)lastPacket, 
-                        readPacketRes);
-                return -9;
-            } 
-            else if (buff[START_BYTE_IND] != START_BYTE_VAL) {
-                // packet that was just read is greater than the actual last
-                // packet since the starting byte of the packet is not 
-                // START_BYTE_VAL. so set bit i to 0, set bits NOT i to 1, 
-                // and bit wise AND to keep all NOT i bits in lastPacket the 
-                // same as before. Next iteration of for loop will check 
-                // bit i-1 to see whether there is a valid packet.
-                lastPacket &= ~(1<<i);
-            }
-        }
-        if (lastPacket < (maxNumPackets-1)) {
-            // Disk not full, don't use the last recorded packet since it might not be complete
-            lastPacket--;
-        }
-
-        fprintf(stdout, "Packets recorded on the disk = %lu (%.2f minutes)\n",
-                (long unsigned)(lastPacket + 1),
+        // find where the recording ends, leaving out anything an older
+        // recording left on the card after it
+        endRes = REND_iLocate(&session, psize, &recordingEnd);
+        if ( endRes ) {
+            fprintf(stderr, "\nError finding the end of the recording: return value"
+                    " of REND_iLocate() is %d\n", endRes);
+            return -9;
+        }
+        lastPacket = recordingEnd->lastPacket;
+        fprintf(stdout, "Packets recorded on the disk = %llu (%.2f minutes)\n",
+                (long long unsigned)(lastPacket + 1),
                 (double)(lastPacket+1)/SAMPLING_RATE/60.0 );
-        readPacketRes = DISKIO_iReadPacket(fpDevice, buff, lastPacket, psize, 1, &deviceInfo);
-        if (readPacketRes) {
-            fprintf(stderr, "\nError reading last packet recorded on disk: return value"
-                    " of DISKIO_iReadPacket() is %d\n", readPacketRes);
-            return -10;
+        fprintf(stdout, "End of the recording found with %llu reads\n",
+                (long long unsigned)recordingEnd->numReads);
+        if ( recordingEnd->olderDataFound ) {
+            fprintf(stdout, "Packets of an older recording follow it on the"
+                    " disk, they are not extracted\n");
         }
         
         // if there are dropped packets, the timestamp of the last packet will be greater
-        // than the number of packets recorded on disk
-        nDroppedPackets = (buff[TIMESTAMP_START_IND + 3] << 24 |
-                           buff[TIMESTAMP_START_IND + 2] << 16 |
-                           buff[TIMESTAMP_START_IND + 1] <<  8 |
-                           buff[TIMESTAMP_START_IND])
-                           - lastPacket;
+        // than the number of packets recorded on disk. Timestamps are 32 bits
+        // and wrap on the largest cards, so the last one is unwrapped first
+        nDroppedPackets = PSCAN_u64Unwrap((uint32_t)recordingEnd->lastTimestamp,
+                                          lastPacket) - lastPacket;
         if ( nDroppedPackets ) {
             fprintf(stdout, "Dropped packets = %llu (%.2f msec = %.2f sec)\n", 
                     (long long unsigned)nDroppedPackets, 
@@ -208,92 +2251,214 @@ int main (int argc, char *argv[])
             fprintf(stdout, "No dropped packets\n");
         }
 
-        fprintf(stdout, "Extracting the data:\n");
-        fpOutput = fopen(outputFile, "w");
-        if ( NULL == fpOutput ) {
-            fprintf(stderr, "Error opening file %s to extract data to!\n", outputFile);
-            return -11;
-        }
-        packetIndex = 0;
-
-        // will be used to display how frequently progress occurs 
-        nPacketsProgress = floor(0.01 * lastPacket * PROGRESS_PERCENT);
-        
-        // read NUM_PACKETS at a time
-        while ( (packetIndex + NUM_PACKETS) < lastPacket ) {
-            if ( packetIndex % nPacketsProgress == 0 ) {
-                fprintf(stdout, "%5.1f%% completed, elapsed time: %5.1f minutes\n", 
-                       (float)packetIndex / (float)lastPacket * 100,
-                       (float)(time(NULL) - startTime)/SEC_PER_MIN );
-            }
-
-            readPacketRes = DISKIO_iReadPacket(fpDevice, buff, packetIndex, 
-                                              psize, NUM_PACKETS, &deviceInfo);
-            if ( readPacketRes ) {
-                fprintf(stderr, "Error reading packets %llu to %llu!\n",
-                        (long long unsigned)packetIndex,
-                        (long long unsigned)(packetIndex + NUM_PACKETS - 1) );
-                return -12;
-            }
-
-            // check that value of start byte is as expected for sd recording
-            if ( buff[START_BYTE_IND] == START_BYTE_VAL ) {
-                if ( buff[FLAG_BYTE_IND] == RF_VALID_VAL ) {
-                    ++rfSyncCt;
+        // every timestamp is unwrapped against packet 0's, wherever the
+        // extraction starts. Then locate the requested time range, so only
+        // its packets are read
+        firstTimestamp = recordingEnd->firstTimestamp;
+        firstPacket = 0;
+        if ( startLimit.given || endLimit.given ) {
+            numSeekReads = 0;
+            endPacket = lastPacket + 1;
+            if ( startLimit.given ) {
+                target = u64LimitTarget(&startLimit, firstTimestamp, "start");
+                if ( iSeekTimestamp(&session, psize, lastPacket, nDroppedPackets,
+                                    firstTimestamp, target, &firstPacket, 
+                                    &numSeekReads) ) {
+                    return -19;
                 }
-                bytesWritten = (uint64_t)fwrite(buff, 1, psize*NUM_PACKETS, fpOutput);
-                if ( (psize*NUM_PACKETS) != bytesWritten ) {
-                fprintf(stderr, "Error: %llu bytes requested to write but %llu"
-                        " bytes actually written when writing packets %llu to %llu\n",
-                        (long long unsigned)(psize*NUM_PACKETS),
-                        (long long unsigned)bytesWritten,
-                        (long long unsigned)packetIndex,
-                        (long long unsigned)(packetIndex + NUM_PACKETS - 1) );
-                return -13;
+            }
+            if ( endLimit.given ) {
+                target = u64LimitTarget(&endLimit, firstTimestamp, "end");
+                if ( iSeekTimestamp(&session, psize, lastPacket, nDroppedPackets,
+                                    firstTimestamp, target, &endPacket, 
+                                    &numSeekReads) ) {
+                    return -19;
                 }
             }
+            if ( endPacket <= firstPacket ) {
+                fprintf(stderr, "\nNo packets recorded in the requested time range\n");
+                return -20;
+            }
+            lastPacket = endPacket - 1;
+            fprintf(stdout, "Time range is packets %llu to %llu (%.2f minutes),"
+                    " found with %llu reads\n",
+                    (long long unsigned)firstPacket, (long long unsigned)lastPacket,
+                    (double)(lastPacket - firstPacket + 1)/SAMPLING_RATE/SEC_PER_MIN,
+                    (long long unsigned)numSeekReads);
+        }
+
+        if ( useDirectIO ) {
+            DISKIO_iEnableDirectIO(&session);
+        }
+        fprintf(stdout, "Extracting the data in %llu MB blocks:\n",
+                (long long unsigned)blockMB);
+        blockSize = blockMB * BYTES_PER_MB;
+        if ( segmentMinutes ) {
+            // segments are timed from the first packet on the card, so
+            // they line up whatever --start is
+            if ( iOpenSegmentSet(&segments, outputFile, firstTimestamp,
+                                 (uint64_t)segmentMinutes*SEC_PER_MIN*SAMPLING_RATE) ) {
+                return -11;
+            }
+            fprintf(stdout, "Writing %u minute segments\n", (unsigned)segmentMinutes);
+        }
+        else if ( (SWR_FORMAT_PACKETS == format) || (SWR_FORMAT_CONTAINER == format) ) {
+            fpOutput = fopen(outputFile, "w");
+            if ( NULL == fpOutput ) {
+                fprintf(stderr, "Error opening file %s to extract data to!\n", outputFile);
+                return -11;
+            }
+        }
+        if ( SWR_FORMAT_CONTAINER == format ) {
+            containerHeader.psize = CFG_u32PacketSize(&outputMap);
+            containerHeader.numChannels = outputMap.numChannels;
+            containerHeader.samplingRate = SAMPLING_RATE;
+            containerHeader.chunkPackets = CNT_CHUNK_SEC * SAMPLING_RATE;
+            containerHeader.sectorSize = session.deviceInfo.sectorSize;
+            containerHeader.sectorCount = session.deviceInfo.sectorCount;
+            containerHeader.firstPacket = firstPacket;
+            containerHeader.lastPacket = lastPacket;
+            containerHeader.timeBase = firstTimestamp;
+            memcpy(containerHeader.channelId, outputMap.channelId,
+                   sizeof(containerHeader.channelId));
+            if ( CNT_iInit(&container, fileno(fpOutput), &containerHeader) ) {
+                return -11;
+            }
+            fprintf(stdout, "Writing %u channels in %d sec chunks\n",
+                    (unsigned)outputMap.numChannels, CNT_CHUNK_SEC);
+        }
+        else if ( SWR_FORMAT_PACKETS != format ) {
+            if ( SWR_iOpen(&samples, format, outputFile, 
+                           CFG_u32PacketSize(&outputMap), &outputMap) ) {
+                SWR_iClose(samples);
+                return -11;
+            }
+            SWR_vSetTimeBase(samples, firstTimestamp + firstPacket);
+            if ( SWR_FORMAT_NPY == format ) {
+                fprintf(stdout, "Writing %u channels as .npy arrays\n",
+                        (unsigned)outputMap.numChannels);
+            }
             else {
-                fprintf(stderr, "Bad packet found. Packet index: %llu, "
-                        "byte[%u] value: %2x. Not saving bad packet to output file\n",
-                        (long long unsigned)packetIndex,
-                        (unsigned)START_BYTE_IND,
-                        (unsigned)buff[START_BYTE_IND] );
+                fprintf(stdout, "Writing %u channels %s, %s transpose\n",
+                        (unsigned)outputMap.numChannels, 
+                        (SWR_FORMAT_COMPRESSED == format) ? "compressed" : "channel-major",
+                        SWR_pcKernelName());
             }
-            packetIndex += NUM_PACKETS;
+        }
 
+        // the report is gathered during the extraction read, so checking
+        // the card costs no extra pass
+        memset(&integrity, 0, sizeof(integrity));
+        if ( (statsFd >= 0) && PSTAT_iOpenStream(&perf, statsFd, statsIntervalSec) ) {
+            return -24;
+        }
+        if ( writeIndex ) {
+            PIDX_vInit(&index, CFG_u32PacketSize(&outputMap), &outputMap);
+        }
+        memset(&opts, 0, sizeof(opts));
+        opts.fpOutput = fpOutput;
+        opts.samples = samples;
+        opts.container = (SWR_FORMAT_CONTAINER == format) ? &container : NULL;
+        opts.segments = segmentMinutes ? &segments : NULL;
+        opts.select = selectChannels ? &channelSelect : NULL;
+        opts.psize = psize;
+        opts.firstPacket = firstPacket;
+        opts.lastPacket = lastPacket;
+        opts.timeBase = firstTimestamp;
+        opts.blockSize = blockSize;
+        opts.queueDepth = queueDepth;
+        opts.backend = backend;
+        opts.numThreads = numThreads;
+        opts.integrity = reportFile ? &integrity : NULL;
+        opts.fillGaps = fillGaps;
+        opts.index = writeIndex ? &index : NULL;
+        opts.zeroCopy = zeroCopy;
+        if ( numThreads > 1 ) {
+            extractRes = iExtractParallel(&session, &opts, &extractStats, &perf);
         }
+        else {
+            extractRes = iExtractBlocks(&session, &opts, &extractStats, &perf);
+        }
+        if ( extractRes ) {
+            fprintf(stderr, "Error extracting data: return value is %d\n", 
+                    extractRes);
+            return -12;
+        }
+        rfSyncCt = extractStats.rfSyncCt;
         
-        // read the last block of packets
-        readPacketRes = DISKIO_iReadPacket(fpDevice, buff, packetIndex, psize, 
-                                           lastPacket - packetIndex + 1, &deviceInfo);
-        if ( readPacketRes ) {
-            fprintf(stderr, "Error reading packets %llu to %llu!\n", 
-                    (long long unsigned)packetIndex,
-                    (long long unsigned)lastPacket );
-            return -14;
-        }
-        bytesWritten = (uint64_t)fwrite(buff, 1, psize*(lastPacket - packetIndex + 1), fpOutput);
-        if ( psize*(lastPacket - packetIndex + 1) != bytesWritten ) {
-            fprintf(stderr, "Error %llu bytes requested to write but %llu"
-                    " bytes actually written when writing packets %llu to %llu\n", 
-                    (long long unsigned)(psize*(lastPacket - packetIndex +1)), 
-                    (long long unsigned)bytesWritten,
-                    (long long unsigned)packetIndex,
-                    (long long unsigned)lastPacket );
-            return -15;
-        }
-        if ( fclose(fpDevice) ) {
+        elapsedSec = extractStats.elapsedSec;
+        fprintf(stdout, "100.0%% completed, elapsed time: %5.1f minutes\n",
+                elapsedSec/SEC_PER_MIN);
+        fprintf(stdout, "Read %.2f MB in %.1f sec (%.1f MB/s), wrote %llu packets,"
+                " %llu bad packets skipped\n",
+                (double)extractStats.bytesRead/BYTES_PER_MB, elapsedSec,
+                (elapsedSec > 0) ? (double)extractStats.bytesRead/BYTES_PER_MB/elapsedSec : 0.0,
+                (long long unsigned)extractStats.packetsWritten,
+                (long long unsigned)extractStats.badPackets );
+        if ( extractStats.packetsFilled ) {
+            fprintf(stdout, "%llu of the packets written are placeholders for"
+                    " dropped and bad packets\n",
+                    (long long unsigned)extractStats.packetsFilled);
+        }
+        if ( 1 == numThreads ) {
+            fprintf(stdout, "Time waiting on the device %.1f sec, writing output"
+                    " %.1f sec\n", extractStats.readWaitSec, extractStats.writeSec);
+        }
+
+        if ( DISKIO_iCloseSession(&session) ) {
             fprintf(stderr, "Error closing %s after extracting data\n", deviceFile);
             return -16;
         }
-        if ( fclose(fpOutput) ) {
+        if ( SWR_FORMAT_CONTAINER == format ) {
+            fprintf(stdout, "Container of %llu chunks\n",
+                    (long long unsigned)container.entryCt);
+            if ( CNT_iFinish(&container) ) {
+                fprintf(stderr, "Error writing the container index\n");
+                return -17;
+            }
+        }
+        if ( segmentMinutes ) {
+            fprintf(stdout, "%llu segments listed in %s.manifest\n",
+                    (long long unsigned)segments.segmentCt, outputFile);
+            if ( iCloseSegmentSet(&segments) ) {
+                fprintf(stderr, "Error finishing the segments\n");
+                return -17;
+            }
+        }
+        else if ( samples ? SWR_iClose(samples) : fclose(fpOutput) ) {
             fprintf(stderr, "Error closing %s after extracting data\n", outputFile);
             return -17;
         }
+        if ( reportFile ) {
+            if ( iWriteReport(reportFile, deviceFile, psize, firstPacket, lastPacket,
+                              &extractStats, &integrity) ) {
+                return -18;
+            }
+            fprintf(stdout, "Integrity report written to %s\n", reportFile);
+            vFreeIntegrityLog(&integrity);
+        }
+        if ( writeIndex ) {
+            snprintf(indexFile, sizeof(indexFile), "%s.idx", outputFile);
+            if ( PIDX_iWrite(&index, indexFile) ) {
+                return -23;
+            }
+            fprintf(stdout, "Index of %llu runs and %llu RF syncs written to %s\n",
+                    (long long unsigned)index.runCt, 
+                    (long long unsigned)index.rfSyncCt, indexFile);
+            PIDX_vFree(&index);
+        }
+        PSTAT_vClose(&perf);
+        if ( statsFile ) {
+            if ( PSTAT_iWriteJson(&perf, statsFile) ) {
+                return -24;
+            }
+            fprintf(stdout, "Performance counters written to %s\n", statsFile);
+        }
 
         // RF sync values found
         if ( rfSyncCt ) {
-            fprintf(stdout, "\nFound %d RF sync values\n", rfSyncCt);
+            fprintf(stdout, "\nFound %llu RF sync values\n", 
+                    (long long unsigned)rfSyncCt);
         }
         else {
             fprintf(stderr, "\nError: Found 0 RF sync values!\n");
@@ -0,0 +1,499 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "card_config.h"
+#include "sample_codec.h"
+#include "container.h"
+#include "card_constants.h"
+
+#define MAX_DECODE_THREADS 256
+
+typedef struct {
+    // shared by the decode threads
+    int inFd;
+    int outFd;              // -1 when verifying
+    int refFd;              // -1 unless verifying
+    uint32_t psize;
+    uint32_t blockPackets;  // most packets a block or chunk holds
+    uint64_t numBlocks;
+    uint64_t numPackets;
+    CodecFileHeaderType header;
+    uint64_t *blockOffsets; // numBlocks + 1 entries, the last is the file end
+    ContainerReaderType *container; // NULL for a compressed file
+    uint64_t *firstPackets; // output packet of each container chunk
+    uint64_t nextBlock;     // taken with an atomic add
+    int abortFlag;
+    uint64_t mismatchBlock; // first block that differs from the reference
+    int mismatch;
+    pthread_mutex_t mismatchLock;
+} DecodeJobType;
+
+typedef struct {
+    DecodeJobType *job;
+    pthread_t thread;
+    int res;
+} DecodeWorkerType;
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : dGetMonotonicSec()
+// Description : Reads the monotonic clock, used for throughput reporting
+// Parameters  : none
+// Returns     : double - seconds since an arbitrary fixed point
+//////////////////////////////////////////////////////////////////////////
+static double dGetMonotonicSec(void) {
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iReadAt()
+// Description : pread() wrapper that retries after interrupts and short
+//               reads until all bytes are in
+// Parameters  : int fd - File descriptor to read from
+//               void *buff - Where to put the bytes
+//               uint64_t numBytes - Number of bytes to read
+//               uint64_t offset - Byte offset in the file to read from
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+static int iReadAt(int fd, void *buff, uint64_t numBytes, uint64_t offset) {
+
+    ssize_t res;
+    uint64_t done = 0;
+
+    while ( done < numBytes ) {
+        res = pread(fd, (uint8_t *)buff + done, numBytes - done, (off_t)(offset + done));
+        if ( res < 0 ) {
+            if ( EINTR == errno ) {
+                continue;
+            }
+            return -1;
+        }
+        if ( 0 == res ) {
+            return -2;
+        }
+        done += (uint64_t)res;
+    }
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iWriteAt()
+// Description : pwrite() wrapper that retries after interrupts and short
+//               writes until all bytes are out
+// Parameters  : int fd - File descriptor to write to
+//               const void *buff - Bytes to write
+//               uint64_t numBytes - Number of bytes to write
+//               uint64_t offset - Byte offset in the file to write at
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+static int iWriteAt(int fd, const void *buff, uint64_t numBytes, uint64_t offset) {
+
+    ssize_t res;
+    uint64_t done = 0;
+
+    while ( done < numBytes ) {
+        res = pwrite(fd, (const uint8_t *)buff + done, numBytes - done,
+                     (off_t)(offset + done));
+        if ( res < 0 ) {
+            if ( EINTR == errno ) {
+                continue;
+            }
+            fprintf(stderr, "Error %d writing %llu bytes at output offset"
+                    " %llu: %s\n", errno, (long long unsigned)numBytes,
+                    (long long unsigned)offset, strerror(errno));
+            return -1;
+        }
+        if ( 0 == res ) {
+            // nothing written and no error, don't spin on it
+            fprintf(stderr, "Error writing %llu bytes at output offset %llu:"
+                    " no bytes written\n", (long long unsigned)numBytes,
+                    (long long unsigned)offset);
+            return -1;
+        }
+        done += (uint64_t)res;
+    }
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iIndexBlocks()
+// Description : Walks the chain of block headers so the blocks can be
+//               handed out to the decode threads. Only the 8 byte
+//               headers are read
+// Parameters  : DecodeJobType *job - The job, header already read
+//               uint64_t firstOffset - File offset of the first block
+//               uint64_t fileSize - Size of the compressed file
+// Returns     : int - 0 if success, negative value if the chain is broken
+//////////////////////////////////////////////////////////////////////////
+static int iIndexBlocks(DecodeJobType *job, uint64_t firstOffset, uint64_t fileSize) {
+
+    CodecBlockHeaderType blockHeader;
+    uint64_t b, offset = firstOffset, numPackets = 0;
+
+    job->blockOffsets = malloc((job->header.numBlocks + 1) * sizeof(uint64_t));
+    if ( NULL == job->blockOffsets ) {
+        return -1;
+    }
+    for (b = 0; b < job->header.numBlocks; b++) {
+        job->blockOffsets[b] = offset;
+        if ( (offset + sizeof(blockHeader) > fileSize)
+             || iReadAt(job->inFd, &blockHeader, sizeof(blockHeader), offset) ) {
+            fprintf(stderr, "Error: file ends inside block %llu\n",
+                    (long long unsigned)b);
+            return -2;
+        }
+        if ( (blockHeader.blockBytes < sizeof(blockHeader))
+             || (offset + blockHeader.blockBytes > fileSize)
+             || (0 == blockHeader.numPackets)
+             || (blockHeader.numPackets > job->header.blockPackets)
+             || ((blockHeader.numPackets != job->header.blockPackets)
+                 && (b + 1 != job->header.numBlocks)) ) {
+            fprintf(stderr, "Error: bad header on block %llu at offset %llu\n",
+                    (long long unsigned)b, (long long unsigned)offset);
+            return -3;
+        }
+        offset += blockHeader.blockBytes;
+        numPackets += blockHeader.numPackets;
+    }
+    job->blockOffsets[b] = offset;
+    if ( numPackets != job->header.numPackets ) {
+        fprintf(stderr, "Error: blocks hold %llu packets, header says %llu\n",
+                (long long unsigned)numPackets,
+                (long long unsigned)job->header.numPackets);
+        return -4;
+    }
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : pvDecodeWorker()
+// Description : Body of each decode thread. Takes blocks in turn, decodes
+//               them, or reads and checks them for a container, and
+//               writes the packets to their place in the output, or
+//               compares them with the reference file
+// Parameters  : void *ctx - DecodeWorkerType of the thread
+// Returns     : void * - NULL, the result is left in the worker
+//////////////////////////////////////////////////////////////////////////
+static void *pvDecodeWorker(void *ctx) {
+
+    DecodeWorkerType *worker = (DecodeWorkerType *)ctx;
+    DecodeJobType *job = worker->job;
+    uint32_t psize = job->psize;
+    uint32_t numPackets;
+    uint64_t b, blockBytes, maxBlockBytes, outOffset, outBytes;
+    uint8_t *block = NULL, *packets, *reference = NULL;
+    CodecType codec;
+
+    memset(&codec, 0, sizeof(codec));
+    maxBlockBytes = CODEC_u64MaxBlockBytes(psize, job->blockPackets);
+    if ( NULL == job->container ) {
+        block = malloc(maxBlockBytes + CODEC_READ_SLACK);
+    }
+    packets = malloc((uint64_t)job->blockPackets * psize);
+    if ( job->refFd >= 0 ) {
+        reference = malloc((uint64_t)job->blockPackets * psize);
+    }
+    if ( ((NULL == job->container) && (NULL == block)) || (NULL == packets)
+         || ((job->refFd >= 0) && (NULL == reference))
+         || ((NULL == job->container) && CODEC_iInit(&codec, psize, job->blockPackets)) ) {
+        worker->res = -1;
+        __atomic_store_n(&job->abortFlag, 1, __ATOMIC_RELEASE);
+        goto cleanup;
+    }
+
+    while ( !__atomic_load_n(&job->abortFlag, __ATOMIC_ACQUIRE) ) {
+        b = __atomic_fetch_add(&job->nextBlock, 1, __ATOMIC_RELAXED);
+        if ( b >= job->numBlocks ) {
+            break;
+        }
+        if ( job->container ) {
+            numPackets = job->container->entryList[b].numPackets;
+            if ( (numPackets > job->blockPackets)
+                 || CNT_iReadChunk(job->container, b, packets) ) {
+                fprintf(stderr, "Error: chunk %llu is damaged\n", (long long unsigned)b);
+                worker->res = -3;
+                break;
+            }
+            outOffset = job->firstPackets[b] * psize;
+        }
+        else {
+                blockBytes = job->blockOffsets[b + 1] - job->blockOffsets[b];
+            if ( (blockBytes > maxBlockBytes)
+                 || iReadAt(job->inFd, block, blockBytes, job->blockOffsets[b]) ) {
+                fprintf(stderr, "Error reading block %llu\n", (long long unsigned)b);
+                worker->res = -2;
+                break;
+            }
+            memset(block + blockBytes, 0, CODEC_READ_SLACK);
+            if ( CODEC_iDecodeBlock(&codec, block, blockBytes, packets, &numPackets) ) {
+                fprintf(stderr, "Error: block %llu is damaged\n", (long long unsigned)b);
+                worker->res = -3;
+                break;
+            }
+            outOffset = b * job->blockPackets * psize;
+        }
+
+        outBytes = (uint64_t)numPackets * psize;
+        if ( reference ) {
+            if ( iReadAt(job->refFd, reference, outBytes, outOffset)
+                 || memcmp(reference, packets, outBytes) ) {
+                pthread_mutex_lock(&job->mismatchLock);
+                if ( !job->mismatch || (b < job->mismatchBlock) ) {
+                    job->mismatchBlock = b;
+                }
+                job->mismatch = 1;
+                pthread_mutex_unlock(&job->mismatchLock);
+            }
+        }
+        else if ( iWriteAt(job->outFd, packets, outBytes, outOffset) ) {
+            worker->res = -4;
+            break;
+        }
+    }
+    if ( worker->res ) {
+        __atomic_store_n(&job->abortFlag, 1, __ATOMIC_RELEASE);
+    }
+
+cleanup:
+    CODEC_vFree(&codec);
+    free(block);
+    free(packets);
+    free(reference);
+
+    return NULL;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function     : main()
+// Description  : Restores the packets file from a file written by
+//                sd_card_extract --format compressed or container, or
+//                checks it against the packets file it was made from
+// CL arguments : compressed or container file name
+//                output file name, not used with --verify
+//                -j, --threads N: decode N blocks at once, optional
+//                -v, --verify FILE: compare with FILE instead of writing,
+//                optional
+// Returns      : int - 0 if success, 1 if usage screen was displayed,
+//                negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int main (int argc, char *argv[])
+{
+    char *endPtr, *verifyFile = NULL;
+    int opt, nArgs, res = 0;
+    uint32_t t, numThreads = 1, started = 0;
+    uint64_t b, firstOffset;
+    uint16_t channelId[CFG_MAX_CHANNELS];
+    char magic[sizeof(CNT_MAGIC) - 1];
+    ContainerReaderType container;
+    double startSec, elapsedSec;
+    struct stat inStat, refStat;
+    DecodeJobType job;
+    DecodeWorkerType *workers;
+    static struct option longOptions[] = {
+        {"threads", required_argument, 0, 'j'},
+        {"verify", required_argument, 0, 'v'},
+        {0, 0, 0, 0}
+    };
+
+    // turn off output buffering
+    setvbuf(stdout, 0, _IONBF, 0);
+    setvbuf(stderr, 0, _IONBF, 0);
+
+    fprintf(stdout, "\n*** sd_decompress 1.0 ***\n");
+
+    while ( -1 != (opt = getopt_long(argc, argv, "j:v:", longOptions, NULL)) ) {
+        switch (opt) {
+            case 'j':
+                numThreads = (uint32_t)strtoul(optarg, &endPtr, 10);
+                if ( ('\0' != *endPtr) || (0 == numThreads)
+                     || (MAX_DECODE_THREADS < numThreads) ) {
+                    fprintf(stderr, "\nNumber of threads must be between 1 and %d\n",
+                            MAX_DECODE_THREADS);
+                    return -1;
+                }
+                break;
+            case 'v':
+                verifyFile = optarg;
+                break;
+            default:
+                return -1;
+        }
+    }
+    nArgs = argc - optind;
+    if ( (0 == nArgs) || ((1 == nArgs) && (NULL == verifyFile)) ) {
+        fprintf(stdout, "\nUsage: sd_decompress [OPTIONS] [COMPRESSED_FILENAME]"
+                " [EXTRACTED_DATA_FILENAME]\n");
+        fprintf(stdout, "Example: `sd_decompress -j 8 data.sdz extracted_data.dat`\n");
+        fprintf(stdout, "Options:\n");
+        fprintf(stdout, "  -j, --threads N       decode N blocks at once (default 1)\n");
+        fprintf(stdout, "  -v, --verify FILE     check the packets match FILE"
+                " instead of writing them\n");
+        return 1;
+    }
+
+    memset(&job, 0, sizeof(job));
+    job.outFd = -1;
+    job.refFd = -1;
+    pthread_mutex_init(&job.mismatchLock, NULL);
+    job.inFd = open(argv[optind], O_RDONLY);
+    if ( (job.inFd < 0) || fstat(job.inFd, &inStat) ) {
+        fprintf(stderr, "Error opening %s: %s\n", argv[optind], strerror(errno));
+        return -2;
+    }
+    if ( (0 == iReadAt(job.inFd, magic, sizeof(magic), 0))
+         && (0 == memcmp(magic, CNT_MAGIC, sizeof(magic))) ) {
+        // containers list their chunks in the trailer, chunk b's packets
+        // follow those of the chunks before it
+        if ( CNT_iOpen(&container, argv[optind]) ) {
+            return -3;
+        }
+        job.container = &container;
+        job.psize = container.header.psize;
+        job.blockPackets = container.header.chunkPackets;
+        job.numBlocks = container.trailer.numChunks;
+        job.numPackets = container.trailer.numPackets;
+        job.firstPackets = malloc((job.numBlocks + 1) * sizeof(uint64_t));
+        if ( NULL == job.firstPackets ) {
+            return -4;
+        }
+        job.firstPackets[0] = 0;
+        for (b = 0; b < job.numBlocks; b++) {
+            job.firstPackets[b + 1] = job.firstPackets[b]
+                                      + container.entryList[b].numPackets;
+        }
+        if ( (container.header.numChannels > CFG_MAX_CHANNELS)
+             || (job.psize != CFG_HEADER_BYTES
+                              + CFG_SAMPLE_BYTES*container.header.numChannels)
+             || (0 == job.blockPackets)
+             || (job.firstPackets[job.numBlocks] != job.numPackets) ) {
+            fprintf(stderr, "%s has a damaged container header\n", argv[optind]);
+            return -4;
+        }
+        fprintf(stdout, "%llu packets of %u channels (%u bytes/packet) in %llu"
+                " chunks of %u card packets\n", (long long unsigned)job.numPackets,
+                (unsigned)container.header.numChannels, (unsigned)job.psize,
+                (long long unsigned)job.numBlocks, (unsigned)job.blockPackets);
+    }
+    else {
+        if ( iReadAt(job.inFd, &job.header, sizeof(job.header), 0)
+             || memcmp(job.header.magic, CODEC_MAGIC, sizeof(job.header.magic))
+             || (job.header.numChannels > CFG_MAX_CHANNELS)
+             || (job.header.psize != CFG_HEADER_BYTES
+                                     + CFG_SAMPLE_BYTES*job.header.numChannels)
+             || (0 == job.header.blockPackets)
+             || iReadAt(job.inFd, channelId,
+                        job.header.numChannels * sizeof(channelId[0]),
+                        sizeof(job.header)) ) {
+            fprintf(stderr, "%s isn't a complete compressed extraction\n", argv[optind]);
+            return -3;
+        }
+        job.psize = job.header.psize;
+        job.blockPackets = job.header.blockPackets;
+        job.numBlocks = job.header.numBlocks;
+        job.numPackets = job.header.numPackets;
+        fprintf(stdout, "%llu packets of %u channels (%u bytes/packet) in %llu blocks\n",
+                (long long unsigned)job.numPackets, (unsigned)job.header.numChannels,
+                (unsigned)job.psize, (long long unsigned)job.numBlocks);
+        firstOffset = sizeof(job.header) + job.header.numChannels * sizeof(channelId[0]);
+        if ( iIndexBlocks(&job, firstOffset, (uint64_t)inStat.st_size) ) {
+            return -4;
+        }
+    }
+
+    if ( verifyFile ) {
+        job.refFd = open(verifyFile, O_RDONLY);
+        if ( (job.refFd < 0) || fstat(job.refFd, &refStat) ) {
+            fprintf(stderr, "Error opening %s: %s\n", verifyFile, strerror(errno));
+            return -5;
+        }
+        if ( (uint64_t)refStat.st_size != job.numPackets * job.psize ) {
+            fprintf(stderr, "Verify failed: %s is %llu bytes, the packets are %llu\n",
+                    verifyFile, (long long unsigned)refStat.st_size,
+                    (long long unsigned)(job.numPackets * job.psize));
+            return -6;
+        }
+    }
+    else {
+        job.outFd = open(argv[optind + 1], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if ( job.outFd < 0 ) {
+            fprintf(stderr, "Error opening file %s to write data to!\n",
+                    argv[optind + 1]);
+            return -5;
+        }
+    }
+
+    workers = calloc(numThreads, sizeof(*workers));
+    if ( NULL == workers ) {
+        return -7;
+    }
+    startSec = dGetMonotonicSec();
+    for (t = 0; t < numThreads; t++) {
+        workers[t].job = &job;
+        if ( pthread_create(&workers[t].thread, NULL, pvDecodeWorker, &workers[t]) ) {
+            fprintf(stderr, "Error starting decode thread %u\n", (unsigned)t);
+            __atomic_store_n(&job.abortFlag, 1, __ATOMIC_RELEASE);
+            res = -8;
+            break;
+        }
+        ++started;
+    }
+    for (t = 0; t < started; t++) {
+        pthread_join(workers[t].thread, NULL);
+        if ( (0 == res) && workers[t].res ) {
+            res = -9;
+        }
+    }
+    elapsedSec = dGetMonotonicSec() - startSec;
+    free(workers);
+
+    if ( (job.outFd >= 0) && close(job.outFd) ) {
+        fprintf(stderr, "Error closing %s\n", argv[optind + 1]);
+        res = -10;
+    }
+    if ( res ) {
+        return res;
+    }
+    fprintf(stdout, "Decoded %.2f MB from %.2f MB (ratio %.2f) in %.1f sec"
+            " (%.1f MB/s)\n",
+            (double)job.numPackets*job.psize/BYTES_PER_MB,
+            (double)inStat.st_size/BYTES_PER_MB,
+            (double)job.numPackets*job.psize/(double)inStat.st_size,
+            elapsedSec,
+            (elapsedSec > 0)
+            ? (double)job.numPackets*job.psize/BYTES_PER_MB/elapsedSec
+            : 0.0);
+    if ( job.mismatch ) {
+        fprintf(stderr, "Verify failed: block %llu (packets from %llu) differs"
+                " from %s\n", (long long unsigned)job.mismatchBlock,
+                (long long unsigned)(job.container
+                                     ? job.firstPackets[job.mismatchBlock]
+                                     : job.mismatchBlock * job.blockPackets),
+                verifyFile);
+        return -11;
+    }
+    if ( verifyFile ) {
+        fprintf(stdout, "Verified: every packet matches %s\n", verifyFile);
+    }
+
+    fprintf(stdout, "Done!\n");
+    return 0;
+}
@@ -0,0 +1,508 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
+#include <getopt.h>
+#include "card_config.h"
+#include "packet_scan.h"
+#include "card_constants.h"
+
+#define SECTOR_SIZE 512       // of card images, sector 0 is the configuration
+#define DEFAULT_PACKETS (60*SAMPLING_RATE)
+#define DEFAULT_GAP_MAX 300   // packets, 10 ms
+#define DEFAULT_RF_EVERY SAMPLING_RATE
+#define DEFAULT_TAIL_MB 1
+#define SINE_BITS 10          // entries in the sine table, log2
+#define PHASE_BITS 20         // a sine period in phase steps, log2
+#define NOISE_SHIFT 60        // 4 random bits, noise of +-8 counts
+#define WRITE_BUFFER_BYTES (4*BYTES_PER_MB)
+
+typedef struct {
+    uint32_t numChannels;
+    uint32_t amplitude[CFG_MAX_CHANNELS];
+    uint32_t phaseStep[CFG_MAX_CHANNELS];
+    int16_t sine[1 << SINE_BITS];   // one period, Q15
+    uint32_t rfEvery;
+    uint64_t noise;                 // xorshift state
+} SignalType;
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : u64NextRandom()
+// Description : xorshift64* generator, so an image is the same for the
+//               same seed on any machine
+// Parameters  : uint64_t *state - Generator state, never 0
+// Returns     : uint64_t - next value
+//////////////////////////////////////////////////////////////////////////
+static uint64_t u64NextRandom(uint64_t *state) {
+
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iCompareIndex()
+// Description : qsort() order of packet indices
+//////////////////////////////////////////////////////////////////////////
+static int iCompareIndex(const void *a, const void *b) {
+
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : u64PickIndices()
+// Description : Draws distinct packet indices in [lo, hi), sorted
+// Parameters  : uint64_t *list - Room for count indices
+//               uint64_t count - Number wanted
+//               uint64_t lo, hi - Range to draw from
+//               uint64_t *state - Random generator state
+// Returns     : uint64_t - number of distinct indices drawn, fewer than
+//               count when draws collide
+//////////////////////////////////////////////////////////////////////////
+static uint64_t u64PickIndices(uint64_t *list, uint64_t count, uint64_t lo,
+                               uint64_t hi, uint64_t *state) {
+
+    uint64_t i, n;
+
+    if ( hi <= lo ) {
+        return 0;
+    }
+    for (i = 0; i < count; i++) {
+        list[i] = lo + u64NextRandom(state) % (hi - lo);
+    }
+    qsort(list, count, sizeof(uint64_t), iCompareIndex);
+    for (i = 0, n = 0; i < count; i++) {
+        if ( (0 == n) || (list[i] != list[n - 1]) ) {
+            list[n++] = list[i];
+        }
+    }
+
+    return n;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : vInitSignal()
+// Description : Gives each channel a sine of its own frequency and
+//               amplitude, so the samples look like a recording to the
+//               codec and differ between channels
+// Parameters  : SignalType *signal - Filled in
+//               const ChannelMapType *map - Channels recorded
+//               uint32_t rfEvery - RF sync flag every rfEvery timestamps,
+//                                  0 for none
+//               uint64_t seed - Noise seed
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+static void vInitSignal(SignalType *signal, const ChannelMapType *map,
+                        uint32_t rfEvery, uint64_t seed) {
+
+    uint32_t k, channel, freqHz;
+
+    memset(signal, 0, sizeof(*signal));
+    signal->numChannels = map->numChannels;
+    signal->rfEvery = rfEvery;
+    signal->noise = seed ? seed : 1;
+    for (k = 0; k < (1u << SINE_BITS); k++) {
+        signal->sine[k] = (int16_t)lrint(32767.0 * sin(2.0 * M_PI * k / (1 << SINE_BITS)));
+    }
+    for (k = 0; k < map->numChannels; k++) {
+        channel = map->channelId[k];
+        freqHz = 4 + (channel * 37) % 250;
+        signal->amplitude[k] = 100 + (channel * 53) % 1500;
+        signal->phaseStep[k] = (uint32_t)(((uint64_t)freqHz << PHASE_BITS) / SAMPLING_RATE);
+    }
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : vBuildPacket()
+// Description : Builds the packet recorded at a timestamp: start byte,
+//               RF flag, timestamp and a sample per channel
+// Parameters  : SignalType *signal - The signal
+//               uint32_t timestamp - Timestamp of the packet
+//               uint8_t *packet - psize bytes, filled in
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+static void vBuildPacket(SignalType *signal, uint32_t timestamp, uint8_t *packet) {
+
+    uint32_t k, phase;
+    int32_t sample;
+
+    memset(packet, 0, CFG_HEADER_BYTES);
+    packet[START_BYTE_IND] = START_BYTE_VAL;
+    if ( signal->rfEvery && (0 == timestamp % signal->rfEvery) ) {
+        packet[FLAG_BYTE_IND] = RF_VALID_VAL;
+    }
+    packet[TIMESTAMP_START_IND] = (uint8_t)timestamp;
+    packet[TIMESTAMP_START_IND + 1] = (uint8_t)(timestamp >> 8);
+    packet[TIMESTAMP_START_IND + 2] = (uint8_t)(timestamp >> 16);
+    packet[TIMESTAMP_START_IND + 3] = (uint8_t)(timestamp >> 24);
+    for (k = 0; k < signal->numChannels; k++) {
+        phase = (timestamp * signal->phaseStep[k]) >> (PHASE_BITS - SINE_BITS);
+        sample = ((int32_t)signal->amplitude[k]
+                  * signal->sine[phase & ((1u << SINE_BITS) - 1)]) >> 15;
+        sample += (int32_t)(u64NextRandom(&signal->noise) >> NOISE_SHIFT) - 8;
+        packet[CFG_HEADER_BYTES + 2*k] = (uint8_t)sample;
+        packet[CFG_HEADER_BYTES + 2*k + 1] = (uint8_t)((uint16_t)sample >> 8);
+    }
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function     : main()
+// Description  : Writes a synthetic card image, the way the headstage
+//                records one, for benchmarking and checking the tools
+//                without a card: the configuration sector from a .cfg
+//                file, then packets with dropped packet gaps, bad start
+//                bytes and RF syncs, optionally a cut short last packet
+//                and packets of an older recording left after it. The
+//                packets a correct extraction writes can be saved as an
+//                oracle to compare the output with. A sparse image leaves
+//                the middle of the recording unwritten, so cards of
+//                hundreds of GB can be made in seconds
+// CL arguments : config file name
+//                image file name
+// Returns      : int - 0 if success, 1 if usage screen was displayed,
+//                negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int main (int argc, char *argv[])
+{
+    char *endPtr, *oracleFile = NULL;
+    int opt, partial = 0;
+    uint8_t configSector[SECTOR_SIZE];
+    uint8_t *packet, *stalePacket;
+    uint32_t psize, rfEvery = DEFAULT_RF_EVERY;
+    uint64_t i, numPackets = DEFAULT_PACKETS, numGaps = 0, gapMax = DEFAULT_GAP_MAX;
+    uint64_t numBad = 0, numStale = 0, tailMB = DEFAULT_TAIL_MB, seed = 1;
+    int64_t staleShift = 0;
+    uint64_t *gapIndex = NULL, *badList = NULL, gapCt, badCt, nextGap, nextBad;
+    uint64_t timestamp, lastRead, dropped, gapsRead, badRead, rfSyncCt, validCt;
+    uint64_t imageBytes, state, gapLength, sparseKeep = 0, holeStart, holeEnd;
+    uint64_t holeStride, next;
+    ChannelMapType map;
+    SignalType signal, staleSignal;
+    FILE *fpImage, *fpOracle = NULL;
+    static struct option longOptions[] = {
+        {"packets", required_argument, 0, 'n'},
+        {"gaps", required_argument, 0, 'g'},
+        {"gap-max", required_argument, 0, 'G'},
+        {"bad", required_argument, 0, 'x'},
+        {"rf-every", required_argument, 0, 'r'},
+        {"partial", no_argument, 0, 'p'},
+        {"stale", required_argument, 0, 'S'},
+        {"stale-shift", required_argument, 0, 'T'},
+        {"tail", required_argument, 0, 't'},
+        {"seed", required_argument, 0, 's'},
+        {"oracle", required_argument, 0, 'o'},
+        {"sparse", required_argument, 0, 'k'},
+        {0, 0, 0, 0}
+    };
+
+    // turn off output buffering
+    setvbuf(stdout, 0, _IONBF, 0);
+    setvbuf(stderr, 0, _IONBF, 0);
+
+    fprintf(stdout, "\n*** sd_make_image 1.0 ***\n");
+
+    while ( -1 != (opt = getopt_long(argc, argv, "n:g:r:s:o:", longOptions, NULL)) ) {
+        errno = 0;
+        switch (opt) {
+            case 'n':
+                numPackets = strtoull(optarg, &endPtr, 10);
+                break;
+            case 'g':
+                numGaps = strtoull(optarg, &endPtr, 10);
+                break;
+            case 'G':
+                gapMax = strtoull(optarg, &endPtr, 10);
+                break;
+            case 'x':
+                numBad = strtoull(optarg, &endPtr, 10);
+                break;
+            case 'r':
+                rfEvery = (uint32_t)strtoul(optarg, &endPtr, 10);
+                break;
+            case 'p':
+                partial = 1;
+                endPtr = "";
+                break;
+            case 'S':
+                numStale = strtoull(optarg, &endPtr, 10);
+                break;
+            case 'T':
+                staleShift = strtoll(optarg, &endPtr, 10);
+                break;
+            case 't':
+                tailMB = strtoull(optarg, &endPtr, 10);
+                break;
+            case 's':
+                seed = strtoull(optarg, &endPtr, 10);
+                break;
+            case 'o':
+                oracleFile = optarg;
+                endPtr = "";
+                break;
+            case 'k':
+                sparseKeep = strtoull(optarg, &endPtr, 10);
+                break;
+            default:
+                return -1;
+        }
+        if ( errno || ('\0' != *endPtr) ) {
+            fprintf(stderr, "\nBad value %s for option -%c\n", optarg, opt);
+            return -1;
+        }
+    }
+    if ( 2 != argc - optind ) {
+        fprintf(stdout, "\nUsage: sd_make_image [OPTIONS] [CONFIG_FILENAME]"
+                " [IMAGE_FILENAME]\n");
+        fprintf(stdout, "Example: `sd_make_image -n 1800000 --gaps 20 --bad 5"
+                " -o expected.dat config/config128.cfg card.img`\n");
+        fprintf(stdout, "Options:\n");
+        fprintf(stdout, "  -n, --packets N       packets recorded (default %d,"
+                " one minute)\n", DEFAULT_PACKETS);
+        fprintf(stdout, "  -g, --gaps N          gaps of dropped packets"
+                " (default 0)\n");
+        fprintf(stdout, "      --gap-max N       longest gap in packets"
+                " (default %d)\n", DEFAULT_GAP_MAX);
+        fprintf(stdout, "      --bad N           packets with a bad start byte"
+                " (default 0)\n");
+        fprintf(stdout, "  -r, --rf-every N      RF sync flag on every Nth"
+                " timestamp, 0 for none (default %d)\n", DEFAULT_RF_EVERY);
+        fprintf(stdout, "      --partial         cut the last packet short\n");
+        fprintf(stdout, "      --stale N         leave N packets of an older"
+                " recording after the end\n");
+        fprintf(stdout, "      --stale-shift S   timestamp of stale packet i is"
+                " i + S (default 0)\n");
+        fprintf(stdout, "      --tail MB         empty space after the recording"
+                " (default %d)\n", DEFAULT_TAIL_MB);
+        fprintf(stdout, "  -s, --seed N          random seed (default 1)\n");
+        fprintf(stdout, "  -o, --oracle FILE     write the packets extraction"
+                " should produce to FILE\n");
+        fprintf(stdout, "      --sparse K        write only the first and last K"
+                " packets, leave a hole\n"
+                "                        between them (gaps still add up)\n");
+        return 1;
+    }
+    // the tools find the packet size from timestamps 0 and 1 in packets 0
+    // and 1, and never extract the last packet
+    if ( numPackets < 3 ) {
+        fprintf(stderr, "\nAt least 3 packets are needed\n");
+        return -1;
+    }
+    // the tools read packets 0 and 1 and the last two
+    if ( sparseKeep && ((sparseKeep < 2) || (numPackets <= 2*sparseKeep)) ) {
+        fprintf(stderr, "\nSparse images keep at least 2 packets at each end,"
+                " and fewer than half\n");
+        return -1;
+    }
+    if ( numGaps && (0 == gapMax) ) {
+        fprintf(stderr, "\nGaps must be at least 1 packet\n");
+        return -1;
+    }
+
+    memset(configSector, 0, sizeof(configSector));
+    if ( CFG_iReadConfigFile(argv[optind], configSector) ) {
+        fprintf(stderr, "Error reading config file %s\n", argv[optind]);
+        return -2;
+    }
+    if ( CFG_iDecodeChannelMap(configSector, &map) ) {
+        fprintf(stderr, "No channels are enabled in %s\n", argv[optind]);
+        return -2;
+    }
+    psize = CFG_u32PacketSize(&map);
+    vInitSignal(&signal, &map, rfEvery, seed);
+    vInitSignal(&staleSignal, &map, rfEvery, seed + 1);
+
+    // gaps before packets 2 to numPackets - 1, bad packets between 2 and
+    // the last packet read
+    state = seed ? seed : 1;
+    gapIndex = malloc((numGaps ? numGaps : 1) * sizeof(uint64_t));
+    badList = malloc((numBad ? numBad : 1) * sizeof(uint64_t));
+    packet = malloc(psize);
+    stalePacket = malloc(psize);
+    if ( (NULL == gapIndex) || (NULL == badList) || (NULL == packet)
+         || (NULL == stalePacket) ) {
+        fprintf(stderr, "Error allocating gap and bad packet lists\n");
+        return -3;
+    }
+    gapCt = u64PickIndices(gapIndex, numGaps, 2, numPackets, &state);
+    badCt = u64PickIndices(badList, numBad, 2, numPackets - 1, &state);
+
+    fpImage = fopen(argv[optind + 1], "w");
+    if ( NULL == fpImage ) {
+        fprintf(stderr, "Error no %d opening image file %s: %s\n",
+                errno, argv[optind + 1], strerror(errno));
+        return -4;
+    }
+    setvbuf(fpImage, NULL, _IOFBF, WRITE_BUFFER_BYTES);
+    if ( oracleFile ) {
+        fpOracle = fopen(oracleFile, "w");
+        if ( NULL == fpOracle ) {
+            fprintf(stderr, "Error no %d opening oracle file %s: %s\n",
+                    errno, oracleFile, strerror(errno));
+            return -4;
+        }
+        setvbuf(fpOracle, NULL, _IOFBF, WRITE_BUFFER_BYTES);
+    }
+    if ( SECTOR_SIZE != fwrite(configSector, 1, SECTOR_SIZE, fpImage) ) {
+        fprintf(stderr, "Error writing the configuration sector\n");
+        return -5;
+    }
+
+    // the recording. Packets 0 to lastRead are the ones the tools read
+    lastRead = numPackets - 2;
+    timestamp = 0;
+    dropped = gapsRead = badRead = rfSyncCt = validCt = 0;
+    nextGap = nextBad = 0;
+    holeStart = sparseKeep ? sparseKeep : numPackets;
+    holeEnd = sparseKeep ? numPackets - sparseKeep : numPackets;
+    // a probe for the end of the recording on a multiple of 2^b is within
+    // 2^(b+1) of the end, so it's in the written tail or on a landmark
+    for (holeStride = 1; holeStride * 4 <= sparseKeep; holeStride *= 2);
+    for (i = 0; i < numPackets; i++) {
+        if ( i == holeStart ) {
+            // unwritten packets read as zeros, like an erased card, except
+            // a landmark packet every holeStride, so a search probing the
+            // card by halves sees the recording carry on
+            for (; i < holeEnd; i = next) {
+                while ( (nextGap < gapCt) && (gapIndex[nextGap] <= i) ) {
+                    gapLength = 1 + u64NextRandom(&state) % gapMax;
+                    timestamp += gapLength;
+                    dropped += gapLength;
+                    ++gapsRead;
+                    ++nextGap;
+                }
+                next = (i / holeStride + 1) * holeStride;
+                if ( next > holeEnd ) {
+                    next = holeEnd;
+                }
+                if ( 0 == i % holeStride ) {
+                    vBuildPacket(&signal, (uint32_t)timestamp, packet);
+                    ++validCt;
+                    rfSyncCt += (RF_VALID_VAL == packet[FLAG_BYTE_IND]);
+                    if ( fseeko(fpImage, (off_t)(SECTOR_SIZE + i * psize), SEEK_SET)
+                         || (psize != fwrite(packet, 1, psize, fpImage))
+                         || (fpOracle && (psize != fwrite(packet, 1, psize, fpOracle))) ) {
+                        fprintf(stderr, "Error writing landmark packet %llu\n",
+                                (long long unsigned)i);
+                        return -5;
+                    }
+                }
+                timestamp += next - i;
+            }
+            while ( (nextGap < gapCt) && (gapIndex[nextGap] < holeEnd) ) {
+                gapLength = 1 + u64NextRandom(&state) % gapMax;
+                timestamp += gapLength;
+                dropped += gapLength;
+                ++gapsRead;
+                ++nextGap;
+            }
+            while ( (nextBad < badCt) && (badList[nextBad] < holeEnd) ) {
+                ++nextBad;
+            }
+            if ( fseeko(fpImage, (off_t)(SECTOR_SIZE + holeEnd * psize), SEEK_SET) ) {
+                fprintf(stderr, "Error seeking over the hole\n");
+                return -5;
+            }
+        }
+        if ( (nextGap < gapCt) && (gapIndex[nextGap] == i) ) {
+            gapLength = 1 + u64NextRandom(&state) % gapMax;
+            timestamp += gapLength;
+            if ( i <= lastRead ) {
+                dropped += gapLength;
+                ++gapsRead;
+            }
+            ++nextGap;
+        }
+        vBuildPacket(&signal, (uint32_t)timestamp, packet);
+        if ( (nextBad < badCt) && (badList[nextBad] == i) ) {
+            packet[START_BYTE_IND] = (uint8_t)u64NextRandom(&state);
+            if ( START_BYTE_VAL == packet[START_BYTE_IND] ) {
+                packet[START_BYTE_IND] = 0;
+            }
+            ++nextBad;
+            ++badRead;
+        }
+        else if ( i <= lastRead ) {
+            ++validCt;
+            rfSyncCt += (RF_VALID_VAL == packet[FLAG_BYTE_IND]);
+            if ( fpOracle && (psize != fwrite(packet, 1, psize, fpOracle)) ) {
+                fprintf(stderr, "Error writing the oracle\n");
+                return -5;
+            }
+        }
+        if ( partial && (i == numPackets - 1) ) {
+            // the rest of the packet is whatever was on the card before
+            memset(stalePacket, 0, psize);
+            if ( numStale ) {
+                vBuildPacket(&staleSignal, (uint32_t)(i + staleShift), stalePacket);
+            }
+            memcpy(packet + psize/2, stalePacket + psize/2, psize - psize/2);
+        }
+        if ( psize != fwrite(packet, 1, psize, fpImage) ) {
+            fprintf(stderr, "Error writing packet %llu\n", (long long unsigned)i);
+            return -5;
+        }
+        ++timestamp;
+    }
+    // an older recording from where this one stopped
+    for (i = numPackets; i < numPackets + numStale; i++) {
+        vBuildPacket(&staleSignal, (uint32_t)(i + staleShift), stalePacket);
+        if ( psize != fwrite(stalePacket, 1, psize, fpImage) ) {
+            fprintf(stderr, "Error writing stale packet %llu\n", (long long unsigned)i);
+            return -5;
+        }
+    }
+
+    // whole sectors, then the empty rest of the card as a hole
+    imageBytes = SECTOR_SIZE + (numPackets + numStale) * psize;
+    imageBytes = (imageBytes + SECTOR_SIZE - 1) / SECTOR_SIZE * SECTOR_SIZE
+                 + tailMB * BYTES_PER_MB;
+    if ( fflush(fpImage) || ftruncate(fileno(fpImage), (off_t)imageBytes)
+         || fclose(fpImage) ) {
+        fprintf(stderr, "Error no %d finishing image file %s: %s\n",
+                errno, argv[optind + 1], strerror(errno));
+        return -6;
+    }
+    if ( fpOracle && fclose(fpOracle) ) {
+        fprintf(stderr, "Error closing oracle file %s\n", oracleFile);
+        return -6;
+    }
+
+    fprintf(stdout, "Packet size: %u bytes/packet, %u channels\n",
+            (unsigned)psize, (unsigned)map.numChannels);
+    fprintf(stdout, "Packets recorded: %llu (%.2f minutes), the tools read %llu\n",
+            (long long unsigned)numPackets,
+            (double)numPackets/SAMPLING_RATE/60.0,
+            (long long unsigned)(lastRead + 1));
+    fprintf(stdout, "Dropped packets: %llu in %llu gaps\n",
+            (long long unsigned)dropped, (long long unsigned)gapsRead);
+    fprintf(stdout, "Bad packets: %llu\n", (long long unsigned)badRead);
+    fprintf(stdout, "RF sync values: %llu\n", (long long unsigned)rfSyncCt);
+    if ( sparseKeep ) {
+        fprintf(stdout, "Unwritten packets: %llu, %llu to %llu\n",
+                (long long unsigned)(holeEnd - holeStart),
+                (long long unsigned)holeStart, (long long unsigned)(holeEnd - 1));
+    }
+    fprintf(stdout, "Stale packets: %llu%s\n", (long long unsigned)numStale,
+            partial ? ", last packet cut short" : "");
+    fprintf(stdout, "Valid packets: %llu (%llu bytes)\n",
+            (long long unsigned)validCt, (long long unsigned)(validCt * psize));
+    fprintf(stdout, "Image size: %llu bytes\n", (long long unsigned)imageBytes);
+
+    free(gapIndex);
+    free(badList);
+    free(packet);
+    free(stalePacket);
+
+    return 0;
+}
@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <getopt.h>
+#include "card_config.h"
+#include "packet_map.h"
+#include "card_constants.h"
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : dGetMonotonicSec()
+// Description : Reads the monotonic clock, used for throughput reporting
+// Parameters  : none
+// Returns     : double - seconds since an arbitrary fixed point
+//////////////////////////////////////////////////////////////////////////
+static double dGetMonotonicSec(void) {
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : iParseTime()
+// Description : Reads a time given as seconds from the first packet of
+//               the file, or as a sample timestamp with a ts suffix
+// Parameters  : const char *arg - The argument
+//               uint64_t firstTimestamp - Timestamp of the first packet
+//               uint64_t *timestamp - The unwrapped timestamp on return
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+static int iParseTime(const char *arg, uint64_t firstTimestamp, uint64_t *timestamp) {
+
+    char *endPtr;
+    double value;
+
+    value = strtod(arg, &endPtr);
+    if ( (endPtr == arg) || (value < 0) ) {
+        return -1;
+    }
+    if ( 0 == strcmp(endPtr, "ts") ) {
+        *timestamp = (uint64_t)value;
+        return 0;
+    }
+    if ( '\0' != *endPtr ) {
+        return -1;
+    }
+    *timestamp = firstTimestamp + (uint64_t)llround(value * SAMPLING_RATE);
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function     : main()
+// Description  : Pulls channels of a time window out of an extracted
+//                packets file into a channel-major file, one row of int16
+//                samples per channel
+// CL arguments : extracted packets file name
+//                start and end of the window, seconds or NNNts
+//                output file name
+//                -c, --channels LIST: channels to pull, optional
+//                -n, --num-channels N: channels per packet, needed when
+//                the file has no .idx, optional
+// Returns      : int - 0 if success, 1 if usage screen was displayed,
+//                negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int main (int argc, char *argv[])
+{
+    char *endPtr;
+    int opt, selectChannels = 0;
+    uint32_t k, numChannels = 0;
+    uint64_t startTimestamp, endTimestamp, firstPacket, numPackets;
+    uint8_t wanted[CFG_MAX_CHANNELS];
+    int16_t *rows;
+    double startSec, elapsedSec;
+    PacketMapType rec;
+    ChannelSelectType select;
+    FILE *fpOutput;
+    static struct option longOptions[] = {
+        {"channels", required_argument, 0, 'c'},
+        {"num-channels", required_argument, 0, 'n'},
+        {0, 0, 0, 0}
+    };
+
+    // turn off output buffering
+    setvbuf(stdout, 0, _IONBF, 0);
+    setvbuf(stderr, 0, _IONBF, 0);
+
+    fprintf(stdout, "\n*** sd_query 1.0 ***\n");
+
+    while ( -1 != (opt = getopt_long(argc, argv, "c:n:", longOptions, NULL)) ) {
+        switch (opt) {
+            case 'c':
+                if ( CFG_iParseChannelList(optarg, wanted) ) {
+                    fprintf(stderr, "\nChannels are a list of channels 0-%d and"
+                            " ranges, e.g. 0-3,64, or a hex mask e.g. 0xF000F\n",
+                            CFG_MAX_CHANNELS - 1);
+                    return -1;
+                }
+                selectChannels = 1;
+                break;
+            case 'n':
+                numChannels = (uint32_t)strtoul(optarg, &endPtr, 10);
+                if ( ('\0' != *endPtr) || (0 == numChannels)
+                     || (CFG_MAX_CHANNELS < numChannels) ) {
+                    fprintf(stderr, "\nNumber of channels must be between 1 and %d\n",
+                            CFG_MAX_CHANNELS);
+                    return -1;
+                }
+                break;
+            default:
+                return -1;
+        }
+    }
+    if ( 4 != argc - optind ) {
+        fprintf(stdout, "\nUsage: sd_query [OPTIONS] [EXTRACTED_DATA_FILENAME]"
+                " [START] [END] [OUTPUT_FILENAME]\n");
+        fprintf(stdout, "Example: `sd_query -c 0-3 extracted_data.dat 600 601"
+                " tetrode.i16`\n");
+        fprintf(stdout, "START and END are seconds from the first packet, or"
+                " timestamps e.g. 1800000ts\n");
+        fprintf(stdout, "Options:\n");
+        fprintf(stdout, "  -c, --channels LIST   channels to pull, e.g. 0-3,64"
+                " (default all)\n");
+        fprintf(stdout, "  -n, --num-channels N  channels per packet, for files"
+                " without a .idx\n");
+        return 1;
+    }
+
+    if ( PMAP_iOpen(&rec, argv[optind], numChannels) ) {
+        return -2;
+    }
+    if ( iParseTime(argv[optind + 1], rec.firstTimestamp, &startTimestamp)
+         || iParseTime(argv[optind + 2], rec.firstTimestamp, &endTimestamp) ) {
+        fprintf(stderr, "\nTimes are seconds from the start of the file, or a"
+                " sample timestamp ending in ts e.g. 1800000ts\n");
+        return -1;
+    }
+    if ( selectChannels && PMAP_iSelectChannels(&rec, wanted, &select) ) {
+        fprintf(stderr, "\nCan't pull the requested channels\n");
+        return -3;
+    }
+    if ( !selectChannels ) {
+        select.numChannels = rec.map.numChannels;
+    }
+
+    PMAP_vFindWindow(&rec, startTimestamp, endTimestamp, &firstPacket, &numPackets);
+    rows = malloc((numPackets ? numPackets : 1) * select.numChannels * sizeof(int16_t));
+    if ( NULL == rows ) {
+        fprintf(stderr, "Error allocating %llu samples\n",
+                (long long unsigned)(numPackets * select.numChannels));
+        return -4;
+    }
+    startSec = dGetMonotonicSec();
+    if ( PMAP_iReadChannels(&rec, startTimestamp, endTimestamp,
+                            selectChannels ? &select : NULL, rows, numPackets,
+                            &numPackets) ) {
+        return -5;
+    }
+    elapsedSec = dGetMonotonicSec() - startSec;
+
+    fprintf(stdout, "Packets %llu to %llu, %llu samples of channels",
+            (long long unsigned)firstPacket,
+            (long long unsigned)(firstPacket + numPackets),
+            (long long unsigned)numPackets);
+    for (k = 0; k < select.numChannels; k++) {
+        fprintf(stdout, " %u", (unsigned)rec.map.channelId[selectChannels
+                                                            ? select.slot[k] : k]);
+    }
+    fprintf(stdout, "\nRead %.2f MB in %.3f sec\n",
+            (double)numPackets*select.numChannels*sizeof(int16_t)/BYTES_PER_MB,
+            elapsedSec);
+
+    fpOutput = fopen(argv[optind + 3], "w");
+    if ( NULL == fpOutput ) {
+        fprintf(stderr, "Error opening file %s to write data to!\n", argv[optind + 3]);
+        return -6;
+    }
+    if ( (numPackets * select.numChannels
+          != fwrite(rows, sizeof(int16_t), numPackets * select.numChannels, fpOutput))
+         | fclose(fpOutput) ) {
+        fprintf(stderr, "Error writing %s\n", argv[optind + 3]);
+        return -7;
+    }
+    free(rows);
+    PMAP_vClose(&rec);
+
+    fprintf(stdout, "Done!\n");
+    return 0;
+}
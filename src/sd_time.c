@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : dGetMonotonicSec()
+// Description : Reads the monotonic clock
+// Parameters  : none
+// Returns     : double - seconds since an arbitrary fixed point
+//////////////////////////////////////////////////////////////////////////
+static double dGetMonotonicSec(void) {
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function     : main()
+// Description  : Runs a command and prints what it cost on one line, for
+//                benchmark.sh: wall time, user and system CPU time, peak
+//                resident memory and the exit status. The command's own
+//                output goes to a log file
+// CL arguments : log file name
+//                command and its arguments
+// Returns      : int - 0 if the command ran, negative value otherwise. The
+//                command's exit status is printed, not returned
+//////////////////////////////////////////////////////////////////////////
+int main (int argc, char *argv[])
+{
+    int fd, status;
+    pid_t pid;
+    double startSec, wallSec;
+    struct rusage usage;
+
+    if ( argc < 3 ) {
+        fprintf(stdout, "\nUsage: sd_time [LOG_FILENAME] [COMMAND] [ARGS]...\n");
+        fprintf(stdout, "Prints: wall_sec user_sec sys_sec max_rss_kb exit_status\n");
+        return 1;
+    }
+
+    startSec = dGetMonotonicSec();
+    pid = fork();
+    if ( pid < 0 ) {
+        fprintf(stderr, "Error no %d starting %s: %s\n", errno, argv[2], strerror(errno));
+        return -1;
+    }
+    if ( 0 == pid ) {
+        fd = open(argv[1], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if ( fd < 0 ) {
+            fprintf(stderr, "Error no %d opening log file %s: %s\n",
+                    errno, argv[1], strerror(errno));
+            _exit(127);
+        }
+        dup2(fd, STDOUT_FILENO);
+        dup2(fd, STDERR_FILENO);
+        close(fd);
+        execvp(argv[2], &argv[2]);
+        fprintf(stderr, "Error no %d running %s: %s\n", errno, argv[2], strerror(errno));
+        _exit(127);
+    }
+    while ( wait4(pid, &status, 0, &usage) < 0 ) {
+        if ( EINTR != errno ) {
+            fprintf(stderr, "Error no %d waiting for %s: %s\n",
+                    errno, argv[2], strerror(errno));
+            return -2;
+        }
+    }
+    wallSec = dGetMonotonicSec() - startSec;
+
+    fprintf(stdout, "%.3f %.3f %.3f %ld %d\n", wallSec,
+            (double)usage.ru_utime.tv_sec + (double)usage.ru_utime.tv_usec * 1e-6,
+            (double)usage.ru_stime.tv_sec + (double)usage.ru_stime.tv_usec * 1e-6,
+            (long)usage.ru_maxrss,
+            WIFEXITED(status) ? (int)(int8_t)WEXITSTATUS(status) : -128 - WTERMSIG(status));
+
+    return 0;
+}
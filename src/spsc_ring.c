@@ -0,0 +1,171 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sched.h>
+#include <time.h>
+#include "spsc_ring.h"
+
+#define RING_SPIN_COUNT 64      // busy polls before yielding the CPU
+#define RING_YIELD_COUNT 16     // yields before sleeping between polls
+#define RING_SLEEP_NSEC 20000
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : vBackoff()
+// Description : Waits a little before polling the ring again. Stages 
+//               usually wait on I/O for milliseconds, so after a short 
+//               spin it's better to give the core away than to burn it
+// Parameters  : uint32_t attempt - How many polls have failed so far
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+static void vBackoff(uint32_t attempt) {
+
+    struct timespec delay;
+
+    if ( attempt < RING_SPIN_COUNT ) {
+        return;
+    }
+    if ( attempt < (RING_SPIN_COUNT + RING_YIELD_COUNT) ) {
+        sched_yield();
+        return;
+    }
+    delay.tv_sec = 0;
+    delay.tv_nsec = RING_SLEEP_NSEC;
+    nanosleep(&delay, NULL);
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : RING_iInit()
+// Description : Sets up an empty ring
+// Parameters  : SpscRingType *ring - Ring to set up
+//               uint32_t minCapacity - Least number of items it must hold,
+//                                      rounded up to a power of two
+// Returns     : int - 0 if success, negative value otherwise
+//////////////////////////////////////////////////////////////////////////
+int RING_iInit(SpscRingType *ring, uint32_t minCapacity) {
+
+    uint64_t capacity = 1;
+
+    while ( capacity < minCapacity ) {
+        capacity <<= 1;
+    }
+
+    memset(ring, 0, sizeof(*ring));
+    ring->slots = calloc(capacity, sizeof(void *));
+    if ( NULL == ring->slots ) {
+        return -1;
+    }
+    ring->mask = capacity - 1;
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : RING_vFree()
+// Description : Frees a ring. Items still in it are not touched
+// Parameters  : SpscRingType *ring - The ring
+// Returns     : void
+//////////////////////////////////////////////////////////////////////////
+void RING_vFree(SpscRingType *ring) {
+
+    free(ring->slots);
+    ring->slots = NULL;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : RING_iTryPush()
+// Description : Adds an item if there is room. Producer side only
+// Parameters  : SpscRingType *ring - The ring
+//               void *item - Item to add
+// Returns     : int - 0 if added, 1 if the ring is full
+//////////////////////////////////////////////////////////////////////////
+int RING_iTryPush(SpscRingType *ring, void *item) {
+
+    uint64_t tail = ring->tail;
+
+    if ( (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)) > ring->mask ) {
+        return 1;
+    }
+    ring->slots[tail & ring->mask] = item;
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : RING_iTryPop()
+// Description : Takes the oldest item if there is one. Consumer side only
+// Parameters  : SpscRingType *ring - The ring
+//               void **itemPtr - Set to the item
+// Returns     : int - 0 if an item was taken, 1 if the ring is empty
+//////////////////////////////////////////////////////////////////////////
+int RING_iTryPop(SpscRingType *ring, void **itemPtr) {
+
+    uint64_t head = ring->head;
+
+    if ( head == __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) ) {
+        return 1;
+    }
+    *itemPtr = ring->slots[head & ring->mask];
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : RING_iPush()
+// Description : Adds an item, waiting for room if the ring is full
+// Parameters  : SpscRingType *ring - The ring
+//               void *item - Item to add
+//               int *abortFlag - Stop waiting once this becomes non-zero,
+//                                may be NULL
+// Returns     : int - 0 if added, negative value if aborted
+//////////////////////////////////////////////////////////////////////////
+int RING_iPush(SpscRingType *ring, void *item, int *abortFlag) {
+
+    uint32_t attempt = 0;
+
+    while ( RING_iTryPush(ring, item) ) {
+        if ( abortFlag && __atomic_load_n(abortFlag, __ATOMIC_ACQUIRE) ) {
+            return -1;
+        }
+        if ( 0 == attempt ) {
+            __atomic_add_fetch(&ring->stalls, 1, __ATOMIC_RELAXED);
+        }
+        vBackoff(attempt++);
+    }
+
+    return 0;
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Function    : RING_iPop()
+// Description : Takes the oldest item, waiting for one if the ring is empty
+// Parameters  : SpscRingType *ring - The ring
+//               void **itemPtr - Set to the item
+//               int *abortFlag - Stop waiting once this becomes non-zero,
+//                                may be NULL
+// Returns     : int - 0 if an item was taken, negative value if aborted
+//////////////////////////////////////////////////////////////////////////
+int RING_iPop(SpscRingType *ring, void **itemPtr, int *abortFlag) {
+
+    uint32_t attempt = 0;
+
+    while ( RING_iTryPop(ring, itemPtr) ) {
+        if ( abortFlag && __atomic_load_n(abortFlag, __ATOMIC_ACQUIRE) ) {
+            return -1;
+        }
+        if ( 0 == attempt ) {
+            __atomic_add_fetch(&ring->stalls, 1, __ATOMIC_RELAXED);
+        }
+        vBackoff(attempt++);
+    }
+
+    return 0;
+
+}
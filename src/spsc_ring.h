@@ -0,0 +1,38 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stdint.h>
+
+#define RING_CACHE_LINE 64
+
+//////////////////////////////////////////////////////////////////////////
+//                      Public Data Types
+//////////////////////////////////////////////////////////////////////////
+typedef struct {
+    // bounded single-producer/single-consumer queue of pointers. Only the
+    // producer writes tail and only the consumer writes head, so no locks
+    // are needed. They sit on separate cache lines so the two threads 
+    // don't keep stealing the line from each other
+    void **slots;
+    uint64_t mask;
+    _Alignas(RING_CACHE_LINE) uint64_t head;
+    _Alignas(RING_CACHE_LINE) uint64_t tail;
+    _Alignas(RING_CACHE_LINE) uint64_t stalls; // times push/pop had to wait
+} SpscRingType;
+
+//////////////////////////////////////////////////////////////////////////
+//                    Public Function Prototypes
+//////////////////////////////////////////////////////////////////////////
+int RING_iInit(SpscRingType *ring, uint32_t minCapacity);
+
+void RING_vFree(SpscRingType *ring);
+
+int RING_iTryPush(SpscRingType *ring, void *item);
+
+int RING_iTryPop(SpscRingType *ring, void **itemPtr);
+
+int RING_iPush(SpscRingType *ring, void *item, int *abortFlag);
+
+int RING_iPop(SpscRingType *ring, void **itemPtr, int *abortFlag);
+
+#endif // SPSC_RING_H